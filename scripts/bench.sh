@@ -0,0 +1,7 @@
+set -e
+
+make all
+for file in bench/*.aster; do
+    echo "== $file"
+    ./build/aster --bench="${RUNS:-20}" "$file" > /dev/null
+done
\ No newline at end of file
@@ -0,0 +1,14 @@
+set -e
+
+# records a profile of a benchmark, then compares it built without and with
+# the profile laying it out
+make all
+FILE="${1:-bench/pgo.aster}"
+PROFILE="$(basename "${FILE%.*}").aprof"
+trap 'rm -f "$PROFILE"' EXIT
+
+./build/aster --no-server --no-cache --profile-generate "$FILE" > /dev/null
+echo "== $FILE without a profile"
+./build/aster --no-server --no-cache --bench="${RUNS:-20}" "$FILE" > /dev/null
+echo "== $FILE with --profile-use=$PROFILE"
+./build/aster --no-server --no-cache --stats --bench="${RUNS:-20}" --profile-use="$PROFILE" "$FILE" 2>&1 > /dev/null | grep -E "^(pgo|bench):"
\ No newline at end of file
@@ -0,0 +1,29 @@
+set -e
+
+# compares the latency of a request to 'aster serve' with starting a fresh
+# process, with and without the on-disk cache
+make all
+export ASTER_SOCKET="${ASTER_SOCKET:-$(mktemp -u /tmp/aster-bench.XXXXXX.sock)}"
+REQUESTS="${REQUESTS:-200}"
+
+latency() {
+    local start end
+    start=$(date +%s%N)
+    for _ in $(seq "$REQUESTS"); do
+        ./build/aster "$@" > /dev/null
+    done
+    end=$(date +%s%N)
+    echo "$(( (end - start) / REQUESTS / 1000 )) us/request"
+}
+
+./build/aster serve 2> /dev/null &
+server=$!
+trap 'kill $server' EXIT
+while [ ! -S "$ASTER_SOCKET" ]; do sleep 0.05; done
+
+for file in example/main.aster bench/*.aster; do
+    echo "== $file"
+    echo "cold, no cache:  $(latency --no-server --no-cache "$file")"
+    echo "cold, cached:    $(latency --no-server "$file")"
+    echo "served:          $(latency "$file")"
+done
\ No newline at end of file
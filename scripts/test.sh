@@ -0,0 +1,44 @@
+set -e
+
+# runs each program in tests/ and compares the last line it writes, its
+# result or the error it stops with, to what it should be. only a program
+# that finished may exit successfully
+make all
+failed=0
+
+check() {
+    local output status=0
+    output="$(./build/aster --no-server --no-cache "$1" 2>&1)" || status=$?
+    output="$(printf '%s\n' "$output" | tail -1)"
+
+    local expected=1
+    case "$2" in "VM execution finished: "*) expected=0 ;; esac
+    [ $status -eq 0 ] || status=1
+
+    if [ "$output" != "$2" ]; then
+        echo "FAIL $1: expected '$2', got '$output'"
+        failed=1
+    elif [ $status -ne $expected ]; then
+        echo "FAIL $1: exited with status $status"
+        failed=1
+    else
+        echo "ok   $1"
+    fi
+}
+
+check tests/literals.aster "VM execution finished: 140737489"
+check tests/literal_range.aster "parse error: integer literal out of range '9223372036854775808' at 2:9"
+check tests/literal_width.aster "type error in 'main': integer literal 3000000000 does not fit in i32"
+check tests/wide_i64.aster "VM execution finished: 1125893340331561"
+check tests/typed_channels.aster "VM execution finished: 9000000000"
+check tests/channel_send_type.aster "type error in 'main': send expects i32, found f64"
+check tests/single_line_bodies.aster "VM execution finished: 18"
+check tests/misplaced_else.aster "parse error: 'else' without an 'if' at 'else' at 4:5"
+check tests/malformed_expression.aster "parse error: expected an expression at '*' at 3:12"
+check tests/return_paths.aster "VM execution finished: 9"
+check tests/missing_return.aster "type error in 'clamp': not every path ends in a ret"
+check tests/bare_ret.aster "type error in 'main': ret without a value in a function returning i32"
+check tests/runtime_failure.aster "All fibers are blocked on channels, the program is deadlocked"
+check tests/missing.aster "unable to open file: tests/missing.aster: No such file or directory"
+
+exit $failed
\ No newline at end of file
@@ -0,0 +1,320 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "aster.h"
+#include "../parser/lexer.h"
+#include "../assembler/assembler.h"
+#include "../incremental/incremental.h"
+#include "../vm/vm.h"
+#include "../isolate/isolate.h"
+#include "../util/alloc.h"
+
+// arguments up to this many are converted on the stack rather than the heap
+#define INLINE_ARGUMENTS 8
+
+typedef struct {
+    const char *name;
+    size_t index;
+} FunctionName;
+
+struct AsterProgram {
+    SharedProgram *shared;
+    // sorted by name for aster_function
+    FunctionName *names;
+};
+
+struct AsterVm {
+    const AsterProgram *program;
+    Isolate isolate;
+
+    // the vm's error stream, rewound before every call
+    FILE *errors;
+    char *errorText;
+    size_t errorLength;
+};
+
+static int compareFunctionNames(const void *a, const void *b) {
+    return strcmp(((const FunctionName *)a)->name, ((const FunctionName *)b)->name);
+}
+
+AsterProgram *aster_compile(const char *source, char **errors) {
+    if (errors) *errors = NULL;
+    if (!source) return NULL;
+
+    char *diagnostics = NULL;
+    size_t diagnosticsLength = 0;
+    FILE *stream = open_memstream(&diagnostics, &diagnosticsLength);
+    assertAlloc(stream);
+
+    Lexer lexer = newSourceLexer("<source>", source);
+    registerLexerKeywords(&lexer);
+    lexerTokenize(&lexer);
+
+    Program program;
+    bool ok = compileTokens(lexer.tokens, lexer.count, "<source>", false, stream, &program);
+    freeLexer(&lexer);
+
+    if (ok && program.imports.count > 0) {
+        fprintf(stream, "'%s' is declared extern but never defined\n", program.imports.entries[0].name);
+        freeProgram(&program);
+        ok = false;
+    }
+    fclose(stream);
+
+    if (!ok) {
+        if (errors) {
+            *errors = diagnostics;
+        } else {
+            free(diagnostics);
+        }
+        return NULL;
+    }
+    free(diagnostics);
+
+    AsterProgram *compiled = alloc(sizeof(AsterProgram));
+    compiled->shared = shareProgram(program, defaultAvmConfig());
+
+    size_t count = program.functions.count;
+    compiled->names = alloc((count + 1) * sizeof(FunctionName));
+    for (size_t i = 0; i < count; i++) {
+        compiled->names[i] = (FunctionName){ .name = program.functions.entries[i].name, .index = i };
+    }
+    qsort(compiled->names, count, sizeof(FunctionName), compareFunctionNames);
+
+    return compiled;
+}
+
+void aster_program_free(AsterProgram *program) {
+    if (!program) return;
+
+    releaseProgram(program->shared);
+    FREE_ALLOC(program->names);
+    FREE_ALLOC(program);
+}
+
+long aster_function(const AsterProgram *program, const char *name) {
+    if (!program || !name) return -1;
+
+    FunctionName key = { .name = name };
+    const FunctionName *found = bsearch(&key, program->names, program->shared->program.functions.count,
+                                        sizeof(FunctionName), compareFunctionNames);
+
+    return found ? (long)found->index : -1;
+}
+
+AsterVm *aster_vm_new(const AsterProgram *program) {
+    if (!program) return NULL;
+
+    AsterVm *vm = alloc(sizeof(AsterVm));
+    vm->program = program;
+    vm->errorText = NULL;
+    vm->errorLength = 0;
+    vm->errors = open_memstream(&vm->errorText, &vm->errorLength);
+    assertAlloc(vm->errors);
+
+    vm->isolate = newIsolate(program->shared);
+    vm->isolate.vm.output = NULL;
+    vm->isolate.vm.errors = vm->errors;
+
+    return vm;
+}
+
+void aster_vm_free(AsterVm *vm) {
+    if (!vm) return;
+
+    freeIsolate(&vm->isolate);
+    fclose(vm->errors);
+    free(vm->errorText);
+    FREE_ALLOC(vm);
+}
+
+void aster_vm_set_output(AsterVm *vm, FILE *output) {
+    if (!vm) return;
+
+    vm->isolate.vm.output = output;
+}
+
+static bool acceptsType(ValueType param, AsterType type) {
+    switch (param) {
+        case TYPE_I32: return type == ASTER_I32;
+        case TYPE_I64: return type == ASTER_I64;
+        case TYPE_F64: return type == ASTER_F64;
+        case TYPE_BOOL: return type == ASTER_BOOL;
+        case TYPE_ANY: return type != ASTER_OPAQUE;
+        default: return false;
+    }
+}
+
+// an i64 too wide to be inline points at the caller's argument, which
+// outlives the call and which collections leave where it is
+static Object toObject(const AsterValue *value) {
+    switch (value->type) {
+        case ASTER_I32: return i32Object(value->as.i32);
+        case ASTER_I64: return fitsInlineI64(value->as.i64) ? i64Object(value->as.i64) : wideI64Object(&value->as.i64);
+        case ASTER_F64: return canonicalF64Object(value->as.f64);
+        case ASTER_BOOL: return boolObject(value->as.boolean);
+        case ASTER_OPAQUE: break;
+    }
+
+    return i32Object(0);
+}
+
+static AsterValue toValue(Object obj) {
+    switch (objectType(obj)) {
+        case OBJ_I64: return aster_i64(asI64(obj));
+        case OBJ_F64: return aster_f64(asF64(obj));
+        case OBJ_BOOL: return aster_bool(asBool(obj));
+        case OBJ_I32: return aster_i32(asI32(obj));
+        default: return (AsterValue){ .type = ASTER_OPAQUE };
+    }
+}
+
+static AsterStatus callError(AsterVm *vm, AsterStatus status, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vfprintf(vm->errors, format, args);
+    va_end(args);
+
+    return status;
+}
+
+// a memory stream that shrinks keeps the old text past its new end, so the
+// error is cut off where this call's writes stopped
+static AsterStatus finishCall(AsterVm *vm, AsterStatus status) {
+    fflush(vm->errors);
+    if (vm->errorText) vm->errorText[vm->errorLength] = '\0';
+
+    return status;
+}
+
+// checks a call against the function's signature, leaving the converted
+// arguments in 'objects'. 'error' names what was wrong with it
+static AsterStatus prepareCall(const Program *program, long function, const AsterValue *args,
+                               size_t argCount, Object *objects, const char **error) {
+    if (function < 0 || (size_t)function >= program->functions.count) {
+        *error = "no function at index";
+        return ASTER_NOT_FOUND;
+    }
+
+    const Function *fn = &program->functions.entries[function];
+    if (argCount != fn->arity || (argCount > 0 && !args)) {
+        *error = "wrong number of arguments to";
+        return ASTER_BAD_ARGUMENTS;
+    }
+
+    for (size_t i = 0; i < argCount; i++) {
+        if (!acceptsType(fn->paramTypes[i], args[i].type)) {
+            *error = "argument of the wrong type to";
+            return ASTER_BAD_ARGUMENTS;
+        }
+        objects[i] = toObject(&args[i]);
+    }
+
+    return ASTER_OK;
+}
+
+static AsterStatus callIndex(AsterVm *vm, long function, const AsterValue *args,
+                             size_t argCount, AsterValue *result) {
+    const Program *program = &vm->program->shared->program;
+
+    Object buffer[INLINE_ARGUMENTS];
+    Object *objects = argCount <= INLINE_ARGUMENTS ? buffer : alloc(argCount * sizeof(Object));
+
+    const char *error = NULL;
+    AsterStatus status = prepareCall(program, function, args, argCount, objects, &error);
+    if (status == ASTER_NOT_FOUND) {
+        callError(vm, status, "%s %ld\n", error, function);
+    } else if (status != ASTER_OK) {
+        callError(vm, status, "%s '%s'\n", error, program->functions.entries[function].name);
+    } else {
+        AVM *avm = &vm->isolate.vm;
+        resetAVM(avm);
+
+        Object value;
+        if (!callFunction(avm, (size_t)function, objects, argCount)) {
+            status = ASTER_RUNTIME_ERROR;
+        } else if (result && vmResult(avm, &value)) {
+            *result = toValue(value);
+        }
+    }
+
+    if (objects != buffer) FREE_ALLOC(objects);
+    return status;
+}
+
+AsterStatus aster_call_index(AsterVm *vm, long function, const AsterValue *args,
+                             size_t argCount, AsterValue *result) {
+    if (!vm) return ASTER_NOT_FOUND;
+
+    rewind(vm->errors);
+    return finishCall(vm, callIndex(vm, function, args, argCount, result));
+}
+
+AsterStatus aster_call(AsterVm *vm, const char *function, const AsterValue *args,
+                       size_t argCount, AsterValue *result) {
+    if (!vm) return ASTER_NOT_FOUND;
+
+    rewind(vm->errors);
+
+    long index = aster_function(vm->program, function);
+    if (index < 0) {
+        AsterStatus status = callError(vm, ASTER_NOT_FOUND, "no function named '%s'\n", function ? function : "");
+        return finishCall(vm, status);
+    }
+
+    return finishCall(vm, callIndex(vm, index, args, argCount, result));
+}
+
+void aster_call_batch(const AsterProgram *program, AsterCall *calls, size_t count, size_t threads) {
+    if (!program || !calls || count == 0) return;
+
+    const Program *code = &program->shared->program;
+
+    // every argument of every call, converted up front so the workers only run them
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) total += calls[i].argCount;
+
+    Object *objects = alloc((total + 1) * sizeof(Object));
+    BatchRequest *requests = alloc(count * sizeof(BatchRequest));
+    size_t *callIndices = alloc(count * sizeof(size_t));
+    size_t runnable = 0, used = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        AsterCall *call = &calls[i];
+        const char *error = NULL;
+
+        call->status = prepareCall(code, call->function, call->args, call->argCount, objects + used, &error);
+        if (call->status != ASTER_OK) continue;
+
+        requests[runnable] = (BatchRequest){
+            .function = (size_t)call->function,
+            .args = objects + used,
+            .argCount = call->argCount,
+        };
+        callIndices[runnable++] = i;
+        used += call->argCount;
+    }
+
+    runBatch(program->shared, requests, runnable, threads, NULL, NULL);
+
+    for (size_t i = 0; i < runnable; i++) {
+        AsterCall *call = &calls[callIndices[i]];
+        call->status = requests[i].ok ? ASTER_OK : ASTER_RUNTIME_ERROR;
+        if (requests[i].ok) call->result = toValue(requests[i].result);
+    }
+
+    FREE_ALLOC(callIndices);
+    FREE_ALLOC(requests);
+    FREE_ALLOC(objects);
+}
+
+const char *aster_vm_error(const AsterVm *vm) {
+    if (!vm || !vm->errorText) return "";
+
+    return vm->errorText;
+}
+
+void aster_free(void *memory) {
+    free(memory);
+}
\ No newline at end of file
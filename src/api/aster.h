@@ -0,0 +1,137 @@
+#ifndef aster_h
+#define aster_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// libaster embeds the compiler and the vm in a host application: compile a
+// program once, create a vm for it and call its functions as often as needed.
+//
+//     char *errors = NULL;
+//     AsterProgram *program = aster_compile(source, &errors);
+//     if (!program) { fputs(errors, stderr); aster_free(errors); return; }
+//
+//     AsterVm *vm = aster_vm_new(program);
+//     long add = aster_function(program, "add");
+//     AsterValue args[] = { aster_i32(1), aster_i32(2) }, result;
+//     if (aster_call_index(vm, add, args, 2, &result) == ASTER_OK) { ... result.as.i32 ... }
+//
+//     aster_vm_free(vm);
+//     aster_program_free(program);
+//
+// the library keeps no global state of its own. a compiled program is never
+// written to again, so any number of vms on any number of threads may share
+// it, while each vm is used by one thread at a time. aster_call_batch spreads
+// many calls over threads that way. nothing is written to
+// stdout or stderr: compile errors are handed back as a string, runtime errors
+// through aster_vm_error, and 'print' only writes where aster_vm_set_output
+// points it.
+//
+// the one process-wide effect is a SIGSEGV handler, installed the first time
+// a vm runs, that turns a fault on a vm's stack guard page into a stack
+// overflow error. every other fault is passed on to the handler that was in
+// place before it, or to the default action when there was none. a host that
+// installs a SIGSEGV handler of its own should do so before the first call, or
+// pass on the faults it does not handle to the one it replaced, or stack
+// overflows in a vm are no longer caught
+
+#define ASTER_API __attribute__((visibility("default")))
+
+typedef struct AsterProgram AsterProgram;
+typedef struct AsterVm AsterVm;
+
+typedef enum {
+    ASTER_I32,
+    ASTER_I64,
+    ASTER_F64,
+    ASTER_BOOL,
+    // a channel or an array, whose contents stay inside the vm. it cannot be
+    // passed back in, as the vm may have collected it by then
+    ASTER_OPAQUE,
+} AsterType;
+
+typedef struct {
+    AsterType type;
+    union {
+        int32_t i32;
+        int64_t i64;
+        double f64;
+        bool boolean;
+    } as;
+} AsterValue;
+
+typedef enum {
+    ASTER_OK,
+    // the program has no function by that name or index
+    ASTER_NOT_FOUND,
+    // the wrong number or types of arguments were passed
+    ASTER_BAD_ARGUMENTS,
+    // the call stopped on an error, described by aster_vm_error
+    ASTER_RUNTIME_ERROR,
+} AsterStatus;
+
+// compiles a nul-terminated source string. on failure returns NULL and, when
+// 'errors' is not NULL, points it at the diagnostics, released with aster_free
+ASTER_API AsterProgram *aster_compile(const char *source, char **errors);
+
+// the program must outlive every vm created for it
+ASTER_API void aster_program_free(AsterProgram *program);
+
+// the index of a function for aster_call_index, or -1 when there is none
+ASTER_API long aster_function(const AsterProgram *program, const char *name);
+
+// reserves the vm's stacks up front, calls reuse them
+ASTER_API AsterVm *aster_vm_new(const AsterProgram *program);
+ASTER_API void aster_vm_free(AsterVm *vm);
+
+// where 'print' writes, NULL (the default) discards it
+ASTER_API void aster_vm_set_output(AsterVm *vm, FILE *output);
+
+// calls a function by name and stores what it returns in 'result'
+ASTER_API AsterStatus aster_call(AsterVm *vm, const char *function, const AsterValue *args,
+                                 size_t argCount, AsterValue *result);
+
+// the same without looking the name up, for functions called many times
+ASTER_API AsterStatus aster_call_index(AsterVm *vm, long function, const AsterValue *args,
+                                       size_t argCount, AsterValue *result);
+
+typedef struct {
+    long function;
+    const AsterValue *args;
+    size_t argCount;
+
+    // filled in once the call has run, runtime errors are not described
+    AsterStatus status;
+    AsterValue result;
+} AsterCall;
+
+// runs every call on 'threads' threads, or one per core when 0, each with a vm
+// of its own, and returns once all of them have finished. 'print' is discarded
+ASTER_API void aster_call_batch(const AsterProgram *program, AsterCall *calls, size_t count,
+                                size_t threads);
+
+// what went wrong in the vm's last call, empty when it succeeded
+ASTER_API const char *aster_vm_error(const AsterVm *vm);
+
+// releases strings handed out by the library
+ASTER_API void aster_free(void *memory);
+
+static inline AsterValue aster_i32(int32_t value) {
+    return (AsterValue){ .type = ASTER_I32, .as.i32 = value };
+}
+
+static inline AsterValue aster_i64(int64_t value) {
+    return (AsterValue){ .type = ASTER_I64, .as.i64 = value };
+}
+
+static inline AsterValue aster_f64(double value) {
+    return (AsterValue){ .type = ASTER_F64, .as.f64 = value };
+}
+
+static inline AsterValue aster_bool(bool value) {
+    return (AsterValue){ .type = ASTER_BOOL, .as.boolean = value };
+}
+
+#endif
\ No newline at end of file
@@ -1,12 +1,14 @@
 #include <stdbool.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "assembler.h"
 #include "../parser/lexer.h"
+#include "../parser/types.h"
 #include "../util/alloc.h"
 
-Assembler newAssembler(bool debug) {
+Assembler newAssembler(const char *ir, bool debug) {
     Assembler assembler = {
         .program = {
             .code = alloc(sizeof(AvmInstruction)),
@@ -21,10 +23,32 @@ Assembler newAssembler(bool debug) {
                 .entries = alloc(sizeof(Function)),
                 .count = 0,
                 .capacity = 1
+            },
+            .imports = {
+                .entries = alloc(sizeof(Function)),
+                .count = 0,
+                .capacity = 1
+            },
+            .relocations = {
+                .entries = alloc(sizeof(Relocation)),
+                .count = 0,
+                .capacity = 1
             }
         },
+        .fixups = alloc(sizeof(CallFixup)),
+        .fixupCount = 0,
+        .fixupCapacity = 1,
+        .labels = alloc(sizeof(size_t)),
+        .labelCount = 0,
+        .labelCapacity = 1,
+        .jumps = alloc(sizeof(JumpFixup)),
+        .jumpCount = 0,
+        .jumpCapacity = 1,
+        .ir = ir,
         .position = 0,
-        .debug = debug
+        .debug = debug,
+        .errors = stderr,
+        .hadError = false
     };
 
     return assembler;
@@ -33,7 +57,49 @@ Assembler newAssembler(bool debug) {
 void freeAssembler(Assembler *assembler) {
     if (!assembler) return;
 
-    FREE_ALLOC(assembler->program.code);
+    freeProgram(&assembler->program);
+    FREE_ALLOC(assembler->fixups);
+    FREE_ALLOC(assembler->labels);
+    FREE_ALLOC(assembler->jumps);
+}
+
+void freeProgram(Program *program) {
+    if (!program) return;
+
+    FREE_ALLOC(program->code);
+    FREE_ALLOC(program->constants.values);
+    FREE_ALLOC(program->relocations.entries);
+
+    freeFunctionTable(&program->functions);
+    freeFunctionTable(&program->imports);
+    freeLineTable(&program->lines);
+
+    program->length = 0;
+    program->constants.count = 0;
+    program->relocations.count = 0;
+}
+
+void freeFunctionTable(FunctionTable *table) {
+    if (!table) return;
+
+    for (size_t i = 0; i < table->count; i++) {
+        FREE_ALLOC(table->entries[i].name);
+        FREE_ALLOC(table->entries[i].paramTypes);
+    }
+    FREE_ALLOC(table->entries);
+
+    table->count = 0;
+}
+
+static void addRelocation(Assembler *a, size_t offset, RelocationKind kind) {
+    RelocationTable *table = &a->program.relocations;
+    if (table->count >= table->capacity) {
+        table->capacity *= 2;
+        table->entries = realloc(table->entries, sizeof(Relocation) * table->capacity);
+        assertAlloc(table->entries);
+    }
+
+    table->entries[table->count++] = (Relocation){ .offset = offset, .kind = kind };
 }
 
 static void advance(Assembler *a) {
@@ -74,6 +140,13 @@ static bool isErr(Token t) {
 }
 
 static void emit (Assembler *a, AvmInstruction instr) {
+    // an opcode always comes before its operands
+    if (a->locationPending) {
+        a->location.pc = a->program.length;
+        addLine(&a->program.lines, a->location);
+        a->locationPending = false;
+    }
+
     if (a->program.length >= a->program.capacity) {
         a->program.capacity *= 2;
         a->program.code = realloc(a->program.code, sizeof(AvmInstruction) * a->program.capacity);
@@ -82,11 +155,17 @@ static void emit (Assembler *a, AvmInstruction instr) {
     a->program.code[a->program.length++] = instr;
 }
 
-static Object newObject(ObjectType type, int32_t i32) {
-    return (Object){
-        .type = type,
-        .i32 = i32,
-    };
+static Object newConstant(const char *type, const char *lexeme) {
+    switch (typeFromName(type)) {
+        case TYPE_I64:
+            return i64Object(strtoll(lexeme, NULL, 10));
+        case TYPE_F64:
+            return canonicalF64Object(strtod(lexeme, NULL));
+        case TYPE_BOOL:
+            return boolObject(atoi(lexeme) != 0);
+        default:
+            return i32Object(atoi(lexeme));
+    }
 }
 
 static void addConstant(Assembler *a, Object obj) {
@@ -117,11 +196,23 @@ static void emitPush(Assembler *a) {
         if (isErr(constant)) return;
         advance(a);
 
-        emit(a, INSTR_PUSH_I32);
+        // the pool only holds i64s that fit in an Object
+        if (typeFromName(type.lexeme) == TYPE_I64) {
+            int64_t value = strtoll(constant.lexeme, NULL, 10);
+            if (!fitsInlineI64(value)) {
+                emit(a, INSTR_PUSH_I64);
+                emit(a, (AvmInstruction)(int32_t)(uint32_t)((uint64_t)value >> 32));
+                emit(a, (AvmInstruction)(int32_t)(uint32_t)value);
+                return;
+            }
+        }
 
-        Object obj = newObject(OBJ_I32, atoi(constant.lexeme));
+        emit(a, INSTR_PUSH_CONST);
+
+        Object obj = newConstant(type.lexeme, constant.lexeme);
         addConstant(a, obj);
 
+        addRelocation(a, a->program.length, RELOC_CONSTANT);
         emit(a, a->program.constants.count - 1);
     }
 }
@@ -137,6 +228,344 @@ static void emitExec(Assembler *a) {
     emit(a, instr);
 }
 
+static void emitLocal(Assembler *a, AvmInstruction instr) {
+    advance(a);
+    if (!expect(a, TOKEN_LOCAL)) return;
+
+    Token slot = expectOrErr(a, TOKEN_INTEGER_LITERAL);
+    if (isErr(slot)) return;
+
+    emit(a, instr);
+    emit(a, atoi(slot.lexeme));
+}
+
+static void addFixup(Assembler *a, CallFixup fixup) {
+    if (a->fixupCount >= a->fixupCapacity) {
+        a->fixupCapacity *= 2;
+        a->fixups = realloc(a->fixups, sizeof(CallFixup) * a->fixupCapacity);
+        assertAlloc(a->fixups);
+    }
+
+    a->fixups[a->fixupCount++] = fixup;
+}
+
+// the callee may not have been assembled yet, so its index is patched in afterwards.
+// 'spawn @name' names its function the same way
+static void emitCall(Assembler *a, AvmInstruction instr) {
+    advance(a);
+    if (!expect(a, TOKEN_AT)) return;
+
+    Token name = expectOrErr(a, TOKEN_IDENTIFIER);
+    if (isErr(name)) return;
+
+    emit(a, instr);
+    addFixup(a, (CallFixup){ .offset = a->program.length, .name = strdup(name.lexeme) });
+    emit(a, 0);
+}
+
+// 'parallel @body reductions', the body named like a call's target
+static void emitParallel(Assembler *a) {
+    advance(a);
+    if (!expect(a, TOKEN_AT)) return;
+
+    Token name = expectOrErr(a, TOKEN_IDENTIFIER);
+    if (isErr(name)) return;
+
+    Token reductions = expectOrErr(a, TOKEN_INTEGER_LITERAL);
+    if (isErr(reductions)) return;
+
+    emit(a, INSTR_PARALLEL);
+    addFixup(a, (CallFixup){ .offset = a->program.length, .name = strdup(name.lexeme) });
+    emit(a, 0);
+    emit(a, atoi(reductions.lexeme));
+}
+
+// 'line <line> <column>', the source of the instructions that follow
+static void setLocation(Assembler *a) {
+    advance(a);
+
+    Token line = expectOrErr(a, TOKEN_INTEGER_LITERAL);
+    Token column = expectOrErr(a, TOKEN_INTEGER_LITERAL);
+    if (isErr(line) || isErr(column) || !a->file) return;
+
+    a->location = (LineEntry){
+        .file = addLineFile(&a->program.lines, a->file),
+        .line = (uint32_t)strtoul(line.lexeme, NULL, 10),
+        .column = (uint32_t)strtoul(column.lexeme, NULL, 10),
+    };
+    a->locationPending = true;
+}
+
+// 'label n' marks the address of the next instruction
+static void defineLabel(Assembler *a) {
+    advance(a);
+
+    Token number = expectOrErr(a, TOKEN_INTEGER_LITERAL);
+    if (isErr(number)) return;
+
+    size_t label = (size_t)atoi(number.lexeme);
+    while (label >= a->labelCount) {
+        if (a->labelCount >= a->labelCapacity) {
+            a->labelCapacity *= 2;
+            a->labels = realloc(a->labels, sizeof(size_t) * a->labelCapacity);
+            assertAlloc(a->labels);
+        }
+        a->labels[a->labelCount++] = SIZE_MAX;
+    }
+
+    if (a->labels[label] != SIZE_MAX) {
+        fprintf(a->errors, "assembler error: label %zu defined twice\n", label);
+        a->hadError = true;
+        return;
+    }
+    a->labels[label] = a->program.length;
+}
+
+// 'jmp n' and 'jmp_false n', the label may come before or after the jump
+static void emitJump(Assembler *a, AvmInstruction instr) {
+    advance(a);
+
+    Token number = expectOrErr(a, TOKEN_INTEGER_LITERAL);
+    if (isErr(number)) return;
+
+    emit(a, instr);
+    if (a->jumpCount >= a->jumpCapacity) {
+        a->jumpCapacity *= 2;
+        a->jumps = realloc(a->jumps, sizeof(JumpFixup) * a->jumpCapacity);
+        assertAlloc(a->jumps);
+    }
+    a->jumps[a->jumpCount++] = (JumpFixup){ .offset = a->program.length, .label = (size_t)atoi(number.lexeme) };
+    emit(a, 0);
+}
+
+// labels are local to their function, so its jumps are patched once it ends
+static void resolveJumps(Assembler *a, const char *function) {
+    for (size_t i = 0; i < a->jumpCount; i++) {
+        JumpFixup jump = a->jumps[i];
+        if (jump.label >= a->labelCount || a->labels[jump.label] == SIZE_MAX) {
+            fprintf(a->errors, "assembler error: jump to undefined label %zu in '%s'\n", jump.label, function);
+            a->hadError = true;
+            continue;
+        }
+
+        a->program.code[jump.offset] = (int32_t)((long)a->labels[jump.label] - (long)(jump.offset + 1));
+    }
+
+    a->labelCount = 0;
+    a->jumpCount = 0;
+}
+
+static int compareFunctionNames(const void *a, const void *b) {
+    return strcmp((*(const Function *const *)a)->name, (*(const Function *const *)b)->name);
+}
+
+// the table's entries sorted by name, so every fixup is a binary search
+static const Function **sortByName(const FunctionTable *table) {
+    const Function **sorted = alloc((table->count + 1) * sizeof(Function *));
+    for (size_t i = 0; i < table->count; i++) sorted[i] = &table->entries[i];
+    qsort(sorted, table->count, sizeof(Function *), compareFunctionNames);
+
+    return sorted;
+}
+
+static bool findFunction(const FunctionTable *table, const Function **sorted, const char *name,
+                         size_t *index) {
+    Function key = { .name = (char *)name };
+    const Function *keyPointer = &key;
+
+    const Function **found = bsearch(&keyPointer, sorted, table->count, sizeof(Function *),
+                                     compareFunctionNames);
+    if (found) *index = *found - table->entries;
+
+    return found != NULL;
+}
+
+// calls to imports are numbered after the defined functions until the linker resolves them
+static void resolveFixups(Assembler *a) {
+    const Function **functions = sortByName(&a->program.functions);
+    const Function **imports = sortByName(&a->program.imports);
+
+    for (size_t i = 0; i < a->fixupCount; i++) {
+        CallFixup fixup = a->fixups[i];
+
+        size_t index = 0;
+        bool found = findFunction(&a->program.functions, functions, fixup.name, &index);
+        if (!found && findFunction(&a->program.imports, imports, fixup.name, &index)) {
+            index += a->program.functions.count;
+            found = true;
+        }
+
+        if (found) {
+            a->program.code[fixup.offset] = index;
+            addRelocation(a, fixup.offset, RELOC_CALL);
+        } else {
+            fprintf(a->errors, "assembler error: call to undefined function '%s'\n", fixup.name);
+            a->hadError = true;
+        }
+
+        FREE_ALLOC(fixup.name);
+    }
+
+    a->fixupCount = 0;
+    FREE_ALLOC(functions);
+    FREE_ALLOC(imports);
+}
+
+static const char *binaryOpNames[BIN_OP_COUNT] = {
+    "add", "sub", "mul", "div", "lt", "le", "gt", "ge", "eq", "ne",
+};
+
+const char *binaryOpName(BinaryOp op) {
+    return binaryOpNames[op];
+}
+
+static bool findBinaryOp(const char *name, BinaryOp *op) {
+    for (int i = 0; i < BIN_OP_COUNT; i++) {
+        if (strcmp(binaryOpNames[i], name) == 0) {
+            *op = (BinaryOp)i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// the typed opcodes are laid out in blocks of BIN_OP_COUNT per operand type
+static bool binaryInstruction(BinaryOp op, ValueType type, AvmInstruction *instr) {
+    switch (type) {
+        case TYPE_I32: *instr = INSTR_ADD_I32 + op; return true;
+        case TYPE_I64: *instr = INSTR_ADD_I64 + op; return true;
+        case TYPE_F64: *instr = INSTR_ADD_F64 + op; return true;
+        case TYPE_ANY: *instr = INSTR_ADD + op; return true;
+        case TYPE_BOOL: {
+            if (op == BIN_EQ) *instr = INSTR_EQ_BOOL;
+            else if (op == BIN_NE) *instr = INSTR_NE_BOOL;
+            else return false;
+            return true;
+        }
+        default: return false;
+    }
+}
+
+// '<op> <type>', e.g. 'add i32'
+static void emitBinary(Assembler *a) {
+    Token name = current(a);
+    advance(a);
+
+    BinaryOp op;
+    if (!findBinaryOp(name.lexeme, &op)) return;
+
+    Token type = expectOrErr(a, TOKEN_IDENTIFIER);
+    if (isErr(type)) return;
+
+    AvmInstruction instr;
+    if (!binaryInstruction(op, typeFromName(type.lexeme), &instr)) {
+        fprintf(a->errors, "assembler error: no '%s' instruction for type '%s'\n", name.lexeme, type.lexeme);
+        a->hadError = true;
+        return;
+    }
+
+    emit(a, instr);
+}
+
+static const char *arrayOpNames[] = {
+    "new", "get", "set", "len", "fill", "copy", "add", "mul", "dot", "sum", "min", "max",
+};
+
+bool isArrayInstruction(AvmInstruction instr) {
+    return instr >= INSTR_ARRAY_NEW && instr <= INSTR_ARRAY_MAX;
+}
+
+const char *arrayOpName(AvmInstruction instr) {
+    return arrayOpNames[instr - INSTR_ARRAY_NEW];
+}
+
+static bool findArrayOp(const char *name, AvmInstruction *instr) {
+    for (AvmInstruction op = INSTR_ARRAY_NEW; op <= INSTR_ARRAY_MAX; op++) {
+        if (strcmp(arrayOpName(op), name) == 0) {
+            *instr = op;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// 'array <op>', and 'array new <element type>'
+static void emitArray(Assembler *a) {
+    advance(a);
+
+    Token name = expectOrErr(a, TOKEN_IDENTIFIER);
+    if (isErr(name)) return;
+
+    AvmInstruction instr;
+    if (!findArrayOp(name.lexeme, &instr)) {
+        fprintf(a->errors, "assembler error: unknown array operation '%s'\n", name.lexeme);
+        a->hadError = true;
+        return;
+    }
+
+    if (instr != INSTR_ARRAY_NEW) {
+        emit(a, instr);
+        return;
+    }
+
+    Token type = expectOrErr(a, TOKEN_IDENTIFIER);
+    if (isErr(type)) return;
+
+    ValueType element = typeFromName(type.lexeme);
+    if (!isNumericType(element)) {
+        fprintf(a->errors, "assembler error: no array of type '%s'\n", type.lexeme);
+        a->hadError = true;
+        return;
+    }
+
+    emit(a, instr);
+    emit(a, (AvmInstruction)element);
+}
+
+bool isBinaryInstruction(AvmInstruction instr) {
+    return instr >= INSTR_ADD_I32 && instr <= INSTR_NE;
+}
+
+size_t functionEnd(const Program *p, size_t address) {
+    size_t end = p->length;
+    for (size_t i = 0; i < p->functions.count; i++) {
+        size_t other = p->functions.entries[i].address;
+        if (other > address && other < end) end = other;
+    }
+
+    return end;
+}
+
+static int compareAddresses(const void *a, const void *b) {
+    const size_t *left = a, *right = b;
+    return (left[0] > right[0]) - (left[0] < right[0]);
+}
+
+void functionExtents(const Program *p, size_t *ends) {
+    size_t count = p->functions.count;
+
+    // (address, index) pairs sorted by address, so every end is found in one pass
+    size_t *order = alloc((count + 1) * 2 * sizeof(size_t));
+    for (size_t i = 0; i < count; i++) {
+        order[i * 2] = p->functions.entries[i].address;
+        order[i * 2 + 1] = i;
+    }
+    qsort(order, count, 2 * sizeof(size_t), compareAddresses);
+
+    size_t end = p->length;
+    for (size_t i = count; i > 0; i--) {
+        size_t address = order[(i - 1) * 2];
+        ends[order[(i - 1) * 2 + 1]] = end;
+
+        // stubs have no code yet and never end another function
+        if (i > 1 && order[(i - 2) * 2] < address && address <= p->length) end = address;
+    }
+
+    FREE_ALLOC(order);
+}
+
 static void emitRet(Assembler *a) {
     expect(a, TOKEN_RET);
     advance(a);
@@ -169,56 +598,181 @@ static void parseInstructions(Assembler *a) {
             emitHalt(a);
             break;
         }
+        case TOKEN_LOAD: {
+            emitLocal(a, INSTR_LOAD_LOCAL);
+            break;
+        }
+        case TOKEN_STORE: {
+            emitLocal(a, INSTR_STORE_LOCAL);
+            break;
+        }
+        case TOKEN_CALL: {
+            emitCall(a, INSTR_CALL);
+            break;
+        }
+        case TOKEN_SPAWN: {
+            emitCall(a, INSTR_SPAWN);
+            break;
+        }
+        case TOKEN_CHANNEL: {
+            advance(a);
+            emit(a, INSTR_CHANNEL);
+            break;
+        }
+        case TOKEN_SEND: {
+            advance(a);
+            emit(a, INSTR_SEND);
+            break;
+        }
+        case TOKEN_RECV: {
+            advance(a);
+            emit(a, INSTR_RECV);
+            break;
+        }
+        case TOKEN_YIELD: {
+            advance(a);
+            emit(a, INSTR_YIELD);
+            break;
+        }
+        case TOKEN_ARRAY: {
+            emitArray(a);
+            break;
+        }
+        case TOKEN_PARALLEL: {
+            emitParallel(a);
+            break;
+        }
+        case TOKEN_NEXT: {
+            advance(a);
+            emit(a, INSTR_PARALLEL_NEXT);
+            break;
+        }
+        case TOKEN_LABEL: {
+            defineLabel(a);
+            break;
+        }
+        case TOKEN_LINE: {
+            setLocation(a);
+            break;
+        }
+        case TOKEN_JMP: {
+            emitJump(a, INSTR_JMP);
+            break;
+        }
+        case TOKEN_JMP_FALSE: {
+            emitJump(a, INSTR_JMP_IF_FALSE);
+            break;
+        }
+        case TOKEN_POP: {
+            advance(a);
+            emit(a, INSTR_POP);
+            break;
+        }
+        case TOKEN_IDENTIFIER: {
+            emitBinary(a);
+            break;
+        }
         default: {
             advance(a);
         }
     }
 }
 
-static Function newFunctionEntry(const char *name, size_t address) {
-    return (Function){
+static Function newFunctionEntry(const char *name, size_t address, ValueType *paramTypes,
+                                 size_t arity, size_t localCount, ValueType returnType) {
+    Function function = {
         .name = strdup(name),
         .address = address,
+        .arity = arity,
+        .localCount = localCount,
+        .paramTypes = paramTypes,
+        .returnType = returnType,
+        .validated = true,
     };
+    assertAlloc(function.name);
+
+    return function;
 }
 
-static void addFunctionEntry(Assembler *a, Function func) {
-    if (a->program.functions.count >= a->program.functions.capacity) {
-        a->program.functions.capacity *= 2;
-        a->program.functions.entries = realloc(
-            a->program.functions.entries,
-            sizeof(Function) * a->program.functions.capacity
-        );
-        assertAlloc(a->program.functions.entries);
+static void addFunctionEntry(FunctionTable *table, Function func) {
+    if (table->count >= table->capacity) {
+        table->capacity *= 2;
+        table->entries = realloc(table->entries, sizeof(Function) * table->capacity);
+        assertAlloc(table->entries);
     }
 
-    a->program.functions.entries[a->program.functions.count++] = func;
+    table->entries[table->count++] = func;
 }
 
-static void parseFunction(Assembler *a) {
-    if (!expect(a, TOKEN_AT)) return;
+// parses '@name(types): type', shared by definitions and declarations
+static bool parseSignature(Assembler *a, Token *name, ValueType **types, size_t *arity, ValueType *returnType) {
+    if (!expect(a, TOKEN_AT)) return false;
 
-    Token name = expectOrErr(a, TOKEN_IDENTIFIER);
-    if (isErr(name)) return;
+    *name = expectOrErr(a, TOKEN_IDENTIFIER);
+    if (isErr(*name)) return false;
 
-    if (!expect(a, TOKEN_LEFT_PAREN)) return;
+    if (!expect(a, TOKEN_LEFT_PAREN)) return false;
     advanceIfMatch(a, TOKEN_NONE);
 
-    if (!expect(a, TOKEN_RIGHT_PAREN)) return;
-    if (!expect(a, TOKEN_COLON)) return;
+    size_t count = 0;
+    size_t typeCapacity = 1;
+    ValueType *paramTypes = alloc(sizeof(ValueType));
+    while (match(a, TOKEN_IDENTIFIER)) {
+        if (count >= typeCapacity) {
+            typeCapacity *= 2;
+            paramTypes = realloc(paramTypes, typeCapacity * sizeof(ValueType));
+            assertAlloc(paramTypes);
+        }
+        paramTypes[count++] = typeFromName(current(a).lexeme);
 
-    Token returnType = expectOrErr(a, TOKEN_IDENTIFIER);
-    if (isErr(returnType)) return;
+        advance(a);
+        if (!expect(a, TOKEN_COMMA)) break;
+    }
+
+    Token type = {0};
+    if (!expect(a, TOKEN_RIGHT_PAREN) || !expect(a, TOKEN_COLON) ||
+        isErr(type = expectOrErr(a, TOKEN_IDENTIFIER))) {
+        FREE_ALLOC(paramTypes);
+        return false;
+    }
+
+    *types = paramTypes;
+    *arity = count;
+    *returnType = typeFromName(type.lexeme);
+    return true;
+}
+
+static void parseFunction(Assembler *a, bool exported) {
+    Token name;
+    ValueType *paramTypes = NULL;
+    size_t arity = 0;
+    ValueType returnType = TYPE_UNKNOWN;
+    if (!parseSignature(a, &name, &paramTypes, &arity, &returnType)) return;
+
+    size_t localCount = arity;
+    if (expect(a, TOKEN_LOCALS)) {
+        Token count = expectOrErr(a, TOKEN_INTEGER_LITERAL);
+        if (isErr(count)) {
+            FREE_ALLOC(paramTypes);
+            return;
+        }
+        localCount = atoi(count.lexeme);
+    }
 
-    Function function = newFunctionEntry(name.lexeme, a->program.length);
-    addFunctionEntry(a, function);
+    Function function = newFunctionEntry(name.lexeme, a->program.length, paramTypes, arity,
+                                         localCount, returnType);
+    function.exported = exported;
+    addFunctionEntry(&a->program.functions, function);
 
     if (!expect(a, TOKEN_LEFT_BRACE)) return;
     if (!expect(a, TOKEN_NEWLINE)) return;
 
+    a->labelCount = 0;
+    a->jumpCount = 0;
     while (!match(a, TOKEN_RIGHT_BRACE)) {
         parseInstructions(a);
     }
+    resolveJumps(a, name.lexeme);
 
     if (!expect(a, TOKEN_RIGHT_BRACE)) return;
     if (!expect(a, TOKEN_NEWLINE)) return;
@@ -226,32 +780,135 @@ static void parseFunction(Assembler *a) {
 
 static void emitDefine(Assembler *a) {
     expect(a, TOKEN_DEFINE);
-    advanceIfMatch(a, TOKEN_PUBLIC);
-    
+    bool exported = expect(a, TOKEN_PUBLIC);
+
     if (match(a, TOKEN_FUNCTION)) {
         advance(a);
-        parseFunction(a);
+        parseFunction(a, exported);
     }
 }
 
+static void emitDeclare(Assembler *a) {
+    expect(a, TOKEN_DECLARE);
+    if (!expect(a, TOKEN_FUNCTION)) return;
+
+    Token name;
+    ValueType *paramTypes = NULL;
+    size_t arity = 0;
+    ValueType returnType = TYPE_UNKNOWN;
+    if (!parseSignature(a, &name, &paramTypes, &arity, &returnType)) return;
+
+    Function import = newFunctionEntry(name.lexeme, 0, paramTypes, arity, arity, returnType);
+    addFunctionEntry(&a->program.imports, import);
+}
+
 static void parseIrTokens(Assembler *a) {
     switch (current(a).type) {
         case TOKEN_DEFINE: {
             emitDefine(a);
             break;
         }
+        case TOKEN_DECLARE: {
+            emitDeclare(a);
+            break;
+        }
         default: {
             advance(a);
         }
     }
 }
 
+size_t operandCount(AvmInstruction instr) {
+    switch (instr) {
+        case INSTR_PUSH_CONST:
+        case INSTR_CALL:
+        case INSTR_SPAWN:
+        case INSTR_ARRAY_NEW:
+        case INSTR_JMP:
+        case INSTR_JMP_IF_FALSE:
+        case INSTR_LOAD_LOCAL:
+        case INSTR_STORE_LOCAL:
+            return 1;
+        case INSTR_PARALLEL:
+        case INSTR_PUSH_I64:
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+static void binaryInstructionName(AvmInstruction instr, char *buffer, size_t size) {
+    if (instr == INSTR_EQ_BOOL || instr == INSTR_NE_BOOL) {
+        snprintf(buffer, size, "%s BOOL", instr == INSTR_EQ_BOOL ? "EQ" : "NE");
+        return;
+    }
+
+    static const char *types[] = { "I32", "I64", "F64" };
+    size_t index = instr - INSTR_ADD_I32;
+    const char *type = index < 3 * BIN_OP_COUNT ? types[index / BIN_OP_COUNT] : "ANY";
+    if (instr >= INSTR_ADD) index = instr - INSTR_ADD;
+
+    char name[8] = {0};
+    const char *op = binaryOpName(index % BIN_OP_COUNT);
+    for (size_t i = 0; op[i] && i < sizeof(name) - 1; i++) name[i] = op[i] - 'a' + 'A';
+    snprintf(buffer, size, "%s %s", name, type);
+}
+
+void instructionName(AvmInstruction instr, char *buffer, size_t size) {
+    static const char *names[] = {
+        [INSTR_PUSH_CONST] = "PUSH CONST",
+        [INSTR_RET] = "RET",
+        [INSTR_EXEC] = "EXEC",
+        [INSTR_HALT] = "HALT",
+        [INSTR_PRINT] = "PRINT",
+        [INSTR_CALL] = "CALL",
+        [INSTR_JMP] = "JMP",
+        [INSTR_LOAD_LOCAL] = "LOAD LOCAL",
+        [INSTR_STORE_LOCAL] = "STORE LOCAL",
+        [INSTR_SPAWN] = "SPAWN",
+        [INSTR_CHANNEL] = "CHANNEL",
+        [INSTR_SEND] = "SEND",
+        [INSTR_RECV] = "RECV",
+        [INSTR_YIELD] = "YIELD",
+        [INSTR_ARRAY_NEW] = "ARRAY NEW",
+        [INSTR_PARALLEL] = "PARALLEL",
+        [INSTR_PARALLEL_NEXT] = "NEXT",
+        [INSTR_JMP_IF_FALSE] = "JMP IF FALSE",
+        [INSTR_POP] = "POP",
+        [INSTR_PUSH_I64] = "PUSH I64",
+    };
+
+    if (isBinaryInstruction(instr)) {
+        binaryInstructionName(instr, buffer, size);
+    } else if (isArrayInstruction(instr) && instr != INSTR_ARRAY_NEW) {
+        snprintf(buffer, size, "ARRAY %s", arrayOpName(instr));
+        for (char *ch = buffer + 6; size > 6 && *ch; ch++) *ch += 'A' - 'a';
+    } else if ((size_t)instr < sizeof(names) / sizeof(names[0]) && names[instr]) {
+        snprintf(buffer, size, "%s", names[instr]);
+    } else {
+        snprintf(buffer, size, "UNKNOWN %d", instr);
+    }
+}
+
+static void printBinaryInstruction(AvmInstruction instr) {
+    char name[32];
+    binaryInstructionName(instr, name, sizeof(name));
+    printf("%s", name);
+}
+
 void printBytecode(Program *b) {
     printf("=== Assembler Output (%ld) ===\n", b->length);
     for (size_t i = 0; i < b->length; i++) {
+        LineEntry entry;
+        if (findLine(&b->lines, i, &entry) && entry.pc == i) {
+            char location[256];
+            formatLine(&b->lines, i, location, sizeof(location));
+            printf("; %s\n", location);
+        }
+
         switch (b->code[i]) {
-            case INSTR_PUSH_I32: {
-                printf("PUSH CONST I32: %d", b->code[++i]);
+            case INSTR_PUSH_CONST: {
+                printf("PUSH CONST: %d", b->code[++i]);
                 break;
             }
             case INSTR_RET: {
@@ -278,7 +935,72 @@ void printBytecode(Program *b) {
                 printf("JMP: %d", b->code[++i]);
                 break;
             }
+            case INSTR_LOAD_LOCAL: {
+                printf("LOAD LOCAL: %d", b->code[++i]);
+                break;
+            }
+            case INSTR_STORE_LOCAL: {
+                printf("STORE LOCAL: %d", b->code[++i]);
+                break;
+            }
+            case INSTR_SPAWN: {
+                printf("SPAWN: %d", b->code[++i]);
+                break;
+            }
+            case INSTR_CHANNEL: {
+                printf("CHANNEL");
+                break;
+            }
+            case INSTR_SEND: {
+                printf("SEND");
+                break;
+            }
+            case INSTR_RECV: {
+                printf("RECV");
+                break;
+            }
+            case INSTR_YIELD: {
+                printf("YIELD");
+                break;
+            }
+            case INSTR_ARRAY_NEW: {
+                printf("ARRAY NEW: %s", typeName((ValueType)b->code[++i]));
+                break;
+            }
+            case INSTR_PARALLEL: {
+                printf("PARALLEL: %d", b->code[i + 1]);
+                printf(" (%d reductions)", b->code[i + 2]);
+                i += 2;
+                break;
+            }
+            case INSTR_PARALLEL_NEXT: {
+                printf("NEXT");
+                break;
+            }
+            case INSTR_JMP_IF_FALSE: {
+                printf("JMP IF FALSE: %d", b->code[++i]);
+                break;
+            }
+            case INSTR_POP: {
+                printf("POP");
+                break;
+            }
+            case INSTR_PUSH_I64: {
+                uint64_t high = (uint32_t)b->code[i + 1], low = (uint32_t)b->code[i + 2];
+                printf("PUSH I64: %lld", (long long)(int64_t)(high << 32 | low));
+                i += 2;
+                break;
+            }
             default: {
+                if (isBinaryInstruction(b->code[i])) {
+                    printBinaryInstruction(b->code[i]);
+                    break;
+                }
+                if (isArrayInstruction(b->code[i])) {
+                    printf("ARRAY ");
+                    for (const char *ch = arrayOpName(b->code[i]); *ch; ch++) printf("%c", *ch - 'a' + 'A');
+                    break;
+                }
                 printf("%s %d", "Unknown program op: ", b->code[i]);
             }
         }
@@ -291,7 +1013,11 @@ static void printFunctionTable(Program *p) {
     printf("=== Function Table (%ld) ===\n", p->functions.count);
     for (size_t i = 0; i < p->functions.count; i++) {
         Function func = p->functions.entries[i];
-        printf("Function: '%s' at address: %zu\n", func.name, func.address);
+        printf("Function: '%s' at address: %zu (arity %zu, locals %zu)%s\n",
+               func.name, func.address, func.arity, func.localCount, func.exported ? " exported" : "");
+    }
+    for (size_t i = 0; i < p->imports.count; i++) {
+        printf("Import: '%s' (arity %zu)\n", p->imports.entries[i].name, p->imports.entries[i].arity);
     }
     printf("=== End Function Table (%ld) ===\n", p->functions.count);
 }
@@ -299,7 +1025,7 @@ static void printFunctionTable(Program *p) {
 void assemble(Assembler *a) {
     if (!a) return;
 
-    Lexer lexer = newLexer("out.air");
+    Lexer lexer = newSourceLexer("out.air", a->ir);
     registerVmKeywords(&lexer);
     lexerTokenize(&lexer);
 
@@ -309,6 +1035,7 @@ void assemble(Assembler *a) {
     while (a->position < a->tokenCount) {
         parseIrTokens(a);
     }
+    resolveFixups(a);
 
     if (a->debug) printTokens(&lexer);
     if (a->debug) printBytecode(&a->program);
@@ -3,13 +3,34 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 
 #include "../parser/token.h"
+#include "../parser/types.h"
 #include "object.h"
+#include "lines.h"
 
 typedef struct {
     char *name;
     size_t address;
+
+    // arguments occupy the first 'arity' of the frame's 'localCount' slots
+    size_t arity;
+    size_t localCount;
+
+    ValueType *paramTypes;
+    ValueType returnType;
+
+    // functions loaded from an image are validated on their first call against
+    // the checksum of their code words, assembled functions are trusted
+    bool validated;
+    uint64_t checksum;
+
+    // defined with 'pub fn', visible to other objects at link time
+    bool exported;
+
+    // only the signature is known, the body is compiled on the first call
+    bool stub;
 } Function;
 
 typedef struct {
@@ -24,16 +45,112 @@ typedef struct {
     size_t capacity;
 } ConstantPool;
 
+// binary operators in the order their typed opcodes are laid out
+typedef enum {
+    BIN_ADD,
+    BIN_SUB,
+    BIN_MUL,
+    BIN_DIV,
+    BIN_LT,
+    BIN_LE,
+    BIN_GT,
+    BIN_GE,
+    BIN_EQ,
+    BIN_NE,
+    BIN_OP_COUNT,
+} BinaryOp;
+
+// bumped whenever an instruction is added or removed or its operands or
+// meaning change, so programs compiled for another instruction set are not reused
+#define BYTECODE_VERSION 2
+
 typedef enum {
-    INSTR_PUSH_I32,
+    INSTR_PUSH_CONST,
     INSTR_RET,
     INSTR_EXEC,
     INSTR_HALT,
     INSTR_PRINT,
     INSTR_CALL,
-    INSTR_JMP,
+    INSTR_JMP, // operand is a signed offset from the following instruction
+    INSTR_LOAD_LOCAL,
+    INSTR_STORE_LOCAL,
+
+    // statically typed operands, executed without looking at tags
+    INSTR_ADD_I32, INSTR_SUB_I32, INSTR_MUL_I32, INSTR_DIV_I32,
+    INSTR_LT_I32, INSTR_LE_I32, INSTR_GT_I32, INSTR_GE_I32, INSTR_EQ_I32, INSTR_NE_I32,
+
+    INSTR_ADD_I64, INSTR_SUB_I64, INSTR_MUL_I64, INSTR_DIV_I64,
+    INSTR_LT_I64, INSTR_LE_I64, INSTR_GT_I64, INSTR_GE_I64, INSTR_EQ_I64, INSTR_NE_I64,
+
+    INSTR_ADD_F64, INSTR_SUB_F64, INSTR_MUL_F64, INSTR_DIV_F64,
+    INSTR_LT_F64, INSTR_LE_F64, INSTR_GT_F64, INSTR_GE_F64, INSTR_EQ_F64, INSTR_NE_F64,
+
+    INSTR_EQ_BOOL, INSTR_NE_BOOL,
+
+    // dynamically typed operands, dispatched on their tags at run time
+    INSTR_ADD, INSTR_SUB, INSTR_MUL, INSTR_DIV,
+    INSTR_LT, INSTR_LE, INSTR_GT, INSTR_GE, INSTR_EQ, INSTR_NE,
+
+    // fibers and the channels between them
+    INSTR_SPAWN, // operand is a function index, like CALL
+    INSTR_CHANNEL,
+    INSTR_SEND,
+    INSTR_RECV,
+    INSTR_YIELD,
+
+    // typed arrays, laid out in the order of their 'array <op>' mnemonics
+    INSTR_ARRAY_NEW, // operand is the element's ValueType
+    INSTR_ARRAY_GET,
+    INSTR_ARRAY_SET,
+    INSTR_ARRAY_LEN,
+    // whole-array operations, run as vectorised kernels
+    INSTR_ARRAY_FILL,
+    INSTR_ARRAY_COPY,
+    INSTR_ARRAY_ADD,
+    INSTR_ARRAY_MUL,
+    INSTR_ARRAY_DOT,
+    INSTR_ARRAY_SUM,
+    INSTR_ARRAY_MIN,
+    INSTR_ARRAY_MAX,
+
+    // a parallel for, operands are the outlined body's function index, which
+    // is relocated like CALL, and the number of reductions it combines
+    INSTR_PARALLEL,
+    // ends an iteration of the outlined body, moving on to the chunk's next index
+    INSTR_PARALLEL_NEXT,
+
+    // pops a bool and jumps when it is false, the operand an offset like JMP's
+    INSTR_JMP_IF_FALSE,
+    INSTR_POP,
+
+    // an i64 constant too wide for the constant pool's Objects, operands are
+    // its high and low 32 bits
+    INSTR_PUSH_I64,
+
+    // not an opcode, the number of them
+    INSTR_COUNT,
 } AvmInstruction;
 
+typedef enum {
+    // operand is a constant pool index
+    RELOC_CONSTANT,
+    // operand is a function index, or past the end of the table an import index.
+    // SPAWN and PARALLEL operands are relocated the same way
+    RELOC_CALL,
+} RelocationKind;
+
+// an operand word that depends on where the object ends up when linked
+typedef struct {
+    size_t offset;
+    RelocationKind kind;
+} Relocation;
+
+typedef struct {
+    Relocation *entries;
+    size_t count;
+    size_t capacity;
+} RelocationTable;
+
 typedef struct {
     AvmInstruction *code;
     size_t length;
@@ -41,20 +158,89 @@ typedef struct {
 
     ConstantPool constants;
     FunctionTable functions;
+
+    // functions declared with 'extern fn', only their signatures are known
+    FunctionTable imports;
+    RelocationTable relocations;
+
+    // where the code came from, empty when compiled without it or stripped
+    LineTable lines;
 } Program;
 
+// a CALL or SPAWN operand waiting for its target function to be defined
+typedef struct {
+    size_t offset;
+    char *name;
+} CallFixup;
+
+// a JMP or JMP_IF_FALSE operand waiting for its label's address
+typedef struct {
+    size_t offset;
+    size_t label;
+} JumpFixup;
+
 typedef struct {
     Program program;
     Token *tokens;
     size_t tokenCount;
 
+    CallFixup *fixups;
+    size_t fixupCount;
+    size_t fixupCapacity;
+
+    // the current function's labels by number, SIZE_MAX until defined, and
+    // the jumps to them. jumps are relative, so they need no relocation
+    size_t *labels;
+    size_t labelCount;
+    size_t labelCapacity;
+    JumpFixup *jumps;
+    size_t jumpCount;
+    size_t jumpCapacity;
+
+    // the textual IR from the compiler
+    const char *ir;
+    // the source the IR was compiled from, named by the line table. the
+    // location of the last 'line' is given to the next instruction emitted
+    const char *file;
+    LineEntry location;
+    bool locationPending;
+
     size_t position;
     bool debug;
+    FILE *errors;
+    bool hadError;
 } Assembler;
 
-Assembler newAssembler(bool debug);
+// number of operand words that follow an opcode in 'Program.code'
+size_t operandCount(AvmInstruction instr);
+
+// checks if an opcode is one of the typed or generic binary operators
+bool isBinaryInstruction(AvmInstruction instr);
+
+const char *binaryOpName(BinaryOp op);
+
+bool isArrayInstruction(AvmInstruction instr);
+// the mnemonic that follows 'array', e.g. "dot"
+const char *arrayOpName(AvmInstruction instr);
+
+// the mnemonic 'printBytecode' shows for an opcode, e.g. "LOAD LOCAL" or "ADD I32"
+void instructionName(AvmInstruction instr, char *buffer, size_t size);
+
+// a function's code extends from its address up to the next function's address
+size_t functionEnd(const Program *program, size_t address);
+
+// the end of every function at once, 'ends' needs room for the whole function table
+void functionExtents(const Program *program, size_t *ends);
+
+Assembler newAssembler(const char *ir, bool debug);
 void freeAssembler(Assembler *assembler);
 
+// frees the code, constants, function tables and relocations of an assembled program
+void freeProgram(Program *program);
+void freeFunctionTable(FunctionTable *table);
+
+void printBytecode(Program *program);
+
 void assemble(Assembler *assembler);
 
 #endif
\ No newline at end of file
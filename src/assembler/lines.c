@@ -0,0 +1,195 @@
+#include <string.h>
+#include <stdio.h>
+
+#include "lines.h"
+#include "../util/alloc.h"
+
+uint32_t addLineFile(LineTable *table, const char *path) {
+    for (size_t i = 0; i < table->fileCount; i++) {
+        if (strcmp(table->files[i], path) == 0) return (uint32_t)i;
+    }
+
+    if (table->fileCount >= table->fileCapacity) {
+        table->fileCapacity = table->fileCapacity ? table->fileCapacity * 2 : 1;
+        table->files = realloc(table->files, sizeof(char *) * table->fileCapacity);
+        assertAlloc(table->files);
+    }
+
+    table->files[table->fileCount] = strdup(path);
+    assertAlloc(table->files[table->fileCount]);
+
+    return (uint32_t)table->fileCount++;
+}
+
+static void appendByte(LineTable *table, uint8_t byte) {
+    if (table->size >= table->capacity) {
+        table->capacity = table->capacity ? table->capacity * 2 : 16;
+        table->bytes = realloc(table->bytes, table->capacity);
+        assertAlloc(table->bytes);
+    }
+
+    table->bytes[table->size++] = byte;
+}
+
+// seven bits at a time, the high bit set on every byte but the last
+static void appendVarint(LineTable *table, uint64_t value) {
+    while (value >= 0x80) {
+        appendByte(table, (uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    appendByte(table, (uint8_t)value);
+}
+
+// small differences either way stay small
+static uint64_t zigzag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static bool readVarint(const uint8_t *bytes, size_t size, size_t *offset, uint64_t *value) {
+    *value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (*offset >= size) return false;
+
+        uint8_t byte = bytes[(*offset)++];
+        *value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+
+    return false;
+}
+
+static void addCheckpoint(LineTable *table) {
+    if (table->checkpointCount >= table->checkpointCapacity) {
+        table->checkpointCapacity = table->checkpointCapacity ? table->checkpointCapacity * 2 : 1;
+        table->checkpoints = realloc(table->checkpoints, sizeof(LineCheckpoint) * table->checkpointCapacity);
+        assertAlloc(table->checkpoints);
+    }
+
+    table->checkpoints[table->checkpointCount++] = (LineCheckpoint){
+        .entry = table->last,
+        .offset = table->size,
+    };
+}
+
+// the pc difference shifted left, its low bit set when a file index follows
+void addLine(LineTable *table, LineEntry entry) {
+    LineEntry last = table->last;
+    if (table->count > 0) {
+        if (entry.pc <= last.pc) return;
+        if (entry.file == last.file && entry.line == last.line && entry.column == last.column) return;
+    }
+
+    bool fileChanged = entry.file != last.file;
+    appendVarint(table, (uint64_t)(entry.pc - last.pc) << 1 | fileChanged);
+    if (fileChanged) appendVarint(table, entry.file);
+    appendVarint(table, zigzag((int64_t)entry.line - last.line));
+    appendVarint(table, zigzag((int64_t)entry.column - last.column));
+
+    table->last = entry;
+    if (table->count++ % LINE_CHECKPOINT_INTERVAL == 0) addCheckpoint(table);
+}
+
+bool nextLine(const uint8_t *bytes, size_t size, size_t *offset, const LineEntry *previous, LineEntry *entry) {
+    uint64_t pcDelta, file = previous->file, line, column;
+    if (!readVarint(bytes, size, offset, &pcDelta)) return false;
+    if ((pcDelta & 1) && !readVarint(bytes, size, offset, &file)) return false;
+    if (!readVarint(bytes, size, offset, &line) || !readVarint(bytes, size, offset, &column)) return false;
+
+    int64_t newLine = (int64_t)previous->line + unzigzag(line);
+    int64_t newColumn = (int64_t)previous->column + unzigzag(column);
+    if (file > UINT32_MAX || newLine < 0 || newLine > UINT32_MAX || newColumn < 0 || newColumn > UINT32_MAX) {
+        return false;
+    }
+
+    *entry = (LineEntry){
+        .pc = previous->pc + (pcDelta >> 1),
+        .file = (uint32_t)file,
+        .line = (uint32_t)newLine,
+        .column = (uint32_t)newColumn,
+    };
+    return true;
+}
+
+// the entry in effect at 'pc' and where the one after it is encoded
+static bool seekLine(const LineTable *table, size_t pc, LineEntry *entry, size_t *offset) {
+    if (!table || table->checkpointCount == 0 || pc < table->checkpoints[0].entry.pc) return false;
+
+    // the last checkpoint at or before 'pc', then at most an interval of entries from it
+    size_t low = 0, high = table->checkpointCount;
+    while (high - low > 1) {
+        size_t middle = low + (high - low) / 2;
+        if (table->checkpoints[middle].entry.pc <= pc) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+
+    *entry = table->checkpoints[low].entry;
+    *offset = table->checkpoints[low].offset;
+
+    LineEntry next;
+    size_t after = *offset;
+    while (nextLine(table->bytes, table->size, &after, entry, &next) && next.pc <= pc) {
+        *entry = next;
+        *offset = after;
+    }
+
+    return true;
+}
+
+bool findLine(const LineTable *table, size_t pc, LineEntry *entry) {
+    size_t offset;
+    return seekLine(table, pc, entry, &offset);
+}
+
+static void addShifted(LineTable *table, const LineTable *from, LineEntry entry, size_t pc, int64_t lineShift) {
+    if (entry.file >= from->fileCount) return;
+
+    int64_t line = (int64_t)entry.line + lineShift;
+    addLine(table, (LineEntry){
+        .pc = pc,
+        // files are numbered per table
+        .file = addLineFile(table, from->files[entry.file]),
+        .line = line > 0 ? (uint32_t)line : 0,
+        .column = entry.column,
+    });
+}
+
+void copyLines(LineTable *table, const LineTable *from, size_t start, size_t end, size_t address,
+               int64_t lineShift) {
+    LineEntry entry;
+    size_t offset;
+    if (start >= end || !seekLine(from, start, &entry, &offset)) return;
+
+    addShifted(table, from, entry, address, lineShift);
+
+    LineEntry next;
+    while (nextLine(from->bytes, from->size, &offset, &entry, &next) && next.pc < end) {
+        addShifted(table, from, next, address + next.pc - start, lineShift);
+        entry = next;
+    }
+}
+
+bool formatLine(const LineTable *table, size_t pc, char *buffer, size_t size) {
+    LineEntry entry;
+    if (!findLine(table, pc, &entry) || entry.file >= table->fileCount) return false;
+
+    snprintf(buffer, size, "%s:%u:%u", table->files[entry.file], entry.line, entry.column);
+    return true;
+}
+
+void freeLineTable(LineTable *table) {
+    if (!table) return;
+
+    for (size_t i = 0; i < table->fileCount; i++) FREE_ALLOC(table->files[i]);
+    FREE_ALLOC(table->files);
+    FREE_ALLOC(table->bytes);
+    FREE_ALLOC(table->checkpoints);
+
+    *table = (LineTable){0};
+}
\ No newline at end of file
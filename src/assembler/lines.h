@@ -0,0 +1,68 @@
+#ifndef lines_h
+#define lines_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// entries between the ones kept decoded for the binary search
+#define LINE_CHECKPOINT_INTERVAL 16
+
+// where the code from 'pc' up to the next entry's pc came from
+typedef struct {
+    size_t pc;
+    uint32_t file;
+    uint32_t line;
+    uint32_t column;
+} LineEntry;
+
+typedef struct {
+    LineEntry entry;
+    // where the entry after it is encoded
+    size_t offset;
+} LineCheckpoint;
+
+// maps code addresses back to the source. entries are in pc order, each
+// encoded in a few bytes as the difference from the one before it
+typedef struct {
+    uint8_t *bytes;
+    size_t size;
+    size_t capacity;
+    size_t count;
+    LineEntry last;
+
+    LineCheckpoint *checkpoints;
+    size_t checkpointCount;
+    size_t checkpointCapacity;
+
+    // the source paths entries refer to by index
+    char **files;
+    size_t fileCount;
+    size_t fileCapacity;
+} LineTable;
+
+// the index of 'path' among the table's files, added if it is not there yet
+uint32_t addLineFile(LineTable *table, const char *path);
+
+// appends an entry past the last one. one that repeats the last location
+// or does not come after it is dropped
+void addLine(LineTable *table, LineEntry entry);
+
+// the entry in effect at 'pc', false if the code there has no location
+bool findLine(const LineTable *table, size_t pc, LineEntry *entry);
+
+// decodes the entry encoded at '*offset' following 'previous', moving the
+// offset past it. false at the end of the table or when the bytes are malformed
+bool nextLine(const uint8_t *bytes, size_t size, size_t *offset, const LineEntry *previous, LineEntry *entry);
+
+// appends the entries covering 'start' to 'end' of another table's code,
+// moved to 'address' and their lines shifted by 'lineShift'
+void copyLines(LineTable *table, const LineTable *from, size_t start, size_t end, size_t address,
+               int64_t lineShift);
+
+// the file, line and column of 'pc' as "path:line:column", false if it has none
+bool formatLine(const LineTable *table, size_t pc, char *buffer, size_t size);
+
+void freeLineTable(LineTable *table);
+
+#endif
\ No newline at end of file
@@ -1,16 +1,148 @@
 #ifndef object_h
 #define object_h
 
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
 typedef enum {
-    OBJ_I32
+    OBJ_I32,
+    OBJ_I64,
+    OBJ_F64,
+    OBJ_BOOL,
+    OBJ_PTR,
 } ObjectType;
 
-typedef struct {
-    ObjectType type;
+// every value is a single NaN-boxed 64-bit word. a double is stored as its own
+// bits, everything else lives in the payload of a quiet NaN:
+//
+//   f64   any double that is not a tagged quiet NaN
+//   i32   0x7ffd_0000_xxxx_xxxx
+//   bool  0x7ffe_0000_0000_000x
+//   i64   0x7fff_xxxx_xxxx_xxxx   48-bit payload, sign-extended on read
+//   ptr   0xfffc_xxxx_xxxx_xxxx   48-bit address
+//   wide  0xfffd_xxxx_xxxx_xxxx   address of an i64 too wide for the payload
+//
+// the NaNs produced by arithmetic never carry these tags, so only doubles
+// coming from outside the VM need 'canonicalF64Object'. an i64 that does not
+// fit in 48 bits is kept in a heap cell, or in memory of the host's for one
+// passed in, and its word points at the full value
+typedef uint64_t Object;
+
+#define OBJ_SIGN_BIT ((uint64_t)0x8000000000000000)
+#define OBJ_QNAN ((uint64_t)0x7ffc000000000000)
+#define OBJ_TAG_I32 ((uint64_t)1 << 48)
+#define OBJ_TAG_BOOL ((uint64_t)2 << 48)
+#define OBJ_TAG_I64 ((uint64_t)3 << 48)
+#define OBJ_TAG_WIDE ((uint64_t)1 << 48)
+#define OBJ_TAG_MASK (OBJ_SIGN_BIT | OBJ_QNAN | OBJ_TAG_I64)
+#define OBJ_PAYLOAD_MASK ((uint64_t)0x0000ffffffffffff)
+#define OBJ_CANONICAL_NAN ((uint64_t)0x7ff8000000000000)
+
+static inline Object i32Object(int32_t value) {
+    return OBJ_QNAN | OBJ_TAG_I32 | (uint32_t)value;
+}
+
+static inline bool fitsInlineI64(int64_t value) {
+    return (int64_t)((uint64_t)value << 16) >> 16 == value;
+}
+
+// only for values that 'fitsInlineI64', the vm boxes the others with 'i64Value'
+static inline Object i64Object(int64_t value) {
+    return OBJ_QNAN | OBJ_TAG_I64 | ((uint64_t)value & OBJ_PAYLOAD_MASK);
+}
+
+static inline Object wideI64Object(const int64_t *value) {
+    return OBJ_SIGN_BIT | OBJ_QNAN | OBJ_TAG_WIDE | ((uint64_t)(uintptr_t)value & OBJ_PAYLOAD_MASK);
+}
+
+static inline Object f64Object(double value) {
+    Object bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    return bits;
+}
+
+// for doubles whose NaN payload is not under our control, e.g. parsed constants
+static inline Object canonicalF64Object(double value) {
+    Object bits = f64Object(value);
+    if ((bits & OBJ_QNAN) == OBJ_QNAN) return OBJ_CANONICAL_NAN;
+
+    return bits;
+}
+
+static inline Object boolObject(bool value) {
+    return OBJ_QNAN | OBJ_TAG_BOOL | (uint64_t)value;
+}
+
+static inline Object ptrObject(const void *pointer) {
+    return OBJ_SIGN_BIT | OBJ_QNAN | ((uint64_t)(uintptr_t)pointer & OBJ_PAYLOAD_MASK);
+}
+
+static inline int32_t asI32(Object obj) {
+    return (int32_t)(uint32_t)obj;
+}
+
+static inline bool isWideI64(Object obj) {
+    return (obj & OBJ_TAG_MASK) == (OBJ_SIGN_BIT | OBJ_QNAN | OBJ_TAG_WIDE);
+}
+
+static inline int64_t asI64(Object obj) {
+    if (__builtin_expect(isWideI64(obj), 0)) return *(const int64_t *)(uintptr_t)(obj & OBJ_PAYLOAD_MASK);
+
+    return (int64_t)(obj << 16) >> 16;
+}
+
+static inline double asF64(Object obj) {
+    double value;
+    memcpy(&value, &obj, sizeof(value));
+
+    return value;
+}
+
+static inline bool asBool(Object obj) {
+    return (obj & 1) != 0;
+}
+
+static inline void *asPtr(Object obj) {
+    return (void *)(uintptr_t)(obj & OBJ_PAYLOAD_MASK);
+}
+
+static inline bool isF64(Object obj) {
+    return (obj & OBJ_QNAN) != OBJ_QNAN;
+}
+
+static inline bool isI32(Object obj) {
+    return (obj & OBJ_TAG_MASK) == (OBJ_QNAN | OBJ_TAG_I32);
+}
+
+static inline bool isI64(Object obj) {
+    return (obj & OBJ_TAG_MASK) == (OBJ_QNAN | OBJ_TAG_I64) || isWideI64(obj);
+}
+
+static inline bool isBool(Object obj) {
+    return (obj & OBJ_TAG_MASK) == (OBJ_QNAN | OBJ_TAG_BOOL);
+}
+
+static inline bool isPtr(Object obj) {
+    return (obj & OBJ_TAG_MASK) == (OBJ_SIGN_BIT | OBJ_QNAN);
+}
+
+// a pointer or a wide i64, either of which may point into the heap
+static inline bool isReference(Object obj) {
+    return isPtr(obj) || isWideI64(obj);
+}
+
+static inline ObjectType objectType(Object obj) {
+    if (isF64(obj)) return OBJ_F64;
 
-    union {
-        int32_t i32;
-    };
-} Object;
+    switch (obj & OBJ_TAG_MASK) {
+        case OBJ_QNAN | OBJ_TAG_I32: return OBJ_I32;
+        case OBJ_QNAN | OBJ_TAG_BOOL: return OBJ_BOOL;
+        case OBJ_QNAN | OBJ_TAG_I64: return OBJ_I64;
+        case OBJ_SIGN_BIT | OBJ_QNAN | OBJ_TAG_WIDE: return OBJ_I64;
+        default: return OBJ_PTR;
+    }
+}
 
 #endif
\ No newline at end of file
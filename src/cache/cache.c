@@ -0,0 +1,238 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+#include "../util/alloc.h"
+#include "../util/hash.h"
+
+typedef struct {
+    char *name;
+    size_t size;
+    struct timespec used;
+} CacheEntry;
+
+static bool makeDirectory(const char *path) {
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+static char *joinPath(const char *directory, const char *name, const char *extension) {
+    size_t length = strlen(directory) + strlen(name) + strlen(extension) + 2;
+    char *path = alloc(length);
+    snprintf(path, length, "%s/%s%s", directory, name, extension);
+
+    return path;
+}
+
+char *cacheFilePath(const Cache *cache, const char *name, const char *extension) {
+    return joinPath(cache->directory, name, extension);
+}
+
+Cache newCache(size_t sizeLimit) {
+    Cache cache = {
+        .directory = NULL,
+        .sizeLimit = sizeLimit,
+    };
+
+    char *base = NULL;
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+
+    if (xdg && xdg[0] == '/') {
+        base = strdup(xdg);
+        assertAlloc(base);
+    } else if (home && home[0] != '\0') {
+        base = joinPath(home, ".cache", "");
+    } else {
+        return cache;
+    }
+
+    char *directory = joinPath(base, "aster", "");
+    if (makeDirectory(base) && makeDirectory(directory)) {
+        cache.directory = directory;
+    } else {
+        FREE_ALLOC(directory);
+    }
+
+    FREE_ALLOC(base);
+    return cache;
+}
+
+void freeCache(Cache *cache) {
+    if (!cache) return;
+
+    FREE_ALLOC(cache->directory);
+}
+
+bool cacheKey(const char *sourcePath, CacheKey *key) {
+    FILE *file = fopen(sourcePath, "rb");
+    if (!file) return false;
+
+    uint16_t version[3] = { BYTECODE_VERSION, IMAGE_VERSION_MAJOR, IMAGE_VERSION_MINOR };
+    uint64_t first = fnv1a(FNV_OFFSET_BASIS, version, sizeof(version));
+    // seeded apart from the first so that the pair behaves like a 128-bit hash
+    uint64_t second = fnv1a(first, "aster", 5);
+
+    char buffer[8192];
+    size_t read = 0;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        first = fnv1a(first, buffer, read);
+        second = fnv1a(second, buffer, read);
+    }
+
+    bool ok = !ferror(file);
+    fclose(file);
+
+    key->hash[0] = first;
+    key->hash[1] = second;
+    snprintf(key->name, sizeof(key->name), "%016llx%016llx",
+             (unsigned long long)first, (unsigned long long)second);
+
+    return ok;
+}
+
+static double readCompileTime(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) return -1;
+
+    double time = -1;
+    if (fscanf(file, "%lf", &time) != 1) time = -1;
+    fclose(file);
+
+    return time;
+}
+
+bool cacheLoad(Cache *cache, const CacheKey *key, Image *image, double *compileTime) {
+    if (!cache || !cache->directory) return false;
+
+    char *path = joinPath(cache->directory, key->name, IMAGE_EXTENSION);
+    char *timePath = joinPath(cache->directory, key->name, ".time");
+
+    // a missing entry is an ordinary miss, don't let the loader complain about it
+    bool ok = access(path, R_OK) == 0 && loadImage(path, image);
+    if (ok) {
+        // the modification time doubles as the last use for eviction
+        utimensat(AT_FDCWD, path, NULL, 0);
+        *compileTime = readCompileTime(timePath);
+    }
+
+    FREE_ALLOC(path);
+    FREE_ALLOC(timePath);
+
+    return ok;
+}
+
+static bool writeCompileTime(const char *path, double compileTime) {
+    size_t tempLength = strlen(path) + 32;
+    char *tempPath = alloc(tempLength);
+    snprintf(tempPath, tempLength, "%s.%ld.tmp", path, (long)getpid());
+
+    bool ok = false;
+    FILE *file = fopen(tempPath, "w");
+    if (file) {
+        ok = fprintf(file, "%.3f\n", compileTime) > 0;
+        ok = fclose(file) == 0 && ok;
+        ok = ok && rename(tempPath, path) == 0;
+        if (!ok) remove(tempPath);
+    }
+
+    FREE_ALLOC(tempPath);
+    return ok;
+}
+
+static int compareEntries(const void *a, const void *b) {
+    const struct timespec *left = &((const CacheEntry *)a)->used;
+    const struct timespec *right = &((const CacheEntry *)b)->used;
+
+    if (left->tv_sec != right->tv_sec) return left->tv_sec < right->tv_sec ? -1 : 1;
+    return (left->tv_nsec > right->tv_nsec) - (left->tv_nsec < right->tv_nsec);
+}
+
+static bool hasExtension(const char *name, const char *extension) {
+    size_t length = strlen(name);
+    size_t extensionLength = strlen(extension);
+
+    return length > extensionLength && strcmp(name + length - extensionLength, extension) == 0;
+}
+
+static bool isEntryName(const char *name) {
+    return hasExtension(name, IMAGE_EXTENSION) || hasExtension(name, CACHE_BUILD_EXTENSION);
+}
+
+// the entry just written is never evicted, even when it alone is over the limit
+static void evictEntries(Cache *cache, const CacheKey *keep) {
+    DIR *directory = opendir(cache->directory);
+    if (!directory) return;
+
+    size_t count = 0, capacity = 1, total = 0;
+    CacheEntry *entries = alloc(capacity * sizeof(CacheEntry));
+
+    struct dirent *dirent;
+    while ((dirent = readdir(directory))) {
+        if (!isEntryName(dirent->d_name)) continue;
+
+        char *path = joinPath(cache->directory, dirent->d_name, "");
+        struct stat info;
+        bool found = stat(path, &info) == 0;
+        FREE_ALLOC(path);
+        if (!found) continue;
+
+        total += info.st_size;
+        if (strncmp(dirent->d_name, keep->name, strlen(keep->name)) == 0) continue;
+
+        if (count >= capacity) {
+            capacity *= 2;
+            entries = realloc(entries, capacity * sizeof(CacheEntry));
+            assertAlloc(entries);
+        }
+
+        entries[count].name = strdup(dirent->d_name);
+        assertAlloc(entries[count].name);
+        entries[count].size = info.st_size;
+        entries[count].used = info.st_mtim;
+        count++;
+    }
+    closedir(directory);
+
+    qsort(entries, count, sizeof(CacheEntry), compareEntries);
+
+    for (size_t i = 0; i < count; i++) {
+        if (total > cache->sizeLimit) {
+            char *path = joinPath(cache->directory, entries[i].name, "");
+            remove(path);
+
+            // the timing file sits next to the image with its extension swapped
+            if (hasExtension(path, IMAGE_EXTENSION)) {
+                strcpy(path + strlen(path) - strlen(IMAGE_EXTENSION), ".time");
+                remove(path);
+            }
+
+            total -= entries[i].size;
+            FREE_ALLOC(path);
+        }
+
+        FREE_ALLOC(entries[i].name);
+    }
+
+    FREE_ALLOC(entries);
+}
+
+bool cacheStore(Cache *cache, const CacheKey *key, const Program *program,
+                const char *sourcePath, double compileTime) {
+    if (!cache || !cache->directory) return false;
+
+    char *path = joinPath(cache->directory, key->name, IMAGE_EXTENSION);
+    char *timePath = joinPath(cache->directory, key->name, ".time");
+
+    bool ok = writeCompileTime(timePath, compileTime) && writeImage(program, sourcePath, path);
+    if (ok) evictEntries(cache, key);
+
+    FREE_ALLOC(path);
+    FREE_ALLOC(timePath);
+
+    return ok;
+}
\ No newline at end of file
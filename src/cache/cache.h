@@ -0,0 +1,48 @@
+#ifndef cache_h
+#define cache_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "../assembler/assembler.h"
+#include "../image/image.h"
+
+// default size of the cache directory before least recently used entries are evicted
+#define CACHE_SIZE_LIMIT ((size_t)64 * 1024 * 1024)
+
+// the state a source file's last build left behind for incremental builds
+#define CACHE_BUILD_EXTENSION ".build"
+
+// two independent FNV-1a hashes of the bytecode version, the image format and
+// the source bytes, written out as the entry's file name
+typedef struct {
+    uint64_t hash[2];
+    char name[33];
+} CacheKey;
+
+typedef struct {
+    // NULL when no cache directory could be found or created
+    char *directory;
+    size_t sizeLimit;
+} Cache;
+
+// uses '$XDG_CACHE_HOME/aster', falling back to '~/.cache/aster'
+Cache newCache(size_t sizeLimit);
+void freeCache(Cache *cache);
+
+bool cacheKey(const char *sourcePath, CacheKey *key);
+
+// the path of a file in the cache directory, the caller frees it
+char *cacheFilePath(const Cache *cache, const char *name, const char *extension);
+
+// maps the entry for 'key' and marks it as recently used. 'compileTime' is
+// what building the entry took in milliseconds, or a negative value if unknown
+bool cacheLoad(Cache *cache, const CacheKey *key, Image *image, double *compileTime);
+
+// writes the entry atomically, then evicts the least recently used entries and
+// build states until the directory fits in the size limit again
+bool cacheStore(Cache *cache, const CacheKey *key, const Program *program,
+                const char *sourcePath, double compileTime);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "counters.h"
+#include "../trace/trace.h"
+
+typedef struct {
+    const char *name;
+    size_t runs;
+    CounterValues totals;
+} PhaseCounts;
+
+// NULL once the report has no room for another phase
+typedef struct {
+    PhaseCounts *phase;
+    CounterValues start;
+} OpenPhase;
+
+static Counters counters;
+static bool started = false;
+static pthread_t owner;
+
+static PhaseCounts phases[COUNTER_PHASES];
+static size_t phaseCount = 0;
+static OpenPhase openPhases[COUNTER_PHASE_DEPTH];
+static size_t depth = 0;
+
+static const uint64_t hardwareEvents[COUNTER_COUNT] = {
+    [COUNTER_CYCLES] = PERF_COUNT_HW_CPU_CYCLES,
+    [COUNTER_INSTRUCTIONS] = PERF_COUNT_HW_INSTRUCTIONS,
+    [COUNTER_BRANCH_MISSES] = PERF_COUNT_HW_BRANCH_MISSES,
+    [COUNTER_CACHE_MISSES] = PERF_COUNT_HW_CACHE_MISSES,
+};
+
+const char *counterName(CounterKind kind) {
+    switch (kind) {
+        case COUNTER_CYCLES: return "cycles";
+        case COUNTER_INSTRUCTIONS: return "instructions";
+        case COUNTER_BRANCH_MISSES: return "branch-misses";
+        case COUNTER_CACHE_MISSES: return "cache-misses";
+        default: return "?";
+    }
+}
+
+// user space only, counted while this thread runs on any cpu
+static int openCounter(CounterKind kind) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = hardwareEvents[kind];
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// the pages are only kept when every counter can be read from them, a
+// counter that has to be read with a system call would skew the others
+static void mapCounters(Counters *c) {
+    long pageSize = sysconf(_SC_PAGESIZE);
+    bool readable = true;
+
+    for (size_t i = 0; i < COUNTER_COUNT; i++) {
+        if (c->fds[i] < 0) continue;
+
+        void *page = mmap(NULL, pageSize, PROT_READ, MAP_SHARED, c->fds[i], 0);
+        if (page == MAP_FAILED) {
+            readable = false;
+            continue;
+        }
+
+        c->pages[i] = page;
+        if (!c->pages[i]->cap_user_rdpmc) readable = false;
+    }
+
+#if !defined(__x86_64__) && !defined(__i386__)
+    readable = false;
+#endif
+
+    for (size_t i = 0; i < COUNTER_COUNT && !readable; i++) {
+        if (c->pages[i]) munmap(c->pages[i], pageSize);
+        c->pages[i] = NULL;
+    }
+}
+
+// scaled up by the share of the time the counter was on the hardware, as
+// the kernel takes turns when there are more counters than registers
+static void readCounters(const Counters *c, CounterValues *values) {
+    for (size_t i = 0; i < COUNTER_COUNT; i++) {
+        uint64_t data[3] = {0};
+        values->values[i] = 0;
+        if (c->fds[i] < 0 || read(c->fds[i], data, sizeof(data)) != sizeof(data)) continue;
+
+        bool multiplexed = data[2] > 0 && data[2] < data[1];
+        values->values[i] = multiplexed ? (uint64_t)((double)data[0] * data[1] / data[2]) : data[0];
+    }
+}
+
+static PhaseCounts *findPhase(const char *name) {
+    for (size_t i = 0; i < phaseCount; i++) {
+        if (phases[i].name == name || strcmp(phases[i].name, name) == 0) return &phases[i];
+    }
+    if (phaseCount >= COUNTER_PHASES) return NULL;
+
+    phases[phaseCount] = (PhaseCounts){ .name = name };
+    return &phases[phaseCount++];
+}
+
+// phases on other threads, such as a collection a worker ran, are not in
+// this thread's counters
+static void onPhase(const char *name, bool begin) {
+    if (!pthread_equal(pthread_self(), owner)) return;
+
+    if (begin) {
+        if (depth < COUNTER_PHASE_DEPTH) {
+            openPhases[depth].phase = findPhase(name);
+            readCounters(&counters, &openPhases[depth].start);
+        }
+        depth++;
+        return;
+    }
+
+    if (depth == 0) return;
+    depth--;
+    if (depth >= COUNTER_PHASE_DEPTH) return;
+
+    CounterValues end;
+    readCounters(&counters, &end);
+
+    PhaseCounts *phase = openPhases[depth].phase;
+    if (!phase) return;
+
+    phase->runs++;
+    for (size_t i = 0; i < COUNTER_COUNT; i++) {
+        phase->totals.values[i] += end.values[i] - openPhases[depth].start.values[i];
+    }
+}
+
+bool startCounters(void) {
+    counters = (Counters){0};
+    int error = 0;
+
+    for (size_t i = 0; i < COUNTER_COUNT; i++) {
+        counters.fds[i] = openCounter((CounterKind)i);
+        if (counters.fds[i] >= 0) {
+            counters.opened++;
+        } else if (error == 0) {
+            error = errno;
+        }
+    }
+
+    // containers and virtual machines often have no counters to give
+    if (counters.opened == 0) {
+        fprintf(stderr, "counters: unavailable (%s), running without them\n", strerror(error));
+        if (error == EACCES || error == EPERM) {
+            fprintf(stderr, "counters: /proc/sys/kernel/perf_event_paranoid or the container's seccomp "
+                            "profile does not allow them\n");
+        }
+        return false;
+    }
+
+    mapCounters(&counters);
+
+    started = true;
+    owner = pthread_self();
+    phaseCount = 0;
+    depth = 0;
+    setPhaseListener(onPhase);
+    return true;
+}
+
+const Counters *mappedCounters(void) {
+    if (!started) return NULL;
+
+    for (size_t i = 0; i < COUNTER_COUNT; i++) {
+        if (counters.pages[i]) return &counters;
+    }
+    return NULL;
+}
+
+// 'n/a' for counters that did not open
+static void formatCount(const PhaseCounts *phase, CounterKind kind, char *buffer, size_t size) {
+    if (counters.fds[kind] < 0) {
+        snprintf(buffer, size, "n/a");
+    } else {
+        snprintf(buffer, size, "%" PRIu64, phase->totals.values[kind]);
+    }
+}
+
+static void formatRate(const PhaseCounts *phase, CounterKind kind, char *buffer, size_t size) {
+    uint64_t instructions = phase->totals.values[COUNTER_INSTRUCTIONS];
+    if (counters.fds[kind] < 0 || counters.fds[COUNTER_INSTRUCTIONS] < 0 || instructions == 0) {
+        snprintf(buffer, size, "n/a");
+    } else {
+        snprintf(buffer, size, "%.2f", 1000.0 * phase->totals.values[kind] / instructions);
+    }
+}
+
+void stopCounters(FILE *out) {
+    if (!started) return;
+    started = false;
+    setPhaseListener(NULL);
+
+    fprintf(out, "counters: %zu of %d opened, phases in the order they first ran, misses per thousand "
+                 "instructions\n", counters.opened, COUNTER_COUNT);
+    fprintf(out, "  %-18s %6s %14s %14s %6s %14s %14s\n", "phase", "runs", "cycles", "instructions", "IPC",
+            "branch-misses", "cache-misses");
+
+    for (size_t i = 0; i < phaseCount; i++) {
+        const PhaseCounts *phase = &phases[i];
+        char cycles[24], instructions[24], ipc[16], branches[16], caches[16];
+
+        formatCount(phase, COUNTER_CYCLES, cycles, sizeof(cycles));
+        formatCount(phase, COUNTER_INSTRUCTIONS, instructions, sizeof(instructions));
+        formatRate(phase, COUNTER_BRANCH_MISSES, branches, sizeof(branches));
+        formatRate(phase, COUNTER_CACHE_MISSES, caches, sizeof(caches));
+
+        uint64_t spent = phase->totals.values[COUNTER_CYCLES];
+        if (counters.fds[COUNTER_CYCLES] < 0 || counters.fds[COUNTER_INSTRUCTIONS] < 0 || spent == 0) {
+            snprintf(ipc, sizeof(ipc), "n/a");
+        } else {
+            snprintf(ipc, sizeof(ipc), "%.2f", (double)phase->totals.values[COUNTER_INSTRUCTIONS] / spent);
+        }
+
+        fprintf(out, "  %-18s %6zu %14s %14s %6s %14s %14s\n", phase->name, phase->runs, cycles, instructions, ipc,
+                branches, caches);
+    }
+
+    long pageSize = sysconf(_SC_PAGESIZE);
+    for (size_t i = 0; i < COUNTER_COUNT; i++) {
+        if (counters.pages[i]) munmap(counters.pages[i], pageSize);
+        if (counters.fds[i] >= 0) close(counters.fds[i]);
+    }
+    counters = (Counters){0};
+}
\ No newline at end of file
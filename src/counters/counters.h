@@ -0,0 +1,86 @@
+#ifndef counters_h
+#define counters_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <linux/perf_event.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// distinct phases the report keeps apart, and how deeply they can nest
+#define COUNTER_PHASES 32
+#define COUNTER_PHASE_DEPTH 16
+
+// cycles and instructions give the IPC, the misses are reported per
+// thousand instructions
+typedef enum {
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_BRANCH_MISSES,
+    COUNTER_CACHE_MISSES,
+    COUNTER_COUNT,
+} CounterKind;
+
+typedef struct {
+    uint64_t values[COUNTER_COUNT];
+} CounterValues;
+
+// hardware counters of the thread that opened them
+typedef struct {
+    // -1 for a counter the kernel or the machine does not offer
+    int fds[COUNTER_COUNT];
+    // each counter's page, for reading it without a system call. all NULL
+    // unless every counter that opened can be read that way
+    struct perf_event_mmap_page *pages[COUNTER_COUNT];
+    size_t opened;
+} Counters;
+
+// a counter's value from its page, retried while the kernel updates it
+static inline uint64_t readMappedCounter(volatile struct perf_event_mmap_page *page) {
+    uint32_t sequence;
+    uint64_t count;
+
+    do {
+        sequence = page->lock;
+        __sync_synchronize();
+
+        uint32_t index = page->index;
+        count = page->offset;
+#if defined(__x86_64__) || defined(__i386__)
+        if (page->cap_user_rdpmc && index != 0) {
+            // the counter is only 'pmc_width' bits wide, sign extended
+            int shift = 64 - page->pmc_width;
+            count += (uint64_t)((int64_t)(__rdpmc(index - 1) << shift) >> shift);
+        }
+#endif
+
+        __sync_synchronize();
+    } while (page->lock != sequence);
+
+    return count;
+}
+
+static inline void readMappedCounters(const Counters *counters, CounterValues *values) {
+    for (size_t i = 0; i < COUNTER_COUNT; i++) {
+        values->values[i] = counters->pages[i] ? readMappedCounter(counters->pages[i]) : 0;
+    }
+}
+
+const char *counterName(CounterKind kind);
+
+// opens the counters on this thread and counts every phase of the run in
+// them. false, after saying why on stderr, when none of them can be opened
+bool startCounters(void);
+
+// the counters if started and readable without a system call, which
+// attributing them to opcodes needs, NULL otherwise
+const Counters *mappedCounters(void);
+
+// writes the counts, IPC and miss rates of every phase and closes the counters
+void stopCounters(FILE *out);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,503 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "image.h"
+#include "../util/alloc.h"
+#include "../util/hash.h"
+
+_Static_assert(sizeof(AvmInstruction) == sizeof(uint32_t), "code words are stored as 32 bits");
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+} ImageBuffer;
+
+static void appendBytes(ImageBuffer *buffer, const void *bytes, size_t size) {
+    while (buffer->size + size > buffer->capacity) {
+        buffer->capacity *= 2;
+        buffer->data = realloc(buffer->data, buffer->capacity);
+        assertAlloc(buffer->data);
+    }
+
+    memcpy(buffer->data + buffer->size, bytes, size);
+    buffer->size += size;
+}
+
+static void alignBuffer(ImageBuffer *buffer) {
+    static const uint8_t padding[8] = {0};
+    if (buffer->size % 8 != 0) appendBytes(buffer, padding, 8 - buffer->size % 8);
+}
+
+// appends a section's contents and records where it landed in the table
+static void appendSection(ImageBuffer *buffer, ImageSection *table, ImageSectionKind kind,
+                          const void *bytes, size_t size, size_t count) {
+    alignBuffer(buffer);
+    table[kind] = (ImageSection){
+        .kind = kind,
+        .count = count,
+        .offset = buffer->size,
+        .size = size,
+    };
+
+    if (size > 0) appendBytes(buffer, bytes, size);
+}
+
+static void appendTypes(ImageBuffer *types, const Function *fn) {
+    for (size_t i = 0; i < fn->arity; i++) {
+        uint8_t type = fn->paramTypes[i];
+        appendBytes(types, &type, 1);
+    }
+}
+
+// 'names' holds the symbol's offsets into the string and type sections
+static ImageSymbol newSymbol(ImageSymbolKind kind, size_t index, const ImageFunction *names,
+                             const Function *fn) {
+    return (ImageSymbol){
+        .name = names->name,
+        .kind = kind,
+        .index = index,
+        .arity = fn->arity,
+        .paramTypes = names->paramTypes,
+        .returnType = fn->returnType,
+    };
+}
+
+static uint64_t imageChecksum(const uint8_t *data, const ImageSection *table, size_t count) {
+    uint64_t hash = fnv1a(FNV_OFFSET_BASIS, table, count * sizeof(ImageSection));
+
+    for (size_t i = 0; i < count; i++) {
+        if (table[i].kind == SECTION_CODE) continue;
+        hash = fnv1a(hash, data + table[i].offset, table[i].size);
+    }
+
+    return hash;
+}
+
+bool writeImage(const Program *program, const char *sourcePath, const char *path) {
+    const FunctionTable *table = &program->functions;
+
+    ImageBuffer strings = { .data = alloc(1), .size = 0, .capacity = 1 };
+    ImageBuffer types = { .data = alloc(1), .size = 0, .capacity = 1 };
+    ImageFunction *functions = alloc((table->count + 1) * sizeof(ImageFunction));
+    size_t *ends = alloc((table->count + 1) * sizeof(size_t));
+    functionExtents(program, ends);
+
+    for (size_t i = 0; i < table->count; i++) {
+        const Function *fn = &table->entries[i];
+        size_t end = ends[i];
+
+        functions[i] = (ImageFunction){
+            .address = fn->address,
+            .checksum = fnv1a(FNV_OFFSET_BASIS, program->code + fn->address,
+                              (end - fn->address) * sizeof(AvmInstruction)),
+            .name = strings.size,
+            .paramTypes = types.size,
+            .arity = fn->arity,
+            .localCount = fn->localCount,
+            .returnType = fn->returnType,
+        };
+
+        appendBytes(&strings, fn->name, strlen(fn->name) + 1);
+        appendTypes(&types, fn);
+    }
+
+    size_t symbolCount = 0;
+    ImageSymbol *symbols = alloc((table->count + program->imports.count + 1) * sizeof(ImageSymbol));
+    for (size_t i = 0; i < table->count; i++) {
+        if (!table->entries[i].exported) continue;
+        symbols[symbolCount++] = newSymbol(SYMBOL_EXPORT, i, &functions[i], &table->entries[i]);
+    }
+    for (size_t i = 0; i < program->imports.count; i++) {
+        const Function *import = &program->imports.entries[i];
+        ImageFunction names = { .name = strings.size, .paramTypes = types.size };
+
+        appendBytes(&strings, import->name, strlen(import->name) + 1);
+        appendTypes(&types, import);
+        symbols[symbolCount++] = newSymbol(SYMBOL_IMPORT, i, &names, import);
+    }
+
+    const LineTable *lines = &program->lines;
+    uint32_t *lineFiles = alloc((lines->fileCount + 1) * sizeof(uint32_t));
+    for (size_t i = 0; i < lines->fileCount; i++) {
+        lineFiles[i] = strings.size;
+        appendBytes(&strings, lines->files[i], strlen(lines->files[i]) + 1);
+    }
+
+    const RelocationTable *relocationTable = &program->relocations;
+    ImageRelocation *relocations = alloc((relocationTable->count + 1) * sizeof(ImageRelocation));
+    for (size_t i = 0; i < relocationTable->count; i++) {
+        relocations[i] = (ImageRelocation){
+            .offset = relocationTable->entries[i].offset,
+            .kind = relocationTable->entries[i].kind,
+        };
+    }
+
+    ImageHeader header = {
+        .magic = IMAGE_MAGIC,
+        .major = IMAGE_VERSION_MAJOR,
+        .minor = IMAGE_VERSION_MINOR,
+        .byteOrder = IMAGE_BYTE_ORDER,
+        .sectionCount = SECTION_COUNT,
+    };
+    ImageSection sections[SECTION_COUNT] = {0};
+
+    ImageBuffer image = { .data = alloc(1), .size = 0, .capacity = 1 };
+    appendBytes(&image, &header, sizeof(header));
+    appendBytes(&image, sections, sizeof(sections));
+
+    appendSection(&image, sections, SECTION_CODE, program->code,
+                  program->length * sizeof(AvmInstruction), program->length);
+    appendSection(&image, sections, SECTION_CONSTANTS, program->constants.values,
+                  program->constants.count * sizeof(Object), program->constants.count);
+    appendSection(&image, sections, SECTION_FUNCTIONS, functions,
+                  table->count * sizeof(ImageFunction), table->count);
+    appendSection(&image, sections, SECTION_TYPES, types.data, types.size, types.size);
+    appendSection(&image, sections, SECTION_STRINGS, strings.data, strings.size, strings.size);
+    appendSection(&image, sections, SECTION_DEBUG, sourcePath, strlen(sourcePath) + 1, 1);
+    appendSection(&image, sections, SECTION_SYMBOLS, symbols,
+                  symbolCount * sizeof(ImageSymbol), symbolCount);
+    appendSection(&image, sections, SECTION_RELOCATIONS, relocations,
+                  relocationTable->count * sizeof(ImageRelocation), relocationTable->count);
+    appendSection(&image, sections, SECTION_LINES, lines->bytes, lines->size, lines->count);
+    appendSection(&image, sections, SECTION_LINE_FILES, lineFiles,
+                  lines->fileCount * sizeof(uint32_t), lines->fileCount);
+    alignBuffer(&image);
+
+    header.checksum = imageChecksum(image.data, sections, SECTION_COUNT);
+    memcpy(image.data, &header, sizeof(header));
+    memcpy(image.data + sizeof(header), sections, sizeof(sections));
+
+    FREE_ALLOC(functions);
+    FREE_ALLOC(ends);
+    FREE_ALLOC(symbols);
+    FREE_ALLOC(relocations);
+    FREE_ALLOC(lineFiles);
+    FREE_ALLOC(types.data);
+    FREE_ALLOC(strings.data);
+
+    // the pid keeps concurrent writers of the same image off each other's temporary file
+    size_t tempLength = strlen(path) + 32;
+    char *tempPath = alloc(tempLength);
+    snprintf(tempPath, tempLength, "%s.%ld.tmp", path, (long)getpid());
+
+    bool ok = false;
+    FILE *file = fopen(tempPath, "wb");
+    if (file) {
+        ok = fwrite(image.data, 1, image.size, file) == image.size;
+        ok = fclose(file) == 0 && ok;
+        ok = ok && rename(tempPath, path) == 0;
+        if (!ok) remove(tempPath);
+    }
+
+    if (!ok) fprintf(stderr, "image error: failed to write '%s'\n", path);
+
+    FREE_ALLOC(tempPath);
+    FREE_ALLOC(image.data);
+
+    return ok;
+}
+
+static bool imageError(const char *path, const char *message) {
+    fprintf(stderr, "image error: %s: %s\n", path, message);
+    return false;
+}
+
+static bool checkSections(const char *path, const uint8_t *data, size_t size,
+                          const ImageSection *table, const ImageSection **sections) {
+    for (size_t i = 0; i < SECTION_COUNT; i++) sections[i] = NULL;
+
+    const ImageHeader *header = (const ImageHeader *)data;
+    for (size_t i = 0; i < header->sectionCount; i++) {
+        const ImageSection *section = &table[i];
+
+        if (section->offset % 8 != 0 || section->offset > size || section->size > size - section->offset) {
+            return imageError(path, "section out of bounds");
+        }
+
+        // unknown sections from newer minor versions are skipped
+        if (section->kind >= SECTION_COUNT) continue;
+        if (sections[section->kind]) return imageError(path, "duplicate section");
+        sections[section->kind] = section;
+    }
+
+    for (size_t i = 0; i < REQUIRED_SECTION_COUNT; i++) {
+        if (!sections[i]) return imageError(path, "missing section");
+    }
+
+    const ImageSection *code = sections[SECTION_CODE];
+    const ImageSection *constants = sections[SECTION_CONSTANTS];
+    const ImageSection *functions = sections[SECTION_FUNCTIONS];
+    if (code->size != (uint64_t)code->count * sizeof(AvmInstruction) ||
+        constants->size != (uint64_t)constants->count * sizeof(Object) ||
+        functions->size != (uint64_t)functions->count * sizeof(ImageFunction)) {
+        return imageError(path, "section size does not match its entry count");
+    }
+
+    // heap objects only exist at run time, a pointer in the constant pool would be forged
+    const Object *values = (const Object *)(data + constants->offset);
+    for (size_t i = 0; i < constants->count; i++) {
+        if (isReference(values[i])) return imageError(path, "malformed constant");
+    }
+
+    const ImageSection *symbols = sections[SECTION_SYMBOLS];
+    const ImageSection *relocations = sections[SECTION_RELOCATIONS];
+    if ((symbols && symbols->size != (uint64_t)symbols->count * sizeof(ImageSymbol)) ||
+        (relocations && relocations->size != (uint64_t)relocations->count * sizeof(ImageRelocation))) {
+        return imageError(path, "section size does not match its entry count");
+    }
+
+    const ImageSection *strings = sections[SECTION_STRINGS];
+    const ImageSection *debug = sections[SECTION_DEBUG];
+    if (strings->size > 0 && data[strings->offset + strings->size - 1] != '\0') {
+        return imageError(path, "unterminated string section");
+    }
+    if (debug->size == 0 || data[debug->offset + debug->size - 1] != '\0') {
+        return imageError(path, "unterminated debug section");
+    }
+
+    return true;
+}
+
+static ValueType *copyTypes(const uint8_t *types, size_t count) {
+    ValueType *copy = alloc((count + 1) * sizeof(ValueType));
+    for (size_t i = 0; i < count; i++) {
+        copy[i] = types[i];
+    }
+
+    return copy;
+}
+
+// copies the function table out of the image, the VM marks entries validated
+static bool loadFunctions(const char *path, const uint8_t *data, const ImageSection **sections,
+                          Program *program) {
+    const ImageSection *section = sections[SECTION_FUNCTIONS];
+    const ImageFunction *records = (const ImageFunction *)(data + section->offset);
+    const char *strings = (const char *)(data + sections[SECTION_STRINGS]->offset);
+    const uint8_t *types = data + sections[SECTION_TYPES]->offset;
+    size_t stringsSize = sections[SECTION_STRINGS]->size;
+    size_t typesSize = sections[SECTION_TYPES]->size;
+
+    FunctionTable *table = &program->functions;
+    table->entries = alloc((section->count + 1) * sizeof(Function));
+    table->capacity = section->count + 1;
+    table->count = 0;
+
+    for (size_t i = 0; i < section->count; i++) {
+        const ImageFunction *record = &records[i];
+
+        if (record->address >= program->length || record->name >= stringsSize ||
+            record->arity > record->localCount || record->paramTypes > typesSize ||
+            record->arity > typesSize - record->paramTypes || record->returnType >= TYPE_COUNT) {
+            return imageError(path, "malformed function record");
+        }
+
+        Function function = {
+            .name = strdup(strings + record->name),
+            .address = record->address,
+            .arity = record->arity,
+            .localCount = record->localCount,
+            .paramTypes = copyTypes(types + record->paramTypes, record->arity),
+            .returnType = record->returnType,
+            .validated = false,
+            .checksum = record->checksum,
+        };
+        assertAlloc(function.name);
+
+        table->entries[table->count++] = function;
+    }
+
+    return true;
+}
+
+// marks exports in the function table and collects the imports
+static bool loadSymbols(const char *path, const uint8_t *data, const ImageSection **sections,
+                        Program *program) {
+    const ImageSection *section = sections[SECTION_SYMBOLS];
+    FunctionTable *imports = &program->imports;
+    imports->entries = alloc(((section ? section->count : 0) + 1) * sizeof(Function));
+    imports->capacity = (section ? section->count : 0) + 1;
+    imports->count = 0;
+    if (!section) return true;
+
+    const ImageSymbol *symbols = (const ImageSymbol *)(data + section->offset);
+    const char *strings = (const char *)(data + sections[SECTION_STRINGS]->offset);
+    const uint8_t *types = data + sections[SECTION_TYPES]->offset;
+    size_t stringsSize = sections[SECTION_STRINGS]->size;
+    size_t typesSize = sections[SECTION_TYPES]->size;
+
+    for (size_t i = 0; i < section->count; i++) {
+        const ImageSymbol *symbol = &symbols[i];
+
+        if (symbol->kind == SYMBOL_EXPORT) {
+            if (symbol->index >= program->functions.count) return imageError(path, "malformed symbol");
+            program->functions.entries[symbol->index].exported = true;
+            continue;
+        }
+
+        if (symbol->kind != SYMBOL_IMPORT || symbol->index != imports->count ||
+            symbol->name >= stringsSize || symbol->paramTypes > typesSize ||
+            symbol->arity > typesSize - symbol->paramTypes || symbol->returnType >= TYPE_COUNT) {
+            return imageError(path, "malformed symbol");
+        }
+
+        Function import = {
+            .name = strdup(strings + symbol->name),
+            .arity = symbol->arity,
+            .localCount = symbol->arity,
+            .paramTypes = copyTypes(types + symbol->paramTypes, symbol->arity),
+            .returnType = symbol->returnType,
+            .validated = true,
+        };
+        assertAlloc(import.name);
+
+        imports->entries[imports->count++] = import;
+    }
+
+    return true;
+}
+
+static bool loadRelocations(const char *path, const uint8_t *data, const ImageSection **sections,
+                            Program *program) {
+    const ImageSection *section = sections[SECTION_RELOCATIONS];
+    RelocationTable *table = &program->relocations;
+    table->entries = alloc(((section ? section->count : 0) + 1) * sizeof(Relocation));
+    table->capacity = (section ? section->count : 0) + 1;
+    table->count = 0;
+    if (!section) return true;
+
+    const ImageRelocation *records = (const ImageRelocation *)(data + section->offset);
+    for (size_t i = 0; i < section->count; i++) {
+        if (records[i].offset >= program->length || records[i].kind > RELOC_CALL) {
+            return imageError(path, "malformed relocation");
+        }
+
+        table->entries[table->count++] = (Relocation){
+            .offset = records[i].offset,
+            .kind = records[i].kind,
+        };
+    }
+
+    return true;
+}
+
+// rebuilt entry by entry, which also checks that every entry is in order and
+// inside the code
+static bool loadLines(const char *path, const uint8_t *data, const ImageSection **sections,
+                      Program *program) {
+    const ImageSection *section = sections[SECTION_LINES];
+    const ImageSection *files = sections[SECTION_LINE_FILES];
+    if (!section || !files || section->count == 0) return true;
+
+    if (files->size != (uint64_t)files->count * sizeof(uint32_t)) {
+        return imageError(path, "section size does not match its entry count");
+    }
+
+    const uint32_t *names = (const uint32_t *)(data + files->offset);
+    const char *strings = (const char *)(data + sections[SECTION_STRINGS]->offset);
+    LineTable *table = &program->lines;
+    for (size_t i = 0; i < files->count; i++) {
+        if (names[i] >= sections[SECTION_STRINGS]->size) return imageError(path, "malformed line table");
+        addLineFile(table, strings + names[i]);
+    }
+
+    const uint8_t *bytes = data + section->offset;
+    LineEntry previous = {0}, entry;
+    size_t offset = 0;
+    for (size_t i = 0; i < section->count; i++) {
+        if (!nextLine(bytes, section->size, &offset, &previous, &entry) || entry.pc >= program->length ||
+            entry.file >= table->fileCount || (i > 0 && entry.pc <= previous.pc)) {
+            return imageError(path, "malformed line table");
+        }
+
+        addLine(table, entry);
+        previous = entry;
+    }
+
+    return true;
+}
+
+bool loadImage(const char *path, Image *image) {
+    *image = (Image){0};
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return imageError(path, "cannot open image");
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(ImageHeader)) {
+        close(fd);
+        return imageError(path, "image is truncated");
+    }
+
+    size_t size = info.st_size;
+    void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return imageError(path, "cannot map image");
+
+    image->mapping = mapping;
+    image->size = size;
+
+    const uint8_t *data = mapping;
+    const ImageHeader *header = mapping;
+    const ImageSection *table = (const ImageSection *)(data + sizeof(ImageHeader));
+
+    bool ok = true;
+    if (memcmp(header->magic, IMAGE_MAGIC, sizeof(header->magic)) != 0) {
+        ok = imageError(path, "not an aster image");
+    } else if (header->major != IMAGE_VERSION_MAJOR) {
+        ok = imageError(path, "unsupported image version");
+    } else if (header->byteOrder != IMAGE_BYTE_ORDER) {
+        ok = imageError(path, "image was written with a different byte order");
+    } else if (header->sectionCount > (size - sizeof(ImageHeader)) / sizeof(ImageSection)) {
+        ok = imageError(path, "section table is truncated");
+    }
+
+    const ImageSection *sections[SECTION_COUNT];
+    ok = ok && checkSections(path, data, size, table, sections);
+    if (ok && imageChecksum(data, table, header->sectionCount) != header->checksum) {
+        ok = imageError(path, "checksum mismatch");
+    }
+
+    if (ok) {
+        // the code and constants are only read, so they are used in place
+        Program *program = &image->program;
+        program->code = (AvmInstruction *)(data + sections[SECTION_CODE]->offset);
+        program->length = sections[SECTION_CODE]->count;
+        program->capacity = program->length;
+        program->constants.values = (Object *)(data + sections[SECTION_CONSTANTS]->offset);
+        program->constants.count = sections[SECTION_CONSTANTS]->count;
+        program->constants.capacity = program->constants.count;
+
+        image->sourcePath = (const char *)(data + sections[SECTION_DEBUG]->offset);
+        ok = loadFunctions(path, data, sections, program) &&
+             loadSymbols(path, data, sections, program) &&
+             loadRelocations(path, data, sections, program) &&
+             loadLines(path, data, sections, program);
+    }
+
+    if (!ok) freeImage(image);
+    return ok;
+}
+
+void freeImage(Image *image) {
+    if (!image) return;
+
+    freeFunctionTable(&image->program.functions);
+    freeFunctionTable(&image->program.imports);
+    FREE_ALLOC(image->program.relocations.entries);
+    freeLineTable(&image->program.lines);
+
+    if (image->mapping) munmap(image->mapping, image->size);
+    *image = (Image){0};
+}
+
+bool isImagePath(const char *path) {
+    size_t length = strlen(path);
+    size_t extension = strlen(IMAGE_EXTENSION);
+
+    return length > extension && strcmp(path + length - extension, IMAGE_EXTENSION) == 0;
+}
\ No newline at end of file
@@ -0,0 +1,114 @@
+#ifndef image_h
+#define image_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "../assembler/assembler.h"
+
+// an .aobj image is a header, a section table and 8-byte aligned sections
+// in host byte order. the code and constants are used in place from a
+// read-only mapping, only the function table is copied out on load
+#define IMAGE_MAGIC "AOBJ"
+#define IMAGE_VERSION_MAJOR 1
+#define IMAGE_VERSION_MINOR 2
+#define IMAGE_BYTE_ORDER 0x01020304u
+#define IMAGE_EXTENSION ".aobj"
+
+typedef enum {
+    SECTION_CODE,
+    SECTION_CONSTANTS,
+    SECTION_FUNCTIONS,
+    // parameter types of every function, one byte each
+    SECTION_TYPES,
+    SECTION_STRINGS,
+    // the source path, never needed to run the program
+    SECTION_DEBUG,
+
+    // added in 1.1 for linking, images without them have no imports or relocations
+    SECTION_SYMBOLS,
+    SECTION_RELOCATIONS,
+
+    // added in 1.2, the line table's encoded entries and its files as offsets
+    // into the string section. empty in images built with --strip
+    SECTION_LINES,
+    SECTION_LINE_FILES,
+    SECTION_COUNT,
+} ImageSectionKind;
+
+// sections every image carries, the rest are optional
+#define REQUIRED_SECTION_COUNT (SECTION_DEBUG + 1)
+
+typedef struct {
+    char magic[4];
+    uint16_t major;
+    uint16_t minor;
+    uint32_t byteOrder;
+    uint32_t sectionCount;
+    // FNV-1a of the section table and every section but the code, which is
+    // checked one function at a time on first call
+    uint64_t checksum;
+} ImageHeader;
+
+typedef struct {
+    uint32_t kind;
+    uint32_t count;
+    uint64_t offset;
+    uint64_t size;
+} ImageSection;
+
+typedef struct {
+    uint64_t address;
+    uint64_t checksum;
+    // offsets into the string and type sections
+    uint32_t name;
+    uint32_t paramTypes;
+    uint32_t arity;
+    uint32_t localCount;
+    uint32_t returnType;
+    uint32_t reserved;
+} ImageFunction;
+
+typedef enum {
+    SYMBOL_EXPORT,
+    SYMBOL_IMPORT,
+} ImageSymbolKind;
+
+// exports name a function record, imports carry the signature they were declared with
+typedef struct {
+    uint32_t name;
+    uint32_t kind;
+    uint32_t index;
+    uint32_t arity;
+    uint32_t paramTypes;
+    uint32_t returnType;
+} ImageSymbol;
+
+typedef struct {
+    uint64_t offset;
+    uint32_t kind;
+    uint32_t reserved;
+} ImageRelocation;
+
+typedef struct {
+    void *mapping;
+    size_t size;
+
+    // code and constants point into the mapping, an image with imports is an
+    // object that has to be linked before it can run
+    Program program;
+    const char *sourcePath;
+} Image;
+
+// writes the program to 'path' through a temporary file and a rename, so
+// readers never see a partially written image
+bool writeImage(const Program *program, const char *sourcePath, const char *path);
+
+// maps an image read-only and checks everything but the function bodies
+bool loadImage(const char *path, Image *image);
+void freeImage(Image *image);
+
+bool isImagePath(const char *path);
+
+#endif
\ No newline at end of file
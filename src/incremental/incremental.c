@@ -0,0 +1,710 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "incremental.h"
+#include "../parser/parser.h"
+#include "../ir/checker.h"
+#include "../ir/compiler.h"
+#include "../image/image.h"
+#include "../trace/trace.h"
+#include "../util/alloc.h"
+#include "../util/hash.h"
+
+typedef struct {
+    FunctionRange range;
+
+    uint64_t signature;
+    uint64_t fingerprint;
+
+    // the function's index among the merged program's functions or imports
+    size_t target;
+} SourceItem;
+
+typedef struct {
+    const char *name;
+    size_t index;
+} NameEntry;
+
+// a program being copied from, with its relocations grouped by function
+typedef struct {
+    const Program *program;
+    size_t *ends;
+    Relocation *relocations;
+    size_t *relocationStarts;
+    size_t *relocationEnds;
+    // where each constant went in the merged pool, SIZE_MAX until it is used
+    size_t *constants;
+} ProgramView;
+
+typedef struct {
+    Token *tokens;
+    SourceItem *items;
+    size_t itemCount;
+    size_t definedCount;
+    NameEntry *names;
+} SourceItems;
+
+Build newBuild(void) {
+    return (Build){
+        .fingerprints = NULL,
+        .lines = NULL,
+        .count = 0,
+        .recompiled = 0,
+        .incremental = false,
+    };
+}
+
+void freeBuild(Build *build) {
+    if (!build) return;
+
+    FREE_ALLOC(build->fingerprints);
+    FREE_ALLOC(build->lines);
+    build->count = 0;
+}
+
+// debug builds leave the IR in 'out.air' to be looked at
+static void writeIr(const char *ir, size_t length) {
+    FILE *file = fopen("out.air", "w");
+    if (!file) return;
+
+    fwrite(ir, 1, length, file);
+    fclose(file);
+}
+
+bool compileTokens(Token *tokens, size_t count, const char *file, bool debug, FILE *errors, Program *program) {
+    TRACE_BEGIN("parse", "compile");
+    Parser parser = newParser(tokens, count);
+    parser.errors = errors;
+    parseAst(&parser);
+    TRACE_END();
+    if (debug) printParserAst(&parser);
+
+    bool ok = !parser.hadError;
+    if (ok) {
+        TRACE_BEGIN("check", "compile");
+        Checker checker = newChecker(parser.ast);
+        checker.errors = errors;
+        checkTypes(&checker);
+        ok = !checker.hadError;
+        freeChecker(&checker);
+        TRACE_END();
+    }
+
+    // the IR never leaves memory, so compiles can run side by side
+    char *ir = NULL;
+    size_t irLength = 0;
+    if (ok) {
+        TRACE_BEGIN("generate ir", "compile");
+        FILE *out = open_memstream(&ir, &irLength);
+        assertAlloc(out);
+
+        Compiler compiler = newCompiler(parser.ast, out);
+        compiler.errors = errors;
+        compile(&compiler);
+        ok = !compiler.hadError;
+        freeCompiler(&compiler);
+        fclose(out);
+        TRACE_END();
+
+        if (debug) writeIr(ir, irLength);
+    }
+
+    if (ok) {
+        TRACE_BEGIN("assemble", "compile");
+        Assembler assembler = newAssembler(ir, debug);
+        assembler.errors = errors;
+        assembler.file = file;
+        assemble(&assembler);
+        ok = !assembler.hadError;
+        TRACE_END();
+
+        if (ok) {
+            *program = assembler.program;
+            assembler.program = (Program){0};
+        }
+        freeAssembler(&assembler);
+    }
+
+    free(ir);
+    freeParser(&parser);
+    return ok;
+}
+
+static int compareNames(const void *a, const void *b) {
+    return strcmp(((const NameEntry *)a)->name, ((const NameEntry *)b)->name);
+}
+
+static const NameEntry *findName(const NameEntry *names, size_t count, const char *name) {
+    NameEntry key = { .name = name };
+    return bsearch(&key, names, count, sizeof(NameEntry), compareNames);
+}
+
+// a function moved as a whole keeps its fingerprint, its line table entries
+// are shifted along with it. one laid out differently inside is recompiled
+static uint64_t hashTokens(uint64_t hash, const Token *tokens, size_t start, size_t end) {
+    for (size_t i = start; i < end; i++) {
+        uint32_t type = tokens[i].type;
+        int32_t position[2] = { tokens[i].line - tokens[start].line, tokens[i].column };
+        hash = fnv1a(hash, &type, sizeof(type));
+        hash = fnv1a(hash, tokens[i].lexeme, strlen(tokens[i].lexeme) + 1);
+        hash = fnv1a(hash, position, sizeof(position));
+    }
+
+    return hash;
+}
+
+// anything but functions at the top level leaves the whole file to the parser
+static bool splitItems(SourceItems *s, Token *tokens, size_t count) {
+    FunctionRange *ranges = NULL;
+    size_t rangeCount = 0;
+    bool ok = prescanFunctions(tokens, count, &ranges, &rangeCount);
+
+    s->tokens = tokens;
+    s->items = alloc((rangeCount + 1) * sizeof(SourceItem));
+    s->itemCount = rangeCount;
+    s->names = alloc((rangeCount + 1) * sizeof(NameEntry));
+    s->definedCount = 0;
+
+    for (size_t k = 0; k < rangeCount; k++) {
+        s->items[k] = (SourceItem){ .range = ranges[k] };
+        s->names[k] = (NameEntry){ .name = ranges[k].name, .index = k };
+
+        // defined functions come first in the merged program, then the imports
+        if (!ranges[k].isExtern) s->items[k].target = s->definedCount++;
+    }
+    size_t imports = 0;
+    for (size_t k = 0; k < rangeCount; k++) {
+        if (ranges[k].isExtern) s->items[k].target = s->definedCount + imports++;
+    }
+    FREE_ALLOC(ranges);
+    if (!ok) return false;
+
+    qsort(s->names, s->itemCount, sizeof(NameEntry), compareNames);
+    for (size_t k = 1; k < s->itemCount; k++) {
+        // duplicates are reported by the checker
+        if (strcmp(s->names[k - 1].name, s->names[k].name) == 0) return false;
+    }
+
+    return true;
+}
+
+static const SourceItem *findItem(const SourceItems *s, const char *name) {
+    const NameEntry *entry = findName(s->names, s->itemCount, name);
+    return entry ? &s->items[entry->index] : NULL;
+}
+
+// calls are an identifier followed by '(' anywhere in the body
+static bool isCall(const SourceItems *s, size_t i, size_t end) {
+    return s->tokens[i].type == TOKEN_IDENTIFIER && i + 1 < end &&
+           s->tokens[i + 1].type == TOKEN_LEFT_PAREN;
+}
+
+static void fingerprintItems(SourceItems *s) {
+    for (size_t k = 0; k < s->itemCount; k++) {
+        SourceItem *item = &s->items[k];
+        item->signature = hashTokens(FNV_OFFSET_BASIS, s->tokens, item->range.signatureStart,
+                                     item->range.signatureEnd);
+    }
+
+    for (size_t k = 0; k < s->itemCount; k++) {
+        SourceItem *item = &s->items[k];
+        uint64_t hash = hashTokens(FNV_OFFSET_BASIS, s->tokens, item->range.start, item->range.end);
+
+        for (size_t i = item->range.signatureEnd; i < item->range.end; i++) {
+            if (!isCall(s, i, item->range.end)) continue;
+
+            const SourceItem *callee = findItem(s, s->tokens[i].lexeme);
+            uint64_t signature = callee ? callee->signature : 0;
+            hash = fnv1a(hash, &signature, sizeof(signature));
+        }
+
+        item->fingerprint = hash;
+    }
+}
+
+static void freeSourceItems(SourceItems *s) {
+    FREE_ALLOC(s->items);
+    FREE_ALLOC(s->names);
+}
+
+static void recordFingerprints(Build *build, const SourceItems *s) {
+    FREE_ALLOC(build->fingerprints);
+    FREE_ALLOC(build->lines);
+    build->fingerprints = alloc((s->definedCount + 1) * sizeof(uint64_t));
+    build->lines = alloc((s->definedCount + 1) * sizeof(uint32_t));
+    build->count = 0;
+
+    for (size_t k = 0; k < s->itemCount; k++) {
+        const SourceItem *item = &s->items[k];
+        if (item->range.isExtern) continue;
+
+        build->fingerprints[build->count] = item->fingerprint;
+        build->lines[build->count++] = s->tokens[item->range.start].line;
+    }
+}
+
+// build states are keyed on where the source lives, not on what it contains
+static char *buildStatePath(Cache *cache, const char *path) {
+    char *resolved = realpath(path, NULL);
+    const char *name = resolved ? resolved : path;
+
+    char key[17];
+    snprintf(key, sizeof(key), "%016llx",
+             (unsigned long long)fnv1a(FNV_OFFSET_BASIS, name, strlen(name)));
+    free(resolved);
+
+    return cacheFilePath(cache, key, CACHE_BUILD_EXTENSION);
+}
+
+static bool loadBuildState(Cache *cache, const char *path, BuildHeader *header, uint64_t **fingerprints,
+                           uint32_t **lines) {
+    char *statePath = buildStatePath(cache, path);
+    FILE *file = fopen(statePath, "rb");
+    FREE_ALLOC(statePath);
+    if (!file) return false;
+
+    bool ok = fread(header, sizeof(BuildHeader), 1, file) == 1 &&
+              memcmp(header->magic, BUILD_MAGIC, 4) == 0 && header->version == BUILD_VERSION &&
+              memchr(header->image, '\0', sizeof(header->image)) != NULL;
+
+    if (ok) {
+        *fingerprints = alloc((header->count + 1) * sizeof(uint64_t));
+        *lines = alloc((header->count + 1) * sizeof(uint32_t));
+        ok = fread(*fingerprints, sizeof(uint64_t), header->count, file) == header->count &&
+             fread(*lines, sizeof(uint32_t), header->count, file) == header->count;
+        if (!ok) {
+            FREE_ALLOC(*fingerprints);
+            FREE_ALLOC(*lines);
+        }
+    }
+
+    fclose(file);
+    return ok;
+}
+
+bool saveBuild(const Build *build, Cache *cache, const char *path, const CacheKey *image) {
+    if (!build || !cache || !cache->directory || build->count == 0) return false;
+
+    BuildHeader header = {
+        .magic = BUILD_MAGIC,
+        .version = BUILD_VERSION,
+        .count = build->count,
+    };
+    snprintf(header.image, sizeof(header.image), "%s", image->name);
+
+    char *statePath = buildStatePath(cache, path);
+    size_t tempLength = strlen(statePath) + 32;
+    char *tempPath = alloc(tempLength);
+    snprintf(tempPath, tempLength, "%s.%ld.tmp", statePath, (long)getpid());
+
+    bool ok = false;
+    FILE *file = fopen(tempPath, "wb");
+    if (file) {
+        ok = fwrite(&header, sizeof(header), 1, file) == 1;
+        ok = ok && fwrite(build->fingerprints, sizeof(uint64_t), build->count, file) == build->count;
+        ok = ok && fwrite(build->lines, sizeof(uint32_t), build->count, file) == build->count;
+        ok = fclose(file) == 0 && ok;
+        ok = ok && rename(tempPath, statePath) == 0;
+        if (!ok) remove(tempPath);
+    }
+
+    FREE_ALLOC(tempPath);
+    FREE_ALLOC(statePath);
+
+    return ok;
+}
+
+static int compareRelocations(const void *a, const void *b) {
+    size_t left = ((const Relocation *)a)->offset, right = ((const Relocation *)b)->offset;
+    return (left > right) - (left < right);
+}
+
+// index of the first relocation at or after 'offset'
+static size_t lowerBound(const Relocation *relocations, size_t count, size_t offset) {
+    size_t low = 0, high = count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (relocations[middle].offset < offset) low = middle + 1;
+        else high = middle;
+    }
+
+    return low;
+}
+
+static ProgramView newProgramView(const Program *program) {
+    size_t count = program->functions.count;
+    size_t relocationCount = program->relocations.count;
+
+    ProgramView view = {
+        .program = program,
+        .ends = alloc((count + 1) * sizeof(size_t)),
+        .relocations = alloc((relocationCount + 1) * sizeof(Relocation)),
+        .relocationStarts = alloc((count + 1) * sizeof(size_t)),
+        .relocationEnds = alloc((count + 1) * sizeof(size_t)),
+        .constants = alloc((program->constants.count + 1) * sizeof(size_t)),
+    };
+
+    functionExtents(program, view.ends);
+    memcpy(view.relocations, program->relocations.entries, relocationCount * sizeof(Relocation));
+    qsort(view.relocations, relocationCount, sizeof(Relocation), compareRelocations);
+
+    for (size_t i = 0; i < count; i++) {
+        view.relocationStarts[i] = lowerBound(view.relocations, relocationCount,
+                                              program->functions.entries[i].address);
+        view.relocationEnds[i] = lowerBound(view.relocations, relocationCount, view.ends[i]);
+    }
+    for (size_t i = 0; i < program->constants.count; i++) view.constants[i] = SIZE_MAX;
+
+    return view;
+}
+
+static void freeProgramView(ProgramView *view) {
+    FREE_ALLOC(view->ends);
+    FREE_ALLOC(view->relocations);
+    FREE_ALLOC(view->relocationStarts);
+    FREE_ALLOC(view->relocationEnds);
+    FREE_ALLOC(view->constants);
+}
+
+static const char *calleeName(const Program *program, size_t operand) {
+    if (operand < program->functions.count) return program->functions.entries[operand].name;
+
+    size_t import = operand - program->functions.count;
+    return import < program->imports.count ? program->imports.entries[import].name : NULL;
+}
+
+static void newProgram(Program *program) {
+    *program = (Program){
+        .code = alloc(sizeof(AvmInstruction)),
+        .capacity = 1,
+        .constants = { .values = alloc(sizeof(Object)), .capacity = 1 },
+        .functions = { .entries = alloc(sizeof(Function)), .capacity = 1 },
+        .imports = { .entries = alloc(sizeof(Function)), .capacity = 1 },
+        .relocations = { .entries = alloc(sizeof(Relocation)), .capacity = 1 },
+    };
+}
+
+static void appendCode(Program *p, const AvmInstruction *code, size_t length) {
+    while (p->length + length > p->capacity) {
+        p->capacity *= 2;
+        p->code = realloc(p->code, p->capacity * sizeof(AvmInstruction));
+        assertAlloc(p->code);
+    }
+
+    memcpy(p->code + p->length, code, length * sizeof(AvmInstruction));
+    p->length += length;
+}
+
+static size_t appendConstant(Program *p, Object value) {
+    ConstantPool *pool = &p->constants;
+    if (pool->count >= pool->capacity) {
+        pool->capacity *= 2;
+        pool->values = realloc(pool->values, pool->capacity * sizeof(Object));
+        assertAlloc(pool->values);
+    }
+
+    pool->values[pool->count] = value;
+    return pool->count++;
+}
+
+static void appendRelocation(Program *p, Relocation relocation) {
+    RelocationTable *table = &p->relocations;
+    if (table->count >= table->capacity) {
+        table->capacity *= 2;
+        table->entries = realloc(table->entries, table->capacity * sizeof(Relocation));
+        assertAlloc(table->entries);
+    }
+
+    table->entries[table->count++] = relocation;
+}
+
+static void appendFunction(FunctionTable *table, const Function *fn, size_t address) {
+    if (table->count >= table->capacity) {
+        table->capacity *= 2;
+        table->entries = realloc(table->entries, table->capacity * sizeof(Function));
+        assertAlloc(table->entries);
+    }
+
+    Function copy = *fn;
+    copy.name = strdup(fn->name);
+    assertAlloc(copy.name);
+    copy.paramTypes = alloc((fn->arity + 1) * sizeof(ValueType));
+    memcpy(copy.paramTypes, fn->paramTypes, fn->arity * sizeof(ValueType));
+    copy.address = address;
+    copy.validated = true;
+    copy.checksum = 0;
+
+    table->entries[table->count++] = copy;
+}
+
+// copies function 'index' of the view onto the end of 'out', pointing its
+// calls at the merged program's numbering and moving its lines by 'lineShift'
+static bool copyFunction(Program *out, ProgramView *view, size_t index, const SourceItems *s, int64_t lineShift) {
+    const Program *from = view->program;
+    const Function *fn = &from->functions.entries[index];
+    size_t start = fn->address, address = out->length;
+
+    appendCode(out, from->code + start, view->ends[index] - start);
+    appendFunction(&out->functions, fn, address);
+
+    copyLines(&out->lines, &from->lines, start, view->ends[index], address, lineShift);
+
+    for (size_t r = view->relocationStarts[index]; r < view->relocationEnds[index]; r++) {
+        Relocation relocation = view->relocations[r];
+        size_t operand = from->code[relocation.offset];
+        size_t offset = address + relocation.offset - start;
+
+        if (relocation.kind == RELOC_CALL) {
+            const char *name = calleeName(from, operand);
+            const SourceItem *callee = name ? findItem(s, name) : NULL;
+            if (!callee) return false;
+
+            out->code[offset] = callee->target;
+        } else {
+            if (operand >= from->constants.count) return false;
+
+            if (view->constants[operand] == SIZE_MAX) {
+                view->constants[operand] = appendConstant(out, from->constants.values[operand]);
+            }
+            out->code[offset] = view->constants[operand];
+        }
+
+        appendRelocation(out, (Relocation){ .offset = offset, .kind = relocation.kind });
+    }
+
+    return true;
+}
+
+static void addToken(Token **tokens, size_t *count, size_t *capacity, Token token) {
+    if (*count >= *capacity) {
+        *capacity *= 2;
+        *tokens = realloc(*tokens, *capacity * sizeof(Token));
+        assertAlloc(*tokens);
+    }
+
+    (*tokens)[(*count)++] = token;
+}
+
+// the changed functions in full, every extern, and the signatures of the
+// unchanged functions they call declared as externs
+static bool compileFragment(const SourceItems *s, const bool *changed, const char *path, Program *fragment) {
+    size_t count = 0, capacity = 1;
+    Token *tokens = alloc(capacity * sizeof(Token));
+    bool *declared = alloc((s->itemCount + 1) * sizeof(bool));
+    memset(declared, 0, (s->itemCount + 1) * sizeof(bool));
+
+    for (size_t k = 0; k < s->itemCount; k++) {
+        const SourceItem *item = &s->items[k];
+        if (!item->range.isExtern) continue;
+
+        for (size_t i = item->range.start; i < item->range.end; i++) {
+            addToken(&tokens, &count, &capacity, s->tokens[i]);
+        }
+        declared[k] = true;
+    }
+
+    for (size_t k = 0; k < s->itemCount; k++) {
+        const SourceItem *item = &s->items[k];
+        if (!changed[k]) continue;
+
+        for (size_t i = item->range.start; i < item->range.end; i++) {
+            addToken(&tokens, &count, &capacity, s->tokens[i]);
+        }
+
+        for (size_t i = item->range.signatureEnd; i < item->range.end; i++) {
+            if (!isCall(s, i, item->range.end)) continue;
+
+            const SourceItem *callee = findItem(s, s->tokens[i].lexeme);
+            if (!callee || callee == item) continue;
+
+            size_t calleeIndex = callee - s->items;
+            if (declared[calleeIndex] || changed[calleeIndex]) continue;
+            declared[calleeIndex] = true;
+
+            Token declaration = s->tokens[callee->range.signatureStart];
+            declaration.type = TOKEN_EXTERN;
+            declaration.lexeme = "extern";
+            addToken(&tokens, &count, &capacity, declaration);
+            for (size_t j = callee->range.signatureStart; j < callee->range.signatureEnd; j++) {
+                addToken(&tokens, &count, &capacity, s->tokens[j]);
+            }
+        }
+    }
+
+    bool ok = compileTokens(tokens, count, path, false, stderr, fragment);
+
+    FREE_ALLOC(declared);
+    FREE_ALLOC(tokens);
+
+    return ok;
+}
+
+static bool findFunctionIndex(const NameEntry *names, size_t count, const char *name, size_t *index) {
+    const NameEntry *entry = findName(names, count, name);
+    if (entry) *index = entry->index;
+
+    return entry != NULL;
+}
+
+static NameEntry *functionNames(const FunctionTable *table) {
+    NameEntry *names = alloc((table->count + 1) * sizeof(NameEntry));
+    for (size_t i = 0; i < table->count; i++) {
+        names[i] = (NameEntry){ .name = table->entries[i].name, .index = i };
+    }
+    qsort(names, table->count, sizeof(NameEntry), compareNames);
+
+    return names;
+}
+
+// lays the functions out in source order, taking changed ones from the
+// fragment and the rest from the last build
+static bool mergePrograms(const SourceItems *s, const bool *changed, const Program *previous, const uint32_t *lines,
+                          const Program *fragment, Program *out) {
+    NameEntry *previousNames = functionNames(&previous->functions);
+    NameEntry *fragmentNames = functionNames(&fragment->functions);
+    ProgramView previousView = newProgramView(previous);
+    ProgramView fragmentView = newProgramView(fragment);
+
+    newProgram(out);
+
+    bool ok = true;
+    for (size_t k = 0; k < s->itemCount && ok; k++) {
+        const SourceItem *item = &s->items[k];
+        if (item->range.isExtern) continue;
+
+        // the fragment was compiled from the source as it is now, the last
+        // build's code moves with wherever its function went
+        size_t index = 0;
+        if (changed[k]) {
+            ok = findFunctionIndex(fragmentNames, fragment->functions.count, item->range.name, &index) &&
+                 copyFunction(out, &fragmentView, index, s, 0);
+        } else {
+            ok = findFunctionIndex(previousNames, previous->functions.count, item->range.name, &index) &&
+                 copyFunction(out, &previousView, index, s,
+                              (int64_t)s->tokens[item->range.start].line - lines[index]);
+        }
+    }
+
+    // every extern was part of the fragment, so their signatures are all there
+    NameEntry *importNames = functionNames(&fragment->imports);
+    for (size_t k = 0; k < s->itemCount && ok; k++) {
+        const SourceItem *item = &s->items[k];
+        if (!item->range.isExtern) continue;
+
+        size_t index = 0;
+        ok = findFunctionIndex(importNames, fragment->imports.count, item->range.name, &index);
+        if (ok) appendFunction(&out->imports, &fragment->imports.entries[index], 0);
+    }
+
+    FREE_ALLOC(importNames);
+    FREE_ALLOC(previousNames);
+    FREE_ALLOC(fragmentNames);
+    freeProgramView(&previousView);
+    freeProgramView(&fragmentView);
+
+    if (!ok) freeProgram(out);
+    return ok;
+}
+
+typedef enum {
+    INCREMENTAL_OK,
+    INCREMENTAL_FAILED,
+    // nothing usable from the last build, compile the whole file instead
+    INCREMENTAL_UNAVAILABLE,
+} IncrementalResult;
+
+static IncrementalResult buildFromPrevious(Build *build, Cache *cache, const char *path,
+                                           const SourceItems *s, Program *program) {
+    BuildHeader header;
+    uint64_t *fingerprints = NULL;
+    uint32_t *lines = NULL;
+    if (!loadBuildState(cache, path, &header, &fingerprints, &lines)) return INCREMENTAL_UNAVAILABLE;
+
+    char *imagePath = cacheFilePath(cache, header.image, IMAGE_EXTENSION);
+    Image image;
+    bool loaded = access(imagePath, R_OK) == 0 && loadImage(imagePath, &image);
+    FREE_ALLOC(imagePath);
+
+    if (!loaded || image.program.functions.count != header.count) {
+        if (loaded) freeImage(&image);
+        FREE_ALLOC(fingerprints);
+        FREE_ALLOC(lines);
+        return INCREMENTAL_UNAVAILABLE;
+    }
+
+    const Program *previous = &image.program;
+    NameEntry *previousNames = functionNames(&previous->functions);
+
+    bool *changed = alloc((s->itemCount + 1) * sizeof(bool));
+    size_t changedCount = 0;
+    for (size_t k = 0; k < s->itemCount; k++) {
+        const SourceItem *item = &s->items[k];
+        size_t index = 0;
+
+        changed[k] = !item->range.isExtern &&
+                     (!findFunctionIndex(previousNames, previous->functions.count, item->range.name, &index) ||
+                      fingerprints[index] != item->fingerprint);
+        if (changed[k]) changedCount++;
+    }
+
+    Program fragment = {0};
+    IncrementalResult result = compileFragment(s, changed, path, &fragment) ? INCREMENTAL_OK : INCREMENTAL_FAILED;
+
+    if (result == INCREMENTAL_OK) {
+        if (mergePrograms(s, changed, previous, lines, &fragment, program)) {
+            build->recompiled = changedCount;
+            build->incremental = true;
+        } else {
+            result = INCREMENTAL_UNAVAILABLE;
+        }
+        freeProgram(&fragment);
+    }
+
+    FREE_ALLOC(changed);
+    FREE_ALLOC(previousNames);
+    FREE_ALLOC(fingerprints);
+    FREE_ALLOC(lines);
+    freeImage(&image);
+
+    return result;
+}
+
+// the fingerprints only describe the program when its functions are in source order
+static bool inSourceOrder(const Program *program, const SourceItems *s) {
+    if (program->functions.count != s->definedCount) return false;
+
+    size_t index = 0;
+    for (size_t k = 0; k < s->itemCount; k++) {
+        if (s->items[k].range.isExtern) continue;
+        if (strcmp(program->functions.entries[index++].name, s->items[k].range.name) != 0) return false;
+    }
+
+    return true;
+}
+
+bool compileIncremental(Build *build, Cache *cache, const char *path, Lexer *lexer, Program *program) {
+    if (!build || !cache || !lexer) return false;
+
+    SourceItems items = {0};
+    bool split = splitItems(&items, lexer->tokens, lexer->count);
+    if (split) fingerprintItems(&items);
+
+    IncrementalResult result = INCREMENTAL_UNAVAILABLE;
+    if (split && cache->directory) result = buildFromPrevious(build, cache, path, &items, program);
+
+    if (result == INCREMENTAL_UNAVAILABLE) {
+        result = compileTokens(lexer->tokens, lexer->count, path, false, stderr, program) ? INCREMENTAL_OK
+                                                                                         : INCREMENTAL_FAILED;
+        build->recompiled = result == INCREMENTAL_OK ? program->functions.count : 0;
+        build->incremental = false;
+    }
+
+    if (result == INCREMENTAL_OK && split && inSourceOrder(program, &items)) {
+        recordFingerprints(build, &items);
+    }
+
+    freeSourceItems(&items);
+    return result == INCREMENTAL_OK;
+}
\ No newline at end of file
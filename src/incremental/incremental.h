@@ -0,0 +1,55 @@
+#ifndef incremental_h
+#define incremental_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "../parser/lexer.h"
+#include "../assembler/assembler.h"
+#include "../cache/cache.h"
+
+#define BUILD_MAGIC "ABLD"
+#define BUILD_VERSION 2
+
+// what a build of a source file leaves for the next one. a function's
+// fingerprint covers its own tokens, where they sit relative to its first,
+// and the signatures of everything it calls
+typedef struct {
+    // in function table order, empty when the source could not be split into functions
+    uint64_t *fingerprints;
+    // the line each function started on, which its copied line table entries move from
+    uint32_t *lines;
+    size_t count;
+
+    // functions lowered by this build, the rest were copied out of the last one
+    size_t recompiled;
+    bool incremental;
+} Build;
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    // cache entry holding the program the fingerprints describe
+    char image[40];
+    uint64_t count;
+} BuildHeader;
+
+Build newBuild(void);
+void freeBuild(Build *build);
+
+// parses, checks, compiles and assembles a token stream into a program,
+// reporting what is wrong with it to 'errors'. the line table names the
+// tokens' source 'file', there is none when it is NULL
+bool compileTokens(Token *tokens, size_t count, const char *file, bool debug, FILE *errors, Program *program);
+
+// compiles only the functions whose fingerprint changed since the last saved
+// build of 'path' and relinks them with the code of the unchanged ones,
+// compiling everything when there is no usable last build
+bool compileIncremental(Build *build, Cache *cache, const char *path, Lexer *lexer, Program *program);
+
+// records the cache entry 'image' as the last build of 'path'
+bool saveBuild(const Build *build, Cache *cache, const char *path, const CacheKey *image);
+
+#endif
\ No newline at end of file
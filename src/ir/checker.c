@@ -0,0 +1,623 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "checker.h"
+#include "../util/alloc.h"
+
+static ValueType checkExpression(Checker *c, AstNode *node, ValueType expected);
+
+Checker newChecker(Ast ast) {
+    return (Checker){
+        .ast = ast,
+        .signatures = alloc((ast.count + 1) * sizeof(FnSignature)),
+        .signatureCount = 0,
+        .byName = alloc((ast.count + 1) * sizeof(FnSignature *)),
+        .locals = alloc(sizeof(TypedLocal)),
+        .localCount = 0,
+        .localCapacity = 1,
+        .fnName = NULL,
+        .returnType = TYPE_UNKNOWN,
+        .parallel = NULL,
+        .errors = stderr,
+        .hadError = false
+    };
+}
+
+void freeChecker(Checker *c) {
+    if (!c) return;
+
+    for (size_t i = 0; i < c->signatureCount; i++) {
+        FREE_ALLOC(c->signatures[i].params);
+    }
+    FREE_ALLOC(c->signatures);
+    FREE_ALLOC(c->byName);
+    FREE_ALLOC(c->locals);
+}
+
+static void typeError(Checker *c, const char *format, ...) {
+    fprintf(c->errors, "type error in '%s': ", c->fnName ? c->fnName : "(top level)");
+
+    va_list args;
+    va_start(args, format);
+    vfprintf(c->errors, format, args);
+    va_end(args);
+
+    fprintf(c->errors, "\n");
+    c->hadError = true;
+}
+
+static ValueType resolveTypeName(Checker *c, const char *name) {
+    ValueType type = typeFromName(name);
+    if (type == TYPE_UNKNOWN) typeError(c, "unknown type '%s'", name);
+
+    return type;
+}
+
+static int compareSignatures(const void *a, const void *b) {
+    return strcmp((*(FnSignature *const *)a)->name, (*(FnSignature *const *)b)->name);
+}
+
+static FnSignature *findSignature(Checker *c, const char *name) {
+    FnSignature key = { .name = name };
+    FnSignature *keyPointer = &key;
+
+    FnSignature **found = bsearch(&keyPointer, c->byName, c->signatureCount,
+                                  sizeof(FnSignature *), compareSignatures);
+    return found ? *found : NULL;
+}
+
+static void declareLocal(Checker *c, const char *name, ValueType type) {
+    if (c->localCount >= c->localCapacity) {
+        c->localCapacity *= 2;
+        c->locals = realloc(c->locals, c->localCapacity * sizeof(TypedLocal));
+        assertAlloc(c->locals);
+    }
+
+    c->locals[c->localCount++] = (TypedLocal){ .name = name, .type = type };
+}
+
+static TypedLocal *findLocal(Checker *c, const char *name) {
+    for (size_t i = c->localCount; i > 0; i--) {
+        if (strcmp(c->locals[i - 1].name, name) == 0) return &c->locals[i - 1];
+    }
+
+    return NULL;
+}
+
+// anything may flow into 'any', but a dynamic value never flows into a static type
+static bool isAssignable(ValueType target, ValueType source) {
+    if (target == TYPE_UNKNOWN || source == TYPE_UNKNOWN) return true;
+    if (target == TYPE_ANY) return true;
+
+    return target == source;
+}
+
+static void expectAssignable(Checker *c, ValueType target, ValueType source, const char *what) {
+    if (isAssignable(target, source)) return;
+
+    typeError(c, "%s expects %s, found %s", what, typeName(target), typeName(source));
+}
+
+static bool isLiteral(const AstNode *node) {
+    return node->type == AST_NODE_INTEGER_LITERAL || node->type == AST_NODE_FLOAT_LITERAL;
+}
+
+static bool isComparisonOp(TokenType op) {
+    return op == TOKEN_LESS || op == TOKEN_LESS_EQUAL || op == TOKEN_GREATER ||
+           op == TOKEN_GREATER_EQUAL || op == TOKEN_EQUAL_EQUAL || op == TOKEN_BANG_EQUAL;
+}
+
+static ValueType checkBinary(Checker *c, AstBinary *binary) {
+    // a literal operand takes its type from the other side, so check that one first
+    ValueType left, right;
+    if (isLiteral(binary->left) && !isLiteral(binary->right)) {
+        right = checkExpression(c, binary->right, TYPE_UNKNOWN);
+        left = checkExpression(c, binary->left, right);
+    } else {
+        left = checkExpression(c, binary->left, TYPE_UNKNOWN);
+        right = checkExpression(c, binary->right, left);
+    }
+
+    bool comparison = isComparisonOp(binary->op);
+    if (left == TYPE_UNKNOWN || right == TYPE_UNKNOWN) return TYPE_UNKNOWN;
+    if (left == TYPE_ANY || right == TYPE_ANY) return comparison ? TYPE_BOOL : TYPE_ANY;
+
+    if (left != right) {
+        typeError(c, "mismatched operand types %s and %s", typeName(left), typeName(right));
+        return TYPE_UNKNOWN;
+    }
+
+    bool equality = binary->op == TOKEN_EQUAL_EQUAL || binary->op == TOKEN_BANG_EQUAL;
+    if (!isNumericType(left) && !(equality && left == TYPE_BOOL)) {
+        typeError(c, "operator '%s' does not apply to %s", getTokenTypeName(binary->op), typeName(left));
+        return TYPE_UNKNOWN;
+    }
+
+    return comparison ? TYPE_BOOL : left;
+}
+
+typedef enum {
+    INTRINSIC_LEN,
+    INTRINSIC_FILL,
+    INTRINSIC_COPY,
+    INTRINSIC_ADD,
+    INTRINSIC_MUL,
+    INTRINSIC_DOT,
+    INTRINSIC_SUM,
+    INTRINSIC_MIN,
+    INTRINSIC_MAX,
+    INTRINSIC_COUNT,
+} Intrinsic;
+
+// built in array operations, named like the IR's 'array' instructions they compile to
+static const struct {
+    const char *name;
+    size_t arity;
+} intrinsics[INTRINSIC_COUNT] = {
+    [INTRINSIC_LEN] = { "len", 1 },
+    [INTRINSIC_FILL] = { "fill", 2 },
+    [INTRINSIC_COPY] = { "copy", 2 },
+    [INTRINSIC_ADD] = { "add", 3 },
+    [INTRINSIC_MUL] = { "mul", 3 },
+    [INTRINSIC_DOT] = { "dot", 2 },
+    [INTRINSIC_SUM] = { "sum", 1 },
+    [INTRINSIC_MIN] = { "min", 1 },
+    [INTRINSIC_MAX] = { "max", 1 },
+};
+
+static bool findIntrinsic(const char *name, Intrinsic *intrinsic) {
+    for (int i = 0; i < INTRINSIC_COUNT; i++) {
+        if (strcmp(intrinsics[i].name, name) == 0) {
+            *intrinsic = (Intrinsic)i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// an array operand, dynamic ones are checked when the operation runs
+static ValueType checkArray(Checker *c, AstNode *node, ValueType expected, const char *what) {
+    ValueType type = checkExpression(c, node, expected);
+    if (type == TYPE_UNKNOWN || type == TYPE_ANY || isArrayType(type)) {
+        if (isArrayType(expected)) expectAssignable(c, expected, type, what);
+        return type;
+    }
+
+    typeError(c, "%s expects an array, found %s", what, typeName(type));
+    return TYPE_UNKNOWN;
+}
+
+// the element type of an array operand, dynamic when the array is
+static ValueType elementOf(ValueType array) {
+    return isArrayType(array) ? elementType(array) : array;
+}
+
+// what a channel operand carries, 'any' for an untyped one
+static ValueType checkChannel(Checker *c, ValueType channel, const char *what) {
+    if (channel == TYPE_UNKNOWN) return TYPE_UNKNOWN;
+    if (isChannelType(channel)) return channelElement(channel);
+
+    typeError(c, "%s expects a channel, found %s", what, typeName(channel));
+    return TYPE_UNKNOWN;
+}
+
+// every array operand has the type of the first, and the operation either
+// hands back its first operand or reduces the arrays to a single element
+static ValueType checkIntrinsic(Checker *c, AstCall *call, Intrinsic intrinsic) {
+    call->intrinsic = intrinsics[intrinsic].name;
+    if (call->argCount != intrinsics[intrinsic].arity) {
+        typeError(c, "wrong number of arguments to '%s'", call->name);
+        for (size_t i = 0; i < call->argCount; i++) {
+            checkExpression(c, call->args[i], TYPE_UNKNOWN);
+        }
+        return TYPE_UNKNOWN;
+    }
+
+    ValueType array = checkArray(c, call->args[0], TYPE_UNKNOWN, call->name);
+    switch (intrinsic) {
+        case INTRINSIC_LEN: {
+            return TYPE_I32;
+        }
+        case INTRINSIC_FILL: {
+            ValueType element = elementOf(array);
+            ValueType value = checkExpression(c, call->args[1], element);
+            expectAssignable(c, element, value, "fill");
+            return array;
+        }
+        case INTRINSIC_SUM:
+        case INTRINSIC_MIN:
+        case INTRINSIC_MAX: {
+            return elementOf(array);
+        }
+        default: {
+            for (size_t i = 1; i < call->argCount; i++) {
+                checkArray(c, call->args[i], array, call->name);
+            }
+            return intrinsic == INTRINSIC_DOT ? elementOf(array) : array;
+        }
+    }
+}
+
+static ValueType checkCall(Checker *c, AstCall *call) {
+    FnSignature *signature = findSignature(c, call->name);
+
+    // a function of the same name hides the built in operation
+    Intrinsic intrinsic;
+    if (!signature && findIntrinsic(call->name, &intrinsic)) return checkIntrinsic(c, call, intrinsic);
+
+    if (!signature) {
+        typeError(c, "call to undefined function '%s'", call->name);
+        for (size_t i = 0; i < call->argCount; i++) {
+            checkExpression(c, call->args[i], TYPE_UNKNOWN);
+        }
+        return TYPE_UNKNOWN;
+    }
+
+    if (call->argCount != signature->paramCount) {
+        typeError(c, "wrong number of arguments to '%s'", call->name);
+    }
+
+    for (size_t i = 0; i < call->argCount; i++) {
+        ValueType param = i < signature->paramCount ? signature->params[i] : TYPE_UNKNOWN;
+        ValueType arg = checkExpression(c, call->args[i], param);
+        expectAssignable(c, param, arg, "argument");
+    }
+
+    return signature->returnType;
+}
+
+// the type of the element 'array[index]' names
+static ValueType checkIndex(Checker *c, AstIndex *index) {
+    ValueType array = checkArray(c, index->array, TYPE_UNKNOWN, "index");
+
+    ValueType position = checkExpression(c, index->index, TYPE_I32);
+    expectAssignable(c, TYPE_I32, position, "index");
+
+    return elementOf(array);
+}
+
+static ValueType checkExpression(Checker *c, AstNode *node, ValueType expected) {
+    ValueType type = TYPE_UNKNOWN;
+
+    switch (node->type) {
+        case AST_NODE_INTEGER_LITERAL: {
+            // integer literals adapt to any numeric context, those too wide
+            // for an i32 are i64 where the context does not say
+            bool wide = node->asInt.value > INT32_MAX;
+            type = isNumericType(expected) ? expected : wide ? TYPE_I64 : TYPE_I32;
+            if (wide && type == TYPE_I32) {
+                typeError(c, "integer literal %" PRId64 " does not fit in i32", node->asInt.value);
+            }
+            break;
+        }
+        case AST_NODE_FLOAT_LITERAL: {
+            type = TYPE_F64;
+            break;
+        }
+        case AST_NODE_IDENTIFIER: {
+            TypedLocal *local = findLocal(c, node->asIdent.name);
+            if (!local) {
+                typeError(c, "undefined variable '%s'", node->asIdent.name);
+                break;
+            }
+            type = local->type;
+            break;
+        }
+        case AST_NODE_CALL: {
+            type = checkCall(c, &node->asCall);
+            break;
+        }
+        case AST_NODE_BINARY: {
+            type = checkBinary(c, &node->asBinary);
+            break;
+        }
+        case AST_NODE_CHAN: {
+            ValueType capacity = checkExpression(c, node->asChan.capacity, TYPE_I32);
+            expectAssignable(c, TYPE_I32, capacity, "channel capacity");
+            type = typeFromName(node->asChan.type);
+            break;
+        }
+        case AST_NODE_RECV: {
+            ValueType channel = checkExpression(c, node->asRecv.channel, TYPE_CHAN);
+            type = checkChannel(c, channel, "recv");
+            break;
+        }
+        case AST_NODE_ARRAY: {
+            ValueType length = checkExpression(c, node->asArray.length, TYPE_I32);
+            expectAssignable(c, TYPE_I32, length, "array length");
+            type = arrayType(typeFromName(node->asArray.elementType));
+            break;
+        }
+        case AST_NODE_INDEX: {
+            type = checkIndex(c, &node->asIndex);
+            break;
+        }
+        case AST_NODE_ERR: {
+            typeError(c, "malformed expression");
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+
+    node->valueType = type;
+    return type;
+}
+
+static void checkStatement(Checker *c, AstNode *node);
+
+static bool isReduced(const AstParallelFor *loop, const char *name) {
+    for (size_t i = 0; i < loop->reductionCount; i++) {
+        if (strcmp(loop->reductions[i].name, name) == 0) return true;
+    }
+
+    return false;
+}
+
+// every iteration of a parallel for sees its own copy of the locals around it
+static void checkParallelAssign(Checker *c, const TypedLocal *local) {
+    size_t slot = local - c->locals;
+
+    if (slot == c->loopVariable) {
+        typeError(c, "the variable of a parallel for cannot be assigned");
+    } else if (slot < c->sharedLocals && !isReduced(c->parallel, local->name)) {
+        typeError(c, "'%s' is shared by every iteration of a parallel for, only a reduction may be assigned",
+                  local->name);
+    }
+}
+
+static void checkReductions(Checker *c, const AstParallelFor *loop) {
+    for (size_t i = 0; i < loop->reductionCount; i++) {
+        const char *name = loop->reductions[i].name;
+        TypedLocal *local = findLocal(c, name);
+
+        if (!local) {
+            typeError(c, "reduction of undefined variable '%s'", name);
+        } else if (!isNumericType(local->type) && local->type != TYPE_UNKNOWN) {
+            typeError(c, "reduction expects a number, found %s", typeName(local->type));
+        }
+
+        for (size_t j = 0; j < i; j++) {
+            if (strcmp(loop->reductions[j].name, name) == 0) typeError(c, "'%s' is reduced twice", name);
+        }
+    }
+}
+
+// the body is checked in a scope of its own, laid out the way the compiler
+// lays out the function it outlines: the locals around the loop, then the
+// loop's index and the body's own
+static void checkParallelFor(Checker *c, AstParallelFor *loop) {
+    ValueType variable = TYPE_I32;
+    if (loop->end) {
+        ValueType start = checkExpression(c, loop->start, TYPE_I32);
+        expectAssignable(c, TYPE_I32, start, "range");
+        ValueType end = checkExpression(c, loop->end, TYPE_I32);
+        expectAssignable(c, TYPE_I32, end, "range");
+    } else {
+        ValueType array = checkArray(c, loop->start, TYPE_UNKNOWN, "parallel for");
+        variable = elementOf(array);
+
+        // the array is kept in a slot of its own for the body to index
+        declareLocal(c, "$in", array);
+    }
+
+    checkReductions(c, loop);
+
+    FREE_ALLOC(loop->captures);
+    loop->captureCount = c->localCount;
+    loop->captures = alloc((c->localCount + 1) * sizeof(ValueType));
+    for (size_t i = 0; i < c->localCount; i++) loop->captures[i] = c->locals[i].type;
+
+    const AstParallelFor *outer = c->parallel;
+    size_t outerShared = c->sharedLocals, outerVariable = c->loopVariable;
+    c->parallel = loop;
+    c->sharedLocals = c->localCount;
+
+    if (!loop->end) declareLocal(c, "$index", TYPE_I32);
+    declareLocal(c, loop->variable, variable);
+    c->loopVariable = c->localCount - 1;
+
+    for (size_t i = 0; i < loop->body.statementCount; i++) {
+        checkStatement(c, loop->body.statements[i]);
+    }
+
+    c->localCount = c->sharedLocals;
+    c->parallel = outer;
+    c->sharedLocals = outerShared;
+    c->loopVariable = outerVariable;
+}
+
+// a block's locals go out of scope at its end
+static void checkBlock(Checker *c, AstBlock *block) {
+    size_t localCount = c->localCount;
+    for (size_t i = 0; i < block->statementCount; i++) {
+        checkStatement(c, block->statements[i]);
+    }
+    c->localCount = localCount;
+}
+
+// whether every path through a block ends in a ret. a while may run no
+// times, so only an if returning on both branches counts besides ret itself
+static bool alwaysReturns(const AstBlock *block) {
+    for (size_t i = 0; i < block->statementCount; i++) {
+        const AstNode *node = block->statements[i];
+        if (node->type == AST_NODE_RET) return true;
+        if (node->type == AST_NODE_IF && alwaysReturns(&node->asIf.thenBlock) &&
+            alwaysReturns(&node->asIf.elseBlock)) return true;
+    }
+
+    return false;
+}
+
+static void checkCondition(Checker *c, AstNode *condition) {
+    ValueType type = checkExpression(c, condition, TYPE_BOOL);
+    expectAssignable(c, TYPE_BOOL, type, "condition");
+}
+
+static void checkStatement(Checker *c, AstNode *node) {
+    switch (node->type) {
+        case AST_NODE_LET: {
+            AstLet *let = &node->asLet;
+            ValueType declared = let->type ? resolveTypeName(c, let->type) : TYPE_UNKNOWN;
+
+            ValueType value = checkExpression(c, let->value, declared);
+            if (let->type) {
+                expectAssignable(c, declared, value, "variable");
+            } else {
+                declared = value;
+            }
+
+            declareLocal(c, let->name, declared);
+            break;
+        }
+        case AST_NODE_ASSIGN: {
+            TypedLocal *local = findLocal(c, node->asAssign.name);
+            ValueType target = local ? local->type : TYPE_UNKNOWN;
+            if (!local) typeError(c, "assignment to undefined variable '%s'", node->asAssign.name);
+            if (local && c->parallel) checkParallelAssign(c, local);
+
+            ValueType value = checkExpression(c, node->asAssign.value, target);
+            expectAssignable(c, target, value, "assignment");
+            break;
+        }
+        case AST_NODE_RET: {
+            if (c->parallel) typeError(c, "ret inside a parallel for");
+            if (!node->asRet.expression) {
+                typeError(c, "ret without a value in a function returning %s", typeName(c->returnType));
+                break;
+            }
+
+            ValueType value = checkExpression(c, node->asRet.expression, c->returnType);
+            expectAssignable(c, c->returnType, value, "return");
+            break;
+        }
+        case AST_NODE_FN: {
+            typeError(c, "nested function '%s'", node->asFn.fnName);
+            break;
+        }
+        case AST_NODE_SPAWN: {
+            checkCall(c, &node->asCall);
+            break;
+        }
+        case AST_NODE_SEND: {
+            ValueType channel = checkExpression(c, node->asSend.channel, TYPE_CHAN);
+            ValueType element = checkChannel(c, channel, "send");
+            ValueType value = checkExpression(c, node->asSend.value, element == TYPE_ANY ? TYPE_UNKNOWN : element);
+            expectAssignable(c, element, value, "send");
+            break;
+        }
+        case AST_NODE_INDEX_ASSIGN: {
+            ValueType element = checkIndex(c, &node->asIndex);
+            ValueType value = checkExpression(c, node->asIndex.value, element);
+            expectAssignable(c, element, value, "element");
+            break;
+        }
+        case AST_NODE_PARALLEL_FOR: {
+            checkParallelFor(c, &node->asParallelFor);
+            break;
+        }
+        case AST_NODE_IF: {
+            checkCondition(c, node->asIf.condition);
+            checkBlock(c, &node->asIf.thenBlock);
+            checkBlock(c, &node->asIf.elseBlock);
+            break;
+        }
+        case AST_NODE_WHILE: {
+            checkCondition(c, node->asWhile.condition);
+            checkBlock(c, &node->asWhile.body);
+            break;
+        }
+        case AST_NODE_ERR: {
+            typeError(c, "malformed statement");
+            break;
+        }
+        case AST_NODE_YIELD:
+        case AST_NODE_EXEC:
+        case AST_NODE_BLOCK: {
+            break;
+        }
+        default: {
+            checkExpression(c, node, TYPE_UNKNOWN);
+            break;
+        }
+    }
+}
+
+static void checkFunction(Checker *c, AstFnNode *fn, FnSignature *signature) {
+    c->fnName = fn->fnName;
+    c->returnType = signature->returnType;
+    c->localCount = 0;
+
+    for (size_t i = 0; i < fn->paramCount; i++) {
+        declareLocal(c, fn->params[i].name, signature->params[i]);
+    }
+
+    for (size_t i = 0; i < fn->block.statementCount; i++) {
+        checkStatement(c, fn->block.statements[i]);
+    }
+
+    // there is no void, so falling off the end would hand back a made-up value
+    if (!alwaysReturns(&fn->block)) typeError(c, "not every path ends in a ret");
+
+    c->fnName = NULL;
+}
+
+static void collectSignature(Checker *c, AstFnNode *fn) {
+    c->fnName = fn->fnName;
+
+    // the compiler names the functions it outlines with a '$'
+    if (strchr(fn->fnName, '$')) typeError(c, "function names may not contain '$'");
+
+    FnSignature signature = {
+        .name = fn->fnName,
+        .params = alloc((fn->paramCount + 1) * sizeof(ValueType)),
+        .paramCount = fn->paramCount,
+        .returnType = resolveTypeName(c, fn->returnType),
+    };
+
+    for (size_t i = 0; i < fn->paramCount; i++) {
+        signature.params[i] = resolveTypeName(c, fn->params[i].type);
+    }
+
+    c->signatures[c->signatureCount++] = signature;
+    c->fnName = NULL;
+}
+
+void checkTypes(Checker *c) {
+    if (!c) return;
+
+    // signatures first so calls may refer to functions defined later
+    for (size_t i = 0; i < c->ast.count; i++) {
+        AstNode *node = c->ast.nodes[i];
+        if (node->type == AST_NODE_FN) collectSignature(c, &node->asFn);
+    }
+
+    for (size_t i = 0; i < c->signatureCount; i++) c->byName[i] = &c->signatures[i];
+    qsort(c->byName, c->signatureCount, sizeof(FnSignature *), compareSignatures);
+
+    for (size_t i = 1; i < c->signatureCount; i++) {
+        if (strcmp(c->byName[i - 1]->name, c->byName[i]->name) == 0) {
+            c->fnName = c->byName[i]->name;
+            typeError(c, "duplicate definition of '%s'", c->byName[i]->name);
+            c->fnName = NULL;
+        }
+    }
+
+    size_t index = 0;
+    for (size_t i = 0; i < c->ast.count; i++) {
+        AstNode *node = c->ast.nodes[i];
+        if (node->type == AST_NODE_ERR) typeError(c, "malformed definition");
+        if (node->type != AST_NODE_FN) continue;
+        if (node->asFn.isExtern) {
+            index++;
+            continue;
+        }
+
+        checkFunction(c, &node->asFn, &c->signatures[index++]);
+    }
+}
\ No newline at end of file
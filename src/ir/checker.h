@@ -0,0 +1,58 @@
+#ifndef checker_h
+#define checker_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "../parser/ast.h"
+#include "../parser/types.h"
+
+typedef struct {
+    const char *name;
+    ValueType *params;
+    size_t paramCount;
+    ValueType returnType;
+} FnSignature;
+
+typedef struct {
+    const char *name;
+    ValueType type;
+} TypedLocal;
+
+typedef struct {
+    Ast ast;
+
+    FnSignature *signatures;
+    size_t signatureCount;
+    // the signatures sorted by name for lookups
+    FnSignature **byName;
+
+    // the current function's variables in declaration order
+    TypedLocal *locals;
+    size_t localCount;
+    size_t localCapacity;
+
+    const char *fnName;
+    ValueType returnType;
+
+    // the innermost parallel for being checked. of the locals below
+    // 'sharedLocals', which belong to the code around it, its body may only
+    // assign those it reduces, and never its own 'loopVariable'
+    const AstParallelFor *parallel;
+    size_t sharedLocals;
+    size_t loopVariable;
+
+    // where type errors are reported
+    FILE *errors;
+    bool hadError;
+} Checker;
+
+Checker newChecker(Ast ast);
+void freeChecker(Checker *checker);
+
+// resolves the type of every expression, storing it in 'AstNode.valueType',
+// and reports mismatches against declared local, parameter and return types
+void checkTypes(Checker *checker);
+
+#endif
\ No newline at end of file
@@ -1,21 +1,92 @@
+#include <inttypes.h>
+#include <string.h>
+
 #include "compiler.h"
 #include "../util/alloc.h"
 
 static void compileNode(Compiler *c, AstNode *node);
+static void compileExpression(Compiler *c, AstNode *expression);
+static void compileRetNode(Compiler *c, AstRet *retNode);
 
-Compiler newCompiler(Ast ast) {
+Compiler newCompiler(Ast ast, FILE *out) {
     Compiler c = {
         .ast = ast,
-        .out = fopen("out.air", "w")
+        .out = out,
+        .errors = stderr,
+        .locals = alloc(sizeof(char *)),
+        .localCount = 0,
+        .localCapacity = 1,
+        .outlined = NULL,
+        .outlinedLength = 0,
+        .outlinedCapacity = 0,
+        .labelCount = 0,
+        .line = 0,
+        .column = 0,
+        .hadError = false
     };
 
-    assertAlloc(c.out);
-
     return c;
 }
 
 void freeCompiler(Compiler *c) {
-    fclose(c->out);
+    FREE_ALLOC(c->locals);
+    if (c->outlined) FREE_ALLOC(c->outlined);
+}
+
+static void compileError(Compiler *c, const char *message, const char *name) {
+    fprintf(c->errors, "compile error: %s '%s'\n", message, name);
+    c->hadError = true;
+}
+
+static size_t declareLocal(Compiler *c, char *name) {
+    if (c->localCount >= c->localCapacity) {
+        c->localCapacity *= 2;
+        c->locals = realloc(c->locals, c->localCapacity * sizeof(char *));
+        assertAlloc(c->locals);
+    }
+
+    c->locals[c->localCount] = name;
+    return c->localCount++;
+}
+
+// later declarations shadow earlier ones, so search from the most recent slot
+static bool resolveLocal(Compiler *c, const char *name, size_t *slot) {
+    for (size_t i = c->localCount; i > 0; i--) {
+        if (strcmp(c->locals[i - 1], name) == 0) {
+            *slot = i - 1;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static size_t maxLocals(size_t a, size_t b) {
+    return a > b ? a : b;
+}
+
+// the most slots the block needs at once. the slots of an if or while body
+// are reused once it ends. a parallel for over an array keeps the array in a
+// hidden slot of its own, everything else the loop declares lives in its
+// outlined function
+static size_t countLocals(AstBlock *block) {
+    size_t count = 0;
+    size_t peak = 0;
+    for (size_t i = 0; i < block->statementCount; i++) {
+        AstNode *statement = block->statements[i];
+        if (statement->type == AST_NODE_LET) count++;
+        if (statement->type == AST_NODE_PARALLEL_FOR && !statement->asParallelFor.end) count++;
+
+        size_t nested = 0;
+        if (statement->type == AST_NODE_IF) {
+            nested = maxLocals(countLocals(&statement->asIf.thenBlock), countLocals(&statement->asIf.elseBlock));
+        } else if (statement->type == AST_NODE_WHILE) {
+            nested = countLocals(&statement->asWhile.body);
+        }
+        peak = maxLocals(peak, count + nested);
+    }
+
+    return peak;
 }
 
 static inline void emit(Compiler *c, char *emit) {
@@ -62,7 +133,61 @@ static inline void emitRightParen(Compiler *c) {
     emit(c, ")");
 }
 
-static void compileFnNode(Compiler *c, AstFnNode *fnNode) {
+static void emitLine(Compiler *c, uint16_t line, uint16_t column) {
+    if (line == 0 || (line == c->line && column == c->column)) return;
+
+    c->line = line;
+    c->column = column;
+    fprintf(c->out, "\tline %u %u\n", line, column);
+}
+
+// what follows is attributed to 'node' in the line table
+static void emitLocation(Compiler *c, const AstNode *node) {
+    emitLine(c, node->line, node->column);
+}
+
+static void emitParamTypes(Compiler *c, AstFnNode *fnNode) {
+    emitLeftParen(c);
+
+    if (fnNode->paramCount == 0) {
+        emit(c, "none");
+    }
+
+    for (size_t i = 0; i < fnNode->paramCount; i++) {
+        if (i > 0) {
+            emit(c, ",");
+            emitSpace(c);
+        }
+        emit(c, fnNode->params[i].type);
+    }
+
+    emitRightParen(c);
+
+    emitColon(c);
+    emitSpace(c);
+
+    emit(c, fnNode->returnType);
+}
+
+// externs become imports that the linker resolves against another object's exports
+static void compileExternNode(Compiler *c, AstFnNode *fnNode) {
+    emit(c, "declare");
+    emitSpace(c);
+    emit(c, "function");
+    emitSpace(c);
+    emitIdentifier(c, fnNode->fnName);
+
+    emitParamTypes(c, fnNode);
+    emitNewline(c);
+}
+
+static void compileFnNode(Compiler *c, AstNode *node) {
+    AstFnNode *fnNode = &node->asFn;
+    if (fnNode->isExtern) {
+        compileExternNode(c, fnNode);
+        return;
+    }
+
     emit(c, "define");
     emitSpace(c);
 
@@ -74,34 +199,52 @@ static void compileFnNode(Compiler *c, AstFnNode *fnNode) {
     emit(c, "function");
     emitSpace(c);
     emitIdentifier(c, fnNode->fnName);
-    
-    emitLeftParen(c);
-    
-    if (1) {
-        emit(c, "none");
-    }
 
-    emitRightParen(c);
+    c->fnName = fnNode->fnName;
+    c->parallelCount = 0;
+    c->labelCount = 0;
+    c->localCount = 0;
+    for (size_t i = 0; i < fnNode->paramCount; i++) {
+        declareLocal(c, fnNode->params[i].name);
+    }
 
-    emitColon(c);
+    emitParamTypes(c, fnNode);
     emitSpace(c);
 
-    emit(c, fnNode->returnType);
+    fprintf(c->out, "locals %zu", fnNode->paramCount + countLocals(&fnNode->block));
     emitSpace(c);
     
     emitLeftBrace(c);
     emitNewline(c);
 
+    // every function names its own location first, so its code never
+    // inherits the one before it
+    c->line = 0;
+    emitLocation(c, node);
+
+    bool returned = false;
     for (size_t i = 0; i < fnNode->block.statementCount; i++) {
         AstNode *stmt = fnNode->block.statements[i];
         compileNode(c, stmt);
+        returned = stmt->type == AST_NODE_RET;
+    }
+
+    // the checker has seen every path return, so the end after an if that
+    // returns on both branches is never reached, it only needs a terminator
+    if (!returned) {
+        emitTab(c);
+        emit(c, "halt");
+        emitNewline(c);
     }
 
     emitRightBrace(c);
     emitNewline(c);
+
+    if (c->outlinedLength > 0) fwrite(c->outlined, 1, c->outlinedLength, c->out);
+    c->outlinedLength = 0;
 }
 
-static void compileIntegerNode(Compiler *c, AstIntegerLiteral *intNode) {
+static void emitPushConst(Compiler *c, ValueType type) {
     emitTab(c);
 
     emit(c, "push");
@@ -110,29 +253,180 @@ static void compileIntegerNode(Compiler *c, AstIntegerLiteral *intNode) {
     emit(c, "const");
     emitSpace(c);
 
-    emit(c, "i32");
+    // dynamically typed values and references still need a concrete tag
+    bool tagged = isNumericType(type) || type == TYPE_BOOL;
+    emit(c, (char *)typeName(tagged ? type : TYPE_I32));
     emitColon(c);
     emitSpace(c);
+}
+
+static void compileIntegerNode(Compiler *c, AstIntegerLiteral *intNode, ValueType type) {
+    emitPushConst(c, type);
+
+    if (type == TYPE_F64) {
+        fprintf(c->out, "%" PRId64 ".0", intNode->value);
+    } else {
+        fprintf(c->out, "%" PRId64, intNode->value);
+    }
+    emitNewline(c);
+}
+
+static void compileFloatNode(Compiler *c, AstFloatLiteral *floatNode) {
+    emitPushConst(c, TYPE_F64);
+
+    fprintf(c->out, "%.17g", floatNode->value);
+    emitNewline(c);
+}
+
+static void emitLocal(Compiler *c, const char *op, size_t slot) {
+    emitTab(c);
+    fprintf(c->out, "%s local %zu", op, slot);
+    emitNewline(c);
+}
+
+static void compileIdentifierNode(Compiler *c, AstIdentifier *identNode) {
+    size_t slot;
+    if (!resolveLocal(c, identNode->name, &slot)) {
+        compileError(c, "undefined variable", identNode->name);
+        return;
+    }
+
+    emitLocal(c, "load", slot);
+}
 
-    fprintf(c->out, "%d", intNode->value);
+// 'array <op>' with the operands already on the stack
+static void emitArrayOp(Compiler *c, const char *op) {
+    emitTab(c);
+    fprintf(c->out, "array %s", op);
+    emitNewline(c);
+}
+
+// 'call' and 'spawn' both take their arguments from the stack, as do the
+// array operations the checker resolved the call to
+static void compileCallNode(Compiler *c, AstNode *node, char *op) {
+    AstCall *callNode = &node->asCall;
+    for (size_t i = 0; i < callNode->argCount; i++) {
+        compileExpression(c, callNode->args[i]);
+    }
+    emitLocation(c, node);
+
+    if (callNode->intrinsic) {
+        emitArrayOp(c, callNode->intrinsic);
+        return;
+    }
+
+    emitTab(c);
+    emit(c, op);
+    emitSpace(c);
+    emitIdentifier(c, callNode->name);
+    emitNewline(c);
+}
+
+static const char *binaryOpMnemonic(TokenType op) {
+    switch (op) {
+        case TOKEN_PLUS: return "add";
+        case TOKEN_MINUS: return "sub";
+        case TOKEN_STAR: return "mul";
+        case TOKEN_SLASH: return "div";
+        case TOKEN_LESS: return "lt";
+        case TOKEN_LESS_EQUAL: return "le";
+        case TOKEN_GREATER: return "gt";
+        case TOKEN_GREATER_EQUAL: return "ge";
+        case TOKEN_EQUAL_EQUAL: return "eq";
+        case TOKEN_BANG_EQUAL: return "ne";
+        default: return NULL;
+    }
+}
+
+// statically known operand types select a typed opcode, anything dynamic
+// falls back to the tagged generic one
+static void compileBinaryNode(Compiler *c, AstNode *node) {
+    AstBinary *binaryNode = &node->asBinary;
+    compileExpression(c, binaryNode->left);
+    compileExpression(c, binaryNode->right);
+    emitLocation(c, node);
+
+    ValueType left = binaryNode->left->valueType;
+    ValueType right = binaryNode->right->valueType;
+    ValueType operands = left;
+    if (left == TYPE_ANY || right == TYPE_ANY || left == TYPE_UNKNOWN) operands = TYPE_ANY;
+
+    emitTab(c);
+    fprintf(c->out, "%s %s", binaryOpMnemonic(binaryNode->op), typeName(operands));
     emitNewline(c);
 }
 
 static void compileExpression(Compiler *c, AstNode *expression) {
     switch (expression->type) {
         case AST_NODE_INTEGER_LITERAL:
-            compileIntegerNode(c, &expression->asInt);
+            compileIntegerNode(c, &expression->asInt, expression->valueType);
+            break;
+        case AST_NODE_FLOAT_LITERAL:
+            compileFloatNode(c, &expression->asFloat);
+            break;
+        case AST_NODE_BINARY:
+            compileBinaryNode(c, expression);
+            break;
+        case AST_NODE_IDENTIFIER:
+            compileIdentifierNode(c, &expression->asIdent);
+            break;
+        case AST_NODE_CALL:
+            compileCallNode(c, expression, "call");
+            break;
+        case AST_NODE_CHAN:
+            compileExpression(c, expression->asChan.capacity);
+            emitTab(c);
+            emit(c, "channel");
+            emitNewline(c);
+            break;
+        case AST_NODE_RECV:
+            compileExpression(c, expression->asRecv.channel);
+            emitTab(c);
+            emit(c, "recv");
+            emitNewline(c);
+            break;
+        case AST_NODE_ARRAY:
+            compileExpression(c, expression->asArray.length);
+            emitTab(c);
+            fprintf(c->out, "array new %s", expression->asArray.elementType);
+            emitNewline(c);
+            break;
+        case AST_NODE_INDEX:
+            compileExpression(c, expression->asIndex.array);
+            compileExpression(c, expression->asIndex.index);
+            emitLocation(c, expression);
+            emitArrayOp(c, "get");
+            break;
+        case AST_NODE_ERR:
+            compileError(c, "malformed expression in", c->fnName);
             break;
         default:
             break;
     }
 }
 
-static void compileRetNode(Compiler *c, AstRet *retNode) {
-    if (retNode->expression) {
-        compileExpression(c, retNode->expression);
+static void compileLetNode(Compiler *c, AstLet *letNode) {
+    compileExpression(c, letNode->value);
+
+    // the slot is only visible after its initialiser, so 'let x = x' reads the outer 'x'
+    size_t slot = declareLocal(c, letNode->name);
+    emitLocal(c, "store", slot);
+}
+
+static void compileAssignNode(Compiler *c, AstAssign *assignNode) {
+    size_t slot;
+    if (!resolveLocal(c, assignNode->name, &slot)) {
+        compileError(c, "assignment to undefined variable", assignNode->name);
+        return;
     }
-    
+
+    compileExpression(c, assignNode->value);
+    emitLocal(c, "store", slot);
+}
+
+static void compileRetNode(Compiler *c, AstRet *retNode) {
+    compileExpression(c, retNode->expression);
+
     emitTab(c);
     emit(c, "ret");
     emitNewline(c);
@@ -148,24 +442,245 @@ static void compileExecNode(Compiler *c, AstExec *execNode) {
     emitNewline(c);
 }
 
+static void compileSendNode(Compiler *c, AstSend *sendNode) {
+    compileExpression(c, sendNode->channel);
+    compileExpression(c, sendNode->value);
+
+    emitTab(c);
+    emit(c, "send");
+    emitNewline(c);
+}
+
+static void compileIndexAssignNode(Compiler *c, AstIndex *indexNode) {
+    compileExpression(c, indexNode->array);
+    compileExpression(c, indexNode->index);
+    compileExpression(c, indexNode->value);
+
+    emitArrayOp(c, "set");
+}
+
+static void appendOutlined(Compiler *c, const char *text, size_t length) {
+    if (c->outlinedLength + length > c->outlinedCapacity) {
+        c->outlinedCapacity = (c->outlinedLength + length) * 2;
+        c->outlined = realloc(c->outlined, c->outlinedCapacity);
+        assertAlloc(c->outlined);
+    }
+
+    memcpy(c->outlined + c->outlinedLength, text, length);
+    c->outlinedLength += length;
+}
+
+// the body becomes a function over the enclosing function's slots, then the
+// iteration index, then what the body declares. the vm runs it once per
+// iteration of a chunk, 'next' moving it on to the chunk's following index.
+// 'array' is the slot holding the array looped over, if there is one
+static void outlineParallelBody(Compiler *c, AstParallelFor *loop, const char *name, size_t array) {
+    char *text = NULL;
+    size_t length = 0;
+    FILE *body = open_memstream(&text, &length);
+    assertAlloc(body);
+
+    FILE *out = c->out;
+    c->out = body;
+    size_t shared = c->localCount;
+    size_t labels = c->labelCount;
+    uint16_t line = c->line, column = c->column;
+    c->labelCount = 0;
+    c->line = 0;
+
+    fprintf(c->out, "define function @%s(", name);
+    for (size_t i = 0; i < shared; i++) {
+        ValueType type = i < loop->captureCount ? loop->captures[i] : TYPE_ANY;
+        fprintf(c->out, "%s, ", typeName(type == TYPE_UNKNOWN ? TYPE_ANY : type));
+    }
+
+    size_t hidden = loop->end ? 1 : 2;
+    fprintf(c->out, "i32): i32 locals %zu {\n", shared + hidden + countLocals(&loop->body));
+    emitLine(c, line, column);
+
+    size_t index = declareLocal(c, loop->end ? loop->variable : "$index");
+    if (!loop->end) {
+        size_t element = declareLocal(c, loop->variable);
+
+        emitLocal(c, "load", array);
+        emitLocal(c, "load", index);
+        emitArrayOp(c, "get");
+        emitLocal(c, "store", element);
+    }
+
+    for (size_t i = 0; i < loop->body.statementCount; i++) {
+        compileNode(c, loop->body.statements[i]);
+    }
+
+    emitTab(c);
+    emit(c, "next");
+    emitNewline(c);
+    emitRightBrace(c);
+    emitNewline(c);
+
+    fclose(body);
+    c->out = out;
+    c->localCount = shared;
+    c->labelCount = labels;
+    c->line = line;
+    c->column = column;
+
+    appendOutlined(c, text, length);
+    free(text);
+}
+
+static void emitLabel(Compiler *c, const char *op, size_t label) {
+    emitTab(c);
+    fprintf(c->out, "%s %zu", op, label);
+    emitNewline(c);
+}
+
+static void compileBlock(Compiler *c, AstBlock *block) {
+    size_t localCount = c->localCount;
+    for (size_t i = 0; i < block->statementCount; i++) {
+        compileNode(c, block->statements[i]);
+    }
+    c->localCount = localCount;
+}
+
+static void compileIfNode(Compiler *c, AstIf *ifNode) {
+    size_t elseLabel = c->labelCount++;
+    size_t endLabel = c->labelCount++;
+
+    compileExpression(c, ifNode->condition);
+    emitLabel(c, "jmp_false", elseLabel);
+    compileBlock(c, &ifNode->thenBlock);
+    emitLabel(c, "jmp", endLabel);
+
+    emitLabel(c, "label", elseLabel);
+    compileBlock(c, &ifNode->elseBlock);
+    emitLabel(c, "label", endLabel);
+}
+
+static void compileWhileNode(Compiler *c, AstWhile *whileNode) {
+    size_t topLabel = c->labelCount++;
+    size_t endLabel = c->labelCount++;
+
+    emitLabel(c, "label", topLabel);
+    compileExpression(c, whileNode->condition);
+    emitLabel(c, "jmp_false", endLabel);
+    compileBlock(c, &whileNode->body);
+    emitLabel(c, "jmp", topLabel);
+    emitLabel(c, "label", endLabel);
+}
+
+// leaves the range, then a slot and operator per reduction, for 'parallel'
+static void compileParallelForNode(Compiler *c, AstParallelFor *loop) {
+    compileExpression(c, loop->start);
+
+    size_t array = 0;
+    if (loop->end) {
+        compileExpression(c, loop->end);
+    } else {
+        array = declareLocal(c, "$in");
+        emitLocal(c, "store", array);
+
+        AstIntegerLiteral zero = { .value = 0 };
+        compileIntegerNode(c, &zero, TYPE_I32);
+        emitLocal(c, "load", array);
+        emitArrayOp(c, "len");
+    }
+
+    for (size_t i = 0; i < loop->reductionCount; i++) {
+        size_t slot;
+        if (!resolveLocal(c, loop->reductions[i].name, &slot)) {
+            compileError(c, "reduction of undefined variable", loop->reductions[i].name);
+            return;
+        }
+
+        AstIntegerLiteral operand = { .value = (int64_t)slot };
+        compileIntegerNode(c, &operand, TYPE_I32);
+        operand.value = (int)loop->reductions[i].op;
+        compileIntegerNode(c, &operand, TYPE_I32);
+    }
+
+    char name[256];
+    snprintf(name, sizeof(name), "%s$for%zu", c->fnName, c->parallelCount++);
+
+    emitTab(c);
+    fprintf(c->out, "parallel @%s %zu", name, loop->reductionCount);
+    emitNewline(c);
+
+    outlineParallelBody(c, loop, name, array);
+}
+
 static void compileNode(Compiler *c, AstNode *node) {
+    if (node->type != AST_NODE_FN) emitLocation(c, node);
+
     switch (node->type) {
         case AST_NODE_FN: {
-            compileFnNode(c, &node->asFn);
+            compileFnNode(c, node);
             break;
         }
         case AST_NODE_RET: {
             compileRetNode(c, &node->asRet);
             break;
         }
-        case AST_NODE_INTEGER_LITERAL: {
-            compileIntegerNode(c, &node->asInt);
-            break;
-        }
         case AST_NODE_EXEC: {
             compileExecNode(c, &node->asExec);
+            break;
+        }
+        case AST_NODE_LET: {
+            compileLetNode(c, &node->asLet);
+            break;
+        }
+        case AST_NODE_ASSIGN: {
+            compileAssignNode(c, &node->asAssign);
+            break;
+        }
+        // the value of an expression statement is dropped
+        case AST_NODE_INTEGER_LITERAL:
+        case AST_NODE_FLOAT_LITERAL:
+        case AST_NODE_BINARY:
+        case AST_NODE_IDENTIFIER:
+        case AST_NODE_CALL:
+        case AST_NODE_CHAN:
+        case AST_NODE_RECV:
+        case AST_NODE_ARRAY:
+        case AST_NODE_INDEX: {
+            compileExpression(c, node);
+            emitTab(c);
+            emit(c, "pop");
+            emitNewline(c);
+            break;
+        }
+        case AST_NODE_INDEX_ASSIGN: {
+            compileIndexAssignNode(c, &node->asIndex);
+            break;
+        }
+        case AST_NODE_SPAWN: {
+            compileCallNode(c, node, "spawn");
+            break;
+        }
+        case AST_NODE_SEND: {
+            compileSendNode(c, &node->asSend);
+            break;
+        }
+        case AST_NODE_YIELD: {
+            emitTab(c);
+            emit(c, "yield");
+            emitNewline(c);
+            break;
+        }
+        case AST_NODE_PARALLEL_FOR: {
+            compileParallelForNode(c, &node->asParallelFor);
+            break;
+        }
+        case AST_NODE_IF: {
+            compileIfNode(c, &node->asIf);
+            break;
+        }
+        case AST_NODE_WHILE: {
+            compileWhileNode(c, &node->asWhile);
+            break;
         }
         case AST_NODE_ERR: {
+            compileError(c, "malformed statement in", c->fnName ? c->fnName : "(top level)");
             break;
         }
         default: {
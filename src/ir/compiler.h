@@ -3,15 +3,43 @@
 
 #include <stddef.h>
 #include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
 
 #include "../parser/ast.h"
+#include "../parser/types.h"
 
 typedef struct {
     Ast ast;
+    // receives the textual IR the assembler reads back
     FILE *out;
+    FILE *errors;
+
+    // names of the current function's slots, arguments first then 'let' locals
+    char **locals;
+    size_t localCount;
+    size_t localCapacity;
+
+    // the function being compiled and how many parallel for bodies it has
+    // outlined so far, which names the next one
+    const char *fnName;
+    size_t parallelCount;
+    // the outlined functions, written out after the function they came from
+    char *outlined;
+    size_t outlinedLength;
+    size_t outlinedCapacity;
+
+    // numbers the current function's jump targets
+    size_t labelCount;
+
+    // the source location the IR last named, a 'line' is only written when it changes
+    uint16_t line;
+    uint16_t column;
+
+    bool hadError;
 }  Compiler;
 
-Compiler newCompiler(Ast ast);
+Compiler newCompiler(Ast ast, FILE *out);
 void freeCompiler(Compiler *compiler);
 
 void compile(Compiler *compiler);
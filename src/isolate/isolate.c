@@ -0,0 +1,147 @@
+#include <pthread.h>
+#include <unistd.h>
+
+#include "isolate.h"
+#include "../vm/verifier.h"
+#include "../util/alloc.h"
+
+// everything that can be decided about the program is decided here, so
+// that nothing running it needs to write to it
+static SharedProgram *newSharedProgram(Program program, AvmConfig limits) {
+    SharedProgram *shared = alloc(sizeof(SharedProgram));
+    shared->program = program;
+    shared->fromImage = false;
+
+    validateProgram(&shared->program);
+
+    // any function may be called, so every one of them is an entry point
+    Verification verification = verifyAllEntries(&shared->program);
+    shared->verified = verification.ok;
+    shared->config = limits;
+    if (verification.ok) {
+        if (verification.maxStack < limits.stackLimit) shared->config.stackLimit = verification.maxStack;
+        if (verification.maxCallDepth < limits.callStackLimit) {
+            shared->config.callStackLimit = verification.maxCallDepth;
+        }
+        shrinkFiberLimits(&shared->config, &verification);
+    }
+
+    atomic_init(&shared->references, 1);
+    return shared;
+}
+
+SharedProgram *shareProgram(Program program, AvmConfig limits) {
+    return newSharedProgram(program, limits);
+}
+
+SharedProgram *shareImage(Image image, AvmConfig limits) {
+    SharedProgram *shared = newSharedProgram(image.program, limits);
+    shared->image = image;
+    shared->fromImage = true;
+
+    return shared;
+}
+
+SharedProgram *retainProgram(SharedProgram *shared) {
+    if (shared) atomic_fetch_add_explicit(&shared->references, 1, memory_order_relaxed);
+    return shared;
+}
+
+void releaseProgram(SharedProgram *shared) {
+    if (!shared) return;
+    if (atomic_fetch_sub_explicit(&shared->references, 1, memory_order_acq_rel) != 1) return;
+
+    if (shared->fromImage) {
+        freeImage(&shared->image);
+    } else {
+        freeProgram(&shared->program);
+    }
+    FREE_ALLOC(shared);
+}
+
+Isolate newIsolate(SharedProgram *shared) {
+    Isolate isolate = {
+        .shared = retainProgram(shared),
+        .vm = newAVM(&shared->program, shared->config),
+    };
+    isolate.vm.verified = shared->verified;
+
+    return isolate;
+}
+
+void freeIsolate(Isolate *isolate) {
+    if (!isolate) return;
+
+    freeAVM(&isolate->vm);
+    releaseProgram(isolate->shared);
+    isolate->shared = NULL;
+}
+
+typedef struct {
+    SharedProgram *shared;
+    BatchRequest *requests;
+    size_t count;
+    atomic_size_t next;
+
+    FILE *output;
+    FILE *errors;
+} Batch;
+
+static void *batchWorker(void *argument) {
+    Batch *batch = argument;
+
+    Isolate isolate = newIsolate(batch->shared);
+    isolate.vm.output = batch->output;
+    isolate.vm.errors = batch->errors;
+
+    for (;;) {
+        size_t index = atomic_fetch_add_explicit(&batch->next, 1, memory_order_relaxed);
+        if (index >= batch->count) break;
+
+        BatchRequest *request = &batch->requests[index];
+        resetAVM(&isolate.vm);
+        request->ok = callFunction(&isolate.vm, request->function, request->args, request->argCount) &&
+                      vmResult(&isolate.vm, &request->result);
+
+        if (request->ok && isWideI64(request->result)) {
+            request->wide = asI64(request->result);
+            request->result = wideI64Object(&request->wide);
+        }
+    }
+
+    freeIsolate(&isolate);
+    return NULL;
+}
+
+void runBatch(SharedProgram *shared, BatchRequest *requests, size_t count, size_t threads,
+              FILE *output, FILE *errors) {
+    if (!shared || count == 0) return;
+
+    if (threads == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cores > 0 ? (size_t)cores : 1;
+    }
+    if (threads > count) threads = count;
+
+    Batch batch = {
+        .shared = shared,
+        .requests = requests,
+        .count = count,
+        .output = output,
+        .errors = errors,
+    };
+    atomic_init(&batch.next, 0);
+
+    // the calling thread is the first worker
+    pthread_t *workers = alloc(threads * sizeof(pthread_t));
+    size_t started = 0;
+    for (size_t i = 1; i < threads; i++) {
+        if (pthread_create(&workers[started], NULL, batchWorker, &batch) != 0) break;
+        started++;
+    }
+
+    batchWorker(&batch);
+    for (size_t i = 0; i < started; i++) pthread_join(workers[i], NULL);
+
+    FREE_ALLOC(workers);
+}
\ No newline at end of file
@@ -0,0 +1,66 @@
+#ifndef isolate_h
+#define isolate_h
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdatomic.h>
+
+#include "../vm/vm.h"
+#include "../image/image.h"
+
+// the code, constants and functions of a program, never written to once
+// shared, so any number of isolates on any number of threads can run it
+typedef struct {
+    Program program;
+    // programs loaded from an image live in its mapping
+    Image image;
+    bool fromImage;
+
+    // a verified program runs on the unchecked interpreter with stacks sized for it
+    bool verified;
+    AvmConfig config;
+
+    atomic_size_t references;
+} SharedProgram;
+
+// the state of one execution over a shared program: its stacks, pc and streams.
+// used by one thread at a time
+typedef struct {
+    SharedProgram *shared;
+    AVM vm;
+} Isolate;
+
+// one call for the batch runner
+typedef struct {
+    size_t function;
+    const Object *args;
+    size_t argCount;
+
+    // filled in once the call has run. the isolate's heap is reused by its
+    // next call, so a wide i64 result is copied to 'wide' and points there
+    bool ok;
+    Object result;
+    int64_t wide;
+} BatchRequest;
+
+// takes ownership of a program, or of the image it lives in, validating and
+// verifying every function up front. 'limits' caps the isolates' stacks
+SharedProgram *shareProgram(Program program, AvmConfig limits);
+SharedProgram *shareImage(Image image, AvmConfig limits);
+
+SharedProgram *retainProgram(SharedProgram *shared);
+// the program is freed with its last reference
+void releaseProgram(SharedProgram *shared);
+
+// holds a reference to the program until it is freed
+Isolate newIsolate(SharedProgram *shared);
+void freeIsolate(Isolate *isolate);
+
+// runs every request on 'threads' worker threads, or one per core when 0, each
+// with an isolate of its own that writes to 'output' and 'errors'. requests are
+// handed out one at a time as workers become free
+void runBatch(SharedProgram *shared, BatchRequest *requests, size_t count, size_t threads,
+              FILE *output, FILE *errors);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lazy.h"
+#include "../incremental/incremental.h"
+#include "../util/alloc.h"
+#include "../util/hash.h"
+
+bool newLazyProgram(const char *path, LazyProgram *lazy) {
+    Lexer lexer;
+    if (!newLexer(path, &lexer)) return false;
+
+    *lazy = (LazyProgram){
+        .lexer = lexer,
+        .ranges = NULL,
+        .rangeCount = 0,
+        .names = NULL,
+        .targets = NULL,
+        .functionRanges = NULL,
+        .declaredIn = NULL,
+        .compiled = 0,
+    };
+
+    registerLexerKeywords(&lazy->lexer);
+    lexerTokenize(&lazy->lexer);
+
+    return true;
+}
+
+void freeLazyProgram(LazyProgram *lazy) {
+    if (!lazy) return;
+
+    FREE_ALLOC(lazy->ranges);
+    FREE_ALLOC(lazy->names);
+    FREE_ALLOC(lazy->targets);
+    FREE_ALLOC(lazy->functionRanges);
+    FREE_ALLOC(lazy->declaredIn);
+    freeLexer(&lazy->lexer);
+}
+
+static int compareNames(const void *a, const void *b) {
+    return strcmp(((const LazyName *)a)->name, ((const LazyName *)b)->name);
+}
+
+static const LazyName *findRange(const LazyProgram *lazy, const char *name) {
+    LazyName key = { .name = name };
+    return bsearch(&key, lazy->names, lazy->rangeCount, sizeof(LazyName), compareNames);
+}
+
+static void addFunction(FunctionTable *table, Function function) {
+    if (table->count >= table->capacity) {
+        table->capacity *= 2;
+        table->entries = realloc(table->entries, table->capacity * sizeof(Function));
+        assertAlloc(table->entries);
+    }
+
+    table->entries[table->count++] = function;
+}
+
+// parses 'fn name(params): type' on its own, the body is left untouched
+static bool stubFromSignature(LazyProgram *lazy, const FunctionRange *range, Function *stub) {
+    Parser parser = newParser(lazy->lexer.tokens + range->signatureStart,
+                              range->signatureEnd - range->signatureStart);
+    AstNode *node = parseSignature(&parser);
+
+    bool ok = node->type == AST_NODE_FN;
+    if (ok) {
+        AstFnNode *fn = &node->asFn;
+        *stub = (Function){
+            .name = strdup(fn->fnName),
+            .address = SIZE_MAX,
+            .arity = fn->paramCount,
+            .localCount = fn->paramCount,
+            .paramTypes = alloc((fn->paramCount + 1) * sizeof(ValueType)),
+            .returnType = typeFromName(fn->returnType),
+            .exported = range->isPublic,
+            .stub = !range->isExtern,
+        };
+        assertAlloc(stub->name);
+
+        for (size_t i = 0; i < fn->paramCount; i++) {
+            stub->paramTypes[i] = typeFromName(fn->params[i].type);
+        }
+    }
+
+    freeAstNode(node);
+    freeParser(&parser);
+
+    return ok;
+}
+
+// a parallel for's body is outlined into a function of its own, which a
+// body compiled on its own has nowhere to put
+static bool hasParallelFor(const Token *tokens, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (tokens[i].type == TOKEN_PARALLEL) return true;
+    }
+
+    return false;
+}
+
+bool prepareLazyProgram(LazyProgram *lazy, Program *program) {
+    if (!lazy || !program) return false;
+
+    Token *tokens = lazy->lexer.tokens;
+    if (hasParallelFor(tokens, lazy->lexer.count)) return false;
+    if (!prescanFunctions(tokens, lazy->lexer.count, &lazy->ranges, &lazy->rangeCount)) return false;
+
+    size_t count = lazy->rangeCount;
+    lazy->names = alloc((count + 1) * sizeof(LazyName));
+    for (size_t i = 0; i < count; i++) {
+        lazy->names[i] = (LazyName){ .name = lazy->ranges[i].name, .range = i };
+    }
+    qsort(lazy->names, count, sizeof(LazyName), compareNames);
+
+    // duplicates are left for the checker to report
+    for (size_t i = 1; i < count; i++) {
+        if (strcmp(lazy->names[i - 1].name, lazy->names[i].name) == 0) return false;
+    }
+
+    *program = (Program){
+        .code = alloc(sizeof(AvmInstruction)),
+        .capacity = 1,
+        .constants = { .values = alloc(sizeof(Object)), .capacity = 1 },
+        .functions = { .entries = alloc(sizeof(Function)), .capacity = 1 },
+        .imports = { .entries = alloc(sizeof(Function)), .capacity = 1 },
+        .relocations = { .entries = alloc(sizeof(Relocation)), .capacity = 1 },
+    };
+
+    lazy->targets = alloc((count + 1) * sizeof(size_t));
+    lazy->functionRanges = alloc((count + 1) * sizeof(size_t));
+    lazy->declaredIn = alloc((count + 1) * sizeof(size_t));
+
+    for (size_t i = 0; i < count; i++) {
+        Function stub;
+        if (!stubFromSignature(lazy, &lazy->ranges[i], &stub)) {
+            freeProgram(program);
+            return false;
+        }
+
+        lazy->declaredIn[i] = 0;
+        if (!lazy->ranges[i].isExtern) {
+            lazy->functionRanges[program->functions.count] = i;
+            lazy->targets[i] = program->functions.count;
+            addFunction(&program->functions, stub);
+        } else {
+            lazy->targets[i] = program->imports.count;
+            addFunction(&program->imports, stub);
+        }
+    }
+
+    // calls to imports are numbered after the functions, as the assembler does
+    for (size_t i = 0; i < count; i++) {
+        if (lazy->ranges[i].isExtern) lazy->targets[i] += program->functions.count;
+    }
+
+    return true;
+}
+
+static void addToken(Token **tokens, size_t *count, size_t *capacity, Token token) {
+    if (*count >= *capacity) {
+        *capacity *= 2;
+        *tokens = realloc(*tokens, *capacity * sizeof(Token));
+        assertAlloc(*tokens);
+    }
+
+    (*tokens)[(*count)++] = token;
+}
+
+// the body of 'range' preceded by everything it calls declared as externs
+static Token *bodyTokens(LazyProgram *lazy, size_t rangeIndex, size_t *count) {
+    const FunctionRange *range = &lazy->ranges[rangeIndex];
+    const Token *source = lazy->lexer.tokens;
+    size_t capacity = range->end - range->start + 1;
+    Token *tokens = alloc(capacity * sizeof(Token));
+    *count = 0;
+
+    size_t stamp = lazy->compiled + 1;
+    for (size_t i = range->signatureEnd; i + 1 < range->end; i++) {
+        if (source[i].type != TOKEN_IDENTIFIER || source[i + 1].type != TOKEN_LEFT_PAREN) continue;
+
+        const LazyName *callee = findRange(lazy, source[i].lexeme);
+        if (!callee || callee->range == rangeIndex || lazy->declaredIn[callee->range] == stamp) continue;
+        lazy->declaredIn[callee->range] = stamp;
+
+        const FunctionRange *declared = &lazy->ranges[callee->range];
+        Token extern_ = source[declared->signatureStart];
+        extern_.type = TOKEN_EXTERN;
+        extern_.lexeme = "extern";
+        addToken(&tokens, count, &capacity, extern_);
+
+        for (size_t j = declared->signatureStart; j < declared->signatureEnd; j++) {
+            addToken(&tokens, count, &capacity, source[j]);
+        }
+    }
+
+    for (size_t i = range->start; i < range->end; i++) addToken(&tokens, count, &capacity, source[i]);
+    return tokens;
+}
+
+static void appendCode(Program *p, const AvmInstruction *code, size_t length) {
+    while (p->length + length > p->capacity) {
+        p->capacity *= 2;
+        p->code = realloc(p->code, p->capacity * sizeof(AvmInstruction));
+        assertAlloc(p->code);
+    }
+
+    memcpy(p->code + p->length, code, length * sizeof(AvmInstruction));
+    p->length += length;
+}
+
+static size_t appendConstant(Program *p, Object value) {
+    ConstantPool *pool = &p->constants;
+    if (pool->count >= pool->capacity) {
+        pool->capacity *= 2;
+        pool->values = realloc(pool->values, pool->capacity * sizeof(Object));
+        assertAlloc(pool->values);
+    }
+
+    pool->values[pool->count] = value;
+    return pool->count++;
+}
+
+static void appendRelocation(Program *p, Relocation relocation) {
+    RelocationTable *table = &p->relocations;
+    if (table->count >= table->capacity) {
+        table->capacity *= 2;
+        table->entries = realloc(table->entries, table->capacity * sizeof(Relocation));
+        assertAlloc(table->entries);
+    }
+
+    table->entries[table->count++] = relocation;
+}
+
+// appends the fragment's only function to 'program', renumbering its
+// constants and pointing its calls at the program's function table
+static bool appendFragment(LazyProgram *lazy, Program *program, const Program *fragment, size_t index) {
+    const Function *compiled = &fragment->functions.entries[0];
+    size_t start = compiled->address, address = program->length;
+    appendCode(program, fragment->code + start, fragment->length - start);
+    copyLines(&program->lines, &fragment->lines, start, fragment->length, address, 0);
+
+    size_t *constants = alloc((fragment->constants.count + 1) * sizeof(size_t));
+    for (size_t i = 0; i < fragment->constants.count; i++) constants[i] = SIZE_MAX;
+
+    bool ok = true;
+    for (size_t r = 0; r < fragment->relocations.count && ok; r++) {
+        Relocation relocation = fragment->relocations.entries[r];
+        size_t operand = fragment->code[relocation.offset];
+        size_t offset = address + relocation.offset - start;
+
+        if (relocation.kind == RELOC_CALL) {
+            const Function *callee = operand < fragment->functions.count
+                ? &fragment->functions.entries[operand]
+                : &fragment->imports.entries[operand - fragment->functions.count];
+            const LazyName *name = findRange(lazy, callee->name);
+
+            ok = name != NULL;
+            if (ok) program->code[offset] = lazy->targets[name->range];
+        } else {
+            if (constants[operand] == SIZE_MAX) {
+                constants[operand] = appendConstant(program, fragment->constants.values[operand]);
+            }
+            program->code[offset] = constants[operand];
+        }
+
+        appendRelocation(program, (Relocation){ .offset = offset, .kind = relocation.kind });
+    }
+    FREE_ALLOC(constants);
+
+    Function *fn = &program->functions.entries[index];
+    fn->address = address;
+    fn->localCount = compiled->localCount;
+    fn->stub = false;
+    fn->validated = false;
+    fn->checksum = fnv1a(FNV_OFFSET_BASIS, program->code + address,
+                         (program->length - address) * sizeof(AvmInstruction));
+
+    return ok;
+}
+
+bool compileStub(void *context, Program *program, size_t index) {
+    LazyProgram *lazy = context;
+    if (!lazy || index >= program->functions.count) return false;
+
+    size_t count = 0;
+    Token *tokens = bodyTokens(lazy, lazy->functionRanges[index], &count);
+
+    Program fragment = {0};
+    bool ok = compileTokens(tokens, count, lazy->lexer.path, false, stderr, &fragment);
+    FREE_ALLOC(tokens);
+
+    // the body is the only function the fragment defines, the rest are its externs
+    if (ok) {
+        ok = fragment.functions.count == 1 && appendFragment(lazy, program, &fragment, index);
+        freeProgram(&fragment);
+    }
+
+    if (ok) lazy->compiled++;
+    return ok;
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#ifndef lazy_h
+#define lazy_h
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "../parser/lexer.h"
+#include "../parser/parser.h"
+#include "../assembler/assembler.h"
+
+typedef struct {
+    const char *name;
+    size_t range;
+} LazyName;
+
+// a source file whose functions are compiled one at a time as they are first called
+typedef struct {
+    Lexer lexer;
+
+    FunctionRange *ranges;
+    size_t rangeCount;
+    // sorted by name, to resolve the calls in a body
+    LazyName *names;
+
+    // index of every range in the function table, or in the imports for externs
+    size_t *targets;
+    // range of every function table entry
+    size_t *functionRanges;
+
+    // marks the callees already declared for the body being compiled
+    size_t *declaredIn;
+
+    // bodies compiled so far
+    size_t compiled;
+} LazyProgram;
+
+// lexes the source, nothing is parsed yet. false when it cannot be read
+bool newLazyProgram(const char *path, LazyProgram *lazy);
+void freeLazyProgram(LazyProgram *lazy);
+
+// pre-scans the tokens and fills 'program' with a stub for every function,
+// parsing only the signatures. false when the file needs the full parser
+bool prepareLazyProgram(LazyProgram *lazy, Program *program);
+
+// parses, checks and compiles a stub's body and appends its code to 'program',
+// meant as the vm's 'materialize' hook with the lazy program as context
+bool compileStub(void *lazy, Program *program, size_t index);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,385 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "linker.h"
+#include "../util/alloc.h"
+
+typedef struct {
+    const char *name;
+    size_t function;
+} Export;
+
+// functions are numbered globally, each object's block starts at its base
+typedef struct {
+    Linker *linker;
+
+    size_t *bases;
+    size_t functionCount;
+    // object of each global function and the first of its relocations
+    size_t *owners;
+    size_t *relocationStarts;
+    size_t *relocationEnds;
+    // relocations of every object, sorted by offset
+    Relocation **relocations;
+
+    Export *exports;
+    size_t exportCount;
+
+    bool *live;
+    size_t *newIndices;
+    size_t **constantIndices;
+} LinkState;
+
+Linker newLinker(const Program *objects, size_t objectCount) {
+    Linker linker = {
+        .objects = objects,
+        .objectCount = objectCount,
+        .program = {0},
+        .droppedFunctions = 0,
+        .hadError = false,
+    };
+
+    return linker;
+}
+
+void freeLinker(Linker *linker) {
+    if (!linker) return;
+
+    freeProgram(&linker->program);
+}
+
+static void linkError(Linker *l, const char *format, const char *name) {
+    fprintf(stderr, "link error: ");
+    fprintf(stderr, format, name);
+    fprintf(stderr, "\n");
+    l->hadError = true;
+}
+
+static int compareExports(const void *a, const void *b) {
+    return strcmp(((const Export *)a)->name, ((const Export *)b)->name);
+}
+
+static int compareRelocations(const void *a, const void *b) {
+    size_t left = ((const Relocation *)a)->offset, right = ((const Relocation *)b)->offset;
+    return (left > right) - (left < right);
+}
+
+static const Function *globalFunction(LinkState *s, size_t global) {
+    size_t object = s->owners[global];
+    return &s->linker->objects[object].functions.entries[global - s->bases[object]];
+}
+
+static bool sameSignature(const Function *a, const Function *b) {
+    if (a->arity != b->arity || a->returnType != b->returnType) return false;
+
+    for (size_t i = 0; i < a->arity; i++) {
+        if (a->paramTypes[i] != b->paramTypes[i]) return false;
+    }
+
+    return true;
+}
+
+// numbers every function, sorts each object's relocations and splits them up by function
+static bool layoutObjects(LinkState *s) {
+    Linker *l = s->linker;
+
+    s->bases = alloc((l->objectCount + 1) * sizeof(size_t));
+    s->relocations = alloc((l->objectCount + 1) * sizeof(Relocation *));
+    s->functionCount = 0;
+    for (size_t i = 0; i < l->objectCount; i++) {
+        s->bases[i] = s->functionCount;
+        s->functionCount += l->objects[i].functions.count;
+    }
+
+    s->owners = alloc((s->functionCount + 1) * sizeof(size_t));
+    s->relocationStarts = alloc((s->functionCount + 1) * sizeof(size_t));
+    s->relocationEnds = alloc((s->functionCount + 1) * sizeof(size_t));
+
+    for (size_t i = 0; i < l->objectCount; i++) {
+        const Program *object = &l->objects[i];
+        const RelocationTable *table = &object->relocations;
+
+        s->relocations[i] = alloc((table->count + 1) * sizeof(Relocation));
+        memcpy(s->relocations[i], table->entries, table->count * sizeof(Relocation));
+        qsort(s->relocations[i], table->count, sizeof(Relocation), compareRelocations);
+
+        size_t next = 0;
+        for (size_t f = 0; f < object->functions.count; f++) {
+            const Function *fn = &object->functions.entries[f];
+            if (f > 0 && fn->address <= object->functions.entries[f - 1].address) {
+                linkError(l, "functions of '%s' are not in address order", fn->name);
+                return false;
+            }
+
+            size_t end = f + 1 < object->functions.count
+                ? object->functions.entries[f + 1].address : object->length;
+            size_t global = s->bases[i] + f;
+
+            s->owners[global] = i;
+            while (next < table->count && s->relocations[i][next].offset < fn->address) next++;
+            s->relocationStarts[global] = next;
+            while (next < table->count && s->relocations[i][next].offset < end) next++;
+            s->relocationEnds[global] = next;
+        }
+    }
+
+    return true;
+}
+
+static bool collectExports(LinkState *s) {
+    s->exports = alloc((s->functionCount + 1) * sizeof(Export));
+    s->exportCount = 0;
+
+    for (size_t g = 0; g < s->functionCount; g++) {
+        const Function *fn = globalFunction(s, g);
+        if (!fn->exported) continue;
+
+        s->exports[s->exportCount++] = (Export){ .name = fn->name, .function = g };
+    }
+
+    qsort(s->exports, s->exportCount, sizeof(Export), compareExports);
+
+    for (size_t i = 1; i < s->exportCount; i++) {
+        if (strcmp(s->exports[i - 1].name, s->exports[i].name) == 0) {
+            linkError(s->linker, "duplicate export '%s'", s->exports[i].name);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// maps a CALL operand of 'object' to a global function, through the exports for imports
+static bool resolveCall(LinkState *s, size_t object, size_t operand, size_t *global) {
+    const Program *program = &s->linker->objects[object];
+
+    if (operand < program->functions.count) {
+        *global = s->bases[object] + operand;
+        return true;
+    }
+
+    size_t importIndex = operand - program->functions.count;
+    if (importIndex >= program->imports.count) {
+        linkError(s->linker, "call to a function that is neither defined nor declared in '%s'",
+                  program->functions.count > 0 ? program->functions.entries[0].name : "?");
+        return false;
+    }
+
+    const Function *import = &program->imports.entries[importIndex];
+    Export key = { .name = import->name };
+    const Export *found = bsearch(&key, s->exports, s->exportCount, sizeof(Export), compareExports);
+    if (!found) {
+        linkError(s->linker, "unresolved import '%s'", import->name);
+        return false;
+    }
+
+    if (!sameSignature(import, globalFunction(s, found->function))) {
+        linkError(s->linker, "'%s' is declared with a different signature than it is defined with",
+                  import->name);
+        return false;
+    }
+
+    *global = found->function;
+    return true;
+}
+
+static bool findEntry(LinkState *s, size_t *entry) {
+    size_t count = 0;
+
+    for (size_t g = 0; g < s->functionCount; g++) {
+        if (strcmp(globalFunction(s, g)->name, "main") == 0) {
+            *entry = g;
+            count++;
+        }
+    }
+
+    if (count == 0) linkError(s->linker, "no '%s' function", "main");
+    if (count > 1) linkError(s->linker, "multiple definitions of '%s'", "main");
+
+    return count == 1;
+}
+
+// marks everything reachable from 'main' through CALL relocations
+static bool markLive(LinkState *s, size_t entry) {
+    s->live = alloc((s->functionCount + 1) * sizeof(bool));
+    memset(s->live, 0, (s->functionCount + 1) * sizeof(bool));
+
+    size_t *worklist = alloc((s->functionCount + 1) * sizeof(size_t));
+    size_t pending = 0;
+
+    s->live[entry] = true;
+    worklist[pending++] = entry;
+
+    bool ok = true;
+    while (ok && pending > 0) {
+        size_t g = worklist[--pending];
+        size_t object = s->owners[g];
+        const Program *program = &s->linker->objects[object];
+
+        for (size_t r = s->relocationStarts[g]; r < s->relocationEnds[g]; r++) {
+            Relocation relocation = s->relocations[object][r];
+            if (relocation.kind != RELOC_CALL) continue;
+
+            size_t callee = 0;
+            if (!resolveCall(s, object, program->code[relocation.offset], &callee)) {
+                ok = false;
+                break;
+            }
+            if (!s->live[callee]) {
+                s->live[callee] = true;
+                worklist[pending++] = callee;
+            }
+        }
+    }
+
+    FREE_ALLOC(worklist);
+    return ok;
+}
+
+static Function copyFunction(const Function *fn, size_t address) {
+    Function copy = *fn;
+    copy.name = strdup(fn->name);
+    copy.address = address;
+    copy.validated = true;
+    copy.paramTypes = alloc((fn->arity + 1) * sizeof(ValueType));
+    memcpy(copy.paramTypes, fn->paramTypes, fn->arity * sizeof(ValueType));
+    assertAlloc(copy.name);
+
+    return copy;
+}
+
+static void allocateProgram(Program *out, size_t length, size_t constants, size_t functions,
+                            size_t relocations) {
+    *out = (Program){
+        .code = alloc((length + 1) * sizeof(AvmInstruction)),
+        .capacity = length + 1,
+        .constants = {
+            .values = alloc((constants + 1) * sizeof(Object)),
+            .capacity = constants + 1,
+        },
+        .functions = {
+            .entries = alloc((functions + 1) * sizeof(Function)),
+            .capacity = functions + 1,
+        },
+        .imports = {
+            .entries = alloc(sizeof(Function)),
+            .capacity = 1,
+        },
+        .relocations = {
+            .entries = alloc((relocations + 1) * sizeof(Relocation)),
+            .capacity = relocations + 1,
+        },
+    };
+}
+
+// copies the live functions in their original order, rewriting every relocated operand
+static bool emitProgram(LinkState *s) {
+    Linker *l = s->linker;
+    size_t length = 0, constants = 0, functions = 0, relocations = 0;
+
+    s->newIndices = alloc((s->functionCount + 1) * sizeof(size_t));
+    for (size_t g = 0; g < s->functionCount; g++) {
+        if (!s->live[g]) continue;
+
+        const Function *fn = globalFunction(s, g);
+        const Program *object = &l->objects[s->owners[g]];
+        size_t next = g + 1 < s->functionCount && s->owners[g + 1] == s->owners[g]
+            ? globalFunction(s, g + 1)->address : object->length;
+
+        s->newIndices[g] = functions++;
+        length += next - fn->address;
+        relocations += s->relocationEnds[g] - s->relocationStarts[g];
+    }
+
+    s->constantIndices = alloc((l->objectCount + 1) * sizeof(size_t *));
+    for (size_t i = 0; i < l->objectCount; i++) {
+        size_t count = l->objects[i].constants.count;
+        s->constantIndices[i] = alloc((count + 1) * sizeof(size_t));
+        for (size_t c = 0; c < count; c++) s->constantIndices[i][c] = SIZE_MAX;
+        constants += count;
+    }
+
+    Program *out = &l->program;
+    allocateProgram(out, length, constants, functions, relocations);
+
+    for (size_t g = 0; g < s->functionCount; g++) {
+        if (!s->live[g]) continue;
+
+        size_t objectIndex = s->owners[g];
+        const Program *object = &l->objects[objectIndex];
+        const Function *fn = globalFunction(s, g);
+        size_t next = g + 1 < s->functionCount && s->owners[g + 1] == objectIndex
+            ? globalFunction(s, g + 1)->address : object->length;
+
+        size_t address = out->length;
+        memcpy(out->code + address, object->code + fn->address,
+               (next - fn->address) * sizeof(AvmInstruction));
+        out->length += next - fn->address;
+        out->functions.entries[out->functions.count++] = copyFunction(fn, address);
+        copyLines(&out->lines, &object->lines, fn->address, next, address, 0);
+
+        for (size_t r = s->relocationStarts[g]; r < s->relocationEnds[g]; r++) {
+            Relocation relocation = s->relocations[objectIndex][r];
+            size_t operand = object->code[relocation.offset];
+            size_t offset = address + relocation.offset - fn->address;
+
+            if (relocation.kind == RELOC_CALL) {
+                size_t callee = 0;
+                if (!resolveCall(s, objectIndex, operand, &callee)) return false;
+                out->code[offset] = s->newIndices[callee];
+            } else {
+                if (operand >= object->constants.count) {
+                    linkError(l, "constant index out of range in '%s'", fn->name);
+                    return false;
+                }
+
+                size_t *mapped = &s->constantIndices[objectIndex][operand];
+                if (*mapped == SIZE_MAX) {
+                    *mapped = out->constants.count;
+                    out->constants.values[out->constants.count++] = object->constants.values[operand];
+                }
+                out->code[offset] = *mapped;
+            }
+
+            out->relocations.entries[out->relocations.count++] = (Relocation){
+                .offset = offset,
+                .kind = relocation.kind,
+            };
+        }
+    }
+
+    l->droppedFunctions = s->functionCount - functions;
+    return true;
+}
+
+static void freeLinkState(LinkState *s) {
+    for (size_t i = 0; i < s->linker->objectCount; i++) {
+        if (s->relocations) FREE_ALLOC(s->relocations[i]);
+        if (s->constantIndices) FREE_ALLOC(s->constantIndices[i]);
+    }
+
+    FREE_ALLOC(s->relocations);
+    FREE_ALLOC(s->constantIndices);
+    FREE_ALLOC(s->bases);
+    FREE_ALLOC(s->owners);
+    FREE_ALLOC(s->relocationStarts);
+    FREE_ALLOC(s->relocationEnds);
+    FREE_ALLOC(s->exports);
+    FREE_ALLOC(s->live);
+    FREE_ALLOC(s->newIndices);
+}
+
+void linkObjects(Linker *l) {
+    if (!l) return;
+
+    LinkState state = { .linker = l };
+    size_t entry = 0;
+
+    bool ok = layoutObjects(&state) && collectExports(&state) && findEntry(&state, &entry) &&
+              markLive(&state, entry) && emitProgram(&state);
+    if (!ok) l->hadError = true;
+
+    freeLinkState(&state);
+}
\ No newline at end of file
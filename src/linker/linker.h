@@ -0,0 +1,29 @@
+#ifndef linker_h
+#define linker_h
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "../assembler/assembler.h"
+
+typedef struct {
+    const Program *objects;
+    size_t objectCount;
+
+    // the merged program, owned by the caller once linking succeeds
+    Program program;
+
+    // functions dropped because nothing reachable from 'main' calls them
+    size_t droppedFunctions;
+    bool hadError;
+} Linker;
+
+Linker newLinker(const Program *objects, size_t objectCount);
+
+// merges the objects into one program. imports are resolved against the
+// exports of the other objects, and only functions reachable from 'main'
+// and the constants they use are kept
+void linkObjects(Linker *linker);
+void freeLinker(Linker *linker);
+
+#endif
\ No newline at end of file
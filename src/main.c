@@ -1,18 +1,315 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
 
 #include "runtime/runtime.h"
+#include "image/image.h"
+#include "cache/cache.h"
+#include "server/server.h"
+#include "pgo/pgo.h"
+#include "trace/trace.h"
+#include "counters/counters.h"
+#include "util/alloc.h"
 
-int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        fprintf(stderr, "usage: %s <source-file>\n", argv[0]);
+static void usage(const char *program) {
+    fprintf(stderr, "usage: %s [--debug] [--stack-limit=N] [--call-depth=N] [--bench=N] [--threads=N] [--workers=N] [--nursery-size=N] [--heap-limit=N] [--osr-threshold=N] [--no-osr] [--stats] [--profile] [--profile-generate] [--profile-use=<file>] [--trace=<file>] [--counters] [--no-cache] [--cache-size=N] [--lazy] [--no-server] <source-file>\n", program);
+    fprintf(stderr, "       %s build [--native] [--strip] [--profile-use=<file>] [--debug] [-o <output>] <source-file>\n", program);
+    fprintf(stderr, "       %s link [-o <output>] <object-file>...\n", program);
+    fprintf(stderr, "       %s serve\n", program);
+}
+
+// false when 'arg' is not 'flag', an invalid value clears 'valid' rather than
+// exiting, as the server parses its requests in-process. values run from 1 to 'max'
+static bool parseLimit(const char *arg, const char *flag, size_t max, size_t *out, bool *valid) {
+    size_t length = strlen(flag);
+    if (strncmp(arg, flag, length) != 0) return false;
+
+    char *end = NULL;
+    errno = 0;
+    unsigned long long value = strtoull(arg + length, &end, 10);
+    if (*end != '\0' || arg[length] == '-' || errno == ERANGE || value == 0 || value > max) {
+        fprintf(stderr, "invalid value for %.*s\n", (int)length - 1, flag);
+        *valid = false;
+        return true;
+    }
+
+    *out = (size_t)value;
+    return true;
+}
+
+// outputs are named after the source file, without its directory and with 'extension' swapped in
+static char *defaultOutput(const char *path, const char *extension) {
+    const char *name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+
+    size_t length = strlen(name);
+    const char *dot = strrchr(name, '.');
+    if (dot && dot != name) length = dot - name;
+
+    char *output = alloc(length + strlen(extension) + 1);
+    memcpy(output, name, length);
+    strcpy(output + length, extension);
+
+    return output;
+}
+
+static int buildCommand(int argc, char *argv[]) {
+    const char *path = NULL;
+    const char *output = NULL;
+    bool debug = false;
+    bool native = false;
+    bool strip = false;
+    const char *profileUse = NULL;
+
+    for (int i = 2; i < argc; i++) {
+        const char *arg = argv[i];
+
+        if (strcmp(arg, "--native") == 0) {
+            native = true;
+        } else if (strcmp(arg, "--strip") == 0) {
+            strip = true;
+        } else if (strncmp(arg, "--profile-use=", 14) == 0) {
+            profileUse = arg + 14;
+        } else if (strcmp(arg, "--debug") == 0) {
+            debug = true;
+        } else if (strcmp(arg, "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (arg[0] == '-') {
+            fprintf(stderr, "unknown option: %s\n", arg);
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        } else {
+            path = arg;
+        }
+    }
+
+    if (!path) {
+        usage(argv[0]);
         return EXIT_FAILURE;
     }
 
-    Runtime aster = newRuntime(argv[1], false);
-    run(&aster);
+    char *defaultName = output ? NULL : defaultOutput(path, native ? "" : IMAGE_EXTENSION);
 
+    Runtime aster = newRuntime(path, debug);
+    aster.strip = strip;
+    aster.profileUse = profileUse;
+    const char *target = output ? output : defaultName;
+    bool built = native ? buildNative(&aster, target) : buildImage(&aster, target);
     freeRuntime(&aster);
 
-    return EXIT_SUCCESS;
+    FREE_ALLOC(defaultName);
+
+    return built ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int linkCommand(int argc, char *argv[]) {
+    const char *output = "out" IMAGE_EXTENSION;
+    const char **paths = alloc(argc * sizeof(char *));
+    size_t count = 0;
+
+    for (int i = 2; i < argc; i++) {
+        const char *arg = argv[i];
+
+        if (strcmp(arg, "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (arg[0] == '-') {
+            fprintf(stderr, "unknown option: %s\n", arg);
+            usage(argv[0]);
+            FREE_ALLOC(paths);
+            return EXIT_FAILURE;
+        } else {
+            paths[count++] = arg;
+        }
+    }
+
+    if (count == 0) {
+        usage(argv[0]);
+        FREE_ALLOC(paths);
+        return EXIT_FAILURE;
+    }
+
+    bool linked = linkImages(paths, count, output);
+    FREE_ALLOC(paths);
+
+    return linked ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// runs a source file or image, with 'warm' set when the server is running it
+static int runCommand(int argc, char *argv[], WarmCache *warm) {
+    const char *path = NULL;
+    bool debug = false;
+    AvmConfig limits = defaultAvmConfig();
+    size_t benchRuns = 0;
+    size_t threads = 0;
+    size_t cacheLimit = CACHE_SIZE_LIMIT;
+    bool useCache = true;
+    bool stats = false;
+    bool lazy = false;
+    bool profile = false;
+    bool profileGenerate = false;
+    const char *profileUse = NULL;
+    const char *tracePath = NULL;
+    bool counters = false;
+    bool valid = true;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+
+        if (strcmp(arg, "--debug") == 0) {
+            debug = true;
+        } else if (parseLimit(arg, "--stack-limit=", AVM_MAX_STACK_LIMIT, &limits.stackLimit, &valid)) {
+            continue;
+        } else if (parseLimit(arg, "--call-depth=", AVM_MAX_STACK_LIMIT, &limits.callStackLimit, &valid)) {
+            continue;
+        } else if (parseLimit(arg, "--bench=", SIZE_MAX, &benchRuns, &valid)) {
+            continue;
+        } else if (parseLimit(arg, "--threads=", SIZE_MAX, &threads, &valid)) {
+            continue;
+        } else if (parseLimit(arg, "--workers=", SIZE_MAX, &limits.workers, &valid)) {
+            continue;
+        } else if (parseLimit(arg, "--nursery-size=", SIZE_MAX, &limits.nurserySize, &valid)) {
+            continue;
+        } else if (parseLimit(arg, "--heap-limit=", SIZE_MAX, &limits.heapLimit, &valid)) {
+            continue;
+        } else if (parseLimit(arg, "--osr-threshold=", SIZE_MAX, &limits.osrThreshold, &valid)) {
+            continue;
+        } else if (strcmp(arg, "--no-osr") == 0) {
+            limits.osrThreshold = SIZE_MAX;
+        } else if (parseLimit(arg, "--cache-size=", SIZE_MAX, &cacheLimit, &valid)) {
+            continue;
+        } else if (strcmp(arg, "--no-cache") == 0) {
+            useCache = false;
+        } else if (strcmp(arg, "--stats") == 0) {
+            stats = true;
+        } else if (strcmp(arg, "--lazy") == 0) {
+            lazy = true;
+        } else if (strcmp(arg, "--profile") == 0) {
+            profile = true;
+        } else if (strcmp(arg, "--profile-generate") == 0) {
+            profileGenerate = true;
+        } else if (strncmp(arg, "--profile-use=", 14) == 0) {
+            profileUse = arg + 14;
+        } else if (strncmp(arg, "--trace=", 8) == 0) {
+            tracePath = arg + 8;
+        } else if (strcmp(arg, "--counters") == 0) {
+            counters = true;
+        } else if (strcmp(arg, "--no-server") == 0) {
+            continue;
+        } else if (arg[0] == '-' && arg[1] == '-') {
+            fprintf(stderr, "unknown option: %s\n", arg);
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        } else {
+            path = arg;
+        }
+    }
+
+    if (!valid) return EXIT_FAILURE;
+    if (!path) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (profile && threads > 0) {
+        fprintf(stderr, "--profile runs a single vm and cannot be combined with --threads\n");
+        return EXIT_FAILURE;
+    }
+    if (profileGenerate && (threads > 0 || lazy)) {
+        fprintf(stderr, "--profile-generate counts a single vm running the whole program and cannot be combined with --threads or --lazy\n");
+        return EXIT_FAILURE;
+    }
+    // counts are taken on the program as it compiles without a profile
+    if (profileUse && (profileGenerate || lazy || isImagePath(path))) {
+        fprintf(stderr, "--profile-use lays out a source file as it is compiled and cannot be combined with --profile-generate or --lazy, or run an image\n");
+        return EXIT_FAILURE;
+    }
+
+    // the folded stacks are named after the source, in the working directory
+    char *profilePath = profile ? defaultOutput(path, ".folded") : NULL;
+    char *countsPath = profileGenerate ? defaultOutput(path, PGO_EXTENSION) : NULL;
+
+    Runtime aster = newRuntime(path, debug);
+    aster.limits = limits;
+    aster.benchRuns = benchRuns;
+    aster.threads = threads;
+    aster.useCache = useCache;
+    aster.cacheLimit = cacheLimit;
+    aster.stats = stats;
+    aster.lazy = lazy;
+    aster.profile = profilePath;
+    aster.profileGenerate = countsPath;
+    aster.profileUse = profileUse;
+    aster.warm = warm;
+
+    // without counters the run goes on, only the report is left out
+    bool counting = counters && startCounters();
+    if (tracePath) startTrace();
+    bool ran = run(&aster);
+    if (tracePath) stopTrace(tracePath);
+    if (counting) stopCounters(stderr);
+
+    freeRuntime(&aster);
+    if (profilePath) FREE_ALLOC(profilePath);
+    if (countsPath) FREE_ALLOC(countsPath);
+
+    return ran ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int serveRequest(int argc, char *argv[], void *context) {
+    return runCommand(argc, argv, context);
+}
+
+// keeps compiled programs and their vms warm between runs forwarded by clients
+static int serveCommand(int argc, char *argv[]) {
+    if (argc > 2) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    char *socketPath = serverSocketPath();
+    if (!socketPath) return EXIT_FAILURE;
+    WarmCache warm = newWarmCache();
+
+    bool served = serve(socketPath, serveRequest, &warm);
+
+    freeWarmCache(&warm);
+    FREE_ALLOC(socketPath);
+
+    return served ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// any argument starting with 'flag', so "--profile" also finds "--profile-use=..."
+static bool hasFlag(int argc, char *argv[], const char *flag) {
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], flag, strlen(flag)) == 0) return true;
+    }
+
+    return false;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "build") == 0) {
+        return buildCommand(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "link") == 0) {
+        return linkCommand(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "serve") == 0) {
+        return serveCommand(argc, argv);
+    }
+
+    // runs go to a server when one is listening, and run here otherwise.
+    // a profile's timer and output, a trace and counters belong to the process that asked for them
+    if (!hasFlag(argc, argv, "--no-server") && !hasFlag(argc, argv, "--profile") && !hasFlag(argc, argv, "--trace") &&
+        !hasFlag(argc, argv, "--counters")) {
+        char *socketPath = serverSocketPath();
+        int status = EXIT_SUCCESS;
+        bool forwarded = socketPath && forwardToServer(socketPath, argc, argv, &status);
+        FREE_ALLOC(socketPath);
+
+        if (forwarded) return status;
+    }
+
+    return runCommand(argc, argv, NULL);
 }
\ No newline at end of file
@@ -0,0 +1,705 @@
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "x86_64.h"
+#include "../util/alloc.h"
+
+// the shallowest operand stack slots live in callee-saved registers so they
+// survive calls, deeper slots spill into the frame below the locals
+#define STACK_REG_COUNT 5
+static const char *stackRegs[STACK_REG_COUNT] = {"%rbx", "%r12", "%r13", "%r14", "%r15"};
+static const char *stackRegs32[STACK_REG_COUNT] = {"%ebx", "%r12d", "%r13d", "%r14d", "%r15d"};
+
+#define INT_ARG_COUNT 6
+#define FLOAT_ARG_COUNT 8
+static const char *intArgRegs[INT_ARG_COUNT] = {"%rdi", "%rsi", "%rdx", "%rcx", "%r8", "%r9"};
+
+NativeBackend newNativeBackend(const Program *program, FILE *out) {
+    NativeBackend n = {
+        .program = program,
+        .out = out,
+        .depths = alloc((program->length + 1) * sizeof(long)),
+        .targets = alloc((program->length + 1) * sizeof(bool)),
+        .stackTypes = NULL,
+        .localTypes = NULL,
+        .hadError = false,
+    };
+
+    for (size_t i = 0; i < program->length; i++) {
+        n.depths[i] = -1;
+        n.targets[i] = false;
+    }
+
+    return n;
+}
+
+void freeNativeBackend(NativeBackend *n) {
+    if (!n) return;
+
+    FREE_ALLOC(n->depths);
+    FREE_ALLOC(n->targets);
+    FREE_ALLOC(n->stackTypes);
+    FREE_ALLOC(n->localTypes);
+}
+
+static void nativeError(NativeBackend *n, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+
+    fprintf(stderr, "native error in '%s': ", n->program->functions.entries[n->function].name);
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+
+    va_end(args);
+    n->hadError = true;
+}
+
+static void emit(NativeBackend *n, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+
+    fprintf(n->out, "\t");
+    vfprintf(n->out, format, args);
+    fprintf(n->out, "\n");
+
+    va_end(args);
+}
+
+static const Function *currentFunction(NativeBackend *n) {
+    return &n->program->functions.entries[n->function];
+}
+
+static long localOffset(NativeBackend *n, size_t slot) {
+    return -(long)(8 * (n->savedCount + 1 + slot));
+}
+
+// writes the location of operand stack slot 'depth' into 'buffer'
+static const char *slotOperand(NativeBackend *n, size_t depth, char *buffer, size_t size) {
+    if (depth < STACK_REG_COUNT) return stackRegs[depth];
+
+    size_t spill = currentFunction(n)->localCount + depth - STACK_REG_COUNT;
+    snprintf(buffer, size, "%ld(%%rbp)", localOffset(n, spill));
+    return buffer;
+}
+
+static void loadSlot(NativeBackend *n, size_t depth, const char *reg) {
+    char buffer[32];
+    emit(n, "movq %s, %s", slotOperand(n, depth, buffer, sizeof(buffer)), reg);
+}
+
+static void storeSlot(NativeBackend *n, size_t depth, const char *reg) {
+    char buffer[32];
+    emit(n, "movq %s, %s", reg, slotOperand(n, depth, buffer, sizeof(buffer)));
+}
+
+static bool isSupportedType(ValueType type) {
+    return type == TYPE_I32 || type == TYPE_I64 || type == TYPE_F64 || type == TYPE_BOOL;
+}
+
+static bool checkSignature(NativeBackend *n, const Function *fn) {
+    size_t ints = 0, floats = 0;
+
+    for (size_t i = 0; i < fn->arity; i++) {
+        if (!isSupportedType(fn->paramTypes[i])) {
+            nativeError(n, "parameter of type '%s' in call to '%s' is not supported",
+                        typeName(fn->paramTypes[i]), fn->name);
+            return false;
+        }
+        if (fn->paramTypes[i] == TYPE_F64) floats++;
+        else ints++;
+    }
+
+    if (ints > INT_ARG_COUNT || floats > FLOAT_ARG_COUNT) {
+        nativeError(n, "'%s' takes more arguments than fit in registers", fn->name);
+        return false;
+    }
+    if (!isSupportedType(fn->returnType)) {
+        nativeError(n, "return type '%s' of '%s' is not supported",
+                    typeName(fn->returnType), fn->name);
+        return false;
+    }
+
+    return true;
+}
+
+static void recordDepth(NativeBackend *n, size_t pc, long depth) {
+    if (n->depths[pc] >= 0 && n->depths[pc] != depth) {
+        nativeError(n, "inconsistent stack depth at %zu", pc);
+        return;
+    }
+    n->depths[pc] = depth;
+}
+
+// walks the function in address order, recording the operand stack depth at
+// each instruction and the deepest slot the frame has to hold
+static void analyseFunction(NativeBackend *n, size_t start, size_t end) {
+    const Program *p = n->program;
+    long depth = 0;
+    bool reachable = true;
+    n->maxDepth = 0;
+
+    for (size_t pc = start; pc < end && !n->hadError; pc += 1 + operandCount(p->code[pc])) {
+        AvmInstruction instr = p->code[pc];
+        size_t next = pc + 1 + operandCount(instr);
+
+        // code after a return or jump is only lowered if a jump lands on it
+        if (!reachable) {
+            if (n->depths[pc] < 0) continue;
+            depth = n->depths[pc];
+            reachable = true;
+        }
+        recordDepth(n, pc, depth);
+
+        switch (instr) {
+            case INSTR_PUSH_CONST:
+            case INSTR_PUSH_I64:
+            case INSTR_LOAD_LOCAL: depth++; break;
+            case INSTR_STORE_LOCAL: depth--; break;
+            case INSTR_EXEC:
+            case INSTR_PRINT: break;
+            case INSTR_HALT:
+            case INSTR_RET: reachable = false; break;
+            case INSTR_CALL: {
+                const Function *callee = &p->functions.entries[p->code[pc + 1]];
+                if (!checkSignature(n, callee)) return;
+                depth = depth - (long)callee->arity + 1;
+                break;
+            }
+            case INSTR_JMP: {
+                size_t target = next + (int32_t)p->code[pc + 1];
+                if (target < start || target >= end) {
+                    nativeError(n, "jump target outside of function at %zu", pc);
+                    return;
+                }
+                recordDepth(n, target, depth);
+                n->targets[target] = true;
+                reachable = false;
+                break;
+            }
+            case INSTR_JMP_IF_FALSE: {
+                size_t target = next + (int32_t)p->code[pc + 1];
+                if (target < start || target >= end) {
+                    nativeError(n, "jump target outside of function at %zu", pc);
+                    return;
+                }
+                depth--;
+                recordDepth(n, target, depth);
+                n->targets[target] = true;
+                break;
+            }
+            case INSTR_POP: depth--; break;
+            case INSTR_SPAWN:
+            case INSTR_CHANNEL:
+            case INSTR_SEND:
+            case INSTR_RECV:
+            case INSTR_YIELD: {
+                // fibers need the vm's scheduler
+                nativeError(n, "fibers and channels are not supported");
+                return;
+            }
+            case INSTR_ARRAY_NEW:
+            case INSTR_ARRAY_GET:
+            case INSTR_ARRAY_SET:
+            case INSTR_ARRAY_LEN:
+            case INSTR_ARRAY_FILL:
+            case INSTR_ARRAY_COPY:
+            case INSTR_ARRAY_ADD:
+            case INSTR_ARRAY_MUL:
+            case INSTR_ARRAY_DOT:
+            case INSTR_ARRAY_SUM:
+            case INSTR_ARRAY_MIN:
+            case INSTR_ARRAY_MAX: {
+                // arrays live on the vm's heap
+                nativeError(n, "arrays are not supported");
+                return;
+            }
+            case INSTR_PARALLEL:
+            case INSTR_PARALLEL_NEXT: {
+                // its chunks run as fibers on the vm's scheduler
+                nativeError(n, "parallel for is not supported");
+                return;
+            }
+            default: {
+                if (instr >= INSTR_ADD) {
+                    nativeError(n, "operations on 'any' are not supported");
+                    return;
+                }
+                depth--;
+                break;
+            }
+        }
+
+        if (depth < 0 || (instr == INSTR_RET && depth < 1)) {
+            nativeError(n, "stack underflow at %zu", pc);
+            return;
+        }
+        if ((size_t)depth > n->maxDepth) n->maxDepth = depth;
+    }
+}
+
+static ValueType constantType(Object constant) {
+    switch (objectType(constant)) {
+        case OBJ_I32: return TYPE_I32;
+        case OBJ_I64: return TYPE_I64;
+        case OBJ_F64: return TYPE_F64;
+        case OBJ_BOOL: return TYPE_BOOL;
+        default: return TYPE_UNKNOWN;
+    }
+}
+
+// a value's bits as a stack slot holds them
+static void emitPushValue(NativeBackend *n, size_t depth, ValueType type, int64_t value) {
+    n->stackTypes[depth] = type;
+
+    if (value >= INT32_MIN && value <= INT32_MAX) {
+        char buffer[32];
+        emit(n, "movq $%lld, %s", (long long)value, slotOperand(n, depth, buffer, sizeof(buffer)));
+        return;
+    }
+
+    emit(n, "movabsq $%lld, %%rax", (long long)value);
+    storeSlot(n, depth, "%rax");
+}
+
+static void emitPushConst(NativeBackend *n, size_t depth, Object constant) {
+    ValueType type = constantType(constant);
+
+    int64_t value = 0;
+    switch (type) {
+        case TYPE_I32: value = asI32(constant); break;
+        case TYPE_I64: value = asI64(constant); break;
+        case TYPE_BOOL: value = asBool(constant); break;
+        case TYPE_F64: {
+            double f = asF64(constant);
+            memcpy(&value, &f, sizeof(value));
+            break;
+        }
+        default: {
+            nativeError(n, "unsupported constant");
+            return;
+        }
+    }
+
+    emitPushValue(n, depth, type, value);
+}
+
+static void emitLocal(NativeBackend *n, AvmInstruction instr, size_t depth, size_t slot) {
+    char local[32];
+    snprintf(local, sizeof(local), "%ld(%%rbp)", localOffset(n, slot));
+
+    if (instr == INSTR_LOAD_LOCAL) {
+        n->stackTypes[depth] = n->localTypes[slot];
+        if (depth < STACK_REG_COUNT) {
+            emit(n, "movq %s, %s", local, stackRegs[depth]);
+            return;
+        }
+        emit(n, "movq %s, %%rax", local);
+        storeSlot(n, depth, "%rax");
+        return;
+    }
+
+    n->localTypes[slot] = n->stackTypes[depth - 1];
+    if (depth - 1 < STACK_REG_COUNT) {
+        emit(n, "movq %s, %s", stackRegs[depth - 1], local);
+        return;
+    }
+    loadSlot(n, depth - 1, "%rax");
+    emit(n, "movq %%rax, %s", local);
+}
+
+static void emitDivision(NativeBackend *n, bool wide, size_t left, size_t right) {
+    const char *suffix = wide ? "q" : "l";
+
+    loadSlot(n, right, "%rcx");
+    emit(n, "test%s %s, %s", suffix, wide ? "%rcx" : "%ecx", wide ? "%rcx" : "%ecx");
+    emit(n, "je aster_division_by_zero");
+    loadSlot(n, left, "%rax");
+
+    // idiv traps on the most negative value divided by -1, negation wraps instead
+    emit(n, "cmp%s $-1, %s", suffix, wide ? "%rcx" : "%ecx");
+    emit(n, "jne 1f");
+    emit(n, "neg%s %s", suffix, wide ? "%rax" : "%eax");
+    emit(n, "jmp 2f");
+    fprintf(n->out, "1:\n");
+    emit(n, wide ? "cqto" : "cltd");
+    emit(n, "idiv%s %s", suffix, wide ? "%rcx" : "%ecx");
+    fprintf(n->out, "2:\n");
+}
+
+static const char *integerCondition(BinaryOp op) {
+    switch (op) {
+        case BIN_LT: return "l";
+        case BIN_LE: return "le";
+        case BIN_GT: return "g";
+        case BIN_GE: return "ge";
+        case BIN_EQ: return "e";
+        default: return "ne";
+    }
+}
+
+static void emitIntegerBinary(NativeBackend *n, BinaryOp op, bool wide, size_t left, size_t right) {
+    char buffer[32];
+    const char *rhs = slotOperand(n, right, buffer, sizeof(buffer));
+    const char *suffix = wide ? "q" : "l";
+    const char *acc = wide ? "%rax" : "%eax";
+
+    // a 32-bit memory operand reads the low half of the slot
+    if (!wide && right < STACK_REG_COUNT) rhs = stackRegs32[right];
+
+    switch (op) {
+        case BIN_ADD:
+        case BIN_SUB:
+        case BIN_MUL: {
+            const char *mnemonic = op == BIN_ADD ? "add" : op == BIN_SUB ? "sub" : "imul";
+            loadSlot(n, left, "%rax");
+            emit(n, "%s%s %s, %s", mnemonic, suffix, rhs, acc);
+            break;
+        }
+        case BIN_DIV: {
+            emitDivision(n, wide, left, right);
+            break;
+        }
+        default: {
+            loadSlot(n, left, "%rax");
+            emit(n, "cmp%s %s, %s", suffix, rhs, acc);
+            emit(n, "set%s %%al", integerCondition(op));
+            emit(n, "movzbl %%al, %%eax");
+            n->stackTypes[left] = TYPE_BOOL;
+            storeSlot(n, left, "%rax");
+            return;
+        }
+    }
+
+    // i32 values are kept sign-extended so they can be passed and stored as 64 bits
+    if (!wide) emit(n, "movslq %%eax, %%rax");
+    storeSlot(n, left, "%rax");
+}
+
+static void emitFloatBinary(NativeBackend *n, BinaryOp op, size_t left, size_t right) {
+    loadSlot(n, left, "%xmm0");
+    loadSlot(n, right, "%xmm1");
+
+    switch (op) {
+        case BIN_ADD: emit(n, "addsd %%xmm1, %%xmm0"); break;
+        case BIN_SUB: emit(n, "subsd %%xmm1, %%xmm0"); break;
+        case BIN_MUL: emit(n, "mulsd %%xmm1, %%xmm0"); break;
+        case BIN_DIV: emit(n, "divsd %%xmm1, %%xmm0"); break;
+        default: {
+            // unordered compares set CF and ZF, so only 'above' conditions are NaN-safe
+            switch (op) {
+                case BIN_LT: emit(n, "ucomisd %%xmm0, %%xmm1"); emit(n, "seta %%al"); break;
+                case BIN_LE: emit(n, "ucomisd %%xmm0, %%xmm1"); emit(n, "setae %%al"); break;
+                case BIN_GT: emit(n, "ucomisd %%xmm1, %%xmm0"); emit(n, "seta %%al"); break;
+                case BIN_GE: emit(n, "ucomisd %%xmm1, %%xmm0"); emit(n, "setae %%al"); break;
+                case BIN_EQ: {
+                    emit(n, "ucomisd %%xmm1, %%xmm0");
+                    emit(n, "sete %%al");
+                    emit(n, "setnp %%cl");
+                    emit(n, "andb %%cl, %%al");
+                    break;
+                }
+                default: {
+                    emit(n, "ucomisd %%xmm1, %%xmm0");
+                    emit(n, "setne %%al");
+                    emit(n, "setp %%cl");
+                    emit(n, "orb %%cl, %%al");
+                    break;
+                }
+            }
+            emit(n, "movzbl %%al, %%eax");
+            n->stackTypes[left] = TYPE_BOOL;
+            storeSlot(n, left, "%rax");
+            return;
+        }
+    }
+
+    storeSlot(n, left, "%xmm0");
+}
+
+static void emitBinary(NativeBackend *n, AvmInstruction instr, size_t depth) {
+    size_t left = depth - 2, right = depth - 1;
+
+    if (instr == INSTR_EQ_BOOL || instr == INSTR_NE_BOOL) {
+        char buffer[32];
+        loadSlot(n, left, "%rax");
+        emit(n, "cmpq %s, %%rax", slotOperand(n, right, buffer, sizeof(buffer)));
+        emit(n, "set%s %%al", instr == INSTR_EQ_BOOL ? "e" : "ne");
+        emit(n, "movzbl %%al, %%eax");
+        storeSlot(n, left, "%rax");
+        return;
+    }
+
+    size_t index = instr - INSTR_ADD_I32;
+    BinaryOp op = index % BIN_OP_COUNT;
+    ValueType type = (ValueType[]){TYPE_I32, TYPE_I64, TYPE_F64}[index / BIN_OP_COUNT];
+
+    n->stackTypes[left] = type;
+    if (type == TYPE_F64) emitFloatBinary(n, op, left, right);
+    else emitIntegerBinary(n, op, type == TYPE_I64, left, right);
+}
+
+static void emitCall(NativeBackend *n, size_t depth, size_t index) {
+    const Function *callee = &n->program->functions.entries[index];
+    size_t base = depth - callee->arity;
+    size_t ints = 0, floats = 0;
+
+    for (size_t i = 0; i < callee->arity; i++) {
+        if (callee->paramTypes[i] == TYPE_F64) {
+            char reg[8];
+            snprintf(reg, sizeof(reg), "%%xmm%zu", floats++);
+            loadSlot(n, base + i, reg);
+        } else {
+            loadSlot(n, base + i, intArgRegs[ints++]);
+        }
+    }
+
+    emit(n, "call aster_%s", callee->name);
+
+    if (callee->returnType == TYPE_F64) emit(n, "movq %%xmm0, %%rax");
+    n->stackTypes[base] = callee->returnType;
+    storeSlot(n, base, "%rax");
+}
+
+// PRINT peeks at the top of the frame, which is the last local when the operand stack is empty
+static void emitPrint(NativeBackend *n, size_t depth) {
+    char buffer[32];
+    const char *operand = buffer;
+    ValueType type;
+
+    if (depth > 0) {
+        operand = slotOperand(n, depth - 1, buffer, sizeof(buffer));
+        type = n->stackTypes[depth - 1];
+    } else if (currentFunction(n)->localCount > 0) {
+        size_t slot = currentFunction(n)->localCount - 1;
+        snprintf(buffer, sizeof(buffer), "%ld(%%rbp)", localOffset(n, slot));
+        type = n->localTypes[slot];
+    } else {
+        nativeError(n, "stack underflow on PRINT");
+        return;
+    }
+
+    switch (type) {
+        case TYPE_BOOL: {
+            emit(n, "movq %s, %%rax", operand);
+            emit(n, "leaq .Lstr_true(%%rip), %%rdi");
+            emit(n, "leaq .Lstr_false(%%rip), %%rcx");
+            emit(n, "testq %%rax, %%rax");
+            emit(n, "cmove %%rcx, %%rdi");
+            emit(n, "call puts@PLT");
+            return;
+        }
+        case TYPE_F64: {
+            emit(n, "movq %s, %%xmm0", operand);
+            emit(n, "leaq .Lfmt_f64(%%rip), %%rdi");
+            emit(n, "movl $1, %%eax");
+            break;
+        }
+        default: {
+            emit(n, "movq %s, %%rsi", operand);
+            emit(n, "leaq .Lfmt_%s(%%rip), %%rdi", type == TYPE_I64 ? "i64" : "i32");
+            emit(n, "xorl %%eax, %%eax");
+            break;
+        }
+    }
+
+    emit(n, "call printf@PLT");
+}
+
+static void emitEpilogue(NativeBackend *n) {
+    emit(n, "leaq %ld(%%rbp), %%rsp", -(long)(8 * n->savedCount));
+    for (size_t i = n->savedCount; i > 0; i--) {
+        emit(n, "popq %s", stackRegs[i - 1]);
+    }
+    emit(n, "popq %%rbp");
+    emit(n, "ret");
+}
+
+static void emitPrologue(NativeBackend *n, const Function *fn) {
+    fprintf(n->out, "\n\t.type aster_%s, @function\naster_%s:\n", fn->name, fn->name);
+    emit(n, "pushq %%rbp");
+    emit(n, "movq %%rsp, %%rbp");
+
+    for (size_t i = 0; i < n->savedCount; i++) {
+        emit(n, "pushq %s", stackRegs[i]);
+    }
+
+    // locals and spilled slots, keeping calls 16-byte aligned
+    size_t spills = n->maxDepth > STACK_REG_COUNT ? n->maxDepth - STACK_REG_COUNT : 0;
+    size_t frame = 8 * (fn->localCount + spills);
+    if ((frame + 8 * n->savedCount) % 16 != 0) frame += 8;
+    if (frame > 0) emit(n, "subq $%zu, %%rsp", frame);
+
+    size_t ints = 0, floats = 0;
+    for (size_t i = 0; i < fn->arity; i++) {
+        n->localTypes[i] = fn->paramTypes[i];
+        if (fn->paramTypes[i] == TYPE_F64) {
+            emit(n, "movq %%xmm%zu, %ld(%%rbp)", floats++, localOffset(n, i));
+        } else {
+            emit(n, "movq %s, %ld(%%rbp)", intArgRegs[ints++], localOffset(n, i));
+        }
+    }
+
+    for (size_t i = fn->arity; i < fn->localCount; i++) {
+        n->localTypes[i] = TYPE_I32;
+        emit(n, "movq $0, %ld(%%rbp)", localOffset(n, i));
+    }
+}
+
+static void emitFunction(NativeBackend *n, size_t index, size_t end) {
+    const Program *p = n->program;
+    const Function *fn = &p->functions.entries[index];
+    size_t start = fn->address;
+
+    n->function = index;
+    if (!checkSignature(n, fn)) return;
+
+    analyseFunction(n, start, end);
+    if (n->hadError) return;
+
+    n->savedCount = n->maxDepth < STACK_REG_COUNT ? n->maxDepth : STACK_REG_COUNT;
+    n->stackTypes = realloc(n->stackTypes, (n->maxDepth + 1) * sizeof(ValueType));
+    n->localTypes = realloc(n->localTypes, (fn->localCount + 1) * sizeof(ValueType));
+    assertAlloc(n->stackTypes);
+    assertAlloc(n->localTypes);
+
+    emitPrologue(n, fn);
+
+    for (size_t pc = start; pc < end && !n->hadError; pc += 1 + operandCount(p->code[pc])) {
+        long depth = n->depths[pc];
+        if (depth < 0) continue;
+
+        if (n->targets[pc]) fprintf(n->out, ".Lpc%zu:\n", pc);
+
+        AvmInstruction instr = p->code[pc];
+        switch (instr) {
+            case INSTR_PUSH_CONST: emitPushConst(n, depth, p->constants.values[p->code[pc + 1]]); break;
+            case INSTR_PUSH_I64: {
+                uint64_t high = (uint32_t)p->code[pc + 1], low = (uint32_t)p->code[pc + 2];
+                emitPushValue(n, depth, TYPE_I64, (int64_t)(high << 32 | low));
+                break;
+            }
+            case INSTR_LOAD_LOCAL:
+            case INSTR_STORE_LOCAL: emitLocal(n, instr, depth, p->code[pc + 1]); break;
+            case INSTR_EXEC: break;
+            case INSTR_PRINT: emitPrint(n, depth); break;
+            case INSTR_CALL: emitCall(n, depth, p->code[pc + 1]); break;
+            case INSTR_JMP: {
+                size_t target = pc + 2 + (int32_t)p->code[pc + 1];
+                emit(n, "jmp .Lpc%zu", target);
+                break;
+            }
+            case INSTR_JMP_IF_FALSE: {
+                // the verifier leaves the condition's type to run time, here it is
+                // known to be a bool from the comparison that made it
+                size_t target = pc + 2 + (int32_t)p->code[pc + 1];
+                loadSlot(n, depth - 1, "%rax");
+                emit(n, "testq %%rax, %%rax");
+                emit(n, "je .Lpc%zu", target);
+                break;
+            }
+            case INSTR_POP: break;
+            case INSTR_HALT: {
+                emit(n, "leaq .Lstr_halted(%%rip), %%rdi");
+                emit(n, "call puts@PLT");
+                emit(n, "xorl %%edi, %%edi");
+                emit(n, "call exit@PLT");
+                break;
+            }
+            case INSTR_RET: {
+                if (fn->returnType == TYPE_F64) loadSlot(n, depth - 1, "%xmm0");
+                else loadSlot(n, depth - 1, "%rax");
+                emitEpilogue(n);
+                break;
+            }
+            default: emitBinary(n, instr, depth); break;
+        }
+    }
+}
+
+static void emitRuntimeSupport(NativeBackend *n) {
+    fprintf(n->out, "\t.section .rodata\n");
+    fprintf(n->out, ".Lfmt_i32:\n\t.string \"%%d\\n\"\n");
+    fprintf(n->out, ".Lfmt_i64:\n\t.string \"%%lld\\n\"\n");
+    fprintf(n->out, ".Lfmt_f64:\n\t.string \"%%g\\n\"\n");
+    fprintf(n->out, ".Lstr_true:\n\t.string \"true\"\n");
+    fprintf(n->out, ".Lstr_false:\n\t.string \"false\"\n");
+    fprintf(n->out, ".Lstr_halted:\n\t.string \"Program halted.\"\n");
+    fprintf(n->out, ".Lstr_division:\n\t.string \"Division by zero\\n\"\n");
+
+    // reached by a jump from an aligned frame, so calls from here stay aligned
+    fprintf(n->out, "\n\t.text\naster_division_by_zero:\n");
+    emit(n, "movq stderr@GOTPCREL(%%rip), %%rax");
+    emit(n, "movq (%%rax), %%rsi");
+    emit(n, "leaq .Lstr_division(%%rip), %%rdi");
+    emit(n, "call fputs@PLT");
+    emit(n, "movl $1, %%edi");
+    emit(n, "call exit@PLT");
+}
+
+// the C entry point runs 'main' and exits with its result
+static void emitEntry(NativeBackend *n, const Function *entry) {
+    fprintf(n->out, "\n\t.globl main\n\t.type main, @function\nmain:\n");
+    emit(n, "pushq %%rbp");
+    emit(n, "movq %%rsp, %%rbp");
+    emit(n, "call aster_main");
+    if (entry->returnType == TYPE_F64) emit(n, "xorl %%eax, %%eax");
+    emit(n, "popq %%rbp");
+    emit(n, "ret");
+}
+
+void emitNative(NativeBackend *n) {
+    if (!n) return;
+
+    const FunctionTable *functions = &n->program->functions;
+    const Function *entry = NULL;
+    for (size_t i = 0; i < functions->count; i++) {
+        if (strcmp(functions->entries[i].name, "main") == 0) entry = &functions->entries[i];
+    }
+
+    if (!entry || entry->arity != 0) {
+        fprintf(stderr, "native error: no 'main' function without arguments\n");
+        n->hadError = true;
+        return;
+    }
+
+    emitRuntimeSupport(n);
+
+    size_t *ends = alloc((functions->count + 1) * sizeof(size_t));
+    functionExtents(n->program, ends);
+    for (size_t i = 0; i < functions->count && !n->hadError; i++) {
+        emitFunction(n, i, ends[i]);
+    }
+    FREE_ALLOC(ends);
+
+    emitEntry(n, entry);
+    fprintf(n->out, "\n\t.section .note.GNU-stack,\"\",@progbits\n");
+}
+
+bool linkNative(const char *assemblyPath, const char *output) {
+    const char *cc = getenv("CC");
+    if (!cc || cc[0] == '\0') cc = "cc";
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return false;
+    }
+
+    if (pid == 0) {
+        execlp(cc, cc, "-o", output, assemblyPath, (char *)NULL);
+        fprintf(stderr, "native error: failed to run '%s'\n", cc);
+        _exit(127);
+    }
+
+    int status = 0;
+    if (waitpid(pid, &status, 0) < 0) {
+        perror("waitpid");
+        return false;
+    }
+
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
\ No newline at end of file
@@ -0,0 +1,42 @@
+#ifndef x86_64_h
+#define x86_64_h
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "../assembler/assembler.h"
+#include "../parser/types.h"
+
+typedef struct {
+    const Program *program;
+    FILE *out;
+
+    // operand stack depth above the locals at each instruction, -1 where unreachable
+    long *depths;
+    // set for instructions a jump lands on, they get a label
+    bool *targets;
+
+    // static types of the current function's operand stack and local slots
+    ValueType *stackTypes;
+    ValueType *localTypes;
+
+    // layout of the function being lowered
+    size_t function;
+    size_t maxDepth;
+    size_t savedCount;
+
+    bool hadError;
+} NativeBackend;
+
+NativeBackend newNativeBackend(const Program *program, FILE *out);
+void freeNativeBackend(NativeBackend *backend);
+
+// lowers every function of a typed program to x86-64 GNU assembly, operand
+// stack slots map onto callee-saved registers and calls follow System V
+void emitNative(NativeBackend *backend);
+
+// assembles and links with the system C compiler, '$CC' when set
+bool linkNative(const char *assemblyPath, const char *output);
+
+#endif
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include <string.h>
 #include <stdio.h>
+#include <inttypes.h>
 
 #include "../util/alloc.h"
 #include "ast.h"
@@ -7,14 +8,21 @@
 static AstNode *newAstNode(AstNodeType type) {
     AstNode *node = alloc(sizeof(AstNode));
     node->type = type;
+    node->valueType = TYPE_UNKNOWN;
+    node->line = 0;
+    node->column = 0;
 
     return node;
 }
 
-AstNode *newFnNode(const char *name, bool isPublic, const char *returnType, AstBlock block) {
+AstNode *newFnNode(const char *name, bool isPublic, AstParam *params, size_t paramCount,
+                   const char *returnType, AstBlock block) {
     AstNode *node = newAstNode(AST_NODE_FN);
     node->asFn.fnName = strdup(name);
     node->asFn.isPublic = isPublic;
+    node->asFn.isExtern = false;
+    node->asFn.params = params;
+    node->asFn.paramCount = paramCount;
     node->asFn.returnType = strdup(returnType);
     node->asFn.block = block;
 
@@ -39,7 +47,7 @@ AstNode *newBlockNode(AstNode **statements, size_t statementCount) {
     return node;
 }
 
-AstNode *newIntegerNode(int value) {
+AstNode *newIntegerNode(int64_t value) {
     AstNode *node = newAstNode(AST_NODE_INTEGER_LITERAL);
     node->asInt.value = value;
 
@@ -53,27 +61,192 @@ AstNode *newExecNode(uint8_t byte) {
     return node;
 }
 
+AstNode *newLetNode(const char *name, const char *type, AstNode *value) {
+    AstNode *node = newAstNode(AST_NODE_LET);
+    node->asLet.name = strdup(name);
+    node->asLet.type = type ? strdup(type) : NULL;
+    node->asLet.value = value;
+
+    assertAlloc(node->asLet.name);
+    if (type) assertAlloc(node->asLet.type);
+
+    return node;
+}
+
+AstNode *newAssignNode(const char *name, AstNode *value) {
+    AstNode *node = newAstNode(AST_NODE_ASSIGN);
+    node->asAssign.name = strdup(name);
+    node->asAssign.value = value;
+
+    assertAlloc(node->asAssign.name);
+
+    return node;
+}
+
+AstNode *newIdentifierNode(const char *name) {
+    AstNode *node = newAstNode(AST_NODE_IDENTIFIER);
+    node->asIdent.name = strdup(name);
+
+    assertAlloc(node->asIdent.name);
+
+    return node;
+}
+
+AstNode *newCallNode(const char *name, AstNode **args, size_t argCount) {
+    AstNode *node = newAstNode(AST_NODE_CALL);
+    node->asCall.name = strdup(name);
+    node->asCall.args = args;
+    node->asCall.argCount = argCount;
+    node->asCall.intrinsic = NULL;
+
+    assertAlloc(node->asCall.name);
+
+    return node;
+}
+
+AstNode *newBinaryNode(TokenType op, AstNode *left, AstNode *right) {
+    AstNode *node = newAstNode(AST_NODE_BINARY);
+    node->asBinary.op = op;
+    node->asBinary.left = left;
+    node->asBinary.right = right;
+
+    return node;
+}
+
+AstNode *newFloatNode(double value) {
+    AstNode *node = newAstNode(AST_NODE_FLOAT_LITERAL);
+    node->asFloat.value = value;
+
+    return node;
+}
+
+AstNode *newSpawnNode(const char *name, AstNode **args, size_t argCount) {
+    AstNode *node = newCallNode(name, args, argCount);
+    node->type = AST_NODE_SPAWN;
+
+    return node;
+}
+
+AstNode *newYieldNode(void) {
+    return newAstNode(AST_NODE_YIELD);
+}
+
+AstNode *newSendNode(AstNode *channel, AstNode *value) {
+    AstNode *node = newAstNode(AST_NODE_SEND);
+    node->asSend.channel = channel;
+    node->asSend.value = value;
+
+    return node;
+}
+
+AstNode *newRecvNode(AstNode *channel) {
+    AstNode *node = newAstNode(AST_NODE_RECV);
+    node->asRecv.channel = channel;
+
+    return node;
+}
+
+AstNode *newChanNode(const char *type, AstNode *capacity) {
+    AstNode *node = newAstNode(AST_NODE_CHAN);
+    node->asChan.type = strdup(type);
+    node->asChan.capacity = capacity;
+
+    return node;
+}
+
+AstNode *newArrayNode(const char *elementType, AstNode *length) {
+    AstNode *node = newAstNode(AST_NODE_ARRAY);
+    node->asArray.elementType = strdup(elementType);
+    node->asArray.length = length;
+
+    assertAlloc(node->asArray.elementType);
+
+    return node;
+}
+
+AstNode *newIndexNode(AstNode *array, AstNode *index) {
+    AstNode *node = newAstNode(AST_NODE_INDEX);
+    node->asIndex.array = array;
+    node->asIndex.index = index;
+    node->asIndex.value = NULL;
+
+    return node;
+}
+
+// takes over the parts of an index node already parsed as the target
+AstNode *newIndexAssignNode(AstNode *index, AstNode *value) {
+    index->type = AST_NODE_INDEX_ASSIGN;
+    index->asIndex.value = value;
+
+    return index;
+}
+
+AstNode *newParallelForNode(const char *variable, AstNode *start, AstNode *end,
+                            AstReduction *reductions, size_t reductionCount, AstBlock body) {
+    AstNode *node = newAstNode(AST_NODE_PARALLEL_FOR);
+    node->asParallelFor.variable = strdup(variable);
+    node->asParallelFor.start = start;
+    node->asParallelFor.end = end;
+    node->asParallelFor.reductions = reductions;
+    node->asParallelFor.reductionCount = reductionCount;
+    node->asParallelFor.body = body;
+    node->asParallelFor.captures = NULL;
+    node->asParallelFor.captureCount = 0;
+
+    assertAlloc(node->asParallelFor.variable);
+
+    return node;
+}
+
+AstNode *newIfNode(AstNode *condition, AstBlock thenBlock, AstBlock elseBlock) {
+    AstNode *node = newAstNode(AST_NODE_IF);
+    node->asIf.condition = condition;
+    node->asIf.thenBlock = thenBlock;
+    node->asIf.elseBlock = elseBlock;
+
+    return node;
+}
+
+AstNode *newWhileNode(AstNode *condition, AstBlock body) {
+    AstNode *node = newAstNode(AST_NODE_WHILE);
+    node->asWhile.condition = condition;
+    node->asWhile.body = body;
+
+    return node;
+}
+
 AstNode *newErrNode(void) {
     AstNode *node = newAstNode(AST_NODE_ERR);
     
     return node;
 }
 
+static void freeBlock(AstBlock *block) {
+    for (size_t i = 0; i < block->statementCount; i++) {
+        freeAstNode(block->statements[i]);
+    }
+    FREE_ALLOC(block->statements);
+}
+
 void freeAstNode(AstNode *node) {
     if (!node) return;
 
     switch (node->type) {
         case AST_NODE_FN:
             FREE_ALLOC(node->asFn.fnName);
+            for (size_t i = 0; i < node->asFn.paramCount; i++) {
+                FREE_ALLOC(node->asFn.params[i].name);
+                FREE_ALLOC(node->asFn.params[i].type);
+            }
+            FREE_ALLOC(node->asFn.params);
+            FREE_ALLOC(node->asFn.returnType);
+            freeBlock(&node->asFn.block);
             break;
         case AST_NODE_RET:
             freeAstNode(node->asRet.expression);
             break;
         case AST_NODE_BLOCK:
-            for (size_t i = 0; i < node->asBlock.statementCount; i++) {
-                freeAstNode(node->asBlock.statements[i]);
-            }
-            FREE_ALLOC(node->asBlock.statements);
+            freeBlock(&node->asBlock);
             break;
         case AST_NODE_EXEC:
             break;
@@ -81,6 +254,75 @@ void freeAstNode(AstNode *node) {
             break;
         case AST_NODE_ERR:
             break;
+        case AST_NODE_LET:
+            FREE_ALLOC(node->asLet.name);
+            FREE_ALLOC(node->asLet.type);
+            freeAstNode(node->asLet.value);
+            break;
+        case AST_NODE_ASSIGN:
+            FREE_ALLOC(node->asAssign.name);
+            freeAstNode(node->asAssign.value);
+            break;
+        case AST_NODE_IDENTIFIER:
+            FREE_ALLOC(node->asIdent.name);
+            break;
+        case AST_NODE_CALL:
+        case AST_NODE_SPAWN:
+            FREE_ALLOC(node->asCall.name);
+            for (size_t i = 0; i < node->asCall.argCount; i++) {
+                freeAstNode(node->asCall.args[i]);
+            }
+            FREE_ALLOC(node->asCall.args);
+            break;
+        case AST_NODE_BINARY:
+            freeAstNode(node->asBinary.left);
+            freeAstNode(node->asBinary.right);
+            break;
+        case AST_NODE_FLOAT_LITERAL:
+            break;
+        case AST_NODE_YIELD:
+            break;
+        case AST_NODE_SEND:
+            freeAstNode(node->asSend.channel);
+            freeAstNode(node->asSend.value);
+            break;
+        case AST_NODE_RECV:
+            freeAstNode(node->asRecv.channel);
+            break;
+        case AST_NODE_CHAN:
+            FREE_ALLOC(node->asChan.type);
+            freeAstNode(node->asChan.capacity);
+            break;
+        case AST_NODE_ARRAY:
+            FREE_ALLOC(node->asArray.elementType);
+            freeAstNode(node->asArray.length);
+            break;
+        case AST_NODE_INDEX:
+        case AST_NODE_INDEX_ASSIGN:
+            freeAstNode(node->asIndex.array);
+            freeAstNode(node->asIndex.index);
+            freeAstNode(node->asIndex.value);
+            break;
+        case AST_NODE_PARALLEL_FOR:
+            FREE_ALLOC(node->asParallelFor.variable);
+            freeAstNode(node->asParallelFor.start);
+            freeAstNode(node->asParallelFor.end);
+            for (size_t i = 0; i < node->asParallelFor.reductionCount; i++) {
+                FREE_ALLOC(node->asParallelFor.reductions[i].name);
+            }
+            FREE_ALLOC(node->asParallelFor.reductions);
+            freeBlock(&node->asParallelFor.body);
+            FREE_ALLOC(node->asParallelFor.captures);
+            break;
+        case AST_NODE_IF:
+            freeAstNode(node->asIf.condition);
+            freeBlock(&node->asIf.thenBlock);
+            freeBlock(&node->asIf.elseBlock);
+            break;
+        case AST_NODE_WHILE:
+            freeAstNode(node->asWhile.condition);
+            freeBlock(&node->asWhile.body);
+            break;
     }
 
     FREE_ALLOC(node);
@@ -103,7 +345,12 @@ void printAstNode(const AstNode *node, int indent) {
     
     switch (node->type) {
         case AST_NODE_FN: {
-            printf("FnNode: %s\n", node->asFn.fnName ? node->asFn.fnName : "(unnamed)");
+            printf("%s: %s (", node->asFn.isExtern ? "ExternFnNode" : "FnNode",
+                   node->asFn.fnName ? node->asFn.fnName : "(unnamed)");
+            for (size_t i = 0; i < node->asFn.paramCount; i++) {
+                printf("%s%s: %s", i ? ", " : "", node->asFn.params[i].name, node->asFn.params[i].type);
+            }
+            printf("): %s\n", node->asFn.returnType);
             for (size_t i = 0; i < node->asFn.block.statementCount; i++) {
                 printAstNode(node->asFn.block.statements[i], indent + 1);
             }
@@ -124,7 +371,7 @@ void printAstNode(const AstNode *node, int indent) {
             break;
         }
         case AST_NODE_INTEGER_LITERAL: {
-            printf("IntegerLiteral: %d\n", node->asInt.value);
+            printf("IntegerLiteral: %" PRId64 "\n", node->asInt.value);
             break;
         }
         case AST_NODE_ERR: {
@@ -135,6 +382,117 @@ void printAstNode(const AstNode *node, int indent) {
             printf("Exec: %d\n", node->asExec.byte);
             break;
         }
+        case AST_NODE_LET: {
+            printf("LetNode: %s: %s\n", node->asLet.name, node->asLet.type ? node->asLet.type : "(inferred)");
+            printAstNode(node->asLet.value, indent + 1);
+            break;
+        }
+        case AST_NODE_ASSIGN: {
+            printf("AssignNode: %s\n", node->asAssign.name);
+            printAstNode(node->asAssign.value, indent + 1);
+            break;
+        }
+        case AST_NODE_IDENTIFIER: {
+            printf("Identifier: %s\n", node->asIdent.name);
+            break;
+        }
+        case AST_NODE_CALL: {
+            printf("CallNode: %s (%zu args)\n", node->asCall.name, node->asCall.argCount);
+            for (size_t i = 0; i < node->asCall.argCount; i++) {
+                printAstNode(node->asCall.args[i], indent + 1);
+            }
+            break;
+        }
+        case AST_NODE_BINARY: {
+            printf("BinaryNode: %s\n", getTokenTypeName(node->asBinary.op));
+            printAstNode(node->asBinary.left, indent + 1);
+            printAstNode(node->asBinary.right, indent + 1);
+            break;
+        }
+        case AST_NODE_FLOAT_LITERAL: {
+            printf("FloatLiteral: %g\n", node->asFloat.value);
+            break;
+        }
+        case AST_NODE_SPAWN: {
+            printf("SpawnNode: %s (%zu args)\n", node->asCall.name, node->asCall.argCount);
+            for (size_t i = 0; i < node->asCall.argCount; i++) {
+                printAstNode(node->asCall.args[i], indent + 1);
+            }
+            break;
+        }
+        case AST_NODE_YIELD: {
+            printf("YieldNode\n");
+            break;
+        }
+        case AST_NODE_SEND: {
+            printf("SendNode:\n");
+            printAstNode(node->asSend.channel, indent + 1);
+            printAstNode(node->asSend.value, indent + 1);
+            break;
+        }
+        case AST_NODE_RECV: {
+            printf("RecvNode:\n");
+            printAstNode(node->asRecv.channel, indent + 1);
+            break;
+        }
+        case AST_NODE_CHAN: {
+            printf("ChanNode:\n");
+            printAstNode(node->asChan.capacity, indent + 1);
+            break;
+        }
+        case AST_NODE_ARRAY: {
+            printf("ArrayNode: %s\n", node->asArray.elementType);
+            printAstNode(node->asArray.length, indent + 1);
+            break;
+        }
+        case AST_NODE_INDEX:
+        case AST_NODE_INDEX_ASSIGN: {
+            printf("%s:\n", node->type == AST_NODE_INDEX ? "IndexNode" : "IndexAssignNode");
+            printAstNode(node->asIndex.array, indent + 1);
+            printAstNode(node->asIndex.index, indent + 1);
+            if (node->asIndex.value) printAstNode(node->asIndex.value, indent + 1);
+            break;
+        }
+        case AST_NODE_PARALLEL_FOR: {
+            static const char *ops[] = { "+", "*", "min", "max" };
+            const AstParallelFor *loop = &node->asParallelFor;
+
+            printf("ParallelForNode: %s (%s)", loop->variable, loop->end ? "range" : "array");
+            for (size_t i = 0; i < loop->reductionCount; i++) {
+                printf("%s%s %s", i ? ", " : " reduce ", ops[loop->reductions[i].op], loop->reductions[i].name);
+            }
+            printf("\n");
+
+            printAstNode(loop->start, indent + 1);
+            if (loop->end) printAstNode(loop->end, indent + 1);
+            for (size_t i = 0; i < loop->body.statementCount; i++) {
+                printAstNode(loop->body.statements[i], indent + 1);
+            }
+            break;
+        }
+        case AST_NODE_IF: {
+            printf("IfNode:\n");
+            printAstNode(node->asIf.condition, indent + 1);
+            for (size_t i = 0; i < node->asIf.thenBlock.statementCount; i++) {
+                printAstNode(node->asIf.thenBlock.statements[i], indent + 1);
+            }
+            if (node->asIf.elseBlock.statementCount) {
+                printIndent(indent);
+                printf("Else:\n");
+                for (size_t i = 0; i < node->asIf.elseBlock.statementCount; i++) {
+                    printAstNode(node->asIf.elseBlock.statements[i], indent + 1);
+                }
+            }
+            break;
+        }
+        case AST_NODE_WHILE: {
+            printf("WhileNode:\n");
+            printAstNode(node->asWhile.condition, indent + 1);
+            for (size_t i = 0; i < node->asWhile.body.statementCount; i++) {
+                printAstNode(node->asWhile.body.statements[i], indent + 1);
+            }
+            break;
+        }
         default: {
             printf("UnknownNode (type: %d)\n", node->type);
             break;
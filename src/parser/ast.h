@@ -3,6 +3,10 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stddef.h>
+
+#include "token.h"
+#include "types.h"
 
 typedef enum {
     AST_NODE_FN,
@@ -11,6 +15,25 @@ typedef enum {
     AST_NODE_BLOCK,
     AST_NODE_EXEC,
     AST_NODE_INTEGER_LITERAL,
+    AST_NODE_LET,
+    AST_NODE_ASSIGN,
+    AST_NODE_IDENTIFIER,
+    AST_NODE_CALL,
+    AST_NODE_BINARY,
+    AST_NODE_FLOAT_LITERAL,
+    // a call whose function runs as a new fiber, stored as 'asCall'
+    AST_NODE_SPAWN,
+    AST_NODE_YIELD,
+    AST_NODE_SEND,
+    AST_NODE_RECV,
+    AST_NODE_CHAN,
+    AST_NODE_ARRAY,
+    AST_NODE_INDEX,
+    // 'array[index] = value', stored as 'asIndex'
+    AST_NODE_INDEX_ASSIGN,
+    AST_NODE_PARALLEL_FOR,
+    AST_NODE_IF,
+    AST_NODE_WHILE,
 } AstNodeType;
 
 typedef struct AstNode AstNode;
@@ -25,26 +48,140 @@ typedef struct {
 } AstBlock;
 
 typedef struct {
-    int value;
+    int64_t value;
 } AstIntegerLiteral;
 
+typedef struct {
+    char *name;
+    char *type;
+} AstParam;
+
 typedef struct {
     char *fnName;
     bool isPublic;
+    // declared with 'extern fn', defined in another object and has no body
+    bool isExtern;
+    AstParam *params;
+    size_t paramCount;
     char *returnType;
     AstBlock block;
 } AstFnNode;
 
+typedef struct {
+    char *name;
+    // NULL when the type is left to be inferred
+    char *type;
+    AstNode *value;
+} AstLet;
+
+typedef struct {
+    char *name;
+    AstNode *value;
+} AstAssign;
+
+typedef struct {
+    char *name;
+} AstIdentifier;
+
+typedef struct {
+    char *name;
+    AstNode **args;
+    size_t argCount;
+    // set by the type checker when the name is no function but a built in
+    // array operation, the operation's IR mnemonic
+    const char *intrinsic;
+} AstCall;
+
+typedef struct {
+    // the operator's token type, e.g. TOKEN_PLUS
+    TokenType op;
+    AstNode *left;
+    AstNode *right;
+} AstBinary;
+
+typedef struct {
+    double value;
+} AstFloatLiteral;
+
 typedef struct {
     AstNode *expression;
 } AstRet;
 
+typedef struct {
+    AstNode *channel;
+    AstNode *value;
+} AstSend;
+
+typedef struct {
+    AstNode *channel;
+} AstRecv;
+
+typedef struct {
+    // 'chan', or the typed channel it makes such as 'chan<i32>'
+    char *type;
+    AstNode *capacity;
+} AstChan;
+
+typedef struct {
+    char *elementType;
+    AstNode *length;
+} AstArray;
+
+typedef struct {
+    AstNode *array;
+    AstNode *index;
+    // NULL unless the element is being assigned
+    AstNode *value;
+} AstIndex;
+
+typedef struct {
+    char *name;
+    ReduceOp op;
+} AstReduction;
+
+// 'parallel for i in start..end reduce + total { ... }'. the body is
+// compiled into a function of its own that the vm runs a chunk at a time
+typedef struct {
+    char *variable;
+    // the range 'start..end', or with 'end' NULL the array in 'start'
+    AstNode *start;
+    AstNode *end;
+
+    AstReduction *reductions;
+    size_t reductionCount;
+    AstBlock body;
+
+    // set by the type checker, the types of the enclosing function's slots
+    // the body can see. they become the outlined function's first parameters
+    ValueType *captures;
+    size_t captureCount;
+} AstParallelFor;
+
+// 'if condition { ... } else { ... }', an 'else if' is an else block holding
+// just the nested if. without an else the block is empty
+typedef struct {
+    AstNode *condition;
+    AstBlock thenBlock;
+    AstBlock elseBlock;
+} AstIf;
+
+typedef struct {
+    AstNode *condition;
+    AstBlock body;
+} AstWhile;
+
 typedef struct {
     int dummy;
 } AstErrNode;
 
 struct AstNode {
     AstNodeType type;
+    // filled in by the type checker for expressions
+    ValueType valueType;
+    // where the node starts, or for a binary operator where the operator
+    // is. zero for nodes the parser did not read from the source
+    uint16_t line;
+    uint16_t column;
 
     union {
         AstFnNode asFn;
@@ -53,6 +190,20 @@ struct AstNode {
         AstBlock asBlock;
         AstExec asExec;
         AstIntegerLiteral asInt;
+        AstLet asLet;
+        AstAssign asAssign;
+        AstIdentifier asIdent;
+        AstCall asCall;
+        AstBinary asBinary;
+        AstFloatLiteral asFloat;
+        AstSend asSend;
+        AstRecv asRecv;
+        AstChan asChan;
+        AstArray asArray;
+        AstIndex asIndex;
+        AstParallelFor asParallelFor;
+        AstIf asIf;
+        AstWhile asWhile;
     };
 };
 
@@ -62,11 +213,30 @@ typedef struct {
     size_t capacity;
 } Ast;
 
-AstNode *newFnNode(const char *name, bool isPublic, const char *returnType, AstBlock block);
+AstNode *newFnNode(const char *name, bool isPublic, AstParam *params, size_t paramCount,
+                   const char *returnType, AstBlock block);
 AstNode *newRetNode(AstNode *expression);
 AstNode *newBlockNode(AstNode **statements, size_t statementCount);
-AstNode *newIntegerNode(int value);
+AstNode *newIntegerNode(int64_t value);
 AstNode *newExecNode(uint8_t byte);
+AstNode *newLetNode(const char *name, const char *type, AstNode *value);
+AstNode *newAssignNode(const char *name, AstNode *value);
+AstNode *newIdentifierNode(const char *name);
+AstNode *newCallNode(const char *name, AstNode **args, size_t argCount);
+AstNode *newBinaryNode(TokenType op, AstNode *left, AstNode *right);
+AstNode *newFloatNode(double value);
+AstNode *newSpawnNode(const char *name, AstNode **args, size_t argCount);
+AstNode *newYieldNode(void);
+AstNode *newSendNode(AstNode *channel, AstNode *value);
+AstNode *newRecvNode(AstNode *channel);
+AstNode *newChanNode(const char *type, AstNode *capacity);
+AstNode *newArrayNode(const char *elementType, AstNode *length);
+AstNode *newIndexNode(AstNode *array, AstNode *index);
+AstNode *newIndexAssignNode(AstNode *index, AstNode *value);
+AstNode *newParallelForNode(const char *variable, AstNode *start, AstNode *end,
+                            AstReduction *reductions, size_t reductionCount, AstBlock body);
+AstNode *newIfNode(AstNode *condition, AstBlock thenBlock, AstBlock elseBlock);
+AstNode *newWhileNode(AstNode *condition, AstBlock body);
 AstNode *newErrNode(void);
 
 void freeAstNode(AstNode *node);
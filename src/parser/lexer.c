@@ -2,42 +2,48 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <errno.h>
 #include <ctype.h>
+#include <sys/stat.h>
 
 #include "lexer.h"
+#include "types.h"
 #include "../util/alloc.h"
 
+// NULL, after saying why on stderr, when the file cannot be read whole
 char *readFile(const char *path) {
-    FILE *fptr = fopen(path, "r");
+    FILE *fptr = fopen(path, "rb");
     if (!fptr) {
-        fprintf(stderr, "unable to open file: %s\n", path);
+        fprintf(stderr, "unable to open file: %s: %s\n", path, strerror(errno));
         return NULL;
     }
 
-    fseek(fptr, 0, SEEK_END);
-    int sz = ftell(fptr);
-    rewind(fptr);
+    struct stat info;
+    bool regular = fstat(fileno(fptr), &info) == 0 && S_ISREG(info.st_mode);
+    off_t sz = regular ? info.st_size : 0;
+
+    char *buff = regular ? malloc((size_t)sz + 1) : NULL;
+    const char *error = NULL;
+    if (!regular) {
+        error = "not a regular file";
+    } else if (!buff) {
+        error = "out of memory";
+    } else if (fread(buff, 1, (size_t)sz, fptr) != (size_t)sz) {
+        error = ferror(fptr) ? strerror(errno) : "file changed while it was read";
+    }
+    fclose(fptr);
 
-    char *buff = malloc(sz + 1);
-    if (!buff) {
-        fclose(fptr);
+    if (error) {
+        fprintf(stderr, "unable to read file: %s: %s\n", path, error);
+        free(buff);
         return NULL;
     }
 
-    fread(buff, 1, sz, fptr);
     buff[sz] = '\0';
-    fclose(fptr);
-
     return buff;
 }
 
-Lexer newLexer(const char *path) {
-    char *source = readFile(path);
-    if (!source) {
-        fprintf(stderr, "failed to read source file: %s\n", path);
-        exit(EXIT_FAILURE);
-    }
-
+static Lexer lexerFor(const char *path, char *source) {
     Lexer lexer = {
         .tokens = alloc(sizeof(Token)),
         .count = 0,
@@ -56,11 +62,24 @@ Lexer newLexer(const char *path) {
         .errorCapacity = 1
     };
 
+    assertAlloc(lexer.path);
     assertAlloc(lexer.source);
 
     return lexer;
 }
 
+bool newLexer(const char *path, Lexer *lexer) {
+    char *source = readFile(path);
+    if (!source) return false;
+
+    *lexer = lexerFor(path, source);
+    return true;
+}
+
+Lexer newSourceLexer(const char *name, const char *source) {
+    return lexerFor(name, strdup(source));
+}
+
 void addKeyword(Lexer *lexer, const char *keyword, TokenType type) {
     if (lexer->keywordCount >= lexer->keywordCapacity) {
         lexer->keywordCapacity *= 2;
@@ -77,6 +96,19 @@ void registerLexerKeywords(Lexer *lexer) {
     addKeyword(lexer, "fn", TOKEN_FN);
     addKeyword(lexer, "ret", TOKEN_RET);
     addKeyword(lexer, "exec", TOKEN_EXEC);
+    addKeyword(lexer, "let", TOKEN_LET);
+    addKeyword(lexer, "extern", TOKEN_EXTERN);
+    addKeyword(lexer, "spawn", TOKEN_SPAWN);
+    addKeyword(lexer, "send", TOKEN_SEND);
+    addKeyword(lexer, "recv", TOKEN_RECV);
+    addKeyword(lexer, "yield", TOKEN_YIELD);
+    addKeyword(lexer, "parallel", TOKEN_PARALLEL);
+    addKeyword(lexer, "for", TOKEN_FOR);
+    addKeyword(lexer, "in", TOKEN_IN);
+    addKeyword(lexer, "reduce", TOKEN_REDUCE);
+    addKeyword(lexer, "if", TOKEN_IF);
+    addKeyword(lexer, "else", TOKEN_ELSE);
+    addKeyword(lexer, "while", TOKEN_WHILE);
 }
 
 void registerVmKeywords(Lexer *lexer) {
@@ -90,7 +122,26 @@ void registerVmKeywords(Lexer *lexer) {
     addKeyword(lexer, "pop", TOKEN_POP);
     addKeyword(lexer, "const", TOKEN_CONST);
     addKeyword(lexer, "ret", TOKEN_RET);
+    addKeyword(lexer, "halt", TOKEN_HALT);
     addKeyword(lexer, "exec", TOKEN_EXEC);
+    addKeyword(lexer, "load", TOKEN_LOAD);
+    addKeyword(lexer, "store", TOKEN_STORE);
+    addKeyword(lexer, "local", TOKEN_LOCAL);
+    addKeyword(lexer, "locals", TOKEN_LOCALS);
+    addKeyword(lexer, "call", TOKEN_CALL);
+    addKeyword(lexer, "declare", TOKEN_DECLARE);
+    addKeyword(lexer, "spawn", TOKEN_SPAWN);
+    addKeyword(lexer, "channel", TOKEN_CHANNEL);
+    addKeyword(lexer, "send", TOKEN_SEND);
+    addKeyword(lexer, "recv", TOKEN_RECV);
+    addKeyword(lexer, "yield", TOKEN_YIELD);
+    addKeyword(lexer, "array", TOKEN_ARRAY);
+    addKeyword(lexer, "parallel", TOKEN_PARALLEL);
+    addKeyword(lexer, "next", TOKEN_NEXT);
+    addKeyword(lexer, "label", TOKEN_LABEL);
+    addKeyword(lexer, "jmp", TOKEN_JMP);
+    addKeyword(lexer, "jmp_false", TOKEN_JMP_FALSE);
+    addKeyword(lexer, "line", TOKEN_LINE);
 }
 
 void freeLexer(Lexer *lexer) {
@@ -126,6 +177,7 @@ static inline void recede(Lexer *lexer) {
     if (!lexer) return;
 
     lexer->position--;
+    lexer->column--;
 }
 
 static inline bool isEnd(Lexer *lexer) {
@@ -140,6 +192,13 @@ static inline char currentChar(Lexer *lexer) {
     return lexer->source[lexer->position];
 }
 
+static inline char peekChar(Lexer *lexer) {
+    if (!lexer) return '\0';
+    if (lexer->position + 1 >= lexer->sourceLength) return '\0';
+
+    return lexer->source[lexer->position + 1];
+}
+
 static void skipWhitespace(Lexer *lexer) {
     while (currentChar(lexer) == ' ' || currentChar(lexer) == '\t' ||
            currentChar(lexer) == '\r') {
@@ -179,23 +238,94 @@ static Token tokenizeSymbol(Lexer *lexer) {
             return newToken(lexer, TOKEN_LEFT_BRACE, "{");
         case '}':
             return newToken(lexer, TOKEN_RIGHT_BRACE, "}");
+        case '[':
+            return newToken(lexer, TOKEN_LEFT_BRACKET, "[");
+        case ']':
+            return newToken(lexer, TOKEN_RIGHT_BRACKET, "]");
         case '@':
             return newToken(lexer, TOKEN_AT, "@");
+        case ',':
+            return newToken(lexer, TOKEN_COMMA, ",");
+        case '.':
+            if (peekChar(lexer) == '.') {
+                advance(lexer);
+                return newToken(lexer, TOKEN_DOT_DOT, "..");
+            }
+            return newToken(lexer, TOKEN_EOF, "");
+        case '=':
+            if (peekChar(lexer) == '=') {
+                advance(lexer);
+                return newToken(lexer, TOKEN_EQUAL_EQUAL, "==");
+            }
+            return newToken(lexer, TOKEN_EQUALS, "=");
+        case '!':
+            if (peekChar(lexer) == '=') {
+                advance(lexer);
+                return newToken(lexer, TOKEN_BANG_EQUAL, "!=");
+            }
+            return newToken(lexer, TOKEN_EOF, "");
+        case '<':
+            if (peekChar(lexer) == '=') {
+                advance(lexer);
+                return newToken(lexer, TOKEN_LESS_EQUAL, "<=");
+            }
+            return newToken(lexer, TOKEN_LESS, "<");
+        case '>':
+            if (peekChar(lexer) == '=') {
+                advance(lexer);
+                return newToken(lexer, TOKEN_GREATER_EQUAL, ">=");
+            }
+            return newToken(lexer, TOKEN_GREATER, ">");
+        case '+':
+            return newToken(lexer, TOKEN_PLUS, "+");
+        case '-':
+            return newToken(lexer, TOKEN_MINUS, "-");
+        case '*':
+            return newToken(lexer, TOKEN_STAR, "*");
+        case '/':
+            return newToken(lexer, TOKEN_SLASH, "/");
         default:
             return newToken(lexer, TOKEN_EOF, "");
     }
 }
 
-static int isAlnumOrUnderscore(int c) {
-    return isalnum(c) || c == '_';
+// '$' never starts an identifier but may follow its first character, the
+// compiler names the functions it makes with one, e.g. 'main$for0'
+static int isIdentifierChar(int c) {
+    return isalnum(c) || c == '_' || c == '$';
 }
 
 static Token tokenizeIdentifier(Lexer *lexer) {
     size_t start = lexer->position;
-    while (isAlnumOrUnderscore(currentChar(lexer)) && !isEnd(lexer)) {
+    while (isIdentifierChar(currentChar(lexer)) && !isEnd(lexer)) {
+        advance(lexer);
+    }
+
+    // an array type name such as 'i32[]' is a single identifier, like any other type
+    if (currentChar(lexer) == '[' && peekChar(lexer) == ']') {
+        advance(lexer);
         advance(lexer);
     }
 
+    // and so is a channel type such as 'chan<i32>', but only for an element
+    // type so that 'chan<limit' still compares
+    if (currentChar(lexer) == '<' && lexer->position - start == 4 &&
+        strncmp(lexer->source + start, "chan", 4) == 0) {
+        size_t end = lexer->position + 1;
+        while (isIdentifierChar(lexer->source[end])) end++;
+
+        char element[8] = "";
+        size_t length = end - lexer->position - 1;
+        if (lexer->source[end] == '>' && length < sizeof(element)) {
+            memcpy(element, lexer->source + lexer->position + 1, length);
+            element[length] = '\0';
+        }
+
+        if (channelType(typeFromName(element)) != TYPE_UNKNOWN) {
+            while (lexer->position <= end) advance(lexer);
+        }
+    }
+
     size_t len = lexer->position - start;
     char *lexeme = malloc(len + 1);
     assertAlloc(lexeme);
@@ -218,6 +348,30 @@ static Token tokenizeInteger(Lexer *lexer) {
         advance(lexer);
     }
 
+    // a fractional part or an exponent turns the literal into a float
+    TokenType type = TOKEN_INTEGER_LITERAL;
+    if (currentChar(lexer) == '.' && isdigit(peekChar(lexer))) {
+        type = TOKEN_FLOAT_LITERAL;
+        advance(lexer);
+        while (isdigit(currentChar(lexer)) && !isEnd(lexer)) {
+            advance(lexer);
+        }
+    }
+
+    if (currentChar(lexer) == 'e' || currentChar(lexer) == 'E') {
+        char next = peekChar(lexer);
+        size_t digit = lexer->position + 1;
+        if (next == '+' || next == '-') digit++;
+
+        if (digit < lexer->sourceLength && isdigit(lexer->source[digit])) {
+            type = TOKEN_FLOAT_LITERAL;
+            while (lexer->position < digit) advance(lexer);
+            while (isdigit(currentChar(lexer)) && !isEnd(lexer)) {
+                advance(lexer);
+            }
+        }
+    }
+
     size_t len = lexer->position - start;
     char *lexeme = malloc(len + 1);
     assertAlloc(lexeme);
@@ -227,7 +381,7 @@ static Token tokenizeInteger(Lexer *lexer) {
 
     recede(lexer);
     
-    Token token = newToken(lexer, TOKEN_INTEGER_LITERAL, lexeme);
+    Token token = newToken(lexer, type, lexeme);
     free(lexeme);
 
     return token;
@@ -264,7 +418,10 @@ void lexerTokenize(Lexer *lexer) {
         
         if (isEnd(lexer)) break;
         
+        // tokens are located where they start, not where scanning them ended
+        uint16_t column = lexer->column;
         Token token = tokenize(lexer);
+        token.column = column;
         if (token.type == TOKEN_NEWLINE) {
             lexer->line++;
             lexer->column = 0;
@@ -2,6 +2,7 @@
 #define lexer_h
 
 #include <stddef.h>
+#include <stdbool.h>
 
 #include "token.h"
 #include "error.h"
@@ -32,7 +33,11 @@ typedef struct {
     size_t errorCapacity;
 } Lexer;
 
-Lexer newLexer(const char *source);
+// false, after saying why on stderr, when 'path' cannot be read. the server
+// runs requests in-process, so a missing file must not end it
+bool newLexer(const char *path, Lexer *lexer);
+// lexes 'source' from memory, 'name' stands in for the path in messages
+Lexer newSourceLexer(const char *name, const char *source);
 void freeLexer(Lexer *lexer);
 
 void lexerTokenize(Lexer *lexer);
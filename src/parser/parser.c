@@ -1,12 +1,17 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
 
 #include "parser.h"
 #include "ast.h"
 #include "../util/alloc.h"
 
 static AstNode *parseStatement(Parser *parser);
+static AstNode *parseExpression(Parser *parser);
+static AstNode *finishFn(Parser *parser, bool isPublic, bool isExtern);
+static bool parseBraced(Parser *parser, AstBlock *block);
 
 Parser newParser(Token *tokens, size_t count) {
     return (Parser){
@@ -17,7 +22,9 @@ Parser newParser(Token *tokens, size_t count) {
             .count = 0,
             .capacity = 1
         },
-        .position = 0
+        .position = 0,
+        .errors = stderr,
+        .hadError = false
     };
 }
 
@@ -61,6 +68,21 @@ static bool expect(Parser *parser, TokenType type) {
     return false;
 }
 
+static void parseError(Parser *parser, const char *message, Token token) {
+    fprintf(parser->errors, "parse error: %s '%s' at %d:%d\n", message, token.lexeme, token.line, token.column);
+    parser->hadError = true;
+}
+
+// gives 'node' the location of 'token' unless it already has one
+static AstNode *locate(AstNode *node, Token token) {
+    if (node->line == 0) {
+        node->line = token.line;
+        node->column = token.column;
+    }
+
+    return node;
+}
+
 static void addAstNode(Parser *parser, AstNode *node) {
     if (parser->ast.count >= parser->ast.capacity) {
         parser->ast.capacity *= 2;
@@ -77,6 +99,11 @@ static AstNode *parseBlock(Parser *parser) {
     size_t bodyCapacity = 1;
 
     while (!match(parser, TOKEN_RIGHT_BRACE) && parser->position < parser->count) {
+        if (match(parser, TOKEN_NEWLINE)) {
+            advance(parser);
+            continue;
+        }
+
         AstNode *node = parseStatement(parser);
         
         if (bodyCount >= bodyCapacity) {
@@ -94,6 +121,49 @@ static AstNode *parseBlock(Parser *parser) {
     return block;
 }
 
+static void freeParams(AstParam *params, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        FREE_ALLOC(params[i].name);
+        FREE_ALLOC(params[i].type);
+    }
+    FREE_ALLOC(params);
+}
+
+// parses '(name: type, ...)', the list may be omitted entirely for no parameters
+static bool parseParams(Parser *parser, AstParam **params, size_t *paramCount) {
+    *params = NULL;
+    *paramCount = 0;
+
+    if (!expect(parser, TOKEN_LEFT_PAREN)) return true;
+
+    size_t capacity = 1;
+    *params = alloc(sizeof(AstParam));
+
+    while (!match(parser, TOKEN_RIGHT_PAREN)) {
+        if (*paramCount > 0 && !expect(parser, TOKEN_COMMA)) return false;
+
+        Token name = currentToken(parser);
+        if (!expect(parser, TOKEN_IDENTIFIER)) return false;
+        if (!expect(parser, TOKEN_COLON)) return false;
+
+        Token type = currentToken(parser);
+        if (!expect(parser, TOKEN_IDENTIFIER)) return false;
+
+        if (*paramCount >= capacity) {
+            capacity *= 2;
+            *params = realloc(*params, capacity * sizeof(AstParam));
+            assertAlloc(*params);
+        }
+
+        AstParam param = { .name = strdup(name.lexeme), .type = strdup(type.lexeme) };
+        assertAlloc(param.name);
+        assertAlloc(param.type);
+        (*params)[(*paramCount)++] = param;
+    }
+
+    return expect(parser, TOKEN_RIGHT_PAREN);
+}
+
 static AstNode *parseFn(Parser *parser) {
     bool isPublic = false;
     if (match(parser, TOKEN_PUB)) {
@@ -101,48 +171,298 @@ static AstNode *parseFn(Parser *parser) {
         isPublic = true;
     }
 
+    bool isExtern = false;
+    if (!isPublic && match(parser, TOKEN_EXTERN)) {
+        advance(parser);
+        isExtern = true;
+    }
+
+    return finishFn(parser, isPublic, isExtern);
+}
+
+AstNode *parseSignature(Parser *parser) {
+    if (!parser) return newErrNode();
+
+    return finishFn(parser, false, true);
+}
+
+// everything from the 'fn' keyword on, externs stop after the return type
+static AstNode *finishFn(Parser *parser, bool isPublic, bool isExtern) {
     if (!match(parser, TOKEN_FN)) return newErrNode();
     advance(parser);
 
     Token nameToken = currentToken(parser);
     if (!expect(parser, TOKEN_IDENTIFIER)) return newErrNode();
-    
-    if (!expect(parser, TOKEN_COLON)) return newErrNode();
+
+    AstParam *params = NULL;
+    size_t paramCount = 0;
+    if (!parseParams(parser, &params, &paramCount)) {
+        freeParams(params, paramCount);
+        return newErrNode();
+    }
+
+    if (!expect(parser, TOKEN_COLON)) {
+        freeParams(params, paramCount);
+        return newErrNode();
+    }
 
     Token returnTypeToken = currentToken(parser);
-    if (!expect(parser, TOKEN_IDENTIFIER)) return newErrNode();
+    if (!expect(parser, TOKEN_IDENTIFIER)) {
+        freeParams(params, paramCount);
+        return newErrNode();
+    }
 
-    if (!expect(parser, TOKEN_LEFT_BRACE)) return newErrNode();
-    if (!expect(parser, TOKEN_NEWLINE)) return newErrNode();
+    // an extern declaration is only a signature, its body lives in another object
+    if (isExtern) {
+        while (match(parser, TOKEN_NEWLINE)) {
+            advance(parser);
+        }
 
-    AstNode *blockNode = parseBlock(parser);
-    if (blockNode->type == AST_NODE_ERR) return blockNode;
+        AstNode *fnNode = newFnNode(nameToken.lexeme, false, params, paramCount,
+                                    returnTypeToken.lexeme, (AstBlock){0});
+        fnNode->asFn.isExtern = true;
+        return fnNode;
+    }
 
-    if (!expect(parser, TOKEN_RIGHT_BRACE)) return newErrNode();
+    AstBlock block;
+    if (!parseBraced(parser, &block)) {
+        freeParams(params, paramCount);
+        return newErrNode();
+    }
 
     while (match(parser, TOKEN_NEWLINE)) {
         advance(parser);
     }
 
-    AstNode *fnNode = newFnNode(nameToken.lexeme, isPublic, returnTypeToken.lexeme, blockNode->asBlock);
+    return newFnNode(nameToken.lexeme, isPublic, params, paramCount, returnTypeToken.lexeme, block);
+}
+
+static AstNode *parseCall(Parser *parser, Token name, bool spawn) {
+    if (!expect(parser, TOKEN_LEFT_PAREN)) return newErrNode();
+
+    AstNode **args = alloc(sizeof(AstNode *));
+    size_t argCount = 0;
+    size_t argCapacity = 1;
+
+    while (!match(parser, TOKEN_RIGHT_PAREN) && parser->position < parser->count) {
+        if (argCount > 0 && !expect(parser, TOKEN_COMMA)) break;
+
+        if (argCount >= argCapacity) {
+            argCapacity *= 2;
+            args = realloc(args, argCapacity * sizeof(AstNode *));
+            assertAlloc(args);
+        }
+        args[argCount++] = parseExpression(parser);
+    }
+
+    AstNode *call = spawn ? newSpawnNode(name.lexeme, args, argCount)
+                          : newCallNode(name.lexeme, args, argCount);
+    if (!expect(parser, TOKEN_RIGHT_PAREN)) {
+        freeAstNode(call);
+        return newErrNode();
+    }
+
+    return locate(call, name);
+}
+
+static AstNode *parseChan(Parser *parser, const char *type) {
+    if (!expect(parser, TOKEN_LEFT_PAREN)) return newErrNode();
+
+    AstNode *capacity = parseExpression(parser);
+    if (!expect(parser, TOKEN_RIGHT_PAREN)) {
+        freeAstNode(capacity);
+        return newErrNode();
+    }
+
+    return newChanNode(type, capacity);
+}
+
+// '[expression]' after an array constructor or an indexed array
+static AstNode *parseBracketed(Parser *parser) {
+    if (!expect(parser, TOKEN_LEFT_BRACKET)) return newErrNode();
+
+    AstNode *inner = parseExpression(parser);
+    if (!expect(parser, TOKEN_RIGHT_BRACKET)) {
+        freeAstNode(inner);
+        return newErrNode();
+    }
 
-    return fnNode;
+    return inner;
 }
 
 static AstNode *parsePrimary(Parser *parser) {
     Token token = currentToken(parser);
 
     if (match(parser, TOKEN_INTEGER_LITERAL)) {
-        AstNode *intNode = newIntegerNode(atoi(token.lexeme));
+        // literals are unsigned, a minus in front of one is an operator
+        errno = 0;
+        char *end;
+        long long value = strtoll(token.lexeme, &end, 10);
         advance(parser);
 
-        return intNode;
+        if (errno == ERANGE || *end != '\0') {
+            parseError(parser, "integer literal out of range", token);
+            return newErrNode();
+        }
+        return newIntegerNode((int64_t)value);
     }
 
+    if (match(parser, TOKEN_FLOAT_LITERAL)) {
+        AstNode *floatNode = newFloatNode(strtod(token.lexeme, NULL));
+        advance(parser);
+
+        return floatNode;
+    }
+
+    if (match(parser, TOKEN_IDENTIFIER)) {
+        advance(parser);
+
+        // the type name doubles as the constructor, 'chan(capacity)' or 'chan<i32>(capacity)'
+        if (match(parser, TOKEN_LEFT_PAREN) && isChannelType(typeFromName(token.lexeme))) {
+            return locate(parseChan(parser, token.lexeme), token);
+        }
+
+        if (match(parser, TOKEN_LEFT_PAREN)) {
+            return parseCall(parser, token, false);
+        }
+
+        // an element type followed by a length makes an array, 'f64[length]'
+        if (match(parser, TOKEN_LEFT_BRACKET) && isNumericType(typeFromName(token.lexeme))) {
+            return locate(newArrayNode(token.lexeme, parseBracketed(parser)), token);
+        }
+
+        if (match(parser, TOKEN_LEFT_BRACKET)) {
+            return locate(newIndexNode(newIdentifierNode(token.lexeme), parseBracketed(parser)), token);
+        }
+
+        return locate(newIdentifierNode(token.lexeme), token);
+    }
+
+    if (match(parser, TOKEN_RECV)) {
+        advance(parser);
+        return locate(newRecvNode(parsePrimary(parser)), token);
+    }
+
+    if (match(parser, TOKEN_LEFT_PAREN)) {
+        advance(parser);
+        AstNode *inner = parseExpression(parser);
+
+        if (!expect(parser, TOKEN_RIGHT_PAREN)) {
+            freeAstNode(inner);
+            return newErrNode();
+        }
+
+        return inner;
+    }
+
+    parseError(parser, "expected an expression at", token);
     advance(parser);
     return newErrNode();
 }
 
+static AstNode *parseFactor(Parser *parser) {
+    AstNode *left = parsePrimary(parser);
+
+    while (match(parser, TOKEN_STAR) || match(parser, TOKEN_SLASH)) {
+        Token op = currentToken(parser);
+        advance(parser);
+
+        left = locate(newBinaryNode(op.type, left, parsePrimary(parser)), op);
+    }
+
+    return left;
+}
+
+static AstNode *parseTerm(Parser *parser) {
+    AstNode *left = parseFactor(parser);
+
+    while (match(parser, TOKEN_PLUS) || match(parser, TOKEN_MINUS)) {
+        Token op = currentToken(parser);
+        advance(parser);
+
+        left = locate(newBinaryNode(op.type, left, parseFactor(parser)), op);
+    }
+
+    return left;
+}
+
+static bool isComparison(Parser *parser) {
+    return match(parser, TOKEN_LESS) || match(parser, TOKEN_LESS_EQUAL) ||
+           match(parser, TOKEN_GREATER) || match(parser, TOKEN_GREATER_EQUAL) ||
+           match(parser, TOKEN_EQUAL_EQUAL) || match(parser, TOKEN_BANG_EQUAL);
+}
+
+static AstNode *parseComparison(Parser *parser) {
+    AstNode *left = parseTerm(parser);
+
+    while (isComparison(parser)) {
+        Token op = currentToken(parser);
+        advance(parser);
+
+        left = locate(newBinaryNode(op.type, left, parseTerm(parser)), op);
+    }
+
+    return left;
+}
+
+static AstNode *parseExpression(Parser *parser) {
+    return parseComparison(parser);
+}
+
+static void skipNewline(Parser *parser) {
+    if (match(parser, TOKEN_NEWLINE)) {
+        advance(parser);
+    }
+}
+
+static AstNode *parseLet(Parser *parser) {
+    if (!expect(parser, TOKEN_LET)) return newErrNode();
+
+    Token name = currentToken(parser);
+    if (!expect(parser, TOKEN_IDENTIFIER)) return newErrNode();
+
+    const char *type = NULL;
+    if (expect(parser, TOKEN_COLON)) {
+        Token typeToken = currentToken(parser);
+        if (!expect(parser, TOKEN_IDENTIFIER)) return newErrNode();
+        type = typeToken.lexeme;
+    }
+
+    if (!expect(parser, TOKEN_EQUALS)) return newErrNode();
+
+    AstNode *value = parseExpression(parser);
+    skipNewline(parser);
+
+    return newLetNode(name.lexeme, type, value);
+}
+
+// an identifier starts either an assignment or an expression statement
+static AstNode *parseIdentifierStatement(Parser *parser) {
+    Token name = currentToken(parser);
+
+    if (parser->position + 1 < parser->count &&
+        parser->tokens[parser->position + 1].type == TOKEN_EQUALS) {
+        advance(parser);
+        advance(parser);
+
+        AstNode *value = parseExpression(parser);
+        skipNewline(parser);
+
+        return newAssignNode(name.lexeme, value);
+    }
+
+    AstNode *expression = parseExpression(parser);
+
+    // 'array[index] = value'
+    if (expression->type == AST_NODE_INDEX && match(parser, TOKEN_EQUALS)) {
+        advance(parser);
+        expression = newIndexAssignNode(expression, parseExpression(parser));
+    }
+    skipNewline(parser);
+
+    return expression;
+}
+
 static AstNode *parseRet(Parser *parser) {
     if (!expect(parser, TOKEN_RET)) return newErrNode();
 
@@ -151,7 +471,7 @@ static AstNode *parseRet(Parser *parser) {
         return newRetNode(NULL);
     }
 
-    AstNode *value = parsePrimary(parser);
+    AstNode *value = parseExpression(parser);
     AstNode *retNode = newRetNode(value);
 
     if (match(parser, TOKEN_NEWLINE)) {
@@ -174,23 +494,275 @@ static AstNode *parseExec(Parser *parser) {
     return newExecNode(atoi(byteToken.lexeme));
 }
 
-static AstNode *parseStatement(Parser *parser) {
+// 'spawn f(args)' runs the call as a new fiber
+static AstNode *parseSpawn(Parser *parser) {
+    if (!expect(parser, TOKEN_SPAWN)) return newErrNode();
+
+    Token name = currentToken(parser);
+    if (!expect(parser, TOKEN_IDENTIFIER)) return newErrNode();
+
+    AstNode *spawn = parseCall(parser, name, true);
+    skipNewline(parser);
+
+    return spawn;
+}
+
+// 'send channel, value'
+static AstNode *parseSend(Parser *parser) {
+    if (!expect(parser, TOKEN_SEND)) return newErrNode();
+
+    AstNode *channel = parseExpression(parser);
+    if (!expect(parser, TOKEN_COMMA)) {
+        freeAstNode(channel);
+        return newErrNode();
+    }
+
+    AstNode *value = parseExpression(parser);
+    skipNewline(parser);
+
+    return newSendNode(channel, value);
+}
+
+static AstNode *parseYield(Parser *parser) {
+    if (!expect(parser, TOKEN_YIELD)) return newErrNode();
+    skipNewline(parser);
+
+    return newYieldNode();
+}
+
+static void freeReductions(AstReduction *reductions, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        FREE_ALLOC(reductions[i].name);
+    }
+    FREE_ALLOC(reductions);
+}
+
+// 'reduce + total, max best', the clause may be omitted entirely
+static bool parseReductions(Parser *parser, AstReduction **reductions, size_t *count) {
+    size_t capacity = 1;
+    *reductions = alloc(sizeof(AstReduction));
+    *count = 0;
+
+    if (!expect(parser, TOKEN_REDUCE)) return true;
+
+    do {
+        Token opToken = currentToken(parser);
+        ReduceOp op;
+        if (match(parser, TOKEN_PLUS)) {
+            op = REDUCE_ADD;
+        } else if (match(parser, TOKEN_STAR)) {
+            op = REDUCE_MUL;
+        } else if (match(parser, TOKEN_IDENTIFIER) && strcmp(opToken.lexeme, "min") == 0) {
+            op = REDUCE_MIN;
+        } else if (match(parser, TOKEN_IDENTIFIER) && strcmp(opToken.lexeme, "max") == 0) {
+            op = REDUCE_MAX;
+        } else {
+            return false;
+        }
+        advance(parser);
+
+        Token name = currentToken(parser);
+        if (!expect(parser, TOKEN_IDENTIFIER)) return false;
+
+        if (*count >= capacity) {
+            capacity *= 2;
+            *reductions = realloc(*reductions, capacity * sizeof(AstReduction));
+            assertAlloc(*reductions);
+        }
+
+        AstReduction reduction = { .name = strdup(name.lexeme), .op = op };
+        assertAlloc(reduction.name);
+        (*reductions)[(*count)++] = reduction;
+    } while (expect(parser, TOKEN_COMMA));
+
+    return true;
+}
+
+// '{', the statements and '}', on one line or over several. false, after
+// saying which brace is missing, when either is
+static bool parseBraced(Parser *parser, AstBlock *block) {
+    if (!expect(parser, TOKEN_LEFT_BRACE)) {
+        parseError(parser, "expected '{' before", currentToken(parser));
+        return false;
+    }
+
+    AstNode *blockNode = parseBlock(parser);
+    *block = blockNode->asBlock;
+    FREE_ALLOC(blockNode);
+    if (expect(parser, TOKEN_RIGHT_BRACE)) return true;
+
+    parseError(parser, "expected '}' before", currentToken(parser));
+    for (size_t i = 0; i < block->statementCount; i++) {
+        freeAstNode(block->statements[i]);
+    }
+    FREE_ALLOC(block->statements);
+    block->statementCount = 0;
+    return false;
+}
+
+// 'parallel for i in start..end' or 'parallel for x in array', then the
+// reductions and the body
+static AstNode *parseParallelFor(Parser *parser) {
+    if (!expect(parser, TOKEN_PARALLEL) || !expect(parser, TOKEN_FOR)) {
+        parseError(parser, "expected 'for' after 'parallel' before", currentToken(parser));
+        return newErrNode();
+    }
+
+    Token variable = currentToken(parser);
+    if (!expect(parser, TOKEN_IDENTIFIER) || !expect(parser, TOKEN_IN)) {
+        parseError(parser, "expected 'variable in' after 'parallel for' before", currentToken(parser));
+        return newErrNode();
+    }
+
+    AstNode *start = parseExpression(parser);
+    AstNode *end = NULL;
+    if (expect(parser, TOKEN_DOT_DOT)) end = parseExpression(parser);
+
+    AstReduction *reductions = NULL;
+    size_t reductionCount = 0;
+    bool ok = parseReductions(parser, &reductions, &reductionCount);
+    if (!ok) parseError(parser, "expected '+', '*', 'min' or 'max' and a name in 'reduce' before", currentToken(parser));
+
+    AstBlock body;
+    if (!ok || !parseBraced(parser, &body)) {
+        freeAstNode(start);
+        freeAstNode(end);
+        freeReductions(reductions, reductionCount);
+        return newErrNode();
+    }
+    skipNewline(parser);
+
+    return newParallelForNode(variable.lexeme, start, end, reductions, reductionCount, body);
+}
+
+// 'if condition { ... }', optionally followed by 'else { ... }' or 'else if ...'
+// on the line of its closing brace or the next
+static AstNode *parseIf(Parser *parser) {
+    if (!expect(parser, TOKEN_IF)) return newErrNode();
+
+    AstNode *condition = parseExpression(parser);
+    AstBlock thenBlock;
+    if (!parseBraced(parser, &thenBlock)) {
+        freeAstNode(condition);
+        return newErrNode();
+    }
+
+    // 'else' never starts a statement of its own, so a newline before it is no ambiguity
+    size_t afterThen = parser->position;
+    while (match(parser, TOKEN_NEWLINE)) advance(parser);
+    if (!match(parser, TOKEN_ELSE)) parser->position = afterThen;
+
+    AstBlock elseBlock = { .statements = NULL, .statementCount = 0 };
+    bool ok = true;
+    if (!expect(parser, TOKEN_ELSE)) {
+        skipNewline(parser);
+    } else if (match(parser, TOKEN_IF)) {
+        elseBlock.statements = alloc(sizeof(AstNode *));
+        elseBlock.statements[0] = parseIf(parser);
+        elseBlock.statementCount = 1;
+        ok = elseBlock.statements[0]->type != AST_NODE_ERR;
+    } else {
+        ok = parseBraced(parser, &elseBlock);
+        skipNewline(parser);
+    }
+
+    AstNode *node = newIfNode(condition, thenBlock, elseBlock);
+    if (ok) return node;
+
+    freeAstNode(node);
+    return newErrNode();
+}
+
+static AstNode *parseWhile(Parser *parser) {
+    if (!expect(parser, TOKEN_WHILE)) return newErrNode();
+
+    AstNode *condition = parseExpression(parser);
+    AstBlock body;
+    if (!parseBraced(parser, &body)) {
+        freeAstNode(condition);
+        return newErrNode();
+    }
+    skipNewline(parser);
+
+    return newWhileNode(condition, body);
+}
+
+static AstNode *parseStatementAt(Parser *parser) {
     switch (currentToken(parser).type) {
-        case TOKEN_PUB: {
+        case TOKEN_PUB:
+        case TOKEN_EXTERN:
+        case TOKEN_FN: {
             return parseFn(parser);
         }
+        case TOKEN_LET: {
+            return parseLet(parser);
+        }
+        case TOKEN_IDENTIFIER: {
+            return parseIdentifierStatement(parser);
+        }
         case TOKEN_RET: {
             return parseRet(parser);
         }
         case TOKEN_EXEC: {
             return parseExec(parser);
         }
+        case TOKEN_SPAWN: {
+            return parseSpawn(parser);
+        }
+        case TOKEN_SEND: {
+            return parseSend(parser);
+        }
+        case TOKEN_YIELD: {
+            return parseYield(parser);
+        }
+        case TOKEN_PARALLEL: {
+            return parseParallelFor(parser);
+        }
+        case TOKEN_IF: {
+            return parseIf(parser);
+        }
+        case TOKEN_WHILE: {
+            return parseWhile(parser);
+        }
+        case TOKEN_ELSE: {
+            parseError(parser, "'else' without an 'if' at", currentToken(parser));
+            advance(parser);
+
+            // skip its block so the rest of the function is not misread
+            AstBlock block;
+            if (match(parser, TOKEN_LEFT_BRACE) && parseBraced(parser, &block)) {
+                freeAstNode(newBlockNode(block.statements, block.statementCount));
+            }
+            return newErrNode();
+        }
+        case TOKEN_RECV:
+        case TOKEN_INTEGER_LITERAL:
+        case TOKEN_FLOAT_LITERAL:
+        case TOKEN_LEFT_PAREN: {
+            AstNode *expression = parseExpression(parser);
+            skipNewline(parser);
+
+            return expression;
+        }
         default: {
             return parsePrimary(parser);
         }
     }
 }
 
+static AstNode *parseStatement(Parser *parser) {
+    Token start = currentToken(parser);
+    bool hadError = parser->hadError;
+    AstNode *node = parseStatementAt(parser);
+
+    // a statement given up on without a more specific report still fails the parse
+    if (node->type == AST_NODE_ERR && !hadError && !parser->hadError) {
+        parseError(parser, "malformed statement at", start);
+    }
+
+    return locate(node, start);
+}
+
 void parseAst(Parser * parser) {
     if (!parser) return;
 
@@ -202,6 +774,63 @@ void parseAst(Parser * parser) {
     }
 }
 
+static void addRange(FunctionRange **ranges, size_t *count, size_t *capacity, FunctionRange range) {
+    if (*count >= *capacity) {
+        *capacity *= 2;
+        *ranges = realloc(*ranges, *capacity * sizeof(FunctionRange));
+        assertAlloc(*ranges);
+    }
+
+    (*ranges)[(*count)++] = range;
+}
+
+bool prescanFunctions(const Token *tokens, size_t count, FunctionRange **ranges, size_t *rangeCount) {
+    size_t capacity = 1;
+    *ranges = alloc(capacity * sizeof(FunctionRange));
+    *rangeCount = 0;
+
+    size_t i = 0;
+    while (true) {
+        while (i < count && tokens[i].type == TOKEN_NEWLINE) i++;
+        if (i >= count) break;
+
+        FunctionRange range = { .start = i };
+        if (tokens[i].type == TOKEN_PUB) {
+            range.isPublic = true;
+            i++;
+        } else if (tokens[i].type == TOKEN_EXTERN) {
+            range.isExtern = true;
+            i++;
+        }
+
+        if (i + 1 >= count || tokens[i].type != TOKEN_FN || tokens[i + 1].type != TOKEN_IDENTIFIER) {
+            return false;
+        }
+        range.signatureStart = i;
+        range.name = tokens[i + 1].lexeme;
+
+        if (range.isExtern) {
+            while (i < count && tokens[i].type != TOKEN_NEWLINE) i++;
+            range.signatureEnd = range.end = i;
+        } else {
+            while (i < count && tokens[i].type != TOKEN_LEFT_BRACE) i++;
+            range.signatureEnd = i;
+
+            size_t depth = 0;
+            for (; i < count; i++) {
+                if (tokens[i].type == TOKEN_LEFT_BRACE) depth++;
+                if (tokens[i].type == TOKEN_RIGHT_BRACE && --depth == 0) break;
+            }
+            if (i >= count) return false;
+            range.end = ++i;
+        }
+
+        addRange(ranges, rangeCount, &capacity, range);
+    }
+
+    return true;
+}
+
 void printParserAst(const Parser *parser) {
     if (!parser) {
         printf("Parser is null\n");
@@ -2,6 +2,8 @@
 #define parser_h
 
 #include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
 
 #include "token.h"
 #include "ast.h"
@@ -12,12 +14,38 @@ typedef struct {
 
     Ast ast;
     size_t position;
+
+    // where parse errors are reported
+    FILE *errors;
+    bool hadError;
 } Parser;
 
+// a top-level function as a range of tokens, found without parsing its body
+typedef struct {
+    const char *name;
+    // the first token, 'pub' or 'extern' when there is one
+    size_t start;
+    // the 'fn' keyword up to the opening brace, or to the end for externs
+    size_t signatureStart;
+    size_t signatureEnd;
+    // one past the closing brace
+    size_t end;
+
+    bool isPublic;
+    bool isExtern;
+} FunctionRange;
+
 Parser newParser(Token *tokens, size_t count);
 void freeParser(Parser *parser);
 
 void parseAst(Parser *parser);
+
+// parses a lone 'fn name(params): type' into an extern function node
+AstNode *parseSignature(Parser *parser);
+
+// matches braces to find every top-level function, false when the top level
+// holds anything else and the file has to go through the full parser
+bool prescanFunctions(const Token *tokens, size_t count, FunctionRange **ranges, size_t *rangeCount);
 void printParserAst(const Parser *parser);
 
 #endif
\ No newline at end of file
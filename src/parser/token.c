@@ -10,6 +10,8 @@ const char *getTokenTypeName(TokenType type) {
         case TOKEN_RIGHT_PAREN: return "RIGHT_PAREN";
         case TOKEN_LEFT_BRACE: return "LEFT_BRACE";
         case TOKEN_RIGHT_BRACE: return "RIGHT_BRACE";
+        case TOKEN_LEFT_BRACKET: return "LEFT_BRACKET";
+        case TOKEN_RIGHT_BRACKET: return "RIGHT_BRACKET";
         case TOKEN_IDENTIFIER: return "IDENTIFIER";
         case TOKEN_INTEGER_LITERAL: return "INTEGER_LITERAL";
         case TOKEN_NEWLINE: return "NEWLINE";
@@ -23,6 +25,47 @@ const char *getTokenTypeName(TokenType type) {
         case TOKEN_CONST: return "TOKEN_CONST";
         case TOKEN_AT: return "TOKEN_AT";
         case TOKEN_EXEC: return "TOKEN_EXEC";
+        case TOKEN_HALT: return "TOKEN_HALT";
+        case TOKEN_LET: return "LET";
+        case TOKEN_LOAD: return "TOKEN_LOAD";
+        case TOKEN_STORE: return "TOKEN_STORE";
+        case TOKEN_LOCAL: return "TOKEN_LOCAL";
+        case TOKEN_LOCALS: return "TOKEN_LOCALS";
+        case TOKEN_CALL: return "TOKEN_CALL";
+        case TOKEN_EXTERN: return "EXTERN";
+        case TOKEN_DECLARE: return "TOKEN_DECLARE";
+        case TOKEN_SPAWN: return "SPAWN";
+        case TOKEN_SEND: return "SEND";
+        case TOKEN_RECV: return "RECV";
+        case TOKEN_YIELD: return "YIELD";
+        case TOKEN_CHANNEL: return "TOKEN_CHANNEL";
+        case TOKEN_ARRAY: return "TOKEN_ARRAY";
+        case TOKEN_PARALLEL: return "PARALLEL";
+        case TOKEN_FOR: return "FOR";
+        case TOKEN_IN: return "IN";
+        case TOKEN_REDUCE: return "REDUCE";
+        case TOKEN_NEXT: return "TOKEN_NEXT";
+        case TOKEN_IF: return "IF";
+        case TOKEN_ELSE: return "ELSE";
+        case TOKEN_WHILE: return "WHILE";
+        case TOKEN_LABEL: return "TOKEN_LABEL";
+        case TOKEN_JMP: return "TOKEN_JMP";
+        case TOKEN_JMP_FALSE: return "TOKEN_JMP_FALSE";
+        case TOKEN_LINE: return "LINE";
+        case TOKEN_COMMA: return "COMMA";
+        case TOKEN_DOT_DOT: return "DOT_DOT";
+        case TOKEN_PLUS: return "PLUS";
+        case TOKEN_MINUS: return "MINUS";
+        case TOKEN_STAR: return "STAR";
+        case TOKEN_SLASH: return "SLASH";
+        case TOKEN_LESS: return "LESS";
+        case TOKEN_LESS_EQUAL: return "LESS_EQUAL";
+        case TOKEN_GREATER: return "GREATER";
+        case TOKEN_GREATER_EQUAL: return "GREATER_EQUAL";
+        case TOKEN_EQUAL_EQUAL: return "EQUAL_EQUAL";
+        case TOKEN_BANG_EQUAL: return "BANG_EQUAL";
+        case TOKEN_FLOAT_LITERAL: return "FLOAT_LITERAL";
+        case TOKEN_EQUALS: return "EQUALS";
         default: return "UNKNOWN";
     }
 }
\ No newline at end of file
@@ -17,6 +17,32 @@ typedef enum {
     TOKEN_CONST,
     TOKEN_EXEC,
     TOKEN_HALT,
+    TOKEN_LET,
+    TOKEN_LOAD,
+    TOKEN_STORE,
+    TOKEN_LOCAL,
+    TOKEN_LOCALS,
+    TOKEN_CALL,
+    TOKEN_EXTERN,
+    TOKEN_DECLARE,
+    TOKEN_SPAWN,
+    TOKEN_SEND,
+    TOKEN_RECV,
+    TOKEN_YIELD,
+    TOKEN_CHANNEL,
+    TOKEN_ARRAY,
+    TOKEN_PARALLEL,
+    TOKEN_FOR,
+    TOKEN_IN,
+    TOKEN_REDUCE,
+    TOKEN_NEXT,
+    TOKEN_IF,
+    TOKEN_ELSE,
+    TOKEN_WHILE,
+    TOKEN_LABEL,
+    TOKEN_JMP,
+    TOKEN_JMP_FALSE,
+    TOKEN_LINE,
 
     // symbols
     TOKEN_COLON,
@@ -24,11 +50,27 @@ typedef enum {
     TOKEN_RIGHT_PAREN,
     TOKEN_LEFT_BRACE,
     TOKEN_RIGHT_BRACE,
+    TOKEN_LEFT_BRACKET,
+    TOKEN_RIGHT_BRACKET,
     TOKEN_AT,
+    TOKEN_COMMA,
+    TOKEN_DOT_DOT,
+    TOKEN_EQUALS,
+    TOKEN_PLUS,
+    TOKEN_MINUS,
+    TOKEN_STAR,
+    TOKEN_SLASH,
+    TOKEN_LESS,
+    TOKEN_LESS_EQUAL,
+    TOKEN_GREATER,
+    TOKEN_GREATER_EQUAL,
+    TOKEN_EQUAL_EQUAL,
+    TOKEN_BANG_EQUAL,
 
     // others
     TOKEN_IDENTIFIER,
     TOKEN_INTEGER_LITERAL,
+    TOKEN_FLOAT_LITERAL,
 
     TOKEN_NEWLINE,
     TOKEN_EOF,
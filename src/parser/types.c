@@ -0,0 +1,92 @@
+#include <string.h>
+
+#include "types.h"
+
+ValueType typeFromName(const char *name) {
+    if (strcmp(name, "i32") == 0) return TYPE_I32;
+    if (strcmp(name, "i64") == 0) return TYPE_I64;
+    if (strcmp(name, "f64") == 0) return TYPE_F64;
+    if (strcmp(name, "bool") == 0) return TYPE_BOOL;
+    if (strcmp(name, "any") == 0) return TYPE_ANY;
+    if (strcmp(name, "chan") == 0) return TYPE_CHAN;
+    if (strcmp(name, "i32[]") == 0) return TYPE_I32_ARRAY;
+    if (strcmp(name, "i64[]") == 0) return TYPE_I64_ARRAY;
+    if (strcmp(name, "f64[]") == 0) return TYPE_F64_ARRAY;
+    if (strcmp(name, "chan<i32>") == 0) return TYPE_I32_CHAN;
+    if (strcmp(name, "chan<i64>") == 0) return TYPE_I64_CHAN;
+    if (strcmp(name, "chan<f64>") == 0) return TYPE_F64_CHAN;
+    if (strcmp(name, "chan<bool>") == 0) return TYPE_BOOL_CHAN;
+
+    return TYPE_UNKNOWN;
+}
+
+const char *typeName(ValueType type) {
+    switch (type) {
+        case TYPE_I32: return "i32";
+        case TYPE_I64: return "i64";
+        case TYPE_F64: return "f64";
+        case TYPE_BOOL: return "bool";
+        case TYPE_ANY: return "any";
+        case TYPE_CHAN: return "chan";
+        case TYPE_I32_ARRAY: return "i32[]";
+        case TYPE_I64_ARRAY: return "i64[]";
+        case TYPE_F64_ARRAY: return "f64[]";
+        case TYPE_I32_CHAN: return "chan<i32>";
+        case TYPE_I64_CHAN: return "chan<i64>";
+        case TYPE_F64_CHAN: return "chan<f64>";
+        case TYPE_BOOL_CHAN: return "chan<bool>";
+        default: return "unknown";
+    }
+}
+
+bool isNumericType(ValueType type) {
+    return type == TYPE_I32 || type == TYPE_I64 || type == TYPE_F64;
+}
+
+bool isArrayType(ValueType type) {
+    return type == TYPE_I32_ARRAY || type == TYPE_I64_ARRAY || type == TYPE_F64_ARRAY;
+}
+
+ValueType arrayType(ValueType element) {
+    switch (element) {
+        case TYPE_I32: return TYPE_I32_ARRAY;
+        case TYPE_I64: return TYPE_I64_ARRAY;
+        case TYPE_F64: return TYPE_F64_ARRAY;
+        default: return TYPE_UNKNOWN;
+    }
+}
+
+ValueType elementType(ValueType array) {
+    switch (array) {
+        case TYPE_I32_ARRAY: return TYPE_I32;
+        case TYPE_I64_ARRAY: return TYPE_I64;
+        case TYPE_F64_ARRAY: return TYPE_F64;
+        default: return TYPE_UNKNOWN;
+    }
+}
+
+bool isChannelType(ValueType type) {
+    return type == TYPE_CHAN || type == TYPE_I32_CHAN || type == TYPE_I64_CHAN || type == TYPE_F64_CHAN ||
+           type == TYPE_BOOL_CHAN;
+}
+
+ValueType channelType(ValueType element) {
+    switch (element) {
+        case TYPE_I32: return TYPE_I32_CHAN;
+        case TYPE_I64: return TYPE_I64_CHAN;
+        case TYPE_F64: return TYPE_F64_CHAN;
+        case TYPE_BOOL: return TYPE_BOOL_CHAN;
+        default: return TYPE_UNKNOWN;
+    }
+}
+
+ValueType channelElement(ValueType channel) {
+    switch (channel) {
+        case TYPE_I32_CHAN: return TYPE_I32;
+        case TYPE_I64_CHAN: return TYPE_I64;
+        case TYPE_F64_CHAN: return TYPE_F64;
+        case TYPE_BOOL_CHAN: return TYPE_BOOL;
+        case TYPE_CHAN: return TYPE_ANY;
+        default: return TYPE_UNKNOWN;
+    }
+}
\ No newline at end of file
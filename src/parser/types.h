@@ -0,0 +1,59 @@
+#ifndef types_h
+#define types_h
+
+#include <stdbool.h>
+
+typedef enum {
+    // not yet resolved, or the expression failed to type check
+    TYPE_UNKNOWN,
+    TYPE_I32,
+    TYPE_I64,
+    TYPE_F64,
+    TYPE_BOOL,
+    // dynamically typed, operations on it go through the tagged generic opcodes
+    TYPE_ANY,
+    // a channel between fibers, made with 'chan(capacity)', whose values are 'any'
+    TYPE_CHAN,
+    // typed arrays of numbers, 'i32[]' and so on, made with 'i32[length]'
+    TYPE_I32_ARRAY,
+    TYPE_I64_ARRAY,
+    TYPE_F64_ARRAY,
+    // channels of one type of value, 'chan<i32>' and so on, made with
+    // 'chan<i32>(capacity)'. what they receive keeps its static type
+    TYPE_I32_CHAN,
+    TYPE_I64_CHAN,
+    TYPE_F64_CHAN,
+    TYPE_BOOL_CHAN,
+
+    // not a type, the number of them
+    TYPE_COUNT,
+} ValueType;
+
+// how a parallel for combines the partial results of its chunks, the
+// compiler hands these to the 'parallel' instruction as i32 constants
+typedef enum {
+    REDUCE_ADD,
+    REDUCE_MUL,
+    REDUCE_MIN,
+    REDUCE_MAX,
+} ReduceOp;
+
+// resolves a type name from source or IR, TYPE_UNKNOWN if it names no type
+ValueType typeFromName(const char *name);
+const char *typeName(ValueType type);
+
+bool isNumericType(ValueType type);
+
+bool isArrayType(ValueType type);
+// the array of 'element', TYPE_UNKNOWN unless it is numeric
+ValueType arrayType(ValueType element);
+ValueType elementType(ValueType array);
+
+// typed or not
+bool isChannelType(ValueType type);
+// the channel of 'element', TYPE_UNKNOWN unless it is numeric or bool
+ValueType channelType(ValueType element);
+// what receiving from 'channel' gives, 'any' for an untyped channel
+ValueType channelElement(ValueType channel);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,750 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "pgo.h"
+#include "../util/alloc.h"
+#include "../util/hash.h"
+
+static uint64_t codeChecksum(const Program *p, size_t start, size_t end) {
+    return fnv1a(FNV_OFFSET_BASIS, p->code + start, (end - start) * sizeof(AvmInstruction));
+}
+
+static bool isJump(AvmInstruction instr) {
+    return instr == INSTR_JMP || instr == INSTR_JMP_IF_FALSE;
+}
+
+// control never reaches the instruction after one of these
+static bool endsFlow(AvmInstruction instr) {
+    return instr == INSTR_JMP || instr == INSTR_RET || instr == INSTR_HALT || instr == INSTR_PARALLEL_NEXT;
+}
+
+static size_t jumpTarget(const Program *p, size_t pc) {
+    return pc + 2 + (int32_t)p->code[pc + 1];
+}
+
+static const char *calleeName(const Program *p, size_t operand) {
+    if (operand < p->functions.count) return p->functions.entries[operand].name;
+
+    size_t import = operand - p->functions.count;
+    return import < p->imports.count ? p->imports.entries[import].name : NULL;
+}
+
+// marks the offsets blocks start at: the entry, every jump target and whatever
+// follows a jump or a return. false when an instruction runs past the end or a
+// jump leaves the function or lands inside an instruction
+static bool markBlocks(const Program *p, size_t start, size_t end, bool *leaders) {
+    size_t length = end - start;
+    bool *boundaries = alloc(length + 1);
+    memset(boundaries, 0, length + 1);
+    memset(leaders, 0, length + 1);
+    leaders[0] = true;
+
+    for (size_t pc = start; pc < end; pc += 1 + operandCount(p->code[pc])) boundaries[pc - start] = true;
+
+    bool ok = true;
+    for (size_t pc = start; pc < end && ok; ) {
+        AvmInstruction instr = p->code[pc];
+        size_t next = pc + 1 + operandCount(instr);
+        if (next > end) {
+            ok = false;
+            break;
+        }
+
+        if (isJump(instr)) {
+            size_t target = jumpTarget(p, pc);
+            ok = target >= start && target < end && boundaries[target - start];
+            if (ok) leaders[target - start] = true;
+        }
+        if ((isJump(instr) || endsFlow(instr)) && next < end) leaders[next - start] = true;
+
+        pc = next;
+    }
+
+    FREE_ALLOC(boundaries);
+    return ok;
+}
+
+typedef struct {
+    AvmInstruction first;
+    AvmInstruction second;
+    uint64_t count;
+} OpcodePair;
+
+static int comparePairs(const void *a, const void *b) {
+    const OpcodePair *left = a, *right = b;
+    if (left->first != right->first) return left->first < right->first ? -1 : 1;
+    return (left->second > right->second) - (left->second < right->second);
+}
+
+static int comparePairCounts(const void *a, const void *b) {
+    uint64_t left = ((const OpcodePair *)a)->count, right = ((const OpcodePair *)b)->count;
+    return (left < right) - (left > right);
+}
+
+// mnemonics without their spaces, so every field of a line is one word
+static void pairName(AvmInstruction instr, char *buffer, size_t size) {
+    instructionName(instr, buffer, size);
+    for (char *c = buffer; *c; c++) {
+        if (*c == ' ') *c = '_';
+    }
+}
+
+// the opcodes that ran back to back within the function, each pair once with
+// how often the second followed the first, most frequent first
+static void writePairs(FILE *out, const Profile *profile, const Program *p, size_t start, size_t end) {
+    OpcodePair *pairs = alloc((end - start + 1) * sizeof(OpcodePair));
+    size_t count = 0;
+
+    for (size_t pc = start; pc < end; pc += 1 + operandCount(p->code[pc])) {
+        AvmInstruction instr = p->code[pc];
+        size_t next = pc + 1 + operandCount(instr);
+        if (next >= end || endsFlow(instr)) continue;
+
+        uint64_t sequential = profile->executed[pc];
+        if (instr == INSTR_JMP_IF_FALSE) sequential -= profile->jumped[pc];
+        if (sequential > 0) pairs[count++] = (OpcodePair){ .first = instr, .second = p->code[next], .count = sequential };
+    }
+
+    qsort(pairs, count, sizeof(OpcodePair), comparePairs);
+    size_t merged = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (merged > 0 && comparePairs(&pairs[merged - 1], &pairs[i]) == 0) {
+            pairs[merged - 1].count += pairs[i].count;
+        } else {
+            pairs[merged++] = pairs[i];
+        }
+    }
+    qsort(pairs, merged, sizeof(OpcodePair), comparePairCounts);
+
+    for (size_t i = 0; i < merged; i++) {
+        char first[32], second[32];
+        pairName(pairs[i].first, first, sizeof(first));
+        pairName(pairs[i].second, second, sizeof(second));
+        fprintf(out, "pair %s %s %" PRIu64 "\n", first, second, pairs[i].count);
+    }
+
+    FREE_ALLOC(pairs);
+}
+
+static void writeFunction(FILE *out, const Profile *profile, const Program *p, const Function *fn, size_t end) {
+    size_t start = fn->address;
+
+    uint64_t instructions = 0;
+    for (size_t pc = start; pc < end; pc++) instructions += profile->executed[pc];
+    if (instructions == 0) return;
+
+    bool *leaders = alloc(end - start + 1);
+    if (!markBlocks(p, start, end, leaders)) {
+        FREE_ALLOC(leaders);
+        return;
+    }
+
+    fprintf(out, "fn %s %016" PRIx64 " %zu %" PRIu64 "\n", fn->name, codeChecksum(p, start, end), end - start,
+            instructions);
+
+    for (size_t pc = start; pc < end; pc += 1 + operandCount(p->code[pc])) {
+        AvmInstruction instr = p->code[pc];
+        uint64_t count = profile->executed[pc];
+        size_t offset = pc - start;
+
+        if (leaders[offset]) fprintf(out, "block %zu %" PRIu64 "\n", offset, count);
+        if (instr == INSTR_CALL || instr == INSTR_SPAWN) {
+            const char *callee = calleeName(p, p->code[pc + 1]);
+            fprintf(out, "call %zu %s %" PRIu64 "\n", offset, callee ? callee : "?", count);
+        }
+        if (instr == INSTR_JMP_IF_FALSE) {
+            fprintf(out, "edge %zu %" PRIu64 " %" PRIu64 "\n", offset, profile->jumped[pc],
+                    count - profile->jumped[pc]);
+        }
+    }
+
+    writePairs(out, profile, p, start, end);
+    fprintf(out, "end\n");
+
+    FREE_ALLOC(leaders);
+}
+
+bool writeProfileData(const Profile *profile, const Program *program, const char *path) {
+    if (!profile->executed || profile->length != program->length) return false;
+
+    FILE *out = fopen(path, "w");
+    if (!out) return false;
+
+    fprintf(out, "%s %d\n", PGO_MAGIC, PGO_VERSION);
+
+    const FunctionTable *table = &program->functions;
+    size_t *ends = alloc((table->count + 1) * sizeof(size_t));
+    functionExtents(program, ends);
+
+    for (size_t i = 0; i < table->count; i++) {
+        const Function *fn = &table->entries[i];
+        if (!fn->stub && fn->address < ends[i]) writeFunction(out, profile, program, fn, ends[i]);
+    }
+
+    FREE_ALLOC(ends);
+    return fclose(out) == 0;
+}
+
+static bool profileError(const char *path, size_t line, const char *message) {
+    fprintf(stderr, "profile error: %s:%zu: %s\n", path, line, message);
+    return false;
+}
+
+static int compareCounts(const void *a, const void *b) {
+    return strcmp(((const FunctionCounts *)a)->name, ((const FunctionCounts *)b)->name);
+}
+
+static FunctionCounts *addFunctionCounts(ProfileData *data, const char *name, uint64_t checksum, size_t length,
+                                         uint64_t instructions) {
+    if (data->count >= data->capacity) {
+        data->capacity *= 2;
+        data->functions = realloc(data->functions, sizeof(FunctionCounts) * data->capacity);
+        assertAlloc(data->functions);
+    }
+
+    FunctionCounts *counts = &data->functions[data->count++];
+    *counts = (FunctionCounts){
+        .name = strdup(name),
+        .checksum = checksum,
+        .length = length,
+        .instructions = instructions,
+        .counts = alloc((length + 1) * sizeof(uint64_t)),
+        .jumped = alloc((length + 1) * sizeof(uint64_t)),
+    };
+    assertAlloc(counts->name);
+    memset(counts->counts, 0, (length + 1) * sizeof(uint64_t));
+    memset(counts->jumped, 0, (length + 1) * sizeof(uint64_t));
+
+    return counts;
+}
+
+// one line of a function's record, false when it is not one
+static bool readCountLine(const char *line, FunctionCounts *counts) {
+    char name[256];
+    size_t offset;
+    uint64_t count, other;
+
+    if (sscanf(line, "block %zu %" SCNu64, &offset, &count) == 2 ||
+        sscanf(line, "call %zu %255s %" SCNu64, &offset, name, &count) == 3) {
+        if (offset >= counts->length) return false;
+        counts->counts[offset] = count;
+        return true;
+    }
+    if (sscanf(line, "edge %zu %" SCNu64 " %" SCNu64, &offset, &count, &other) == 3) {
+        if (offset >= counts->length) return false;
+        counts->counts[offset] = count + other;
+        counts->jumped[offset] = count;
+        return true;
+    }
+
+    // pairs are there to read, laying the code out does not need them
+    return strncmp(line, "pair ", 5) == 0;
+}
+
+bool readProfileData(const char *path, ProfileData *data) {
+    *data = (ProfileData){
+        .functions = alloc(sizeof(FunctionCounts)),
+        .count = 0,
+        .capacity = 1,
+    };
+
+    FILE *file = fopen(path, "r");
+    if (!file) return profileError(path, 0, "cannot open profile");
+
+    char line[512];
+    char magic[8];
+    int version = 0;
+    size_t number = 1;
+    bool ok = fgets(line, sizeof(line), file) && sscanf(line, "%7s %d", magic, &version) == 2 &&
+              strcmp(magic, PGO_MAGIC) == 0;
+    if (!ok) profileError(path, number, "not a profile");
+    if (ok && version != PGO_VERSION) ok = profileError(path, number, "profile was written by another version");
+
+    FunctionCounts *current = NULL;
+    while (ok && fgets(line, sizeof(line), file)) {
+        number++;
+
+        char name[256];
+        uint64_t checksum, instructions;
+        size_t length;
+
+        if (line[0] == '\n') continue;
+        if (strcmp(line, "end\n") == 0 && current) {
+            current = NULL;
+        } else if (!current && sscanf(line, "fn %255s %" SCNx64 " %zu %" SCNu64, name, &checksum, &length,
+                                      &instructions) == 4) {
+            // no function is anywhere near this long, the line is damaged
+            if (length == 0 || length > UINT32_MAX) ok = profileError(path, number, "malformed function record");
+            if (ok) current = addFunctionCounts(data, name, checksum, length, instructions);
+        } else if (!current || !readCountLine(line, current)) {
+            ok = profileError(path, number, "malformed line");
+        }
+    }
+
+    if (ok && current) ok = profileError(path, number, "function record is not closed");
+    fclose(file);
+
+    qsort(data->functions, data->count, sizeof(FunctionCounts), compareCounts);
+    return ok;
+}
+
+void freeProfileData(ProfileData *data) {
+    if (!data) return;
+
+    for (size_t i = 0; i < data->count; i++) {
+        FREE_ALLOC(data->functions[i].name);
+        FREE_ALLOC(data->functions[i].counts);
+        FREE_ALLOC(data->functions[i].jumped);
+    }
+    FREE_ALLOC(data->functions);
+    data->count = 0;
+}
+
+static const FunctionCounts *findCounts(const ProfileData *data, const char *name) {
+    FunctionCounts key = { .name = (char *)name };
+    return bsearch(&key, data->functions, data->count, sizeof(FunctionCounts), compareCounts);
+}
+
+// a jump in the rewritten code, patched once its target's new address is known
+typedef struct {
+    size_t position;
+    size_t target;
+} JumpPatch;
+
+typedef struct {
+    Program *program;
+    size_t *ends;
+
+    // the profile of each function, NULL when it never ran or changed since
+    const FunctionCounts **counts;
+    bool *inlinable;
+    // the new index of each function
+    size_t *indices;
+
+    // the rewritten code and the address each word was copied from, which
+    // gives it its line
+    AvmInstruction *code;
+    size_t *origins;
+    size_t length;
+    size_t capacity;
+    RelocationTable relocations;
+
+    JumpPatch *patches;
+    size_t patchCount;
+    size_t patchCapacity;
+
+    // the constant a frame's locals start at, added the first time an inlined callee needs it
+    size_t zero;
+
+    PgoStats *stats;
+} Rewriter;
+
+static void emitWord(Rewriter *r, AvmInstruction word, size_t origin) {
+    if (r->length >= r->capacity) {
+        r->capacity *= 2;
+        r->code = realloc(r->code, sizeof(AvmInstruction) * r->capacity);
+        r->origins = realloc(r->origins, sizeof(size_t) * r->capacity);
+        assertAlloc(r->code);
+        assertAlloc(r->origins);
+    }
+
+    r->code[r->length] = word;
+    r->origins[r->length++] = origin;
+}
+
+static void addRelocation(Rewriter *r, RelocationKind kind) {
+    RelocationTable *table = &r->relocations;
+    if (table->count >= table->capacity) {
+        table->capacity *= 2;
+        table->entries = realloc(table->entries, sizeof(Relocation) * table->capacity);
+        assertAlloc(table->entries);
+    }
+
+    table->entries[table->count++] = (Relocation){ .offset = r->length, .kind = kind };
+}
+
+static void addPatch(Rewriter *r, size_t target) {
+    if (r->patchCount >= r->patchCapacity) {
+        r->patchCapacity *= 2;
+        r->patches = realloc(r->patches, sizeof(JumpPatch) * r->patchCapacity);
+        assertAlloc(r->patches);
+    }
+
+    r->patches[r->patchCount++] = (JumpPatch){ .position = r->length, .target = target };
+}
+
+static size_t zeroConstant(Rewriter *r) {
+    if (r->zero != SIZE_MAX) return r->zero;
+
+    ConstantPool *pool = &r->program->constants;
+    if (pool->count >= pool->capacity) {
+        pool->capacity *= 2;
+        pool->values = realloc(pool->values, sizeof(Object) * pool->capacity);
+        assertAlloc(pool->values);
+    }
+
+    pool->values[pool->count] = i32Object(0);
+    r->zero = pool->count++;
+    return r->zero;
+}
+
+// copies the instruction at 'pc', renumbering the functions it names and
+// moving its local slot up by 'slotBase'
+static void copyInstruction(Rewriter *r, size_t pc, size_t slotBase) {
+    const Program *p = r->program;
+    AvmInstruction instr = p->code[pc];
+    emitWord(r, instr, pc);
+
+    for (size_t i = 1; i <= operandCount(instr); i++) {
+        AvmInstruction operand = p->code[pc + i];
+
+        if (i == 1 && (instr == INSTR_CALL || instr == INSTR_SPAWN || instr == INSTR_PARALLEL)) {
+            if ((size_t)operand < p->functions.count) operand = r->indices[operand];
+            addRelocation(r, RELOC_CALL);
+        } else if (instr == INSTR_PUSH_CONST) {
+            addRelocation(r, RELOC_CONSTANT);
+        } else if (instr == INSTR_LOAD_LOCAL || instr == INSTR_STORE_LOCAL) {
+            operand += slotBase;
+        }
+
+        emitWord(r, operand, pc);
+    }
+}
+
+// straight-line code that only moves values between the stack and its
+// slots and computes on them, ending in its only RET with just the result
+// left above its locals
+static bool isInlinable(const Program *p, const Function *fn, size_t end) {
+    size_t start = fn->address;
+    if (fn->stub || end <= start || end - start > PGO_INLINE_WORDS) return false;
+
+    size_t depth = fn->localCount;
+    for (size_t pc = start; pc < end; ) {
+        AvmInstruction instr = p->code[pc];
+        size_t next = pc + 1 + operandCount(instr);
+        if (next > end) return false;
+
+        switch (instr) {
+            case INSTR_RET: return next == end && depth == fn->localCount + 1;
+            case INSTR_PUSH_CONST:
+            case INSTR_PUSH_I64: depth++; break;
+            case INSTR_LOAD_LOCAL: {
+                if ((size_t)p->code[pc + 1] >= fn->localCount) return false;
+                depth++;
+                break;
+            }
+            case INSTR_STORE_LOCAL: {
+                if ((size_t)p->code[pc + 1] >= fn->localCount || depth <= fn->localCount) return false;
+                depth--;
+                break;
+            }
+            case INSTR_POP:
+            case INSTR_ARRAY_GET: {
+                if (depth <= fn->localCount) return false;
+                depth--;
+                break;
+            }
+            case INSTR_ARRAY_LEN: break;
+            default: {
+                if (!isBinaryInstruction(instr) || depth < fn->localCount + 2) return false;
+                depth--;
+                break;
+            }
+        }
+
+        pc = next;
+    }
+
+    return false;
+}
+
+static bool shouldInline(const Rewriter *r, size_t caller, size_t pc) {
+    const Program *p = r->program;
+    const FunctionCounts *counts = r->counts[caller];
+    size_t callee = p->code[pc + 1];
+    if (!counts || p->code[pc] != INSTR_CALL || callee >= p->functions.count || callee == caller ||
+        !r->inlinable[callee]) {
+        return false;
+    }
+
+    return counts->counts[pc - p->functions.entries[caller].address] >= PGO_INLINE_CALLS;
+}
+
+// the callee's body in place of the call, on slots past the caller's own
+static void inlineCall(Rewriter *r, size_t callee, size_t pc, size_t slotBase) {
+    const Program *p = r->program;
+    const Function *fn = &p->functions.entries[callee];
+    size_t start = fn->address, end = r->ends[callee];
+
+    // the arguments come off the stack last first, as a call leaves them in its frame
+    for (size_t i = fn->arity; i > 0; i--) {
+        emitWord(r, INSTR_STORE_LOCAL, pc);
+        emitWord(r, slotBase + i - 1, pc);
+    }
+
+    // a frame's other locals start at zero, the slots here may hold an earlier callee's
+    bool *stored = alloc(fn->localCount + 1);
+    memset(stored, 0, fn->localCount + 1);
+    for (size_t q = start; q < end; q += 1 + operandCount(p->code[q])) {
+        AvmInstruction instr = p->code[q];
+        size_t slot = instr == INSTR_LOAD_LOCAL || instr == INSTR_STORE_LOCAL ? (size_t)p->code[q + 1] : 0;
+
+        if (instr == INSTR_STORE_LOCAL) {
+            stored[slot] = true;
+        } else if (instr == INSTR_LOAD_LOCAL && slot >= fn->arity && !stored[slot]) {
+            stored[slot] = true;
+            emitWord(r, INSTR_PUSH_CONST, q);
+            addRelocation(r, RELOC_CONSTANT);
+            emitWord(r, zeroConstant(r), q);
+            emitWord(r, INSTR_STORE_LOCAL, q);
+            emitWord(r, slotBase + slot, q);
+        }
+    }
+    FREE_ALLOC(stored);
+
+    // everything but the closing RET, whose result is already on top of the stack
+    for (size_t q = start; q < end - 1; q += 1 + operandCount(p->code[q])) copyInstruction(r, q, slotBase);
+}
+
+// the function's blocks in their original order with the ones that never ran
+// moved behind them, blocks that used to fall into the next one jump there
+static void emitFunction(Rewriter *r, size_t index, Function *out) {
+    const Program *p = r->program;
+    const Function *fn = &p->functions.entries[index];
+    const FunctionCounts *counts = r->counts[index];
+    size_t start = fn->address, end = r->ends[index], length = end - start;
+
+    bool *leaders = alloc(length + 1);
+    markBlocks(p, start, end, leaders);
+
+    size_t *blocks = alloc((length + 1) * sizeof(size_t));
+    size_t blockCount = 0;
+    for (size_t offset = 0; offset < length; offset++) {
+        if (leaders[offset]) blocks[blockCount++] = offset;
+    }
+
+    // the entry block stays first, a parallel body starts over there
+    size_t *order = alloc((blockCount + 1) * sizeof(size_t));
+    size_t placed = 0;
+    for (int cold = 0; cold <= 1; cold++) {
+        for (size_t b = 0; b < blockCount; b++) {
+            bool neverRan = counts && b > 0 && counts->counts[blocks[b]] == 0;
+            if (neverRan != (bool)cold) continue;
+
+            if (cold && placed != b) r->stats->movedBlocks++;
+            order[placed++] = b;
+        }
+    }
+
+    size_t *addresses = alloc((length + 1) * sizeof(size_t));
+    size_t address = r->length, extraSlots = 0;
+    r->patchCount = 0;
+
+    for (size_t k = 0; k < blockCount; k++) {
+        size_t b = order[k];
+        size_t blockEnd = b + 1 < blockCount ? start + blocks[b + 1] : end;
+        size_t last = start + blocks[b];
+
+        for (size_t pc = start + blocks[b]; pc < blockEnd; pc += 1 + operandCount(p->code[pc])) {
+            AvmInstruction instr = p->code[pc];
+            addresses[pc - start] = r->length;
+            last = pc;
+
+            if (isJump(instr)) {
+                emitWord(r, instr, pc);
+                addPatch(r, jumpTarget(p, pc) - start);
+                emitWord(r, 0, pc);
+            } else if (shouldInline(r, index, pc)) {
+                size_t callee = p->code[pc + 1];
+                inlineCall(r, callee, pc, fn->localCount);
+
+                size_t slots = p->functions.entries[callee].localCount;
+                if (slots > extraSlots) extraSlots = slots;
+                r->stats->inlined++;
+            } else {
+                copyInstruction(r, pc, 0);
+            }
+        }
+
+        bool fallsThrough = !endsFlow(p->code[last]) && blockEnd < end;
+        if (fallsThrough && (k + 1 >= blockCount || order[k + 1] != b + 1)) {
+            emitWord(r, INSTR_JMP, last);
+            addPatch(r, blockEnd - start);
+            emitWord(r, 0, last);
+        }
+    }
+
+    for (size_t i = 0; i < r->patchCount; i++) {
+        JumpPatch patch = r->patches[i];
+        r->code[patch.position] = (int32_t)((long)addresses[patch.target] - (long)(patch.position + 1));
+    }
+
+    *out = *fn;
+    out->address = address;
+    out->localCount = fn->localCount + extraSlots;
+
+    FREE_ALLOC(leaders);
+    FREE_ALLOC(blocks);
+    FREE_ALLOC(order);
+    FREE_ALLOC(addresses);
+}
+
+typedef struct {
+    size_t index;
+    uint64_t heat;
+    size_t address;
+} FunctionHeat;
+
+static int compareHeat(const void *a, const void *b) {
+    const FunctionHeat *left = a, *right = b;
+    if (left->heat != right->heat) return left->heat < right->heat ? 1 : -1;
+    return (left->address > right->address) - (left->address < right->address);
+}
+
+// hottest first, by the instructions they ran. a callee inlined at every
+// call the profile saw no longer runs on its own and goes with the cold ones
+static FunctionHeat *orderFunctions(const Rewriter *r) {
+    const Program *p = r->program;
+    size_t count = p->functions.count;
+
+    uint64_t *calls = alloc((count + 1) * sizeof(uint64_t));
+    uint64_t *inlined = alloc((count + 1) * sizeof(uint64_t));
+    memset(calls, 0, (count + 1) * sizeof(uint64_t));
+    memset(inlined, 0, (count + 1) * sizeof(uint64_t));
+
+    for (size_t i = 0; i < count; i++) {
+        const FunctionCounts *counts = r->counts[i];
+        size_t start = p->functions.entries[i].address;
+        if (!counts) continue;
+
+        for (size_t pc = start; pc < r->ends[i]; pc += 1 + operandCount(p->code[pc])) {
+            AvmInstruction instr = p->code[pc];
+            if (instr != INSTR_CALL && instr != INSTR_SPAWN && instr != INSTR_PARALLEL) continue;
+
+            size_t callee = p->code[pc + 1];
+            if (callee >= count) continue;
+
+            calls[callee] += counts->counts[pc - start];
+            if (shouldInline(r, i, pc)) inlined[callee] += counts->counts[pc - start];
+        }
+    }
+
+    FunctionHeat *order = alloc((count + 1) * sizeof(FunctionHeat));
+    for (size_t i = 0; i < count; i++) {
+        bool absorbed = calls[i] > 0 && calls[i] == inlined[i];
+        order[i] = (FunctionHeat){
+            .index = i,
+            .heat = r->counts[i] && !absorbed ? r->counts[i]->instructions : 0,
+            .address = p->functions.entries[i].address,
+        };
+    }
+    qsort(order, count, sizeof(FunctionHeat), compareHeat);
+
+    FREE_ALLOC(calls);
+    FREE_ALLOC(inlined);
+    return order;
+}
+
+// the location each rewritten instruction was copied from
+static LineTable relocateLines(const Rewriter *r) {
+    const LineTable *from = &r->program->lines;
+    LineTable lines = {0};
+    if (from->count == 0) return lines;
+
+    for (size_t i = 0; i < from->fileCount; i++) addLineFile(&lines, from->files[i]);
+
+    for (size_t pc = 0; pc < r->length; pc += 1 + operandCount(r->code[pc])) {
+        LineEntry entry;
+        if (!findLine(from, r->origins[pc], &entry)) continue;
+
+        entry.pc = pc;
+        addLine(&lines, entry);
+    }
+
+    return lines;
+}
+
+void optimizeProgram(Program *program, const ProfileData *data, PgoStats *stats) {
+    const FunctionTable *table = &program->functions;
+    size_t count = table->count;
+    if (count == 0) return;
+
+    Rewriter r = {
+        .program = program,
+        .ends = alloc((count + 1) * sizeof(size_t)),
+        .counts = alloc((count + 1) * sizeof(FunctionCounts *)),
+        .inlinable = alloc(count + 1),
+        .indices = alloc((count + 1) * sizeof(size_t)),
+        .code = alloc(sizeof(AvmInstruction)),
+        .origins = alloc(sizeof(size_t)),
+        .length = 0,
+        .capacity = 1,
+        .relocations = { .entries = alloc(sizeof(Relocation)), .count = 0, .capacity = 1 },
+        .patches = alloc(sizeof(JumpPatch)),
+        .patchCount = 0,
+        .patchCapacity = 1,
+        .zero = SIZE_MAX,
+        .stats = stats,
+    };
+    functionExtents(program, r.ends);
+
+    // code that is not all there or jumps oddly is left exactly as it is
+    bool ok = true;
+    for (size_t i = 0; i < count && ok; i++) {
+        const Function *fn = &table->entries[i];
+        size_t start = fn->address, end = r.ends[i];
+        if (fn->stub || start >= end) {
+            ok = false;
+            break;
+        }
+
+        bool *leaders = alloc(end - start + 1);
+        ok = markBlocks(program, start, end, leaders);
+        FREE_ALLOC(leaders);
+
+        const FunctionCounts *counts = findCounts(data, fn->name);
+        bool current = counts && counts->length == end - start && counts->checksum == codeChecksum(program, start, end);
+        if (counts && !current) stats->stale++;
+        if (current) stats->profiled++;
+
+        r.counts[i] = current ? counts : NULL;
+        r.inlinable[i] = isInlinable(program, fn, end);
+    }
+
+    if (ok) {
+        FunctionHeat *order = orderFunctions(&r);
+        for (size_t i = 0; i < count; i++) r.indices[order[i].index] = i;
+
+        Function *functions = alloc((count + 1) * sizeof(Function));
+        for (size_t i = 0; i < count; i++) emitFunction(&r, order[i].index, &functions[i]);
+
+        LineTable lines = relocateLines(&r);
+
+        // the functions keep their names and types, only the table holding them is new
+        FREE_ALLOC(program->code);
+        FREE_ALLOC(program->functions.entries);
+        FREE_ALLOC(program->relocations.entries);
+        freeLineTable(&program->lines);
+
+        program->code = r.code;
+        program->length = r.length;
+        program->capacity = r.capacity;
+        program->functions = (FunctionTable){ .entries = functions, .count = count, .capacity = count + 1 };
+        program->relocations = r.relocations;
+        program->lines = lines;
+
+        FREE_ALLOC(order);
+    } else {
+        FREE_ALLOC(r.code);
+        FREE_ALLOC(r.relocations.entries);
+    }
+
+    FREE_ALLOC(r.ends);
+    FREE_ALLOC(r.counts);
+    FREE_ALLOC(r.inlinable);
+    FREE_ALLOC(r.indices);
+    FREE_ALLOC(r.origins);
+    FREE_ALLOC(r.patches);
+}
\ No newline at end of file
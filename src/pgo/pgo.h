@@ -0,0 +1,66 @@
+#ifndef pgo_h
+#define pgo_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "../assembler/assembler.h"
+#include "../vm/profile.h"
+
+#define PGO_MAGIC "aprof"
+#define PGO_VERSION 1
+#define PGO_EXTENSION ".aprof"
+
+// call sites that ran at least this often have their callee inlined, when
+// it is small enough and straight-line
+#define PGO_INLINE_CALLS 1000
+#define PGO_INLINE_WORDS 32
+
+// what a run recorded about one function, addressed by offsets into its code
+typedef struct {
+    char *name;
+    // of the code words the counts were taken on, a function compiled
+    // differently since then keeps none of them
+    uint64_t checksum;
+    size_t length;
+
+    // instructions that ran inside the function, the hottest come first
+    uint64_t instructions;
+    // how often the block starting at an offset or the call there ran, and
+    // how often the JMP_IF_FALSE there jumped
+    uint64_t *counts;
+    uint64_t *jumped;
+} FunctionCounts;
+
+// a '.aprof' file as read back, sorted by function name
+typedef struct {
+    FunctionCounts *functions;
+    size_t count;
+    size_t capacity;
+} ProfileData;
+
+// what 'optimizeProgram' did with a profile
+typedef struct {
+    size_t inlined;
+    size_t movedBlocks;
+    size_t profiled;
+    // functions that changed since the profile was recorded
+    size_t stale;
+} PgoStats;
+
+// writes the block, call and branch counts and the opcode pairs that ran
+// back to back in every function that ran, from a profile that counted
+// addresses, as text
+bool writeProfileData(const Profile *profile, const Program *program, const char *path);
+
+bool readProfileData(const char *path, ProfileData *data);
+void freeProfileData(ProfileData *data);
+
+// lays the program out by what a recorded run did: hot small callees are
+// inlined into their hot call sites, blocks that never ran are moved to the
+// end of their function and functions are ordered hottest first. the
+// function table is renumbered to match the new order
+void optimizeProgram(Program *program, const ProfileData *data, PgoStats *stats);
+
+#endif
\ No newline at end of file
@@ -1,48 +1,664 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
 #include "runtime.h"
 
 #include "../parser/lexer.h"
-#include "../parser/parser.h"
-#include "../ir/compiler.h"
 #include "../assembler/assembler.h"
 #include "../vm/vm.h"
+#include "../vm/verifier.h"
+#include "../vm/heap.h"
+#include "../vm/profile.h"
+#include "../native/x86_64.h"
+#include "../image/image.h"
+#include "../linker/linker.h"
+#include "../cache/cache.h"
+#include "../incremental/incremental.h"
+#include "../lazy/lazy.h"
+#include "../pgo/pgo.h"
+#include "../trace/trace.h"
+#include "../util/alloc.h"
 
 Runtime newRuntime(const char *path, bool debug) {
     Runtime runtime = {
         .path = path,
         .debug = debug,
+        .limits = defaultAvmConfig(),
+        .useCache = true,
+        .cacheLimit = CACHE_SIZE_LIMIT,
     };
     
     return runtime;
 }
 
-void run(Runtime *runtime) {
-    if (!runtime) return;
+// lays the assembled program out by the counts recorded in 'profileUse'
+static bool applyProfile(Runtime *runtime, Program *program) {
+    ProfileData data;
+    if (!readProfileData(runtime->profileUse, &data)) {
+        freeProfileData(&data);
+        return false;
+    }
+
+    PgoStats stats = {0};
+    TRACE_BEGIN("pgo", "compile");
+    optimizeProgram(program, &data, &stats);
+    TRACE_END();
+    freeProfileData(&data);
 
-    Lexer lexer = newLexer(runtime->path);
+    if (stats.stale > 0) {
+        fprintf(stderr, "pgo: %zu functions changed since %s was recorded, their counts were ignored\n",
+                stats.stale, runtime->profileUse);
+    }
+    if (runtime->stats || runtime->debug) {
+        fprintf(stderr, "pgo: %zu functions profiled, %zu calls inlined, %zu blocks moved out of line\n",
+                stats.profiled, stats.inlined, stats.movedBlocks);
+    }
+    if (runtime->debug) printBytecode(program);
+
+    return true;
+}
+
+// runs the front end and the assembler, handing the assembled program to the caller.
+// given a build, only what changed since the last build of the file is compiled
+static bool compileProgram(Runtime *runtime, Program *program, Cache *cache, Build *build) {
+    TRACE_BEGIN("lex", "compile");
+    Lexer lexer;
+    if (!newLexer(runtime->path, &lexer)) {
+        TRACE_END();
+        return false;
+    }
     registerLexerKeywords(&lexer);
     lexerTokenize(&lexer);
+    TRACE_END();
     if (runtime->debug) printTokens(&lexer);
 
-    Parser parser = newParser(lexer.tokens, lexer.count);
-    parseAst(&parser);
-    if (runtime->debug) printParserAst(&parser);
+    TRACE_BEGIN(build ? "incremental build" : "build", "compile");
+    bool ok = build ? compileIncremental(build, cache, runtime->path, &lexer, program)
+                    : compileTokens(lexer.tokens, lexer.count, runtime->path, runtime->debug, stderr, program);
+    TRACE_END();
+
+    freeLexer(&lexer);
+    if (ok && runtime->profileUse && !applyProfile(runtime, program)) {
+        freeProgram(program);
+        return false;
+    }
+
+    return ok;
+}
+
+static double millisecondsSince(const struct timespec *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return (end.tv_sec - start->tv_sec) * 1e3 + (end.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+// the survivor ratios are the share of the bytes a collection looked at that it kept
+static void reportHeap(Heap *heap, double elapsed) {
+    GcStats stats = heapStats(heap);
+    double minorSurvival = stats.nurseryCollected ? 100.0 * stats.promoted / stats.nurseryCollected : 0;
+    double majorSurvival = stats.oldCollected ? 100.0 * stats.oldSurvived / stats.oldCollected : 0;
+
+    fprintf(stderr, "gc: allocated %zu bytes at %.1f MB/s\n", stats.allocated,
+            elapsed > 0 ? stats.allocated / (elapsed * 1e3) : 0);
+    fprintf(stderr, "gc: %zu minor collections, %.3f ms paused, %.1f%% survived\n",
+            stats.minorCollections, stats.minorPause, minorSurvival);
+    fprintf(stderr, "gc: %zu major collections, %.3f ms paused, %.1f%% survived\n",
+            stats.majorCollections, stats.majorPause, majorSurvival);
+    fprintf(stderr, "gc: longest pause %.3f ms\n", stats.maxPause);
+}
+
+// the loops that ran most, each by its function and the offset of the jump
+// that closes it within the function
+static void reportLoops(AVM *vm) {
+    LoopCount *loops;
+    size_t count = hotLoops(vm, &loops);
+    const Program *p = vm->program;
+
+    for (size_t i = 0; i < count && i < 5; i++) {
+        const Function *owner = owningFunction(p, loops[i].address);
+        fprintf(stderr, "loop: %s+%zu taken %llu times\n", owner ? owner->name : "?",
+                owner ? loops[i].address - owner->address : loops[i].address,
+                (unsigned long long)loops[i].count);
+    }
+
+    FREE_ALLOC(loops);
+
+    if (vm->osrCompiled > 0) {
+        fprintf(stderr, "osr: translated %llu functions, loops moved into them %llu times\n",
+                (unsigned long long)vm->osrCompiled, (unsigned long long)vm->osrEntered);
+    }
+}
+
+static void reportProfile(Runtime *runtime, const Profile *profile, const Program *program) {
+    printOpcodeHistogram(profile, stderr);
+    printOpcodeCounters(profile, stderr);
+    printHotLines(profile, program, stderr);
+
+    if (!writeFoldedStacks(profile, program, runtime->profile)) {
+        fprintf(stderr, "profile: could not write '%s'\n", runtime->profile);
+        return;
+    }
+
+    fprintf(stderr, "profile: wrote %zu stack samples to %s, %zu dropped\n",
+            profile->taken - profile->dropped, runtime->profile, profile->dropped);
+}
+
+static void writeProfileCounts(Runtime *runtime, const Profile *profile, const Program *program) {
+    if (!writeProfileData(profile, program, runtime->profileGenerate)) {
+        fprintf(stderr, "pgo: could not write '%s'\n", runtime->profileGenerate);
+        return;
+    }
+
+    fprintf(stderr, "pgo: wrote %s, rebuild with --profile-use=%s\n", runtime->profileGenerate,
+            runtime->profileGenerate);
+}
+
+// runs the vm's program once, or 'benchRuns' times and reports timings,
+// resetting the vm in between so its stacks are only reserved once. false
+// when any of the runs failed
+static bool executeOn(Runtime *runtime, AVM *vm) {
+    size_t runs = runtime->benchRuns > 0 ? runtime->benchRuns : 1;
+
+    // loops moved into the optimised tier would go uncounted
+    if (runtime->profile || runtime->profileGenerate) {
+        vm->profile = newProfile();
+        vm->config.osrThreshold = SIZE_MAX;
+    }
+    if (runtime->profileGenerate) countAddresses(vm->profile, vm->program->length);
+    if (runtime->profile) {
+        const Counters *counters = mappedCounters();
+        if (counters) attachCounters(vm->profile, counters);
+        startProfileTimer();
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    resetHeapStats(vm->heap);
+    resetCounters(vm);
+
+    bool ok = true;
+    for (size_t i = 0; i < runs; i++) {
+        if (i > 0) resetAVM(vm);
+        TRACE_BEGIN("execute", "run");
+        execute(vm);
+        TRACE_END();
+        if (vm->failed) ok = false;
+
+        Object result;
+        if (i == runs - 1 && vmResult(vm, &result)) {
+            printf("\nVM execution finished: ");
+            printObject(result);
+            printf("\n");
+        }
+    }
 
-    Compiler compiler = newCompiler(parser.ast);
-    compile(&compiler);
-    freeCompiler(&compiler);
+    double elapsed = millisecondsSince(&start);
+    if (vm->profile) {
+        if (runtime->profile) {
+            stopProfileTimer();
+            reportProfile(runtime, vm->profile, vm->program);
+        }
+        if (runtime->profileGenerate) writeProfileCounts(runtime, vm->profile, vm->program);
+        freeProfile(vm->profile);
+        vm->profile = NULL;
+    }
 
-    Assembler assembler = newAssembler(runtime->debug);
-    assemble(&assembler);
+    if (runtime->benchRuns > 0) {
+        fprintf(stderr, "bench: %zu runs, %.3f ms total, %.3f ms/run\n", runs, elapsed, elapsed / runs);
+    }
 
-    AVM vm = newAVM(assembler.program);
-    execute(&vm);
+    if (runtime->stats && vm->heap) reportHeap(vm->heap, elapsed);
+    if (runtime->stats) reportLoops(vm);
+    return ok;
+}
+
+// given a lazy program, stubs are compiled as the vm reaches them and the
+// grown program is handed back to the caller
+static bool executeProgram(Runtime *runtime, Program *program, AvmConfig config, bool verified,
+                           LazyProgram *lazy) {
+    AVM vm = newAVM(program, config);
+    vm.verified = verified;
+    if (lazy) {
+        vm.materialize = compileStub;
+        vm.materializeContext = lazy;
+    }
 
+    bool ok = executeOn(runtime, &vm);
     freeAVM(&vm);
-    freeAssembler(&assembler);
-    freeParser(&parser);
-    freeLexer(&lexer);
+    return ok;
+}
+
+// spreads the runs over isolates on 'threads' threads, all running the one
+// copy of the program, and reports the throughput. false unless every run succeeded
+static bool executeShared(Runtime *runtime, SharedProgram *shared) {
+    size_t entry;
+    if (!findFunction(&shared->program, "main", &entry)) {
+        fprintf(stderr, "No 'main' function to execute\n");
+        releaseProgram(shared);
+        return false;
+    }
+
+    if (shared->program.functions.entries[entry].arity != 0) {
+        fprintf(stderr, "'main' must not take any arguments\n");
+        releaseProgram(shared);
+        return false;
+    }
+
+    size_t runs = runtime->benchRuns > 0 ? runtime->benchRuns : 1;
+    BatchRequest *requests = alloc(runs * sizeof(BatchRequest));
+    for (size_t i = 0; i < runs; i++) requests[i] = (BatchRequest){ .function = entry };
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    TRACE_BEGIN("execute batch", "run");
+    runBatch(shared, requests, runs, runtime->threads, stdout, stderr);
+    TRACE_END();
+    double elapsed = millisecondsSince(&start);
+
+    bool ok = true;
+    for (size_t i = 0; i < runs; i++) {
+        if (!requests[i].ok) ok = false;
+    }
+
+    if (requests[runs - 1].ok) {
+        printf("\nVM execution finished: ");
+        printObject(requests[runs - 1].result);
+        printf("\n");
+    }
+
+    if (runtime->benchRuns > 0) {
+        fprintf(stderr, "bench: %zu runs on %zu threads, %.3f ms total, %.0f runs/s\n",
+                runs, runtime->threads, elapsed, runs / (elapsed / 1e3));
+    }
+
+    FREE_ALLOC(requests);
+    releaseProgram(shared);
+    return ok;
+}
+
+// objects with imports only run once 'aster link' has resolved them
+static bool checkLinked(const Program *program, const char *path) {
+    if (program->imports.count == 0) return true;
+
+    fprintf(stderr, "%s: '%s' is declared extern but never defined, link it with 'aster link'\n",
+            path, program->imports.entries[0].name);
+    return false;
+}
+
+// images skip the front end entirely, their functions are validated on first
+// call so they run on the checked interpreter
+static bool runImage(Runtime *runtime) {
+    Image image;
+    TRACE_BEGIN("load image", "load");
+    bool loaded = loadImage(runtime->path, &image);
+    TRACE_END();
+    if (!loaded) return false;
+    if (runtime->debug) printBytecode(&image.program);
+    if (!checkLinked(&image.program, runtime->path)) {
+        freeImage(&image);
+        return false;
+    }
+
+    if (runtime->threads > 0) return executeShared(runtime, shareImage(image, runtime->limits));
+
+    bool ok = executeProgram(runtime, &image.program, runtime->limits, false, NULL);
+    freeImage(&image);
+    return ok;
+}
+
+// a verified program only reserves what it can reach, anything beyond
+// the configured limits is still caught by the guard pages
+static AvmConfig verifiedConfig(Runtime *runtime, const Program *program, bool *verified) {
+    TRACE_BEGIN("verify", "load");
+    Verification verification = verifyProgram(program);
+    TRACE_END();
+    if (runtime->debug) printVerification(&verification);
+
+    AvmConfig config = runtime->limits;
+    if (verification.ok) {
+        if (verification.maxStack < config.stackLimit) config.stackLimit = verification.maxStack;
+        if (verification.maxCallDepth < config.callStackLimit) config.callStackLimit = verification.maxCallDepth;
+        shrinkFiberLimits(&config, &verification);
+    }
+
+    *verified = verification.ok;
+    return config;
+}
+
+static bool runVerified(Runtime *runtime, Program *program) {
+    bool verified = false;
+    AvmConfig config = verifiedConfig(runtime, program, &verified);
+
+    return executeProgram(runtime, program, config, verified, NULL);
+}
+
+static WarmProgram *findWarm(WarmCache *warm, const CacheKey *key, AvmConfig limits) {
+    for (size_t i = 0; i < warm->count; i++) {
+        WarmProgram *entry = &warm->entries[i];
+        if (memcmp(entry->key.hash, key->hash, sizeof(key->hash)) == 0 &&
+            entry->limits.stackLimit == limits.stackLimit &&
+            entry->limits.callStackLimit == limits.callStackLimit &&
+            entry->limits.fiberStackLimit == limits.fiberStackLimit &&
+            entry->limits.fiberCallStackLimit == limits.fiberCallStackLimit &&
+            entry->limits.workers == limits.workers &&
+            entry->limits.nurserySize == limits.nurserySize &&
+            entry->limits.heapLimit == limits.heapLimit &&
+            entry->limits.osrThreshold == limits.osrThreshold) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+static void freeWarmProgram(WarmProgram *entry) {
+    freeIsolate(&entry->isolate);
+}
+
+// takes over the reference to the program, evicting the least recently
+// used entry once the cache is full
+static bool keepWarm(Runtime *runtime, const CacheKey *key, SharedProgram *shared) {
+    WarmCache *warm = runtime->warm;
+
+    WarmProgram *entry = &warm->entries[warm->count];
+    if (warm->count < WARM_PROGRAM_LIMIT) {
+        warm->count++;
+    } else {
+        entry = &warm->entries[0];
+        for (size_t i = 1; i < warm->count; i++) {
+            if (warm->entries[i].lastUsed < entry->lastUsed) entry = &warm->entries[i];
+        }
+        freeWarmProgram(entry);
+    }
+
+    *entry = (WarmProgram){
+        .key = *key,
+        .limits = runtime->limits,
+        .isolate = newIsolate(shared),
+        .lastUsed = ++warm->clock,
+        .runs = 1,
+    };
+    releaseProgram(shared);
+
+    return executeOn(runtime, &entry->isolate.vm);
+}
+
+// a warm program skips the front end, the verifier and the stack reservations.
+// false on a miss, 'ok' says whether a hit ran successfully
+static bool runWarm(Runtime *runtime, const CacheKey *key, bool *ok) {
+    WarmProgram *entry = findWarm(runtime->warm, key, runtime->limits);
+    if (!entry) return false;
+
+    entry->lastUsed = ++runtime->warm->clock;
+    entry->runs++;
+    resetAVM(&entry->isolate.vm);
+
+    if (runtime->stats) {
+        fprintf(stderr, "warm: hit %s, run %zu times so far\n", key->name, entry->runs);
+    }
+
+    *ok = executeOn(runtime, &entry->isolate.vm);
+    return true;
+}
+
+// a hit maps the entry and goes straight to the verifier, skipping the front end.
+// false on a miss, 'ok' says whether a hit ran successfully
+static bool runCached(Runtime *runtime, Cache *cache, const CacheKey *key, bool *ok) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    Image image;
+    double compileTime = -1;
+    TRACE_BEGIN("cache load", "load");
+    bool hit = cacheLoad(cache, key, &image, &compileTime);
+    TRACE_END();
+    if (!hit) return false;
+
+    if (runtime->stats) {
+        double loadTime = millisecondsSince(&start);
+        fprintf(stderr, "cache: hit %s, loaded in %.3f ms", key->name, loadTime);
+        if (compileTime >= 0) fprintf(stderr, ", saved %.3f ms", compileTime - loadTime);
+        fprintf(stderr, "\n");
+    }
+
+    if (runtime->warm) {
+        *ok = keepWarm(runtime, key, shareImage(image, runtime->limits));
+    } else if (runtime->threads > 0) {
+        *ok = executeShared(runtime, shareImage(image, runtime->limits));
+    } else {
+        *ok = runVerified(runtime, &image.program);
+        freeImage(&image);
+    }
+
+    return true;
+}
+
+// only signatures are parsed up front, every body is parsed, checked and compiled
+// the first time it is called, so it runs on the checked interpreter. false when
+// the file has to go through the eager front end instead, with 'ran' cleared
+// when it could not be read at all or did not run successfully
+static bool runLazy(Runtime *runtime, bool *ran) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    LazyProgram lazy;
+    if (!newLazyProgram(runtime->path, &lazy)) {
+        *ran = false;
+        return true;
+    }
+
+    Program program;
+    if (!prepareLazyProgram(&lazy, &program)) {
+        freeLazyProgram(&lazy);
+        return false;
+    }
+
+    if (runtime->stats) {
+        fprintf(stderr, "lazy: prepared %zu functions in %.3f ms\n",
+                program.functions.count, millisecondsSince(&start));
+    }
+
+    *ran = checkLinked(&program, runtime->path);
+    if (*ran) {
+        *ran = executeProgram(runtime, &program, runtime->limits, false, &lazy);
+
+        if (runtime->stats) {
+            fprintf(stderr, "lazy: compiled %zu of %zu functions\n", lazy.compiled,
+                    program.functions.count);
+        }
+    }
+
+    freeProgram(&program);
+    freeLazyProgram(&lazy);
+    return true;
+}
+
+bool run(Runtime *runtime) {
+    if (!runtime) return false;
+
+    if (isImagePath(runtime->path)) return runImage(runtime);
+
+    bool ran = true;
+    if (runtime->lazy && !runtime->debug && runLazy(runtime, &ran)) return ran;
+
+    // debug runs are there to show the front end, so they always compile, and
+    // the cache does not know which profile a program was laid out by
+    CacheKey key;
+    bool keyed = runtime->useCache && !runtime->debug && !runtime->profileUse && cacheKey(runtime->path, &key);
+    if (keyed && runtime->warm && runWarm(runtime, &key, &ran)) return ran;
+
+    Cache cache = newCache(runtime->cacheLimit);
+    bool cached = keyed && cache.directory;
+
+    if (cached && runCached(runtime, &cache, &key, &ran)) {
+        freeCache(&cache);
+        return ran;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    Program program;
+    Build build = newBuild();
+    if (!compileProgram(runtime, &program, &cache, cached ? &build : NULL)) {
+        freeBuild(&build);
+        freeCache(&cache);
+        return false;
+    }
+    double compileTime = millisecondsSince(&start);
+
+    if (!checkLinked(&program, runtime->path)) {
+        freeProgram(&program);
+        freeBuild(&build);
+        freeCache(&cache);
+        return false;
+    }
+
+    if (cached) {
+        TRACE_BEGIN("cache store", "compile");
+        bool stored = cacheStore(&cache, &key, &program, runtime->path, compileTime);
+        if (stored) saveBuild(&build, &cache, runtime->path, &key);
+        TRACE_END();
+
+        if (runtime->stats) {
+            fprintf(stderr, "cache: miss %s, compiled in %.3f ms%s\n", key.name, compileTime,
+                    stored ? "" : ", could not store the entry");
+            fprintf(stderr, "build: %s, recompiled %zu of %zu functions\n",
+                    build.incremental ? "incremental" : "full", build.recompiled,
+                    program.functions.count);
+        }
+    } else if (runtime->stats) {
+        fprintf(stderr, "cache: disabled, compiled in %.3f ms\n", compileTime);
+    }
+
+    if (runtime->warm && keyed) {
+        ran = keepWarm(runtime, &key, shareProgram(program, runtime->limits));
+    } else if (runtime->threads > 0) {
+        ran = executeShared(runtime, shareProgram(program, runtime->limits));
+    } else {
+        ran = runVerified(runtime, &program);
+        freeProgram(&program);
+    }
+    freeBuild(&build);
+    freeCache(&cache);
+    return ran;
+}
+
+bool buildImage(Runtime *runtime, const char *output) {
+    if (!runtime) return false;
+
+    Program program;
+    if (!compileProgram(runtime, &program, NULL, NULL)) return false;
+    if (runtime->strip) freeLineTable(&program.lines);
+
+    bool ok = writeImage(&program, runtime->path, output);
+    freeProgram(&program);
+
+    return ok;
+}
+
+bool buildNative(Runtime *runtime, const char *output) {
+    if (!runtime) return false;
+
+    Program program;
+    if (!compileProgram(runtime, &program, NULL, NULL)) return false;
+    if (!checkLinked(&program, runtime->path)) {
+        freeProgram(&program);
+        return false;
+    }
+
+    size_t length = strlen(output) + 3;
+    char *assemblyPath = alloc(length);
+    snprintf(assemblyPath, length, "%s.s", output);
+
+    FILE *out = fopen(assemblyPath, "w");
+    if (!out) {
+        fprintf(stderr, "could not create %s: %s\n", assemblyPath, strerror(errno));
+        FREE_ALLOC(assemblyPath);
+        freeProgram(&program);
+        return false;
+    }
+
+    NativeBackend backend = newNativeBackend(&program, out);
+    emitNative(&backend);
+    bool ok = !backend.hadError;
+    freeNativeBackend(&backend);
+    fclose(out);
+
+    if (ok) ok = linkNative(assemblyPath, output);
+
+    // the assembly is kept around for inspection in debug builds
+    if (!runtime->debug) remove(assemblyPath);
+
+    FREE_ALLOC(assemblyPath);
+    freeProgram(&program);
+
+    return ok;
+}
+
+bool linkImages(const char **paths, size_t count, const char *output) {
+    Image *images = alloc((count + 1) * sizeof(Image));
+    Program *objects = alloc((count + 1) * sizeof(Program));
+
+    size_t loaded = 0;
+    size_t sourcesLength = 1;
+    for (; loaded < count; loaded++) {
+        if (!loadImage(paths[loaded], &images[loaded])) break;
+        objects[loaded] = images[loaded].program;
+        sourcesLength += strlen(images[loaded].sourcePath) + 1;
+    }
+
+    bool ok = loaded == count;
+    if (ok) {
+        Linker linker = newLinker(objects, count);
+        linkObjects(&linker);
+        ok = !linker.hadError;
+
+        if (ok) {
+            // the debug section lists every source that went into the image
+            char *sources = alloc(sourcesLength);
+            sources[0] = '\0';
+            for (size_t i = 0; i < count; i++) {
+                if (i > 0) strcat(sources, ",");
+                strcat(sources, images[i].sourcePath);
+            }
+
+            ok = writeImage(&linker.program, sources, output);
+            if (ok && linker.droppedFunctions > 0) {
+                fprintf(stderr, "link: dropped %zu unreachable function%s\n",
+                        linker.droppedFunctions, linker.droppedFunctions == 1 ? "" : "s");
+            }
+            FREE_ALLOC(sources);
+        }
+        freeLinker(&linker);
+    }
+
+    for (size_t i = 0; i < loaded; i++) freeImage(&images[i]);
+    FREE_ALLOC(images);
+    FREE_ALLOC(objects);
+
+    return ok;
 }
 
 void freeRuntime(Runtime *runtime) {
     if (!runtime) return;
+}
+
+WarmCache newWarmCache(void) {
+    return (WarmCache){
+        .entries = alloc(WARM_PROGRAM_LIMIT * sizeof(WarmProgram)),
+        .count = 0,
+        .clock = 0,
+    };
+}
+
+void freeWarmCache(WarmCache *warm) {
+    if (!warm) return;
+
+    for (size_t i = 0; i < warm->count; i++) freeWarmProgram(&warm->entries[i]);
+    FREE_ALLOC(warm->entries);
+    warm->count = 0;
 }
\ No newline at end of file
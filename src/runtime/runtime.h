@@ -4,15 +4,87 @@
 #include <stdbool.h>
 
 #include "../parser/lexer.h"
+#include "../vm/vm.h"
+#include "../image/image.h"
+#include "../cache/cache.h"
+#include "../isolate/isolate.h"
+
+// programs 'aster serve' keeps compiled between requests
+#define WARM_PROGRAM_LIMIT 64
+
+// a verified program with a vm whose stacks are already reserved for it
+typedef struct {
+    CacheKey key;
+    // the limits the request asked for, the vm's own are sized from them
+    AvmConfig limits;
+    // holds the only reference to its program
+    Isolate isolate;
+    uint64_t lastUsed;
+    size_t runs;
+} WarmProgram;
+
+typedef struct {
+    WarmProgram *entries;
+    size_t count;
+    uint64_t clock;
+} WarmCache;
 
 typedef struct {
     const char *path;
     bool debug;
+
+    // per-vm stack limits, overridable from the command line
+    AvmConfig limits;
+
+    // when non-zero, execute the program this many times and report timings
+    size_t benchRuns;
+    // when non-zero, the runs are spread over this many isolates on their own threads
+    size_t threads;
+
+    // compiled programs are kept in a cache directory keyed on the source
+    bool useCache;
+    size_t cacheLimit;
+    // reports cache hits and misses and the time they took, and what the heap did
+    bool stats;
+
+    // function bodies are compiled on their first call rather than up front
+    bool lazy;
+
+    // set by --profile to where the sampled stacks are written, the opcode
+    // histogram goes to stderr. NULL when not profiling
+    const char *profile;
+
+    // set by --profile-generate to where the run's block, call and branch
+    // counts are written, and by --profile-use to the counts the program is
+    // laid out by. NULL otherwise
+    const char *profileGenerate;
+    const char *profileUse;
+
+    // images are built without the line table, so errors carry no trace and
+    // profiles name functions only
+    bool strip;
+
+    // set by the server, finished programs are kept here instead of being freed
+    WarmCache *warm;
 } Runtime;
 
 Runtime newRuntime(const char *path, bool debug);
-void run(Runtime *runtime);
+// false, after saying why on stderr, when the program could not be read,
+// compiled or loaded, and when it failed as it ran, which the vm reports itself
+bool run(Runtime *runtime);
+
+// compiles to a bytecode image at 'output' that 'run' can load without the front end
+bool buildImage(Runtime *runtime, const char *output);
+
+// compiles ahead of time to a standalone executable at 'output'
+bool buildNative(Runtime *runtime, const char *output);
+
+// links object images into a single image at 'output', keeping only what 'main' reaches
+bool linkImages(const char **paths, size_t count, const char *output);
 
 void freeRuntime(Runtime *runtime);
 
+WarmCache newWarmCache(void);
+void freeWarmCache(WarmCache *warm);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,411 @@
+// struct ucred, for the peer's credentials
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "server.h"
+#include "../util/alloc.h"
+
+// stdin, stdout and stderr travel with every request
+#define STDIO_COUNT 3
+
+static volatile sig_atomic_t stopping = 0;
+
+static void stopServer(int signal) {
+    (void)signal;
+    stopping = 1;
+}
+
+// the socket's directory must belong to this user and be closed to everyone
+// else, or another user could put a socket of their own in its place
+static bool privateDirectory(const char *path) {
+    struct stat info;
+    if (lstat(path, &info) != 0 || !S_ISDIR(info.st_mode) || info.st_uid != geteuid() ||
+        (info.st_mode & 0077) != 0) {
+        fprintf(stderr, "%s is not a directory only this user can use, the server is not used\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+char *serverSocketPath(void) {
+    const char *explicit = getenv("ASTER_SOCKET");
+    const char *runtimeDirectory = getenv("XDG_RUNTIME_DIR");
+
+    if (explicit && explicit[0] != '\0') {
+        char *path = strdup(explicit);
+        assertAlloc(path);
+        return path;
+    }
+
+    char directory[PATH_MAX];
+    if (runtimeDirectory && runtimeDirectory[0] == '/') {
+        snprintf(directory, sizeof(directory), "%s", runtimeDirectory);
+    } else {
+        snprintf(directory, sizeof(directory), "/tmp/aster-%u", (unsigned)geteuid());
+        if (mkdir(directory, 0700) != 0 && errno != EEXIST) {
+            fprintf(stderr, "could not create %s: %s\n", directory, strerror(errno));
+            return NULL;
+        }
+    }
+
+    if (!privateDirectory(directory)) return NULL;
+
+    size_t length = strlen(directory) + sizeof("/aster.sock");
+    char *path = alloc(length);
+    snprintf(path, length, "%s/aster.sock", directory);
+
+    return path;
+}
+
+// descriptors and requests only go to and come from processes of this user
+static bool peerIsOwner(int fd) {
+    struct ucred peer;
+    socklen_t length = sizeof(peer);
+
+    return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &length) == 0 && peer.uid == geteuid();
+}
+
+static bool socketAddress(const char *path, struct sockaddr_un *address) {
+    if (strlen(path) >= sizeof(address->sun_path)) {
+        fprintf(stderr, "socket path is too long: %s\n", path);
+        return false;
+    }
+
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    strcpy(address->sun_path, path);
+    return true;
+}
+
+static int connectTo(const char *path) {
+    struct sockaddr_un address;
+    if (!socketAddress(path, &address)) return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static bool writeAll(int fd, const void *data, size_t size) {
+    const char *bytes = data;
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+
+        bytes += written;
+        size -= written;
+    }
+
+    return true;
+}
+
+static bool readAll(int fd, void *data, size_t size) {
+    char *bytes = data;
+    while (size > 0) {
+        ssize_t got = read(fd, bytes, size);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+
+        bytes += got;
+        size -= got;
+    }
+
+    return true;
+}
+
+// the header goes out as one message carrying the descriptors
+static bool sendRequest(int fd, const ServerRequest *request, const int *fds) {
+    union {
+        char buffer[CMSG_SPACE(STDIO_COUNT * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct iovec iov = { .iov_base = (void *)request, .iov_len = sizeof(*request) };
+    struct msghdr message = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buffer,
+        .msg_controllen = sizeof(control.buffer),
+    };
+
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(STDIO_COUNT * sizeof(int));
+    memcpy(CMSG_DATA(header), fds, STDIO_COUNT * sizeof(int));
+
+    ssize_t sent;
+    do {
+        sent = sendmsg(fd, &message, 0);
+    } while (sent < 0 && errno == EINTR);
+
+    return sent == (ssize_t)sizeof(*request);
+}
+
+static bool receiveRequest(int fd, ServerRequest *request, int *fds) {
+    union {
+        char buffer[CMSG_SPACE(STDIO_COUNT * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+
+    struct iovec iov = { .iov_base = request, .iov_len = sizeof(*request) };
+    struct msghdr message = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buffer,
+        .msg_controllen = sizeof(control.buffer),
+    };
+
+    ssize_t got;
+    do {
+        got = recvmsg(fd, &message, MSG_CMSG_CLOEXEC);
+    } while (got < 0 && errno == EINTR);
+
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    bool hasFds = header && header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS &&
+                  header->cmsg_len == CMSG_LEN(STDIO_COUNT * sizeof(int));
+    if (hasFds) memcpy(fds, CMSG_DATA(header), STDIO_COUNT * sizeof(int));
+
+    bool ok = got == (ssize_t)sizeof(*request) && hasFds && !(message.msg_flags & MSG_CTRUNC);
+    if (!ok && hasFds) {
+        for (int i = 0; i < STDIO_COUNT; i++) close(fds[i]);
+    }
+
+    return ok;
+}
+
+bool forwardToServer(const char *socketPath, int argc, char *argv[], int *status) {
+    int fd = connectTo(socketPath);
+    if (fd < 0) return false;
+
+    if (!peerIsOwner(fd)) {
+        fprintf(stderr, "the server at %s belongs to another user, running here instead\n", socketPath);
+        close(fd);
+        return false;
+    }
+
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) {
+        close(fd);
+        return false;
+    }
+
+    size_t size = strlen(cwd) + 1;
+    for (int i = 0; i < argc; i++) size += strlen(argv[i]) + 1;
+
+    char *payload = alloc(size);
+    char *cursor = payload;
+    cursor = stpcpy(cursor, cwd) + 1;
+    for (int i = 0; i < argc; i++) cursor = stpcpy(cursor, argv[i]) + 1;
+
+    ServerRequest request = {
+        .magic = SERVER_REQUEST_MAGIC,
+        .version = SERVER_VERSION,
+        .argc = (uint32_t)argc,
+        .size = (uint32_t)size,
+    };
+    int fds[STDIO_COUNT] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+
+    // the server may not be able to take requests this size, so run locally
+    if (size > SERVER_REQUEST_LIMIT || !sendRequest(fd, &request, fds) || !writeAll(fd, payload, size)) {
+        FREE_ALLOC(payload);
+        close(fd);
+        return false;
+    }
+    FREE_ALLOC(payload);
+
+    // the program may already have run in part, so it is never retried locally
+    ServerReply reply;
+    if (!readAll(fd, &reply, sizeof(reply)) || memcmp(reply.magic, SERVER_REPLY_MAGIC, 4) != 0) {
+        fprintf(stderr, "lost the connection to the server at %s\n", socketPath);
+        *status = EXIT_FAILURE;
+    } else {
+        *status = reply.status;
+    }
+
+    close(fd);
+    return true;
+}
+
+// splits the payload into the working directory and a NULL-terminated argv
+static char **unpackArguments(char *payload, size_t size, uint32_t argc, char **cwd) {
+    if (size == 0 || payload[size - 1] != '\0') return NULL;
+
+    char **argv = alloc((argc + 1) * sizeof(char *));
+    char *cursor = payload, *end = payload + size;
+
+    *cwd = cursor;
+    cursor += strlen(cursor) + 1;
+    for (uint32_t i = 0; i < argc; i++) {
+        if (cursor >= end) {
+            FREE_ALLOC(argv);
+            return NULL;
+        }
+        argv[i] = cursor;
+        cursor += strlen(cursor) + 1;
+    }
+    argv[argc] = NULL;
+
+    return argv;
+}
+
+// points the process's stdio at the client's for the length of the handler
+static int runRequest(ServerHandler handler, void *context, int argc, char **argv,
+                      const int *clientFds, const int *savedFds) {
+    fflush(NULL);
+    for (int i = 0; i < STDIO_COUNT; i++) dup2(clientFds[i], i);
+
+    int status = handler(argc, argv, context);
+
+    // a client that went away leaves errors behind that must not outlive its request
+    fflush(NULL);
+    clearerr(stdout);
+    clearerr(stderr);
+    for (int i = 0; i < STDIO_COUNT; i++) dup2(savedFds[i], i);
+
+    return status;
+}
+
+static void handleConnection(int connection, ServerHandler handler, void *context, const int *savedFds) {
+    ServerRequest request;
+    int clientFds[STDIO_COUNT];
+    if (!receiveRequest(connection, &request, clientFds)) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) fprintf(stderr, "dropped a client that sent no request\n");
+        return;
+    }
+
+    bool valid = memcmp(request.magic, SERVER_REQUEST_MAGIC, 4) == 0 && request.version == SERVER_VERSION &&
+                 request.size <= SERVER_REQUEST_LIMIT && request.argc > 0;
+
+    char *payload = valid ? alloc(request.size + 1) : NULL;
+    char *cwd = NULL;
+    char **argv = NULL;
+    if (valid && readAll(connection, payload, request.size)) {
+        argv = unpackArguments(payload, request.size, request.argc, &cwd);
+    }
+
+    ServerReply reply = { .magic = SERVER_REPLY_MAGIC, .status = EXIT_FAILURE };
+    if (!argv) {
+        fprintf(stderr, "dropped a malformed request\n");
+    } else if (chdir(cwd) != 0) {
+        dprintf(clientFds[2], "server could not enter '%s': %s\n", cwd, strerror(errno));
+    } else {
+        reply.status = runRequest(handler, context, (int)request.argc, argv, clientFds, savedFds);
+    }
+
+    for (int i = 0; i < STDIO_COUNT; i++) close(clientFds[i]);
+    writeAll(connection, &reply, sizeof(reply));
+
+    FREE_ALLOC(argv);
+    FREE_ALLOC(payload);
+}
+
+// a socket nobody answers on is left over from a server that died
+static bool claimSocket(const char *socketPath) {
+    int existing = connectTo(socketPath);
+    if (existing >= 0) {
+        close(existing);
+        fprintf(stderr, "a server is already listening on %s\n", socketPath);
+        return false;
+    }
+
+    struct stat info;
+    if (lstat(socketPath, &info) == 0) {
+        if (!S_ISSOCK(info.st_mode)) {
+            fprintf(stderr, "%s exists and is not a socket\n", socketPath);
+            return false;
+        }
+        unlink(socketPath);
+    }
+
+    return true;
+}
+
+static int listenOn(const char *socketPath) {
+    struct sockaddr_un address;
+    if (!socketAddress(socketPath, &address) || !claimSocket(socketPath)) return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    // only the owner may connect, requests run with the server's privileges
+    mode_t previous = umask(0077);
+    bool bound = bind(fd, (struct sockaddr *)&address, sizeof(address)) == 0;
+    umask(previous);
+
+    if (!bound || listen(fd, SOMAXCONN) != 0) {
+        perror(socketPath);
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+bool serve(const char *socketPath, ServerHandler handler, void *context) {
+    int listener = listenOn(socketPath);
+    if (listener < 0) return false;
+
+    // interrupting accept() is how the loop notices it should stop
+    struct sigaction stop = { .sa_handler = stopServer };
+    sigemptyset(&stop.sa_mask);
+    sigaction(SIGINT, &stop, NULL);
+    sigaction(SIGTERM, &stop, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    int savedFds[STDIO_COUNT];
+    for (int i = 0; i < STDIO_COUNT; i++) savedFds[i] = fcntl(i, F_DUPFD_CLOEXEC, STDERR_FILENO + 1);
+
+    fprintf(stderr, "serving on %s\n", socketPath);
+
+    while (!stopping) {
+        int connection = accept(listener, NULL, NULL);
+        if (connection < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            perror("accept");
+            break;
+        }
+
+        if (!peerIsOwner(connection)) {
+            fprintf(stderr, "refused a connection from another user\n");
+            close(connection);
+            continue;
+        }
+
+        struct timeval timeout = { .tv_sec = SERVER_REQUEST_TIMEOUT };
+        setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        handleConnection(connection, handler, context, savedFds);
+        close(connection);
+    }
+
+    for (int i = 0; i < STDIO_COUNT; i++) close(savedFds[i]);
+    close(listener);
+    unlink(socketPath);
+
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,56 @@
+#ifndef server_h
+#define server_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define SERVER_REQUEST_MAGIC "ASRQ"
+#define SERVER_REPLY_MAGIC "ASRP"
+#define SERVER_VERSION 1
+
+// the most a request's arguments may take up, anything larger is dropped
+#define SERVER_REQUEST_LIMIT (1024 * 1024)
+
+// seconds a client has to send its whole request, and to take the reply,
+// before the connection is dropped
+#define SERVER_REQUEST_TIMEOUT 5
+
+// a request is this header, sent along with the client's stdin, stdout and
+// stderr, followed by the client's working directory and its arguments as
+// 'size' bytes of nul-terminated strings
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t argc;
+    uint32_t size;
+} ServerRequest;
+
+// sent back once the request has run and its output has been flushed
+typedef struct {
+    char magic[4];
+    int32_t status;
+} ServerReply;
+
+// runs one request's arguments with the process's stdio pointed at the client's
+typedef int (*ServerHandler)(int argc, char *argv[], void *context);
+
+// '$ASTER_SOCKET', or 'aster.sock' in '$XDG_RUNTIME_DIR' or in '/tmp/aster-<uid>',
+// which is created with mode 0700. NULL when that directory is not this user's
+// alone. the caller frees it
+char *serverSocketPath(void);
+
+// listens on 'socketPath' and handles requests one at a time until interrupted.
+// a request points the process's stdio and working directory at the client's
+// and runs on the warm programs, all of which belong to the whole process, so
+// requests are never run side by side. a client that connects and stalls is
+// dropped after SERVER_REQUEST_TIMEOUT, but a long running program holds up
+// the requests behind it, clients that cannot wait run with '--no-server'
+bool serve(const char *socketPath, ServerHandler handler, void *context);
+
+// hands the arguments and this process's stdio to the server listening on
+// 'socketPath' and waits for its exit status. false when no server is
+// listening, or the one that is runs as another user
+bool forwardToServer(const char *socketPath, int argc, char *argv[], int *status);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "trace.h"
+#include "../util/alloc.h"
+
+bool traceEnabled = false;
+static bool recording = false;
+static PhaseListener phaseListener = NULL;
+
+// every thread's buffer, pushed as threads first record. a new trace bumps
+// the generation, so a thread does not go back to a buffer already freed
+static _Atomic(TraceBuffer *) buffers = NULL;
+static atomic_uint threadCount = 0;
+static uint32_t generation = 0;
+static uint64_t origin = 0;
+
+static _Thread_local TraceBuffer *threadBuffer = NULL;
+static _Thread_local uint32_t threadGeneration = 0;
+
+static uint64_t nanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+static TraceBuffer *currentBuffer(void) {
+    if (threadBuffer && threadGeneration == generation) return threadBuffer;
+
+    TraceBuffer *buffer = alloc(sizeof(TraceBuffer));
+    *buffer = (TraceBuffer){
+        .phases = { .events = alloc(sizeof(TraceEvent) * TRACE_PHASE_EVENTS), .capacity = TRACE_PHASE_EVENTS },
+        .calls = { .events = alloc(sizeof(TraceEvent) * TRACE_CALL_EVENTS), .capacity = TRACE_CALL_EVENTS },
+        .thread = atomic_fetch_add(&threadCount, 1) + 1,
+    };
+
+    buffer->next = atomic_load(&buffers);
+    while (!atomic_compare_exchange_weak(&buffers, &buffer->next, buffer)) {}
+
+    threadBuffer = buffer;
+    threadGeneration = generation;
+    return buffer;
+}
+
+static void record(TraceRing *ring, char phase, const char *name, const char *category) {
+    TraceEvent *event = &ring->events[ring->head++ & (ring->capacity - 1)];
+
+    event->timestamp = nanoseconds();
+    event->phase = phase;
+    event->category = category;
+    strncpy(event->name, name, TRACE_NAME_LENGTH - 1);
+    event->name[TRACE_NAME_LENGTH - 1] = '\0';
+}
+
+// the listener is told of the end before it is recorded and of the
+// beginning after, so the recording is not counted in the phase
+void traceBegin(const char *name, const char *category) {
+    if (recording) record(&currentBuffer()->phases, 'B', name, category);
+    if (phaseListener) phaseListener(name, true);
+}
+
+// the name of the phase an end closes is only known to the listener
+void traceEnd(void) {
+    if (phaseListener) phaseListener(NULL, false);
+    if (recording) record(&currentBuffer()->phases, 'E', "", NULL);
+}
+
+void traceCall(const char *name) {
+    if (recording) record(&currentBuffer()->calls, 'B', name, "call");
+}
+
+void traceReturn(void) {
+    if (recording) record(&currentBuffer()->calls, 'E', "", NULL);
+}
+
+void setPhaseListener(PhaseListener listener) {
+    phaseListener = listener;
+    traceEnabled = recording || phaseListener;
+}
+
+void startTrace(void) {
+    generation++;
+    atomic_store(&buffers, NULL);
+    atomic_store(&threadCount, 0);
+
+    origin = nanoseconds();
+    recording = true;
+    traceEnabled = true;
+}
+
+// names are identifiers and fixed phase names, but are escaped all the same
+static void writeString(FILE *out, const char *text) {
+    fputc('"', out);
+    for (const char *c = text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(out, "\\%c", *c);
+        } else if ((unsigned char)*c < 0x20) {
+            fprintf(out, "\\u%04x", *c);
+        } else {
+            fputc(*c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void writeEvent(FILE *out, const TraceEvent *event, uint32_t thread, bool first) {
+    uint64_t since = event->timestamp - origin;
+
+    fprintf(out, "%s\n{\"ph\":\"%c\",\"ts\":%" PRIu64 ".%03" PRIu64 ",\"pid\":%d,\"tid\":%" PRIu32,
+            first ? "" : ",", event->phase, since / 1000, since % 1000, (int)getpid(), thread);
+    if (event->phase == 'B') {
+        fprintf(out, ",\"name\":");
+        writeString(out, event->name);
+        fprintf(out, ",\"cat\":");
+        writeString(out, event->category);
+    }
+    fputc('}', out);
+}
+
+// reads a ring from its oldest event, which is past the overwritten ones once
+// it is full. the ends of slices whose beginning was overwritten are skipped
+typedef struct {
+    const TraceRing *ring;
+    size_t position;
+    size_t depth;
+} RingCursor;
+
+static RingCursor startCursor(const TraceRing *ring) {
+    size_t count = ring->head < ring->capacity ? ring->head : ring->capacity;
+    return (RingCursor){ .ring = ring, .position = ring->head - count, .depth = 0 };
+}
+
+static const TraceEvent *peekEvent(RingCursor *cursor) {
+    const TraceRing *ring = cursor->ring;
+
+    while (cursor->position < ring->head) {
+        const TraceEvent *event = &ring->events[cursor->position & (ring->capacity - 1)];
+        if (event->phase == 'B' || cursor->depth > 0) return event;
+        cursor->position++;
+    }
+
+    return NULL;
+}
+
+static void takeEvent(RingCursor *cursor, const TraceEvent *event) {
+    cursor->depth += event->phase == 'B' ? 1 : -1;
+    cursor->position++;
+}
+
+// both rings in time order. on a tie a phase begins before the calls in it
+// and ends after them
+static size_t writeThread(FILE *out, const TraceBuffer *buffer, size_t written) {
+    RingCursor phases = startCursor(&buffer->phases);
+    RingCursor calls = startCursor(&buffer->calls);
+
+    for (;;) {
+        const TraceEvent *phase = peekEvent(&phases);
+        const TraceEvent *call = peekEvent(&calls);
+        if (!phase && !call) break;
+
+        bool phaseFirst = phase && (!call || phase->timestamp < call->timestamp ||
+                                    (phase->timestamp == call->timestamp && phase->phase == 'B'));
+        RingCursor *cursor = phaseFirst ? &phases : &calls;
+        const TraceEvent *event = phaseFirst ? phase : call;
+
+        takeEvent(cursor, event);
+        writeEvent(out, event, buffer->thread, written == 0);
+        written++;
+    }
+
+    return written;
+}
+
+bool stopTrace(const char *path) {
+    recording = false;
+    traceEnabled = phaseListener != NULL;
+
+    FILE *out = fopen(path, "w");
+    size_t written = 0, overwritten = 0;
+
+    if (out) fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+    TraceBuffer *buffer = atomic_exchange(&buffers, NULL);
+    while (buffer) {
+        if (out) written = writeThread(out, buffer, written);
+        overwritten += startCursor(&buffer->phases).position + startCursor(&buffer->calls).position;
+
+        TraceBuffer *next = buffer->next;
+        FREE_ALLOC(buffer->phases.events);
+        FREE_ALLOC(buffer->calls.events);
+        FREE_ALLOC(buffer);
+        buffer = next;
+    }
+
+    if (!out) {
+        fprintf(stderr, "trace: could not write '%s'\n", path);
+        return false;
+    }
+
+    fprintf(out, "\n]}\n");
+    bool ok = fclose(out) == 0;
+
+    fprintf(stderr, "trace: wrote %zu events to %s, %zu overwritten\n", written, path, overwritten);
+    return ok;
+}
\ No newline at end of file
@@ -0,0 +1,72 @@
+#ifndef trace_h
+#define trace_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// events each thread keeps, older ones are overwritten once a ring is full.
+// calls have a ring of their own so they do not push out the phases around them
+#define TRACE_PHASE_EVENTS ((size_t)1 << 12)
+#define TRACE_CALL_EVENTS ((size_t)1 << 16)
+// longer names are cut short, function names are copied as they are only
+// valid as long as their program
+#define TRACE_NAME_LENGTH 40
+
+typedef struct {
+    uint64_t timestamp;
+    // a Chrome trace phase: 'B' begins a slice, 'E' ends the innermost one
+    char phase;
+    const char *category;
+    char name[TRACE_NAME_LENGTH];
+} TraceEvent;
+
+// 'head' counts every event written so far, including the overwritten ones
+typedef struct {
+    TraceEvent *events;
+    size_t capacity;
+    size_t head;
+} TraceRing;
+
+// one thread's events, only its own thread writes to them
+typedef struct TraceBuffer {
+    TraceRing phases;
+    TraceRing calls;
+    uint32_t thread;
+    struct TraceBuffer *next;
+} TraceBuffer;
+
+// set while tracing or while phases are listened to, a hook that finds it
+// clear does nothing else
+extern bool traceEnabled;
+
+// told of every phase that begins or ends, on whichever thread it does
+typedef void (*PhaseListener)(const char *name, bool begin);
+
+#define TRACE_BEGIN(name, category) \
+    do { if (__builtin_expect(traceEnabled, 0)) traceBegin((name), (category)); } while (0)
+#define TRACE_END() \
+    do { if (__builtin_expect(traceEnabled, 0)) traceEnd(); } while (0)
+
+// the same around the vm's calls and returns
+#define TRACE_CALL(name) \
+    do { if (__builtin_expect(traceEnabled, 0)) traceCall(name); } while (0)
+#define TRACE_RETURN() \
+    do { if (__builtin_expect(traceEnabled, 0)) traceReturn(); } while (0)
+
+void traceBegin(const char *name, const char *category);
+void traceEnd(void);
+void traceCall(const char *name);
+void traceReturn(void);
+
+// NULL stops listening
+void setPhaseListener(PhaseListener listener);
+
+// clears the buffers and starts recording, from before any thread that is traced is started
+void startTrace(void);
+
+// stops recording and writes every thread's events to 'path' as Chrome
+// trace-event JSON, freeing the buffers. from after the traced threads are joined
+bool stopTrace(const char *path);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,14 @@
+#include "hash.h"
+
+#define FNV_PRIME ((uint64_t)0x100000001b3)
+
+uint64_t fnv1a(uint64_t hash, const void *data, size_t size) {
+    const uint8_t *bytes = data;
+
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
\ No newline at end of file
@@ -0,0 +1,12 @@
+#ifndef hash_h
+#define hash_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define FNV_OFFSET_BASIS ((uint64_t)0xcbf29ce484222325)
+
+// 64-bit FNV-1a, pass the previous result as 'hash' to continue over several buffers
+uint64_t fnv1a(uint64_t hash, const void *data, size_t size);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "region.h"
+#include "alloc.h"
+
+static size_t pageSize(void) {
+    static size_t size = 0;
+    if (size == 0) size = (size_t)sysconf(_SC_PAGESIZE);
+
+    return size;
+}
+
+Region reserveRegion(size_t size) {
+    size_t page = pageSize();
+    size = (size + REGION_ALIGNMENT - 1) & ~(size_t)(REGION_ALIGNMENT - 1);
+    size_t pages = (size + page - 1) / page * page;
+    if (pages == 0) pages = page;
+
+    size_t mappingSize = pages + 2 * page;
+    void *mapping = mmap(NULL, mappingSize, PROT_NONE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapping == MAP_FAILED) mapping = NULL;
+    assertAlloc(mapping);
+
+    uint8_t *first = (uint8_t *)mapping + page;
+    if (mprotect(first, pages, PROT_READ | PROT_WRITE) != 0) {
+        munmap(mapping, mappingSize);
+        assertAlloc(NULL);
+    }
+
+    // the slack of the rounding goes before the first usable byte
+    return (Region){
+        .base = first + pages - size,
+        .size = size,
+        .mapping = mapping,
+        .mappingSize = mappingSize,
+    };
+}
+
+void releaseRegion(Region *region) {
+    if (!region || !region->mapping) return;
+
+    munmap(region->mapping, region->mappingSize);
+    *region = (Region){0};
+}
+
+bool inRegionGuard(const Region *region, const void *address) {
+    if (!region->mapping) return false;
+
+    const uint8_t *addr = address;
+    const uint8_t *start = region->mapping;
+    const uint8_t *base = region->base;
+    const uint8_t *end = start + region->mappingSize;
+
+    return (addr >= start && addr < base) || (addr >= base + region->size && addr < end);
+}
\ No newline at end of file
@@ -0,0 +1,32 @@
+#ifndef region_h
+#define region_h
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// a block of address space reserved with 'mmap' and bracketed by inaccessible
+// guard pages. pages are only backed by memory once they are first touched, so
+// a large reservation costs nothing until it is used
+typedef struct {
+    void *base;
+    size_t size;
+
+    void *mapping;
+    size_t mappingSize;
+} Region;
+
+// usable bytes are a multiple of this, the alignment of everything kept in a region
+#define REGION_ALIGNMENT 8
+
+// reserves 'size' usable bytes, rounded up to REGION_ALIGNMENT only. the
+// usable bytes end directly at the upper guard page, so a limit is exact
+// whatever the page size, and the rest of the first page stays unused
+Region reserveRegion(size_t size);
+
+// unmaps the region including its guard pages
+void releaseRegion(Region *region);
+
+// checks if an address falls inside one of the region's guard pages
+bool inRegionGuard(const Region *region, const void *address);
+
+#endif
\ No newline at end of file
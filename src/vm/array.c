@@ -0,0 +1,617 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "array.h"
+
+// one implementation of every whole-array operation. integer kernels wrap
+// on overflow, so every set computes the same integers in whatever order
+typedef struct {
+    const char *name;
+
+    void (*fill32)(uint32_t *dst, uint32_t value, size_t n);
+    void (*fill64)(uint64_t *dst, uint64_t value, size_t n);
+
+    void (*addI32)(int32_t *dst, const int32_t *a, const int32_t *b, size_t n);
+    void (*addI64)(int64_t *dst, const int64_t *a, const int64_t *b, size_t n);
+    void (*addF64)(double *dst, const double *a, const double *b, size_t n);
+
+    void (*mulI32)(int32_t *dst, const int32_t *a, const int32_t *b, size_t n);
+    void (*mulI64)(int64_t *dst, const int64_t *a, const int64_t *b, size_t n);
+    void (*mulF64)(double *dst, const double *a, const double *b, size_t n);
+
+    int32_t (*dotI32)(const int32_t *a, const int32_t *b, size_t n);
+    int64_t (*dotI64)(const int64_t *a, const int64_t *b, size_t n);
+    double (*dotF64)(const double *a, const double *b, size_t n);
+
+    int32_t (*sumI32)(const int32_t *a, size_t n);
+    int64_t (*sumI64)(const int64_t *a, size_t n);
+    double (*sumF64)(const double *a, size_t n);
+
+    int32_t (*minI32)(const int32_t *a, size_t n);
+    int64_t (*minI64)(const int64_t *a, size_t n);
+    double (*minF64)(const double *a, size_t n);
+
+    int32_t (*maxI32)(const int32_t *a, size_t n);
+    int64_t (*maxI64)(const int64_t *a, size_t n);
+    double (*maxF64)(const double *a, size_t n);
+} ArrayKernels;
+
+static void fill32Scalar(uint32_t *dst, uint32_t value, size_t n) {
+    for (size_t i = 0; i < n; i++) dst[i] = value;
+}
+
+static void fill64Scalar(uint64_t *dst, uint64_t value, size_t n) {
+    for (size_t i = 0; i < n; i++) dst[i] = value;
+}
+
+// 'wrap' is the type the arithmetic is done in, unsigned for the integers
+#define SCALAR_ARITHMETIC(name, type, wrap) \
+    static void add##name##Scalar(type *dst, const type *a, const type *b, size_t n) { \
+        for (size_t i = 0; i < n; i++) dst[i] = (type)((wrap)a[i] + (wrap)b[i]); \
+    } \
+    \
+    static void mul##name##Scalar(type *dst, const type *a, const type *b, size_t n) { \
+        for (size_t i = 0; i < n; i++) dst[i] = (type)((wrap)a[i] * (wrap)b[i]); \
+    } \
+    \
+    static type dot##name##Scalar(const type *a, const type *b, size_t n) { \
+        wrap sum = 0; \
+        for (size_t i = 0; i < n; i++) sum += (wrap)a[i] * (wrap)b[i]; \
+        return (type)sum; \
+    } \
+    \
+    static type sum##name##Scalar(const type *a, size_t n) { \
+        wrap sum = 0; \
+        for (size_t i = 0; i < n; i++) sum += (wrap)a[i]; \
+        return (type)sum; \
+    }
+
+// min and max start from the far end of the type's range, so a NaN, which
+// compares false against everything, is never picked
+#define SCALAR_ORDER(name, type, lowest, highest) \
+    static type min##name##Scalar(const type *a, size_t n) { \
+        type min = highest; \
+        for (size_t i = 0; i < n; i++) min = a[i] < min ? a[i] : min; \
+        return min; \
+    } \
+    \
+    static type max##name##Scalar(const type *a, size_t n) { \
+        type max = lowest; \
+        for (size_t i = 0; i < n; i++) max = a[i] > max ? a[i] : max; \
+        return max; \
+    }
+
+SCALAR_ARITHMETIC(I32, int32_t, uint32_t)
+SCALAR_ARITHMETIC(I64, int64_t, uint64_t)
+SCALAR_ARITHMETIC(F64, double, double)
+
+SCALAR_ORDER(I32, int32_t, INT32_MIN, INT32_MAX)
+SCALAR_ORDER(I64, int64_t, INT64_MIN, INT64_MAX)
+SCALAR_ORDER(F64, double, -INFINITY, INFINITY)
+
+static const ArrayKernels scalarKernels = {
+    .name = "scalar",
+    .fill32 = fill32Scalar, .fill64 = fill64Scalar,
+    .addI32 = addI32Scalar, .addI64 = addI64Scalar, .addF64 = addF64Scalar,
+    .mulI32 = mulI32Scalar, .mulI64 = mulI64Scalar, .mulF64 = mulF64Scalar,
+    .dotI32 = dotI32Scalar, .dotI64 = dotI64Scalar, .dotF64 = dotF64Scalar,
+    .sumI32 = sumI32Scalar, .sumI64 = sumI64Scalar, .sumF64 = sumF64Scalar,
+    .minI32 = minI32Scalar, .minI64 = minI64Scalar, .minF64 = minF64Scalar,
+    .maxI32 = maxI32Scalar, .maxI64 = maxI64Scalar, .maxF64 = maxF64Scalar,
+};
+
+#if defined(__x86_64__)
+
+// SSE2 is part of x86-64, so these need no check. it has no 32-bit multiply
+// and no 64-bit compare, the operations needing them stay scalar. reductions
+// keep one value per lane and finish with the scalar kernel over the lanes
+// and whatever elements did not fill a vector
+
+static void fill32Sse2(uint32_t *dst, uint32_t value, size_t n) {
+    __m128i v = _mm_set1_epi32((int32_t)value);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) _mm_storeu_si128((__m128i *)(dst + i), v);
+    fill32Scalar(dst + i, value, n - i);
+}
+
+static void fill64Sse2(uint64_t *dst, uint64_t value, size_t n) {
+    __m128i v = _mm_set1_epi64x((int64_t)value);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) _mm_storeu_si128((__m128i *)(dst + i), v);
+    fill64Scalar(dst + i, value, n - i);
+}
+
+static void addI32Sse2(int32_t *dst, const int32_t *a, const int32_t *b, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_add_epi32(x, y));
+    }
+    addI32Scalar(dst + i, a + i, b + i, n - i);
+}
+
+static void addI64Sse2(int64_t *dst, const int64_t *a, const int64_t *b, size_t n) {
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_add_epi64(x, y));
+    }
+    addI64Scalar(dst + i, a + i, b + i, n - i);
+}
+
+static void addF64Sse2(double *dst, const double *a, const double *b, size_t n) {
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(dst + i, _mm_add_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    }
+    addF64Scalar(dst + i, a + i, b + i, n - i);
+}
+
+static void mulF64Sse2(double *dst, const double *a, const double *b, size_t n) {
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(dst + i, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    }
+    mulF64Scalar(dst + i, a + i, b + i, n - i);
+}
+
+static double dotF64Sse2(const double *a, const double *b, size_t n) {
+    __m128d sum = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        sum = _mm_add_pd(sum, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    }
+
+    double lanes[2];
+    _mm_storeu_pd(lanes, sum);
+    return sumF64Scalar(lanes, 2) + dotF64Scalar(a + i, b + i, n - i);
+}
+
+static int32_t sumI32Sse2(const int32_t *a, size_t n) {
+    __m128i sum = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) sum = _mm_add_epi32(sum, _mm_loadu_si128((const __m128i *)(a + i)));
+
+    int32_t lanes[4];
+    _mm_storeu_si128((__m128i *)lanes, sum);
+    return (int32_t)((uint32_t)sumI32Scalar(lanes, 4) + (uint32_t)sumI32Scalar(a + i, n - i));
+}
+
+static int64_t sumI64Sse2(const int64_t *a, size_t n) {
+    __m128i sum = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) sum = _mm_add_epi64(sum, _mm_loadu_si128((const __m128i *)(a + i)));
+
+    int64_t lanes[2];
+    _mm_storeu_si128((__m128i *)lanes, sum);
+    return (int64_t)((uint64_t)sumI64Scalar(lanes, 2) + (uint64_t)sumI64Scalar(a + i, n - i));
+}
+
+static double sumF64Sse2(const double *a, size_t n) {
+    __m128d sum = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) sum = _mm_add_pd(sum, _mm_loadu_pd(a + i));
+
+    double lanes[2];
+    _mm_storeu_pd(lanes, sum);
+    return sumF64Scalar(lanes, 2) + sumF64Scalar(a + i, n - i);
+}
+
+// MINPD keeps its second operand when the first is NaN, as the scalar kernel does,
+// so no lane ever holds a NaN
+static double minF64Sse2(const double *a, size_t n) {
+    __m128d min = _mm_set1_pd(INFINITY);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) min = _mm_min_pd(_mm_loadu_pd(a + i), min);
+
+    double lanes[2];
+    _mm_storeu_pd(lanes, min);
+    double vector = minF64Scalar(lanes, 2), tail = minF64Scalar(a + i, n - i);
+    return vector < tail ? vector : tail;
+}
+
+static double maxF64Sse2(const double *a, size_t n) {
+    __m128d max = _mm_set1_pd(-INFINITY);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) max = _mm_max_pd(_mm_loadu_pd(a + i), max);
+
+    double lanes[2];
+    _mm_storeu_pd(lanes, max);
+    double vector = maxF64Scalar(lanes, 2), tail = maxF64Scalar(a + i, n - i);
+    return vector > tail ? vector : tail;
+}
+
+static const ArrayKernels sse2Kernels = {
+    .name = "sse2",
+    .fill32 = fill32Sse2, .fill64 = fill64Sse2,
+    .addI32 = addI32Sse2, .addI64 = addI64Sse2, .addF64 = addF64Sse2,
+    .mulI32 = mulI32Scalar, .mulI64 = mulI64Scalar, .mulF64 = mulF64Sse2,
+    .dotI32 = dotI32Scalar, .dotI64 = dotI64Scalar, .dotF64 = dotF64Sse2,
+    .sumI32 = sumI32Sse2, .sumI64 = sumI64Sse2, .sumF64 = sumF64Sse2,
+    .minI32 = minI32Scalar, .minI64 = minI64Scalar, .minF64 = minF64Sse2,
+    .maxI32 = maxI32Scalar, .maxI64 = maxI64Scalar, .maxF64 = maxF64Sse2,
+};
+
+// AVX2 doubles the width and brings the 32-bit multiply and min and max.
+// there is still no 64-bit multiply, so i64 mul and dot stay scalar
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static void fill32Avx2(uint32_t *dst, uint32_t value, size_t n) {
+    __m256i v = _mm256_set1_epi32((int32_t)value);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) _mm256_storeu_si256((__m256i *)(dst + i), v);
+    fill32Scalar(dst + i, value, n - i);
+}
+
+AVX2 static void fill64Avx2(uint64_t *dst, uint64_t value, size_t n) {
+    __m256i v = _mm256_set1_epi64x((int64_t)value);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) _mm256_storeu_si256((__m256i *)(dst + i), v);
+    fill64Scalar(dst + i, value, n - i);
+}
+
+AVX2 static void addI32Avx2(int32_t *dst, const int32_t *a, const int32_t *b, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_add_epi32(x, y));
+    }
+    addI32Scalar(dst + i, a + i, b + i, n - i);
+}
+
+AVX2 static void addI64Avx2(int64_t *dst, const int64_t *a, const int64_t *b, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_add_epi64(x, y));
+    }
+    addI64Scalar(dst + i, a + i, b + i, n - i);
+}
+
+AVX2 static void addF64Avx2(double *dst, const double *a, const double *b, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(dst + i, _mm256_add_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    }
+    addF64Scalar(dst + i, a + i, b + i, n - i);
+}
+
+AVX2 static void mulI32Avx2(int32_t *dst, const int32_t *a, const int32_t *b, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_mullo_epi32(x, y));
+    }
+    mulI32Scalar(dst + i, a + i, b + i, n - i);
+}
+
+AVX2 static void mulF64Avx2(double *dst, const double *a, const double *b, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(dst + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    }
+    mulF64Scalar(dst + i, a + i, b + i, n - i);
+}
+
+AVX2 static int32_t dotI32Avx2(const int32_t *a, const int32_t *b, size_t n) {
+    __m256i sum = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+        sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(x, y));
+    }
+
+    int32_t lanes[8];
+    _mm256_storeu_si256((__m256i *)lanes, sum);
+    return (int32_t)((uint32_t)sumI32Scalar(lanes, 8) + (uint32_t)dotI32Scalar(a + i, b + i, n - i));
+}
+
+// separate multiplies and adds rather than FMA, so each product is rounded
+// as it is everywhere else
+AVX2 static double dotF64Avx2(const double *a, const double *b, size_t n) {
+    __m256d sum = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        sum = _mm256_add_pd(sum, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    }
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, sum);
+    return sumF64Scalar(lanes, 4) + dotF64Scalar(a + i, b + i, n - i);
+}
+
+AVX2 static int32_t sumI32Avx2(const int32_t *a, size_t n) {
+    __m256i sum = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) sum = _mm256_add_epi32(sum, _mm256_loadu_si256((const __m256i *)(a + i)));
+
+    int32_t lanes[8];
+    _mm256_storeu_si256((__m256i *)lanes, sum);
+    return (int32_t)((uint32_t)sumI32Scalar(lanes, 8) + (uint32_t)sumI32Scalar(a + i, n - i));
+}
+
+AVX2 static int64_t sumI64Avx2(const int64_t *a, size_t n) {
+    __m256i sum = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) sum = _mm256_add_epi64(sum, _mm256_loadu_si256((const __m256i *)(a + i)));
+
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, sum);
+    return (int64_t)((uint64_t)sumI64Scalar(lanes, 4) + (uint64_t)sumI64Scalar(a + i, n - i));
+}
+
+AVX2 static double sumF64Avx2(const double *a, size_t n) {
+    __m256d sum = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) sum = _mm256_add_pd(sum, _mm256_loadu_pd(a + i));
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, sum);
+    return sumF64Scalar(lanes, 4) + sumF64Scalar(a + i, n - i);
+}
+
+AVX2 static int32_t minI32Avx2(const int32_t *a, size_t n) {
+    __m256i min = _mm256_set1_epi32(INT32_MAX);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) min = _mm256_min_epi32(min, _mm256_loadu_si256((const __m256i *)(a + i)));
+
+    int32_t lanes[8], tail = minI32Scalar(a + i, n - i);
+    _mm256_storeu_si256((__m256i *)lanes, min);
+    int32_t vector = minI32Scalar(lanes, 8);
+    return vector < tail ? vector : tail;
+}
+
+AVX2 static int32_t maxI32Avx2(const int32_t *a, size_t n) {
+    __m256i max = _mm256_set1_epi32(INT32_MIN);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) max = _mm256_max_epi32(max, _mm256_loadu_si256((const __m256i *)(a + i)));
+
+    int32_t lanes[8], tail = maxI32Scalar(a + i, n - i);
+    _mm256_storeu_si256((__m256i *)lanes, max);
+    int32_t vector = maxI32Scalar(lanes, 8);
+    return vector > tail ? vector : tail;
+}
+
+// no 64-bit min or max before AVX-512, a compare and blend does the same
+AVX2 static int64_t minI64Avx2(const int64_t *a, size_t n) {
+    __m256i min = _mm256_set1_epi64x(INT64_MAX);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i value = _mm256_loadu_si256((const __m256i *)(a + i));
+        min = _mm256_blendv_epi8(min, value, _mm256_cmpgt_epi64(min, value));
+    }
+
+    int64_t lanes[4], tail = minI64Scalar(a + i, n - i);
+    _mm256_storeu_si256((__m256i *)lanes, min);
+    int64_t vector = minI64Scalar(lanes, 4);
+    return vector < tail ? vector : tail;
+}
+
+AVX2 static int64_t maxI64Avx2(const int64_t *a, size_t n) {
+    __m256i max = _mm256_set1_epi64x(INT64_MIN);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i value = _mm256_loadu_si256((const __m256i *)(a + i));
+        max = _mm256_blendv_epi8(max, value, _mm256_cmpgt_epi64(value, max));
+    }
+
+    int64_t lanes[4], tail = maxI64Scalar(a + i, n - i);
+    _mm256_storeu_si256((__m256i *)lanes, max);
+    int64_t vector = maxI64Scalar(lanes, 4);
+    return vector > tail ? vector : tail;
+}
+
+AVX2 static double minF64Avx2(const double *a, size_t n) {
+    __m256d min = _mm256_set1_pd(INFINITY);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) min = _mm256_min_pd(_mm256_loadu_pd(a + i), min);
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, min);
+    double vector = minF64Scalar(lanes, 4), tail = minF64Scalar(a + i, n - i);
+    return vector < tail ? vector : tail;
+}
+
+AVX2 static double maxF64Avx2(const double *a, size_t n) {
+    __m256d max = _mm256_set1_pd(-INFINITY);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) max = _mm256_max_pd(_mm256_loadu_pd(a + i), max);
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, max);
+    double vector = maxF64Scalar(lanes, 4), tail = maxF64Scalar(a + i, n - i);
+    return vector > tail ? vector : tail;
+}
+
+static const ArrayKernels avx2Kernels = {
+    .name = "avx2",
+    .fill32 = fill32Avx2, .fill64 = fill64Avx2,
+    .addI32 = addI32Avx2, .addI64 = addI64Avx2, .addF64 = addF64Avx2,
+    .mulI32 = mulI32Avx2, .mulI64 = mulI64Scalar, .mulF64 = mulF64Avx2,
+    .dotI32 = dotI32Avx2, .dotI64 = dotI64Scalar, .dotF64 = dotF64Avx2,
+    .sumI32 = sumI32Avx2, .sumI64 = sumI64Avx2, .sumF64 = sumF64Avx2,
+    .minI32 = minI32Avx2, .minI64 = minI64Avx2, .minF64 = minF64Avx2,
+    .maxI32 = maxI32Avx2, .maxI64 = maxI64Avx2, .maxF64 = maxF64Avx2,
+};
+
+#endif
+
+static const ArrayKernels *kernels = &scalarKernels;
+static pthread_once_t kernelsOnce = PTHREAD_ONCE_INIT;
+
+static void selectKernels(void) {
+    const ArrayKernels *supported[3];
+    size_t count = 0;
+
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) supported[count++] = &avx2Kernels;
+    supported[count++] = &sse2Kernels;
+#endif
+    supported[count++] = &scalarKernels;
+
+    kernels = supported[0];
+
+    const char *forced = getenv("ASTER_SIMD");
+    for (size_t i = 0; forced && i < count; i++) {
+        if (strcmp(supported[i]->name, forced) == 0) kernels = supported[i];
+    }
+}
+
+static inline const ArrayKernels *arrayKernels(void) {
+    pthread_once(&kernelsOnce, selectKernels);
+    return kernels;
+}
+
+const char *arrayKernelName(void) {
+    return arrayKernels()->name;
+}
+
+static size_t elementSize(ValueType elementType) {
+    return elementType == TYPE_I32 ? sizeof(int32_t) : sizeof(int64_t);
+}
+
+Array *newArray(AVM *vm, ValueType elementType, size_t length) {
+    size_t size = sizeof(Array) + length * elementSize(elementType);
+
+    Array *array = (Array *)heapAllocate(vm, HEAP_ARRAY, size);
+    if (!array) return NULL;
+
+    array->elementType = elementType;
+    array->length = length;
+
+    return array;
+}
+
+// the elements seen as each of the element types
+#define I32S(array) ((int32_t *)(array)->elements)
+#define I64S(array) ((int64_t *)(array)->elements)
+#define F64S(array) ((double *)(array)->elements)
+
+Object arrayGet(AVM *vm, const Array *array, size_t index) {
+    switch (array->elementType) {
+        case TYPE_I32: return i32Object(I32S(array)[index]);
+        case TYPE_I64: return i64Value(vm, I64S(array)[index]);
+        default: return f64Object(F64S(array)[index]);
+    }
+}
+
+static bool isElement(const Array *array, Object value) {
+    switch (array->elementType) {
+        case TYPE_I32: return isI32(value);
+        case TYPE_I64: return isI64(value);
+        default: return isF64(value);
+    }
+}
+
+bool arraySet(Array *array, size_t index, Object value) {
+    if (!isElement(array, value)) return false;
+
+    switch (array->elementType) {
+        case TYPE_I32: I32S(array)[index] = asI32(value); break;
+        case TYPE_I64: I64S(array)[index] = asI64(value); break;
+        default: F64S(array)[index] = asF64(value); break;
+    }
+
+    return true;
+}
+
+bool arrayFill(Array *array, Object value) {
+    if (!isElement(array, value)) return false;
+
+    switch (array->elementType) {
+        case TYPE_I32: {
+            arrayKernels()->fill32((uint32_t *)array->elements, (uint32_t)asI32(value), array->length);
+            break;
+        }
+        case TYPE_I64: {
+            arrayKernels()->fill64((uint64_t *)array->elements, (uint64_t)asI64(value), array->length);
+            break;
+        }
+        default: {
+            // a double's bits are the Object
+            arrayKernels()->fill64((uint64_t *)array->elements, value, array->length);
+            break;
+        }
+    }
+
+    return true;
+}
+
+// the C library already picks a vectorised copy for the machine
+void arrayCopy(Array *dst, const Array *src) {
+    memmove(dst->elements, src->elements, src->length * elementSize(src->elementType));
+}
+
+void arrayAdd(Array *dst, const Array *a, const Array *b) {
+    const ArrayKernels *k = arrayKernels();
+
+    switch (dst->elementType) {
+        case TYPE_I32: k->addI32(I32S(dst), I32S(a), I32S(b), dst->length); break;
+        case TYPE_I64: k->addI64(I64S(dst), I64S(a), I64S(b), dst->length); break;
+        default: k->addF64(F64S(dst), F64S(a), F64S(b), dst->length); break;
+    }
+}
+
+void arrayMul(Array *dst, const Array *a, const Array *b) {
+    const ArrayKernels *k = arrayKernels();
+
+    switch (dst->elementType) {
+        case TYPE_I32: k->mulI32(I32S(dst), I32S(a), I32S(b), dst->length); break;
+        case TYPE_I64: k->mulI64(I64S(dst), I64S(a), I64S(b), dst->length); break;
+        default: k->mulF64(F64S(dst), F64S(a), F64S(b), dst->length); break;
+    }
+}
+
+Object arrayDot(AVM *vm, const Array *a, const Array *b) {
+    const ArrayKernels *k = arrayKernels();
+
+    switch (a->elementType) {
+        case TYPE_I32: return i32Object(k->dotI32(I32S(a), I32S(b), a->length));
+        case TYPE_I64: return i64Value(vm, k->dotI64(I64S(a), I64S(b), a->length));
+        default: return f64Object(k->dotF64(F64S(a), F64S(b), a->length));
+    }
+}
+
+Object arraySum(AVM *vm, const Array *array) {
+    const ArrayKernels *k = arrayKernels();
+
+    switch (array->elementType) {
+        case TYPE_I32: return i32Object(k->sumI32(I32S(array), array->length));
+        case TYPE_I64: return i64Value(vm, k->sumI64(I64S(array), array->length));
+        default: return f64Object(k->sumF64(F64S(array), array->length));
+    }
+}
+
+Object arrayMin(AVM *vm, const Array *array) {
+    const ArrayKernels *k = arrayKernels();
+
+    switch (array->elementType) {
+        case TYPE_I32: return i32Object(k->minI32(I32S(array), array->length));
+        case TYPE_I64: return i64Value(vm, k->minI64(I64S(array), array->length));
+        default: return f64Object(k->minF64(F64S(array), array->length));
+    }
+}
+
+Object arrayMax(AVM *vm, const Array *array) {
+    const ArrayKernels *k = arrayKernels();
+
+    switch (array->elementType) {
+        case TYPE_I32: return i32Object(k->maxI32(I32S(array), array->length));
+        case TYPE_I64: return i64Value(vm, k->maxI64(I64S(array), array->length));
+        default: return f64Object(k->maxF64(F64S(array), array->length));
+    }
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+#ifndef array_h
+#define array_h
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "vm.h"
+#include "heap.h"
+
+// a typed array made by 'i32[length]' and the like. its elements are kept
+// unboxed, so whole-array operations run over them with vector instructions
+typedef struct Array {
+    HeapObject header;
+    // TYPE_I32, TYPE_I64 or TYPE_F64
+    ValueType elementType;
+    size_t length;
+
+    // 4 or 8 bytes each, only 8-byte aligned
+    uint8_t elements[];
+} Array;
+
+// a zeroed array on the heap, NULL when it did not fit
+Array *newArray(AVM *vm, ValueType elementType, size_t length);
+
+// the reads and reductions box an i64 too wide for an Object on 'vm's heap,
+// so like any allocation they may collect and move the arrays
+Object arrayGet(AVM *vm, const Array *array, size_t index);
+
+// false when 'value' is not of the array's element type
+bool arraySet(Array *array, size_t index, Object value);
+bool arrayFill(Array *array, Object value);
+
+// the operations on several arrays expect them to match in element type and length
+void arrayCopy(Array *dst, const Array *src);
+void arrayAdd(Array *dst, const Array *a, const Array *b);
+void arrayMul(Array *dst, const Array *a, const Array *b);
+Object arrayDot(AVM *vm, const Array *a, const Array *b);
+
+// integer results wrap. f64 results are summed a vector lane at a time, so
+// they may differ from a sum in element order in the last bits
+Object arraySum(AVM *vm, const Array *array);
+
+// on a non-empty array. NaN elements are passed over
+Object arrayMin(AVM *vm, const Array *array);
+Object arrayMax(AVM *vm, const Array *array);
+
+// the instruction set the kernels were picked for: "avx2", "sse2" or "scalar".
+// 'ASTER_SIMD' set to one of those that the machine supports picks it instead
+const char *arrayKernelName(void);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,473 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "heap.h"
+#include "scheduler.h"
+#include "../trace/trace.h"
+#include "../util/alloc.h"
+
+// a collection's view of the heap, 'visit' is applied to every root and every
+// slot of the objects it traces
+typedef struct Collector {
+    Heap *heap;
+    void (*visit)(struct Collector *collector, Object *slot);
+
+    // objects marked but not yet traced by a major collection
+    HeapObject **marking;
+    size_t markingCount;
+    size_t markingCapacity;
+} Collector;
+
+static size_t alignSize(size_t size) {
+    return (size + 7) & ~(size_t)7;
+}
+
+// objects this large skip the nursery, copying them would cost more than it saves
+static size_t largeObjectSize(const Heap *heap) {
+    return heap->nursery.size / 4;
+}
+
+static size_t initialThreshold(const Heap *heap) {
+    size_t threshold = 4 * heap->nursery.size;
+    return threshold < heap->oldLimit ? threshold : heap->oldLimit;
+}
+
+static HeapObject *oldObjectAt(const Heap *heap, size_t offset) {
+    return (HeapObject *)((uint8_t *)heap->old.base + offset);
+}
+
+static bool inOld(const Heap *heap, const HeapObject *object) {
+    const uint8_t *address = (const uint8_t *)object;
+    const uint8_t *base = heap->old.base;
+
+    return address >= base && address < base + heap->oldUsed;
+}
+
+// 'value' pointed at again once its object has moved to 'object'
+static Object movedReference(Object value, HeapObject *object) {
+    if (isWideI64(value)) return wideI64Object(&((WideI64 *)object)->value);
+
+    return ptrObject(object);
+}
+
+Heap *newHeap(const AvmConfig *config) {
+    Heap *heap = alloc(sizeof(Heap));
+    memset(heap, 0, sizeof(Heap));
+
+    heap->nursery = reserveRegion(config->nurserySize);
+    heap->oldLimit = config->heapLimit;
+    heap->old = reserveRegion(heap->oldLimit + heap->nursery.size);
+    heap->majorThreshold = initialThreshold(heap);
+
+    atomic_init(&heap->nurseryUsed, 0);
+    atomic_init(&heap->mutators, 0);
+    atomic_init(&heap->collecting, false);
+    pthread_mutex_init(&heap->lock, NULL);
+    pthread_cond_init(&heap->stopped, NULL);
+    pthread_cond_init(&heap->resumed, NULL);
+
+    return heap;
+}
+
+void freeHeap(Heap *heap) {
+    if (!heap) return;
+
+    releaseRegion(&heap->nursery);
+    releaseRegion(&heap->old);
+    FREE_ALLOC(heap->remembered);
+    pthread_mutex_destroy(&heap->lock);
+    pthread_cond_destroy(&heap->stopped);
+    pthread_cond_destroy(&heap->resumed);
+    FREE_ALLOC(heap);
+}
+
+void resetHeap(Heap *heap) {
+    if (!heap) return;
+
+    heap->stats.allocated += atomic_load(&heap->nurseryUsed);
+    atomic_store(&heap->nurseryUsed, 0);
+    heap->oldUsed = 0;
+    heap->majorThreshold = initialThreshold(heap);
+    heap->rememberedCount = 0;
+}
+
+GcStats heapStats(Heap *heap) {
+    GcStats stats = heap->stats;
+    stats.allocated += atomic_load(&heap->nurseryUsed);
+
+    return stats;
+}
+
+void resetHeapStats(Heap *heap) {
+    if (heap) heap->stats = (GcStats){0};
+}
+
+// the only slots that can point into the heap are on the stacks, in the
+// partial results of parallel fors and in other heap objects, the language
+// has no globals
+static void visitValues(Object *values, size_t count, void *context) {
+    Collector *collector = context;
+
+    for (size_t i = 0; i < count; i++) {
+        collector->visit(collector, &values[i]);
+    }
+}
+
+static void visitRoots(AVM *vm, Collector *collector) {
+    if (vm->worker) {
+        visitFiberRoots(vm, visitValues, collector);
+    } else {
+        visitValues(vm->stack.values, vm->stack.top, collector);
+    }
+}
+
+static void traceObject(Collector *collector, HeapObject *object) {
+    switch (object->kind) {
+        case HEAP_CHANNEL: {
+            Channel *channel = (Channel *)object;
+            for (size_t i = 0; i < channel->count; i++) {
+                collector->visit(collector, &channel->values[(channel->head + i) % channel->capacity]);
+            }
+            break;
+        }
+        case HEAP_ARRAY:
+        case HEAP_I64: {
+            // unboxed numbers, nothing to follow
+            break;
+        }
+    }
+}
+
+// copies a nursery object to the end of the old generation the first time it is reached
+static void evacuate(Collector *collector, Object *slot) {
+    if (!isReference(*slot)) return;
+
+    Heap *heap = collector->heap;
+    HeapObject *object = referencedObject(*slot);
+    if (!inNursery(heap, object)) return;
+
+    if (!object->forward) {
+        HeapObject *copy = oldObjectAt(heap, heap->oldUsed);
+        memcpy(copy, object, object->size);
+        heap->oldUsed += object->size;
+        object->forward = copy;
+    }
+
+    *slot = movedReference(*slot, object->forward);
+}
+
+// everything that survives is promoted, the copies themselves are the queue
+// of objects still to scan
+static void minorCollection(AVM *vm, Heap *heap) {
+    Collector collector = { .heap = heap, .visit = evacuate };
+    size_t scan = heap->oldUsed;
+    size_t promotedFrom = heap->oldUsed;
+
+    visitRoots(vm, &collector);
+
+    for (size_t i = 0; i < heap->rememberedCount; i++) {
+        HeapObject *object = heap->remembered[i];
+        atomic_fetch_and(&object->flags, ~HEAP_REMEMBERED);
+        traceObject(&collector, object);
+    }
+    heap->rememberedCount = 0;
+
+    while (scan < heap->oldUsed) {
+        HeapObject *object = oldObjectAt(heap, scan);
+        traceObject(&collector, object);
+        scan += object->size;
+    }
+
+    size_t used = atomic_load(&heap->nurseryUsed);
+    heap->stats.minorCollections++;
+    heap->stats.allocated += used;
+    heap->stats.nurseryCollected += used;
+    heap->stats.promoted += heap->oldUsed - promotedFrom;
+
+    atomic_store(&heap->nurseryUsed, 0);
+}
+
+// a wide i64 the host passed in is left where it is
+static void mark(Collector *collector, Object *slot) {
+    if (!isReference(*slot)) return;
+
+    HeapObject *object = referencedObject(*slot);
+    if (!inOld(collector->heap, object)) return;
+    uint32_t flags = atomic_load_explicit(&object->flags, memory_order_relaxed);
+    if (flags & HEAP_MARKED) return;
+    atomic_store_explicit(&object->flags, flags | HEAP_MARKED, memory_order_relaxed);
+
+    if (collector->markingCount >= collector->markingCapacity) {
+        collector->markingCapacity *= 2;
+        collector->marking = realloc(collector->marking, collector->markingCapacity * sizeof(HeapObject *));
+        assertAlloc(collector->marking);
+    }
+
+    collector->marking[collector->markingCount++] = object;
+}
+
+static void relocate(Collector *collector, Object *slot) {
+    if (!isReference(*slot)) return;
+
+    HeapObject *object = referencedObject(*slot);
+    if (inOld(collector->heap, object)) *slot = movedReference(*slot, object->forward);
+}
+
+static bool isMarked(HeapObject *object) {
+    return atomic_load_explicit(&object->flags, memory_order_relaxed) & HEAP_MARKED;
+}
+
+// runs right after a minor collection, so every live object is old. marks
+// from the roots, assigns each marked object its compacted address, points
+// every slot there and then slides the objects down
+static void majorCollection(AVM *vm, Heap *heap) {
+    Collector collector = {
+        .heap = heap,
+        .visit = mark,
+        .marking = alloc(sizeof(HeapObject *)),
+        .markingCapacity = 1,
+    };
+
+    visitRoots(vm, &collector);
+    while (collector.markingCount > 0) {
+        traceObject(&collector, collector.marking[--collector.markingCount]);
+    }
+    FREE_ALLOC(collector.marking);
+
+    size_t live = 0;
+    for (size_t scan = 0; scan < heap->oldUsed; ) {
+        HeapObject *object = oldObjectAt(heap, scan);
+        if (isMarked(object)) {
+            object->forward = oldObjectAt(heap, live);
+            live += object->size;
+        }
+        scan += object->size;
+    }
+
+    collector.visit = relocate;
+    visitRoots(vm, &collector);
+    for (size_t scan = 0; scan < heap->oldUsed; ) {
+        HeapObject *object = oldObjectAt(heap, scan);
+        if (isMarked(object)) traceObject(&collector, object);
+        scan += object->size;
+    }
+
+    // objects only ever move down, so the next header is intact when it is read
+    for (size_t scan = 0; scan < heap->oldUsed; ) {
+        HeapObject *object = oldObjectAt(heap, scan);
+        size_t size = object->size;
+
+        if (isMarked(object)) {
+            HeapObject *target = object->forward;
+            object->forward = NULL;
+            atomic_fetch_and(&object->flags, ~HEAP_MARKED);
+            memmove(target, object, size);
+        }
+        scan += size;
+    }
+
+    heap->stats.majorCollections++;
+    heap->stats.oldCollected += heap->oldUsed;
+    heap->stats.oldSurvived += live;
+
+    heap->oldUsed = live;
+    heap->majorThreshold = 2 * live > initialThreshold(heap) ? 2 * live : initialThreshold(heap);
+}
+
+static void waitForCollection(Heap *heap) {
+    pthread_mutex_lock(&heap->lock);
+    while (atomic_load(&heap->collecting)) {
+        pthread_cond_wait(&heap->resumed, &heap->lock);
+    }
+    pthread_mutex_unlock(&heap->lock);
+}
+
+// 'running' is set before the count is raised, so a collection starting
+// meanwhile either stops this vm or is seen here and waited out
+void joinMutators(AVM *vm) {
+    Heap *heap = vm->heap;
+
+    for (;;) {
+        atomic_store(&vm->running, true);
+        atomic_fetch_add(&heap->mutators, 1);
+        if (!atomic_load(&heap->collecting)) return;
+
+        leaveMutators(vm);
+        waitForCollection(heap);
+    }
+}
+
+void leaveMutators(AVM *vm) {
+    Heap *heap = vm->heap;
+
+    atomic_fetch_sub(&heap->mutators, 1);
+    if (!atomic_load(&heap->collecting)) return;
+
+    pthread_mutex_lock(&heap->lock);
+    pthread_cond_broadcast(&heap->stopped);
+    pthread_mutex_unlock(&heap->lock);
+}
+
+void heapSafepoint(AVM *vm) {
+    saveRunningFiber(vm);
+    leaveMutators(vm);
+    waitForCollection(vm->heap);
+    joinMutators(vm);
+}
+
+// true once every other worker has stopped, false when another thread got to
+// collect first, this one has then waited for it to finish
+static bool stopTheWorld(AVM *vm, Heap *heap) {
+    if (!vm->worker) return true;
+
+    saveRunningFiber(vm);
+    pthread_mutex_lock(&heap->lock);
+
+    if (atomic_load(&heap->collecting)) {
+        pthread_mutex_unlock(&heap->lock);
+        heapSafepoint(vm);
+        return false;
+    }
+
+    atomic_store(&heap->collecting, true);
+    interruptWorkers(vm);
+    while (atomic_load(&heap->mutators) > 1) {
+        pthread_cond_wait(&heap->stopped, &heap->lock);
+    }
+
+    pthread_mutex_unlock(&heap->lock);
+    return true;
+}
+
+static void resumeTheWorld(AVM *vm, Heap *heap) {
+    if (!vm->worker) return;
+
+    pthread_mutex_lock(&heap->lock);
+    atomic_store(&heap->collecting, false);
+    pthread_cond_broadcast(&heap->resumed);
+    pthread_mutex_unlock(&heap->lock);
+}
+
+static double millisecondsSince(const struct timespec *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return (end.tv_sec - start->tv_sec) * 1e3 + (end.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+// false when even a major collection left the old generation over its limit
+static bool collect(AVM *vm, Heap *heap, bool major) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (!stopTheWorld(vm, heap)) return true;
+
+    TRACE_BEGIN("minor gc", "gc");
+    minorCollection(vm, heap);
+    TRACE_END();
+
+    major = major || heap->oldUsed > heap->majorThreshold;
+    if (major) {
+        TRACE_BEGIN("major gc", "gc");
+        majorCollection(vm, heap);
+        TRACE_END();
+    }
+
+    double pause = millisecondsSince(&start);
+    if (major) {
+        heap->stats.majorPause += pause;
+    } else {
+        heap->stats.minorPause += pause;
+    }
+    if (pause > heap->stats.maxPause) heap->stats.maxPause = pause;
+
+    bool ok = heap->oldUsed <= heap->oldLimit;
+    resumeTheWorld(vm, heap);
+
+    return ok;
+}
+
+static HeapObject *bumpNursery(Heap *heap, size_t size) {
+    size_t used = atomic_load_explicit(&heap->nurseryUsed, memory_order_relaxed);
+
+    do {
+        if (used + size > heap->nursery.size) return NULL;
+    } while (!atomic_compare_exchange_weak_explicit(&heap->nurseryUsed, &used, used + size,
+                                                    memory_order_relaxed, memory_order_relaxed));
+
+    return (HeapObject *)((uint8_t *)heap->nursery.base + used);
+}
+
+static HeapObject *bumpOld(Heap *heap, size_t size) {
+    HeapObject *object = NULL;
+
+    pthread_mutex_lock(&heap->lock);
+    if (heap->oldUsed + size <= heap->oldLimit) {
+        object = oldObjectAt(heap, heap->oldUsed);
+        heap->oldUsed += size;
+        heap->stats.allocated += size;
+    }
+    pthread_mutex_unlock(&heap->lock);
+
+    return object;
+}
+
+static HeapObject *allocateYoung(AVM *vm, Heap *heap, size_t size) {
+    for (;;) {
+        HeapObject *object = bumpNursery(heap, size);
+        if (object) return object;
+
+        if (!collect(vm, heap, false)) return NULL;
+    }
+}
+
+static HeapObject *allocateOld(AVM *vm, Heap *heap, size_t size) {
+    HeapObject *object = bumpOld(heap, size);
+    if (object) return object;
+
+    if (!collect(vm, heap, true)) return NULL;
+    return bumpOld(heap, size);
+}
+
+HeapObject *heapAllocate(AVM *vm, HeapKind kind, size_t size) {
+    if (!vm->heap) vm->heap = newHeap(&vm->config);
+    Heap *heap = vm->heap;
+
+    size = alignSize(size);
+    HeapObject *object = size > largeObjectSize(heap) ? allocateOld(vm, heap, size)
+                                                      : allocateYoung(vm, heap, size);
+    if (!object) {
+        avmError(vm, "The heap is out of memory, %zu more bytes did not fit\n", size);
+        return NULL;
+    }
+
+    memset(object, 0, size);
+    object->kind = kind;
+    object->size = size;
+
+    return object;
+}
+
+Object boxI64(AVM *vm, int64_t value) {
+    WideI64 *cell = (WideI64 *)heapAllocate(vm, HEAP_I64, sizeof(WideI64));
+    if (!cell) return i64Object(0);
+
+    cell->value = value;
+    return wideI64Object(&cell->value);
+}
+
+void rememberObject(Heap *heap, HeapObject *object) {
+    if (atomic_fetch_or(&object->flags, HEAP_REMEMBERED) & HEAP_REMEMBERED) return;
+
+    pthread_mutex_lock(&heap->lock);
+
+    if (heap->rememberedCount >= heap->rememberedCapacity) {
+        heap->rememberedCapacity = heap->rememberedCapacity ? heap->rememberedCapacity * 2 : 1;
+        heap->remembered = realloc(heap->remembered, heap->rememberedCapacity * sizeof(HeapObject *));
+        assertAlloc(heap->remembered);
+    }
+    heap->remembered[heap->rememberedCount++] = object;
+
+    pthread_mutex_unlock(&heap->lock);
+}
\ No newline at end of file
@@ -0,0 +1,146 @@
+#ifndef heap_h
+#define heap_h
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "vm.h"
+
+typedef enum {
+    HEAP_CHANNEL,
+    HEAP_ARRAY,
+    HEAP_I64,
+} HeapKind;
+
+#define HEAP_MARKED ((uint32_t)1)
+// an old object already in the remembered set
+#define HEAP_REMEMBERED ((uint32_t)2)
+
+// the header every heap object starts with. a 'ptr' Object always points at one
+typedef struct HeapObject {
+    uint32_t kind;
+    _Atomic uint32_t flags;
+    // in bytes including the header, a multiple of 8
+    size_t size;
+    // where a collection has moved or is about to move the object
+    struct HeapObject *forward;
+} HeapObject;
+
+// an i64 beyond the 48 bits an Object holds inline. a 'wide' Object points
+// at the value rather than the header
+typedef struct {
+    HeapObject header;
+    int64_t value;
+} WideI64;
+
+typedef struct {
+    size_t minorCollections;
+    size_t majorCollections;
+
+    // in milliseconds, from the moment the world is asked to stop until it resumes
+    double minorPause;
+    double majorPause;
+    double maxPause;
+
+    // bytes handed out, and the share of them each kind of collection kept
+    size_t allocated;
+    size_t nurseryCollected;
+    size_t promoted;
+    size_t oldCollected;
+    size_t oldSurvived;
+} GcStats;
+
+// new objects are bump allocated in the nursery. a minor collection copies
+// what survives into the old generation, which a major collection marks and
+// compacts in place. every collection stops every thread running on the heap
+typedef struct Heap {
+    Region nursery;
+    atomic_size_t nurseryUsed;
+
+    // 'heapLimit' bytes, plus room for a full nursery to be promoted into
+    Region old;
+    size_t oldUsed;
+    size_t oldLimit;
+    // a major collection runs once the old generation grows past this
+    size_t majorThreshold;
+
+    // old objects that may point into the nursery, roots of a minor collection
+    HeapObject **remembered;
+    size_t rememberedCount;
+    size_t rememberedCapacity;
+
+    // guards the remembered set, large allocations and a collection's start and end
+    pthread_mutex_t lock;
+    pthread_cond_t stopped;
+    pthread_cond_t resumed;
+    // threads running fibers on the heap, a collection waits until it is the only one
+    atomic_size_t mutators;
+    atomic_bool collecting;
+
+    // bumped by every scheduler made over the heap, so channels can tell
+    // that the fibers waiting on them belonged to an earlier one
+    uint64_t epoch;
+
+    GcStats stats;
+} Heap;
+
+Heap *newHeap(const AvmConfig *config);
+void freeHeap(Heap *heap);
+
+// drops every object, keeping the memory already reserved
+void resetHeap(Heap *heap);
+
+// what the heap has done so far, with the nursery's allocations counted
+GcStats heapStats(Heap *heap);
+void resetHeapStats(Heap *heap);
+
+// a zeroed object of 'size' bytes including its header, NULL with an error
+// reported when the heap is full. this may collect, so pointers into the heap
+// held across it have to be read again from the stack
+HeapObject *heapAllocate(AVM *vm, HeapKind kind, size_t size);
+
+// records an old object once a pointer into the nursery is stored in it
+static inline bool inNursery(const Heap *heap, const void *pointer) {
+    const uint8_t *address = pointer;
+    const uint8_t *base = heap->nursery.base;
+
+    return address >= base && address < base + heap->nursery.size;
+}
+
+void rememberObject(Heap *heap, HeapObject *object);
+
+// the object a pointer or wide i64 refers to, which for a wide i64 the host
+// passed in is not on the heap
+static inline HeapObject *referencedObject(Object value) {
+    if (isWideI64(value)) return (HeapObject *)((uint8_t *)asPtr(value) - offsetof(WideI64, value));
+
+    return asPtr(value);
+}
+
+static inline void writeBarrier(Heap *heap, HeapObject *object, Object value) {
+    if (isReference(value) && !inNursery(heap, object) && inNursery(heap, referencedObject(value))) {
+        rememberObject(heap, object);
+    }
+}
+
+Object boxI64(AVM *vm, int64_t value);
+
+// an i64 result as an Object, in a heap cell when it is too wide to be
+// inline. making the cell may collect, like any other allocation
+static inline Object i64Value(AVM *vm, int64_t value) {
+    if (__builtin_expect(fitsInlineI64(value), 1)) return i64Object(value);
+
+    return boxI64(vm, value);
+}
+
+// how fiber workers take part in collections: a worker joins before running
+// a fiber and leaves once it has stopped. a worker stopped by a collection
+// waits it out at a safepoint
+void joinMutators(AVM *vm);
+void leaveMutators(AVM *vm);
+void heapSafepoint(AVM *vm);
+
+#endif
\ No newline at end of file
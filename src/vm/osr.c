@@ -0,0 +1,321 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "osr.h"
+#include "../util/alloc.h"
+
+// typed operators whose result only depends on their operands, integer
+// division is left to the interpreter, which reports division by zero
+static bool isPureBinary(AvmInstruction instr) {
+    return isBinaryInstruction(instr) && instr < INSTR_ADD &&
+           instr != INSTR_DIV_I32 && instr != INSTR_DIV_I64;
+}
+
+static bool isComparison(AvmInstruction instr) {
+    if (instr == INSTR_EQ_BOOL || instr == INSTR_NE_BOOL) return true;
+
+    BinaryOp op = (BinaryOp)((instr - INSTR_ADD_I32) % BIN_OP_COUNT);
+    return op >= BIN_LT;
+}
+
+// not an Object any operator makes, an i64 result too wide to be inline.
+// the tier has no heap cells to box it in, so the interpreter runs the op
+#define OSR_WIDE (OBJ_SIGN_BIT | OBJ_QNAN | OBJ_TAG_I64)
+
+static inline Object osrI64(int64_t value) {
+    return __builtin_expect(fitsInlineI64(value), 1) ? i64Object(value) : OSR_WIDE;
+}
+
+// wide operands are read out of their cells, so only when the op is on i64s
+static inline Object osrBinaryI64(AvmInstruction instr, int64_t a, int64_t b) {
+    switch (instr) {
+        case INSTR_ADD_I64: return osrI64((int64_t)((uint64_t)a + (uint64_t)b));
+        case INSTR_SUB_I64: return osrI64((int64_t)((uint64_t)a - (uint64_t)b));
+        case INSTR_MUL_I64: return osrI64((int64_t)((uint64_t)a * (uint64_t)b));
+        case INSTR_LT_I64: return boolObject(a < b);
+        case INSTR_LE_I64: return boolObject(a <= b);
+        case INSTR_GT_I64: return boolObject(a > b);
+        case INSTR_GE_I64: return boolObject(a >= b);
+        case INSTR_EQ_I64: return boolObject(a == b);
+        default: return boolObject(a != b);
+    }
+}
+
+// the same results as the interpreter's typed handlers
+static inline Object osrBinary(AvmInstruction instr, Object left, Object right) {
+    int32_t a32 = asI32(left), b32 = asI32(right);
+    double af = asF64(left), bf = asF64(right);
+
+    switch (instr) {
+        case INSTR_ADD_I32: return i32Object((int32_t)((uint32_t)a32 + (uint32_t)b32));
+        case INSTR_SUB_I32: return i32Object((int32_t)((uint32_t)a32 - (uint32_t)b32));
+        case INSTR_MUL_I32: return i32Object((int32_t)((uint32_t)a32 * (uint32_t)b32));
+        case INSTR_LT_I32: return boolObject(a32 < b32);
+        case INSTR_LE_I32: return boolObject(a32 <= b32);
+        case INSTR_GT_I32: return boolObject(a32 > b32);
+        case INSTR_GE_I32: return boolObject(a32 >= b32);
+        case INSTR_EQ_I32: return boolObject(a32 == b32);
+        case INSTR_NE_I32: return boolObject(a32 != b32);
+        case INSTR_ADD_I64:
+        case INSTR_SUB_I64:
+        case INSTR_MUL_I64:
+        case INSTR_LT_I64:
+        case INSTR_LE_I64:
+        case INSTR_GT_I64:
+        case INSTR_GE_I64:
+        case INSTR_EQ_I64:
+        case INSTR_NE_I64: return osrBinaryI64(instr, asI64(left), asI64(right));
+        case INSTR_ADD_F64: return f64Object(af + bf);
+        case INSTR_SUB_F64: return f64Object(af - bf);
+        case INSTR_MUL_F64: return f64Object(af * bf);
+        case INSTR_DIV_F64: return f64Object(af / bf);
+        case INSTR_LT_F64: return boolObject(af < bf);
+        case INSTR_LE_F64: return boolObject(af <= bf);
+        case INSTR_GT_F64: return boolObject(af > bf);
+        case INSTR_GE_F64: return boolObject(af >= bf);
+        case INSTR_EQ_F64: return boolObject(af == bf);
+        case INSTR_NE_F64: return boolObject(af != bf);
+        case INSTR_EQ_BOOL: return boolObject(asBool(left) == asBool(right));
+        default: return boolObject(asBool(left) != asBool(right));
+    }
+}
+
+static size_t jumpTarget(const Program *p, size_t pc) {
+    return pc + 2 + (int32_t)p->code[pc + 1];
+}
+
+// fusing never swallows an instruction a jump lands on
+static bool fusable(const Program *p, const bool *targets, size_t start, size_t end,
+                    size_t pc, size_t count) {
+    for (size_t i = 1; i < count; i++) {
+        pc += 1 + operandCount(p->code[pc]);
+        if (pc >= end || targets[pc - start]) return false;
+    }
+
+    return true;
+}
+
+// 'load a; load b; op; store c' and the like, false when the code at 'pc' is not one
+static bool fuseOperands(const Program *p, const bool *targets, size_t start, size_t end,
+                         size_t pc, OsrOp *op) {
+    if (p->code[pc] != INSTR_LOAD_LOCAL || !fusable(p, targets, start, end, pc, 4)) return false;
+
+    AvmInstruction second = p->code[pc + 2];
+    if (second != INSTR_LOAD_LOCAL && second != INSTR_PUSH_CONST) return false;
+
+    AvmInstruction instr = p->code[pc + 4];
+    if (!isPureBinary(instr)) return false;
+
+    AvmInstruction last = p->code[pc + 5];
+    bool branch = last == INSTR_JMP_IF_FALSE && isComparison(instr);
+    if (last != INSTR_STORE_LOCAL && !branch) return false;
+
+    op->instr = instr;
+    op->a = p->code[pc + 1];
+    if (second == INSTR_LOAD_LOCAL) {
+        op->b = p->code[pc + 3];
+    } else {
+        op->constant = p->constants.values[p->code[pc + 3]];
+    }
+
+    if (branch) {
+        op->kind = second == INSTR_LOAD_LOCAL ? OSR_BRANCH_LOCALS : OSR_BRANCH_CONST;
+        op->target = jumpTarget(p, pc + 5);
+    } else {
+        op->kind = second == INSTR_LOAD_LOCAL ? OSR_LOCALS : OSR_LOCAL_CONST;
+        op->c = p->code[pc + 6];
+    }
+    op->next = pc + 7;
+
+    return true;
+}
+
+static OsrOp translate(const Program *p, const bool *targets, size_t start, size_t end, size_t pc) {
+    AvmInstruction instr = p->code[pc];
+    OsrOp op = {
+        .kind = OSR_STEP,
+        .instr = instr,
+        .pc = pc,
+        .next = pc + 1 + operandCount(instr),
+    };
+
+    if (fuseOperands(p, targets, start, end, pc, &op)) return op;
+
+    if (isPureBinary(instr) && isComparison(instr) && fusable(p, targets, start, end, pc, 2) &&
+        p->code[pc + 1] == INSTR_JMP_IF_FALSE) {
+        op.kind = OSR_BRANCH;
+        op.target = jumpTarget(p, pc + 1);
+        op.next = pc + 3;
+        return op;
+    }
+
+    switch (instr) {
+        case INSTR_LOAD_LOCAL: op.kind = OSR_LOAD; op.a = p->code[pc + 1]; break;
+        case INSTR_STORE_LOCAL: op.kind = OSR_STORE; op.a = p->code[pc + 1]; break;
+        case INSTR_PUSH_CONST: {
+            op.kind = OSR_CONST;
+            op.constant = p->constants.values[p->code[pc + 1]];
+            break;
+        }
+        case INSTR_POP: op.kind = OSR_POP; break;
+        case INSTR_JMP: {
+            op.kind = OSR_JUMP;
+            op.target = jumpTarget(p, pc);
+            op.backEdge = op.target <= pc;
+            break;
+        }
+        case INSTR_JMP_IF_FALSE: {
+            op.kind = OSR_JUMP_IF_FALSE;
+            op.target = jumpTarget(p, pc);
+            break;
+        }
+        default: {
+            if (isPureBinary(instr)) op.kind = OSR_BINARY;
+            break;
+        }
+    }
+
+    return op;
+}
+
+OsrCode *compileOsr(const Program *p, size_t start, size_t end) {
+    size_t length = end - start;
+    bool *targets = alloc(length + 1);
+    memset(targets, 0, length + 1);
+
+    for (size_t pc = start; pc < end; pc += 1 + operandCount(p->code[pc])) {
+        AvmInstruction instr = p->code[pc];
+        if (instr != INSTR_JMP && instr != INSTR_JMP_IF_FALSE) continue;
+
+        size_t target = jumpTarget(p, pc);
+        if (target >= start && target < end) targets[target - start] = true;
+    }
+
+    OsrCode *code = alloc(sizeof(OsrCode));
+    *code = (OsrCode){
+        .start = start,
+        .end = end,
+        .ops = alloc(sizeof(OsrOp) * (length + 1)),
+        .opCount = 0,
+        .entries = alloc(sizeof(size_t) * (length + 1)),
+        .next = NULL,
+    };
+    for (size_t i = 0; i < length; i++) code->entries[i] = SIZE_MAX;
+
+    for (size_t pc = start; pc < end; ) {
+        OsrOp op = translate(p, targets, start, end, pc);
+        code->entries[pc - start] = code->opCount;
+        code->ops[code->opCount++] = op;
+        pc = op.next;
+    }
+
+    // the verifier keeps every jump inside its function and on an instruction
+    for (size_t i = 0; i < code->opCount; i++) {
+        OsrOp *op = &code->ops[i];
+        bool jumps = op->kind == OSR_JUMP || op->kind == OSR_JUMP_IF_FALSE || op->kind == OSR_BRANCH ||
+                     op->kind == OSR_BRANCH_LOCALS || op->kind == OSR_BRANCH_CONST;
+        if (jumps) op->target = code->entries[op->target - start];
+    }
+
+    FREE_ALLOC(targets);
+    return code;
+}
+
+void freeOsrCode(OsrCode *code) {
+    if (!code) return;
+
+    FREE_ALLOC(code->ops);
+    FREE_ALLOC(code->entries);
+    FREE_ALLOC(code);
+}
+
+void runOsr(AVM *vm, const OsrCode *code, size_t pc) {
+    const OsrOp *ops = code->ops;
+    const OsrOp *op = &ops[code->entries[pc - code->start]];
+    Object *frame = vm->stack.values + vm->fp;
+    Object *top = vm->stack.values + vm->stack.top;
+
+    for (;;) {
+        switch (op->kind) {
+            case OSR_LOAD: *top++ = frame[op->a]; op++; break;
+            case OSR_STORE: frame[op->a] = *--top; op++; break;
+            case OSR_CONST: *top++ = op->constant; op++; break;
+            case OSR_POP: top--; op++; break;
+            case OSR_BINARY: {
+                Object result = osrBinary(op->instr, top[-2], top[-1]);
+                if (__builtin_expect(result == OSR_WIDE, 0)) goto leave;
+
+                top--;
+                top[-1] = result;
+                op++;
+                break;
+            }
+            case OSR_LOCALS: {
+                Object result = osrBinary(op->instr, frame[op->a], frame[op->b]);
+                if (__builtin_expect(result == OSR_WIDE, 0)) goto leave;
+
+                frame[op->c] = result;
+                op++;
+                break;
+            }
+            case OSR_LOCAL_CONST: {
+                Object result = osrBinary(op->instr, frame[op->a], op->constant);
+                if (__builtin_expect(result == OSR_WIDE, 0)) goto leave;
+
+                frame[op->c] = result;
+                op++;
+                break;
+            }
+            case OSR_JUMP: {
+                // the interpreter stops between instructions, this tier between iterations
+                if (op->backEdge) {
+                    vm->backEdges[op->pc]++;
+                    if (!vm->running) {
+                        op = &ops[op->target];
+                        goto leave;
+                    }
+                }
+                op = &ops[op->target];
+                break;
+            }
+            case OSR_JUMP_IF_FALSE: {
+                // a condition of the wrong type is reported by the interpreter
+                if (!isBool(top[-1])) goto leave;
+                top--;
+                op = asBool(*top) ? op + 1 : &ops[op->target];
+                break;
+            }
+            case OSR_BRANCH: {
+                top -= 2;
+                op = asBool(osrBinary(op->instr, top[0], top[1])) ? op + 1 : &ops[op->target];
+                break;
+            }
+            case OSR_BRANCH_LOCALS: {
+                bool taken = !asBool(osrBinary(op->instr, frame[op->a], frame[op->b]));
+                op = taken ? &ops[op->target] : op + 1;
+                break;
+            }
+            case OSR_BRANCH_CONST: {
+                bool taken = !asBool(osrBinary(op->instr, frame[op->a], op->constant));
+                op = taken ? &ops[op->target] : op + 1;
+                break;
+            }
+            case OSR_STEP: {
+                // calls, returns and anything that parks the fiber leave the tier
+                vm->pc = op->pc;
+                vm->stack.top = top - vm->stack.values;
+                stepInstruction(vm);
+                if (!vm->running || vm->pc != op->next) return;
+
+                frame = vm->stack.values + vm->fp;
+                top = vm->stack.values + vm->stack.top;
+                op++;
+                break;
+            }
+        }
+    }
+
+leave:
+    vm->pc = op->pc;
+    vm->stack.top = top - vm->stack.values;
+}
\ No newline at end of file
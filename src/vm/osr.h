@@ -0,0 +1,73 @@
+#ifndef osr_h
+#define osr_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "vm.h"
+
+typedef enum {
+    OSR_LOAD,
+    OSR_STORE,
+    OSR_CONST,
+    OSR_POP,
+    // a typed binary operator on the two values on top of the stack
+    OSR_BINARY,
+    // 'c = a op b' and 'c = a op constant' over the frame's slots
+    OSR_LOCALS,
+    OSR_LOCAL_CONST,
+    OSR_JUMP,
+    OSR_JUMP_IF_FALSE,
+    // a comparison and the JMP_IF_FALSE after it, on the stack or on slots
+    OSR_BRANCH,
+    OSR_BRANCH_LOCALS,
+    OSR_BRANCH_CONST,
+    // anything else runs through the interpreter one instruction at a time
+    OSR_STEP,
+} OsrOpKind;
+
+typedef struct {
+    OsrOpKind kind;
+    // the typed opcode of a binary operator or comparison
+    AvmInstruction instr;
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;
+    Object constant;
+
+    // the op a jump lands on, and for JMP whether it closes a loop
+    size_t target;
+    bool backEdge;
+
+    // the bytecode the op was made from, the interpreter resumes at 'pc'
+    size_t pc;
+    size_t next;
+} OsrOp;
+
+// a function translated once one of its loops got hot. it runs on the same
+// frame and value stack as the interpreter, so a loop moves into it between
+// any two instructions, with operands decoded, jumps resolved and the common
+// load, operate and store or branch sequences fused into single ops
+typedef struct OsrCode {
+    size_t start;
+    size_t end;
+
+    OsrOp *ops;
+    size_t opCount;
+    // the op each bytecode address starts, SIZE_MAX inside a fused op
+    size_t *entries;
+
+    // every translation a vm made, so they are all freed with it
+    struct OsrCode *next;
+} OsrCode;
+
+// translates the function whose code spans 'start' to 'end'
+OsrCode *compileOsr(const Program *program, size_t start, size_t end);
+void freeOsrCode(OsrCode *code);
+
+// continues the running frame at bytecode address 'pc', which a jump in the
+// function lands on, until it leaves the function or the vm stops. the vm's pc
+// and stack are then where the interpreter picks up
+void runOsr(AVM *vm, const OsrCode *code, size_t pc);
+
+#endif
\ No newline at end of file
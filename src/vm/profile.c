@@ -0,0 +1,395 @@
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <sys/time.h>
+
+#include "profile.h"
+#include "../util/alloc.h"
+
+Profile *newProfile(void) {
+    Profile *profile = alloc(sizeof(Profile));
+    memset(profile, 0, sizeof(Profile));
+
+    profile->samples = alloc(sizeof(size_t) * PROFILE_SAMPLE_WORDS);
+    profile->capacity = PROFILE_SAMPLE_WORDS;
+
+    profile->overhead = UINT64_MAX;
+    for (int i = 0; i < 64; i++) {
+        uint64_t start = readCycles();
+        uint64_t elapsed = readCycles() - start;
+        if (elapsed < profile->overhead) profile->overhead = elapsed;
+    }
+
+    return profile;
+}
+
+void freeProfile(Profile *profile) {
+    if (!profile) return;
+
+    FREE_ALLOC(profile->samples);
+    FREE_ALLOC(profile->executed);
+    FREE_ALLOC(profile->jumped);
+    FREE_ALLOC(profile);
+}
+
+void countAddresses(Profile *profile, size_t length) {
+    profile->executed = alloc((length + 1) * sizeof(uint64_t));
+    profile->jumped = alloc((length + 1) * sizeof(uint64_t));
+    memset(profile->executed, 0, (length + 1) * sizeof(uint64_t));
+    memset(profile->jumped, 0, (length + 1) * sizeof(uint64_t));
+    profile->length = length;
+}
+
+void attachCounters(Profile *profile, const Counters *counters) {
+    profile->counters = counters;
+
+    for (size_t i = 0; i < COUNTER_COUNT; i++) profile->counterOverhead[i] = UINT64_MAX;
+    for (int i = 0; i < 64; i++) {
+        CounterValues before, after;
+        readMappedCounters(counters, &before);
+        readMappedCounters(counters, &after);
+
+        for (size_t j = 0; j < COUNTER_COUNT; j++) {
+            uint64_t counted = after.values[j] - before.values[j];
+            if (counted < profile->counterOverhead[j]) profile->counterOverhead[j] = counted;
+        }
+    }
+}
+
+void countOpcode(Profile *profile, AvmInstruction instr, const CounterValues *before) {
+    CounterValues after;
+    readMappedCounters(profile->counters, &after);
+
+    for (size_t i = 0; i < COUNTER_COUNT; i++) {
+        uint64_t counted = after.values[i] - before->values[i];
+        if (counted > profile->counterOverhead[i]) profile->counted[i][instr] += counted - profile->counterOverhead[i];
+    }
+}
+
+void mergeProfile(Profile *profile, const Profile *worker) {
+    if (!profile || !worker) return;
+
+    for (size_t i = 0; i < INSTR_COUNT; i++) {
+        profile->counts[i] += worker->counts[i];
+        profile->cycles[i] += worker->cycles[i];
+        profile->timed[i] += worker->timed[i];
+    }
+    profile->taken += worker->taken;
+    profile->dropped += worker->dropped;
+
+    if (profile->executed && worker->executed && worker->length == profile->length) {
+        for (size_t i = 0; i < profile->length; i++) {
+            profile->executed[i] += worker->executed[i];
+            profile->jumped[i] += worker->jumped[i];
+        }
+    }
+
+    // only whole samples that fit are copied, the rest count as dropped
+    size_t room = profile->capacity - profile->used;
+    size_t copied = 0;
+    while (copied < worker->used && copied + 1 + worker->samples[copied] <= room) {
+        copied += 1 + worker->samples[copied];
+    }
+    for (size_t i = copied; i < worker->used; i += 1 + worker->samples[i]) profile->dropped++;
+
+    // claimed before copying, so a sample the timer takes meanwhile lands after it
+    size_t at = profile->used;
+    profile->used += copied;
+    memcpy(profile->samples + at, worker->samples, sizeof(size_t) * copied);
+}
+
+// the pc, then where each caller resumes. the entry frame at the bottom
+// returns to no caller and is left out
+static void recordSample(Profile *profile, const AVM *vm) {
+    profile->taken++;
+
+    size_t frames = vm->callStack.top > 0 ? vm->callStack.top - 1 : 0;
+    if (frames > PROFILE_MAX_DEPTH - 1) frames = PROFILE_MAX_DEPTH - 1;
+    if (profile->used + 2 + frames > profile->capacity) {
+        profile->dropped++;
+        return;
+    }
+
+    size_t *sample = profile->samples + profile->used;
+    sample[0] = 1 + frames;
+    sample[1] = vm->pc;
+    for (size_t i = 0; i < frames; i++) {
+        sample[2 + i] = vm->callStack.frames[vm->callStack.top - 1 - i].returnAddress;
+    }
+
+    profile->used += 2 + frames;
+}
+
+static void onProfileTick(int signal) {
+    (void)signal;
+
+    AVM *vm = currentVm();
+    if (vm && vm->profile && vm->running) recordSample(vm->profile, vm);
+}
+
+void startProfileTimer(void) {
+    struct sigaction action = {
+        .sa_handler = onProfileTick,
+        .sa_flags = SA_RESTART,
+    };
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, NULL);
+
+    struct itimerval timer = {
+        .it_interval = { .tv_sec = 0, .tv_usec = PROFILE_INTERVAL },
+        .it_value = { .tv_sec = 0, .tv_usec = PROFILE_INTERVAL },
+    };
+    setitimer(ITIMER_PROF, &timer, NULL);
+}
+
+// the handler stays, a tick already pending would otherwise end the process
+void stopProfileTimer(void) {
+    struct itimerval timer = {0};
+    setitimer(ITIMER_PROF, &timer, NULL);
+}
+
+typedef struct {
+    size_t address;
+    const char *name;
+} FunctionStart;
+
+static int compareStarts(const void *a, const void *b) {
+    size_t left = ((const FunctionStart *)a)->address;
+    size_t right = ((const FunctionStart *)b)->address;
+    return (left > right) - (left < right);
+}
+
+static int compareLines(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// the function whose code starts at or last before 'pc'
+static const char *functionAt(const FunctionStart *starts, size_t count, size_t pc) {
+    size_t low = 0, high = count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (starts[mid].address <= pc) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low > 0 ? starts[low - 1].name : NULL;
+}
+
+static char *foldSample(const size_t *pcs, size_t depth, const Program *program,
+                        const FunctionStart *starts, size_t startCount) {
+    size_t length = 0, capacity = 1;
+    char *line = alloc(capacity);
+    line[0] = '\0';
+
+    for (size_t i = depth; i-- > 0; ) {
+        // a caller resumes just past its call
+        size_t pc = i > 0 ? pcs[i] - 1 : pcs[i];
+        if (pc >= program->length) continue;
+
+        const char *name = functionAt(starts, startCount, pc);
+        if (!name) continue;
+
+        size_t needed = length + strlen(name) + 2;
+        while (capacity < needed) {
+            capacity *= 2;
+            line = realloc(line, capacity);
+            assertAlloc(line);
+        }
+
+        if (length > 0) line[length++] = ';';
+        strcpy(line + length, name);
+        length += strlen(name);
+    }
+
+    return line;
+}
+
+bool writeFoldedStacks(const Profile *profile, const Program *program, const char *path) {
+    FILE *out = fopen(path, "w");
+    if (!out) return false;
+
+    // stubs have no code yet, every other function starts where its address says
+    FunctionStart *starts = alloc(sizeof(FunctionStart) * (program->functions.count + 1));
+    size_t startCount = 0;
+    for (size_t i = 0; i < program->functions.count; i++) {
+        Function *func = &program->functions.entries[i];
+        if (func->stub) continue;
+        starts[startCount++] = (FunctionStart){ .address = func->address, .name = func->name };
+    }
+    qsort(starts, startCount, sizeof(FunctionStart), compareStarts);
+
+    size_t lineCount = 0, lineCapacity = 1;
+    char **lines = alloc(sizeof(char *) * lineCapacity);
+    for (size_t i = 0; i < profile->used; i += 1 + profile->samples[i]) {
+        if (profile->samples[i] == 0) continue;
+
+        char *line = foldSample(profile->samples + i + 1, profile->samples[i], program, starts, startCount);
+        if (line[0] == '\0') {
+            FREE_ALLOC(line);
+            continue;
+        }
+
+        if (lineCount == lineCapacity) {
+            lineCapacity *= 2;
+            lines = realloc(lines, sizeof(char *) * lineCapacity);
+            assertAlloc(lines);
+        }
+        lines[lineCount++] = line;
+    }
+
+    // equal stacks end up next to each other and are written once with their count
+    qsort(lines, lineCount, sizeof(char *), compareLines);
+    for (size_t i = 0; i < lineCount; ) {
+        size_t same = i + 1;
+        while (same < lineCount && strcmp(lines[same], lines[i]) == 0) same++;
+
+        fprintf(out, "%s %zu\n", lines[i], same - i);
+        i = same;
+    }
+
+    for (size_t i = 0; i < lineCount; i++) FREE_ALLOC(lines[i]);
+    FREE_ALLOC(lines);
+    FREE_ALLOC(starts);
+
+    return fclose(out) == 0;
+}
+
+typedef struct {
+    AvmInstruction instr;
+    double cycles;
+} OpcodeCost;
+
+static int compareCosts(const void *a, const void *b) {
+    double left = ((const OpcodeCost *)a)->cycles;
+    double right = ((const OpcodeCost *)b)->cycles;
+    return (left < right) - (left > right);
+}
+
+void printOpcodeHistogram(const Profile *profile, FILE *out) {
+    double perOp[INSTR_COUNT];
+    OpcodeCost costs[INSTR_COUNT];
+    size_t costCount = 0;
+    uint64_t total = 0;
+    double totalCycles = 0;
+
+    for (size_t i = 0; i < INSTR_COUNT; i++) {
+        if (profile->counts[i] == 0) continue;
+
+        // opcodes too rare to have been timed count as free
+        perOp[i] = profile->timed[i] ? (double)profile->cycles[i] / profile->timed[i] - profile->overhead : 0;
+        if (perOp[i] < 0) perOp[i] = 0;
+
+        costs[costCount++] = (OpcodeCost){ .instr = (AvmInstruction)i, .cycles = perOp[i] * profile->counts[i] };
+        total += profile->counts[i];
+        totalCycles += perOp[i] * profile->counts[i];
+    }
+    qsort(costs, costCount, sizeof(OpcodeCost), compareCosts);
+
+    fprintf(out, "profile: %" PRIu64 " instructions, one in %d timed\n", total, PROFILE_TIMED_MASK + 1);
+    fprintf(out, "  %-16s %14s %8s %10s %8s\n", "opcode", "count", "share", "cycles/op", "time");
+    for (size_t i = 0; i < costCount; i++) {
+        AvmInstruction instr = costs[i].instr;
+        char name[32];
+        instructionName(instr, name, sizeof(name));
+        fprintf(out, "  %-16s %14" PRIu64 " %7.2f%% %10.1f %7.2f%%\n", name, profile->counts[instr],
+                100.0 * profile->counts[instr] / total, perOp[instr],
+                totalCycles > 0 ? 100.0 * costs[i].cycles / totalCycles : 0);
+    }
+}
+
+void printOpcodeCounters(const Profile *profile, FILE *out) {
+    if (!profile->counters) return;
+
+    OpcodeCost costs[INSTR_COUNT];
+    size_t costCount = 0;
+    for (size_t i = 0; i < INSTR_COUNT; i++) {
+        if (profile->timed[i] == 0) continue;
+
+        double cycles = (double)profile->counted[COUNTER_CYCLES][i] / profile->timed[i];
+        costs[costCount++] = (OpcodeCost){ .instr = (AvmInstruction)i, .cycles = cycles * profile->counts[i] };
+    }
+    qsort(costs, costCount, sizeof(OpcodeCost), compareCosts);
+
+    fprintf(out, "counters: per opcode over the timed share, misses per thousand opcodes run\n");
+    fprintf(out, "  %-16s %10s %12s %6s %14s %14s\n", "opcode", "cycles/op", "instrs/op", "IPC", "branch-misses",
+            "cache-misses");
+    for (size_t i = 0; i < costCount; i++) {
+        AvmInstruction instr = costs[i].instr;
+        double timed = profile->timed[instr];
+        double cycles = profile->counted[COUNTER_CYCLES][instr] / timed;
+        double instructions = profile->counted[COUNTER_INSTRUCTIONS][instr] / timed;
+
+        char name[32];
+        instructionName(instr, name, sizeof(name));
+        fprintf(out, "  %-16s %10.1f %12.1f %6.2f %14.2f %14.2f\n", name, cycles, instructions,
+                cycles > 0 ? instructions / cycles : 0, 1000.0 * profile->counted[COUNTER_BRANCH_MISSES][instr] / timed,
+                1000.0 * profile->counted[COUNTER_CACHE_MISSES][instr] / timed);
+    }
+}
+
+typedef struct {
+    uint32_t file;
+    uint32_t line;
+    size_t samples;
+} HotLine;
+
+static int compareLocations(const void *a, const void *b) {
+    const HotLine *left = a, *right = b;
+    if (left->file != right->file) return left->file < right->file ? -1 : 1;
+    return (left->line > right->line) - (left->line < right->line);
+}
+
+static int compareHotness(const void *a, const void *b) {
+    size_t left = ((const HotLine *)a)->samples;
+    size_t right = ((const HotLine *)b)->samples;
+    return (left < right) - (left > right);
+}
+
+void printHotLines(const Profile *profile, const Program *program, FILE *out) {
+    if (program->lines.count == 0) return;
+
+    // the line each sample's running instruction came from
+    size_t count = 0, capacity = 1, total = 0;
+    HotLine *lines = alloc(sizeof(HotLine) * capacity);
+    for (size_t i = 0; i < profile->used; i += 1 + profile->samples[i]) {
+        if (profile->samples[i] == 0) continue;
+
+        LineEntry entry;
+        if (!findLine(&program->lines, profile->samples[i + 1], &entry)) continue;
+
+        if (count == capacity) {
+            capacity *= 2;
+            lines = realloc(lines, sizeof(HotLine) * capacity);
+            assertAlloc(lines);
+        }
+        lines[count++] = (HotLine){ .file = entry.file, .line = entry.line, .samples = 1 };
+        total++;
+    }
+
+    qsort(lines, count, sizeof(HotLine), compareLocations);
+    size_t merged = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (merged > 0 && compareLocations(&lines[merged - 1], &lines[i]) == 0) {
+            lines[merged - 1].samples++;
+        } else {
+            lines[merged++] = lines[i];
+        }
+    }
+    qsort(lines, merged, sizeof(HotLine), compareHotness);
+
+    if (merged > 0) {
+        fprintf(out, "hot lines: %zu samples\n", total);
+        fprintf(out, "  %-40s %10s %8s\n", "line", "samples", "share");
+    }
+    for (size_t i = 0; i < merged && i < PROFILE_HOT_LINES; i++) {
+        char location[256];
+        snprintf(location, sizeof(location), "%s:%u", program->lines.files[lines[i].file], lines[i].line);
+        fprintf(out, "  %-40s %10zu %7.2f%%\n", location, lines[i].samples, 100.0 * lines[i].samples / total);
+    }
+
+    FREE_ALLOC(lines);
+}
\ No newline at end of file
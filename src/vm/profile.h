@@ -0,0 +1,106 @@
+#ifndef profile_h
+#define profile_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "vm.h"
+#include "../counters/counters.h"
+
+// one instruction in this many is timed, the rest are only counted
+#define PROFILE_TIMED_MASK 63
+// how often the timer samples the call stack, in microseconds of cpu time
+#define PROFILE_INTERVAL 1000
+// frames past this are left off a sample
+#define PROFILE_MAX_DEPTH 64
+// words of stack samples a vm keeps, samples past this are dropped
+#define PROFILE_SAMPLE_WORDS ((size_t)1 << 20)
+// how many of the hottest lines are reported
+#define PROFILE_HOT_LINES 10
+
+typedef struct Profile {
+    // how often each opcode ran, and the cycles the timed share of them took
+    uint64_t counts[INSTR_COUNT];
+    uint64_t cycles[INSTR_COUNT];
+    uint64_t timed[INSTR_COUNT];
+    uint64_t tick;
+    // what reading the counter around nothing takes, left out of each timing
+    uint64_t overhead;
+
+    // stack samples back to back, each its depth followed by the pc and the
+    // return address of every frame, innermost first. written by the timer's signal handler, so
+    // the buffer never grows
+    size_t *samples;
+    size_t used;
+    size_t capacity;
+    size_t taken;
+    size_t dropped;
+
+    // with addresses counted, how often the instruction at each address ran
+    // and how often the JMP_IF_FALSE there jumped, NULL otherwise
+    uint64_t *executed;
+    uint64_t *jumped;
+    size_t length;
+
+    // with hardware counters readable from user space, what they counted
+    // over the timed share of each opcode, NULL otherwise
+    const Counters *counters;
+    uint64_t counted[COUNTER_COUNT][INSTR_COUNT];
+    // what reading them around nothing counts, left out like 'overhead'
+    uint64_t counterOverhead[COUNTER_COUNT];
+} Profile;
+
+// the time stamp counter where there is one, nanoseconds elsewhere
+static inline uint64_t readCycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+#endif
+}
+
+Profile *newProfile(void);
+void freeProfile(Profile *profile);
+
+// also counts every address of a program 'length' words long, which is what
+// a profile for the optimiser is made from
+void countAddresses(Profile *profile, size_t length);
+
+// also attributes the hardware counters to the opcodes timed, on the thread
+// that opened them
+void attachCounters(Profile *profile, const Counters *counters);
+
+// adds what the counters went up by since 'before' to the opcode just timed
+void countOpcode(Profile *profile, AvmInstruction instr, const CounterValues *before);
+
+// adds the counts and samples of a worker's profile to 'profile'
+void mergeProfile(Profile *profile, const Profile *worker);
+
+// samples whichever vm is running on the thread the cpu-time timer lands on,
+// into that vm's profile
+void startProfileTimer(void);
+void stopProfileTimer(void);
+
+// writes one line per distinct stack, its functions from the outermost in
+// separated by ';' and then the number of samples, as flame graph scripts read
+bool writeFoldedStacks(const Profile *profile, const Program *program, const char *path);
+
+// every opcode that ran with its count and estimated cycles, costliest first
+void printOpcodeHistogram(const Profile *profile, FILE *out);
+
+// with counters attached, the IPC and misses per opcode of every timed one
+void printOpcodeCounters(const Profile *profile, FILE *out);
+
+// the source lines most samples were taken on, nothing without a line table
+void printHotLines(const Profile *profile, const Program *program, FILE *out);
+
+#endif
\ No newline at end of file
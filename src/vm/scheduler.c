@@ -0,0 +1,920 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+
+#include "scheduler.h"
+#include "profile.h"
+#include "../util/alloc.h"
+
+#define LIVE_FIBER ((uint64_t)1 << 32)
+#define PARKED_FIBER ((uint64_t)1)
+
+static size_t liveFibers(uint64_t population) {
+    return (size_t)(population >> 32);
+}
+
+static size_t parkedFibers(uint64_t population) {
+    return (size_t)(population & 0xffffffff);
+}
+
+static void enqueue(FiberQueue *queue, Fiber *fiber) {
+    fiber->next = NULL;
+    if (queue->tail) {
+        queue->tail->next = fiber;
+    } else {
+        queue->head = fiber;
+    }
+    queue->tail = fiber;
+}
+
+static Fiber *dequeue(FiberQueue *queue) {
+    Fiber *fiber = queue->head;
+    if (!fiber) return NULL;
+
+    queue->head = fiber->next;
+    if (!queue->head) queue->tail = NULL;
+    fiber->next = NULL;
+
+    return fiber;
+}
+
+// only the owning worker pushes, false when the deque is full
+static bool dequePush(Deque *deque, Fiber *fiber) {
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    if (bottom - top >= DEQUE_SIZE) return false;
+
+    // the release publishes the fiber's registers along with the slot
+    atomic_store_explicit(&deque->slots[bottom % DEQUE_SIZE], fiber, memory_order_relaxed);
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_release);
+
+    return true;
+}
+
+// the owner takes its most recent fiber, racing thieves only for the last one
+static Fiber *dequePop(Deque *deque) {
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+    if (top > bottom) {
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    Fiber *fiber = atomic_load_explicit(&deque->slots[bottom % DEQUE_SIZE], memory_order_relaxed);
+    if (top == bottom) {
+        if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                                     memory_order_seq_cst, memory_order_relaxed)) {
+            fiber = NULL;
+        }
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    }
+
+    return fiber;
+}
+
+// other workers take the oldest fiber, NULL when it is empty or the race was lost
+static Fiber *dequeSteal(Deque *deque) {
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+    if (top >= bottom) return NULL;
+
+    Fiber *fiber = atomic_load_explicit(&deque->slots[top % DEQUE_SIZE], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                                 memory_order_seq_cst, memory_order_relaxed)) {
+        return NULL;
+    }
+
+    return fiber;
+}
+
+static bool dequeEmpty(Deque *deque) {
+    return atomic_load(&deque->bottom) <= atomic_load(&deque->top);
+}
+
+static void loadFiber(AVM *vm, const Fiber *fiber) {
+    vm->stack = fiber->stack;
+    vm->callStack = fiber->callStack;
+    vm->pc = fiber->pc;
+    vm->fp = fiber->fp;
+}
+
+static void saveFiber(const AVM *vm, Fiber *fiber) {
+    fiber->stack = vm->stack;
+    fiber->callStack = vm->callStack;
+    fiber->pc = vm->pc;
+    fiber->fp = vm->fp;
+}
+
+void saveRunningFiber(AVM *vm) {
+    if (vm->worker && vm->worker->current) saveFiber(vm, vm->worker->current);
+}
+
+// channel sections are a handful of stores, too short to be worth sleeping on
+static void lockChannel(Channel *channel) {
+    while (atomic_flag_test_and_set_explicit(&channel->lock, memory_order_acquire)) {
+        sched_yield();
+    }
+}
+
+static void unlockChannel(Channel *channel) {
+    atomic_flag_clear_explicit(&channel->lock, memory_order_release);
+}
+
+// a channel can outlive the scheduler whose fibers waited on it, those are
+// gone along with it. called with the channel's lock held
+static void claimChannel(Scheduler *s, Channel *channel) {
+    if (channel->epoch == s->epoch) return;
+
+    channel->senders = (FiberQueue){0};
+    channel->receivers = (FiberQueue){0};
+    channel->epoch = s->epoch;
+}
+
+// lazily compiled functions are written into the program as they are
+// reached, so those programs keep to the one thread
+static size_t workerCount(const AVM *vm) {
+    if (vm->materialize) return 1;
+    if (vm->config.workers > 0) return vm->config.workers;
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (size_t)cores : 1;
+}
+
+// made by the first spawn or channel, the vm that made it is the first worker
+// and what it is running becomes the main fiber. the workers share its heap
+static Scheduler *getScheduler(AVM *vm) {
+    if (vm->worker) return vm->worker->scheduler;
+
+    Scheduler *s = alloc(sizeof(Scheduler));
+    memset(s, 0, sizeof(Scheduler));
+
+    s->workerCount = workerCount(vm);
+    s->workers = alloc(s->workerCount * sizeof(Worker));
+    memset(s->workers, 0, s->workerCount * sizeof(Worker));
+
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->wake, NULL);
+    atomic_init(&s->queued, 0);
+    atomic_init(&s->idle, 0);
+    atomic_init(&s->population, LIVE_FIBER);
+    atomic_init(&s->done, false);
+    atomic_init(&s->failed, false);
+
+    for (size_t i = 0; i < s->workerCount; i++) {
+        Worker *worker = &s->workers[i];
+        worker->scheduler = s;
+        worker->id = i;
+        atomic_init(&worker->deque.top, 0);
+        atomic_init(&worker->deque.bottom, 0);
+    }
+
+    for (size_t i = 0; i < s->workerCount; i++) {
+        atomic_init(&s->workers[i].interrupted, false);
+    }
+
+    if (!vm->heap) vm->heap = newHeap(&vm->config);
+    s->epoch = ++vm->heap->epoch;
+    s->main.live = true;
+
+    s->workers[0].vm = vm;
+    s->workers[0].current = &s->main;
+    vm->worker = &s->workers[0];
+    joinMutators(vm);
+
+    return s;
+}
+
+static void stopScheduler(Scheduler *s, bool failed) {
+    if (failed) atomic_store(&s->failed, true);
+    atomic_store(&s->done, true);
+
+    pthread_mutex_lock(&s->lock);
+    pthread_cond_broadcast(&s->wake);
+    pthread_mutex_unlock(&s->lock);
+}
+
+// pairs with the fence in 'waitForWork', so either the sleeper sees the new
+// fiber or this sees the sleeper
+static void wakeIdle(Scheduler *s) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&s->idle) == 0) return;
+
+    pthread_mutex_lock(&s->lock);
+    pthread_cond_signal(&s->wake);
+    pthread_mutex_unlock(&s->lock);
+}
+
+static void pushShared(Scheduler *s, Fiber *fiber) {
+    pthread_mutex_lock(&s->lock);
+    enqueue(&s->queue, fiber);
+    atomic_fetch_add(&s->queued, 1);
+    if (atomic_load(&s->idle) > 0) pthread_cond_signal(&s->wake);
+    pthread_mutex_unlock(&s->lock);
+}
+
+static Fiber *popShared(Scheduler *s) {
+    if (atomic_load(&s->queued) == 0) return NULL;
+
+    pthread_mutex_lock(&s->lock);
+    Fiber *fiber = dequeue(&s->queue);
+    if (fiber) atomic_fetch_sub(&s->queued, 1);
+    pthread_mutex_unlock(&s->lock);
+
+    return fiber;
+}
+
+// new and woken fibers stay with the worker that made them runnable until
+// another worker runs out of its own
+static void makeReady(Worker *worker, Fiber *fiber) {
+    if (!dequePush(&worker->deque, fiber)) {
+        pushShared(worker->scheduler, fiber);
+        return;
+    }
+
+    wakeIdle(worker->scheduler);
+}
+
+static Fiber *findWork(Worker *worker) {
+    Scheduler *s = worker->scheduler;
+
+    Fiber *fiber = dequePop(&worker->deque);
+    if (!fiber) fiber = popShared(s);
+
+    for (size_t i = 1; !fiber && i < s->workerCount; i++) {
+        fiber = dequeSteal(&s->workers[(worker->id + i) % s->workerCount].deque);
+    }
+
+    return fiber;
+}
+
+// called with the lock held
+static bool hasWork(Scheduler *s) {
+    if (s->queue.head) return true;
+
+    for (size_t i = 0; i < s->workerCount; i++) {
+        if (!dequeEmpty(&s->workers[i].deque)) return true;
+    }
+
+    return false;
+}
+
+static void waitForWork(Scheduler *s) {
+    pthread_mutex_lock(&s->lock);
+    atomic_fetch_add(&s->idle, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    while (!atomic_load(&s->done) && !hasWork(s)) {
+        pthread_cond_wait(&s->wake, &s->lock);
+    }
+
+    atomic_fetch_sub(&s->idle, 1);
+    pthread_mutex_unlock(&s->lock);
+}
+
+// every live fiber parked on a channel means none of them can ever be woken
+static void checkDeadlock(Worker *worker, uint64_t population) {
+    if (liveFibers(population) == 0 || liveFibers(population) != parkedFibers(population)) return;
+
+    avmError(worker->vm, "All fibers are blocked on channels, the program is deadlocked\n");
+    stopScheduler(worker->scheduler, true);
+}
+
+static void finishFiber(Worker *worker, Fiber *fiber) {
+    Scheduler *s = worker->scheduler;
+
+    // the program ends with its main fiber, whatever else is still running
+    if (fiber == &s->main) {
+        stopScheduler(s, false);
+        return;
+    }
+
+    pthread_mutex_lock(&s->lock);
+    fiber->live = false;
+    fiber->next = s->freeFibers;
+    s->freeFibers = fiber;
+    pthread_mutex_unlock(&s->lock);
+
+    uint64_t population = atomic_fetch_sub(&s->population, LIVE_FIBER) - LIVE_FIBER;
+    checkDeadlock(worker, population);
+}
+
+// a fiber is only put on a channel's queue once its registers are saved, so
+// whoever wakes it finds it ready to run
+static void parkFiber(Worker *worker, Fiber *fiber, SuspendReason reason) {
+    Channel *channel = worker->parkedOn;
+    bool sending = reason == SUSPEND_SEND;
+    uint64_t population = 0;
+
+    lockChannel(channel);
+    claimChannel(worker->scheduler, channel);
+
+    // the channel may have changed since the instruction found it full or empty
+    bool ready = sending ? channel->count < channel->capacity : channel->count > 0;
+    if (!ready) {
+        enqueue(sending ? &channel->senders : &channel->receivers, fiber);
+        population = atomic_fetch_add(&worker->scheduler->population, PARKED_FIBER) + PARKED_FIBER;
+    }
+
+    unlockChannel(channel);
+
+    if (ready) {
+        makeReady(worker, fiber);
+    } else {
+        checkDeadlock(worker, population);
+    }
+}
+
+// the last chunk of a parallel for to finish wakes the fiber waiting on it
+static void finishChunk(Worker *worker, Fiber *fiber) {
+    Scheduler *s = worker->scheduler;
+    ParallelJob *job = fiber->job;
+    Fiber *woken = NULL;
+    fiber->job = NULL;
+
+    pthread_mutex_lock(&s->lock);
+    if (--job->remaining == 0 && job->waiter) {
+        woken = job->waiter;
+        job->waiter = NULL;
+        atomic_fetch_sub(&s->population, PARKED_FIBER);
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    if (woken) makeReady(worker, woken);
+}
+
+// the chunks may all have finished before the fiber that spawned them stopped
+static void joinChunks(Worker *worker, Fiber *fiber) {
+    Scheduler *s = worker->scheduler;
+    ParallelJob *job = fiber->joining;
+    uint64_t population = 0;
+
+    pthread_mutex_lock(&s->lock);
+    bool ready = job->remaining == 0;
+    if (!ready) {
+        job->waiter = fiber;
+        population = atomic_fetch_add(&s->population, PARKED_FIBER) + PARKED_FIBER;
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    if (ready) {
+        makeReady(worker, fiber);
+    } else {
+        checkDeadlock(worker, population);
+    }
+}
+
+// the worker's vm has stopped running its current fiber
+static void suspendFiber(Worker *worker) {
+    Scheduler *s = worker->scheduler;
+    AVM *vm = worker->vm;
+    Fiber *fiber = worker->current;
+
+    saveFiber(vm, fiber);
+    worker->current = NULL;
+
+    SuspendReason reason = worker->suspend;
+    worker->suspend = SUSPEND_NONE;
+
+    if (vm->failed) {
+        stopScheduler(s, true);
+        return;
+    }
+
+    switch (reason) {
+        case SUSPEND_YIELD: {
+            // behind everything already waiting, so it does not just run again
+            pushShared(s, fiber);
+            break;
+        }
+        case SUSPEND_SEND:
+        case SUSPEND_RECV: {
+            parkFiber(worker, fiber, reason);
+            break;
+        }
+        case SUSPEND_JOIN: {
+            joinChunks(worker, fiber);
+            break;
+        }
+        case SUSPEND_NONE: {
+            if (fiber->job) finishChunk(worker, fiber);
+            finishFiber(worker, fiber);
+            break;
+        }
+    }
+}
+
+// a vm stopped by a collection waits it out and carries on with the same fiber
+static void resumeInterrupted(Worker *worker) {
+    AVM *vm = worker->vm;
+
+    while (atomic_exchange(&worker->interrupted, false)) {
+        heapSafepoint(vm);
+        if (vm->failed || worker->suspend != SUSPEND_NONE || vm->callStack.top == 0) return;
+
+        runFiber(vm);
+    }
+}
+
+// a worker only touches the heap between joining and leaving, so collections
+// never wait on one that is looking for work
+static void runOn(Worker *worker, Fiber *fiber) {
+    AVM *vm = worker->vm;
+
+    loadFiber(vm, fiber);
+    worker->current = fiber;
+    joinMutators(vm);
+
+    runFiber(vm);
+    resumeInterrupted(worker);
+    suspendFiber(worker);
+
+    leaveMutators(vm);
+}
+
+// fibers only give way when they yield, block or return, so a worker runs
+// each one it picks up until it does
+static void workLoop(Worker *worker) {
+    Scheduler *s = worker->scheduler;
+
+    while (!atomic_load(&s->done)) {
+        Fiber *fiber = findWork(worker);
+        if (fiber) {
+            runOn(worker, fiber);
+        } else {
+            waitForWork(s);
+        }
+    }
+}
+
+static void *workerThread(void *argument) {
+    workLoop(argument);
+    return NULL;
+}
+
+// the threads only start with the first fiber they could run
+static void startWorkers(Scheduler *s) {
+    if (s->started) return;
+    s->started = true;
+    if (s->workerCount == 1) return;
+
+    AVM *root = s->workers[0].vm;
+
+    // functions otherwise validated on their first call would be written to
+    // while other threads read them
+    validateProgram(root->program);
+
+    for (size_t i = 1; i < s->workerCount; i++) {
+        Worker *worker = &s->workers[i];
+        worker->threadVm = (AVM){
+            .program = root->program,
+            .config = root->config,
+            .worker = worker,
+            .heap = root->heap,
+            .verified = root->verified,
+            .output = root->output,
+            .errors = root->errors,
+            .profile = root->profile ? newProfile() : NULL,
+        };
+        worker->vm = &worker->threadVm;
+        if (root->profile && root->profile->executed) countAddresses(worker->threadVm.profile, root->profile->length);
+
+        if (pthread_create(&worker->thread, NULL, workerThread, worker) != 0) {
+            freeProfile(worker->threadVm.profile);
+            break;
+        }
+        s->threads++;
+    }
+}
+
+static Fiber *takeFiber(Scheduler *s, const AVM *vm) {
+    pthread_mutex_lock(&s->lock);
+    Fiber *fiber = s->freeFibers;
+    if (fiber) s->freeFibers = fiber->next;
+    pthread_mutex_unlock(&s->lock);
+
+    if (fiber) return fiber;
+
+    Region stackRegion = reserveRegion(vm->config.fiberStackLimit * sizeof(Object));
+    Region callRegion = reserveRegion(vm->config.fiberCallStackLimit * sizeof(Frame));
+
+    fiber = alloc(sizeof(Fiber));
+    *fiber = (Fiber){
+        .stack = {
+            .values = stackRegion.base,
+            .capacity = stackRegion.size / sizeof(Object),
+            .region = stackRegion
+        },
+        .callStack = {
+            .frames = callRegion.base,
+            .capacity = callRegion.size / sizeof(Frame),
+            .region = callRegion
+        },
+    };
+
+    pthread_mutex_lock(&s->lock);
+    fiber->allocated = s->fibers;
+    s->fibers = fiber;
+    pthread_mutex_unlock(&s->lock);
+
+    return fiber;
+}
+
+// a fiber ready to run 'function' from its start, whose caller fills in the
+// frame's slots. NULL when the frame does not fit on the fiber's stack
+static Fiber *prepareFiber(AVM *vm, Scheduler *s, const Function *function) {
+    Fiber *fiber = takeFiber(s, vm);
+
+    if (function->localCount >= fiber->stack.capacity) {
+        pthread_mutex_lock(&s->lock);
+        fiber->next = s->freeFibers;
+        s->freeFibers = fiber;
+        pthread_mutex_unlock(&s->lock);
+
+        avmError(vm, "'%s' does not fit on a fiber's stack\n", function->name);
+        return NULL;
+    }
+
+    fiber->stack.top = function->localCount;
+
+    // returning from this frame finishes the fiber, like the vm's own entry frame
+    fiber->callStack.frames[0] = (Frame){ .returnAddress = vm->program->length, .fp = 0 };
+    fiber->callStack.top = 1;
+    fiber->fp = 0;
+    fiber->pc = function->address;
+    fiber->job = NULL;
+    fiber->joining = NULL;
+
+    return fiber;
+}
+
+static void launchFiber(AVM *vm, Scheduler *s, Fiber *fiber) {
+    fiber->live = true;
+
+    atomic_fetch_add(&s->population, LIVE_FIBER);
+    startWorkers(s);
+    makeReady(vm->worker, fiber);
+}
+
+bool spawnFiber(AVM *vm, const Function *function) {
+    Scheduler *s = getScheduler(vm);
+    Fiber *fiber = prepareFiber(vm, s, function);
+    if (!fiber) return false;
+
+    vm->stack.top -= function->arity;
+    memcpy(fiber->stack.values, vm->stack.values + vm->stack.top, function->arity * sizeof(Object));
+    for (size_t i = function->arity; i < function->localCount; i++) {
+        fiber->stack.values[i] = i32Object(0);
+    }
+
+    launchFiber(vm, s, fiber);
+    return true;
+}
+
+Channel *newChannel(AVM *vm, size_t capacity) {
+    Scheduler *s = getScheduler(vm);
+
+    Channel *channel = (Channel *)heapAllocate(vm, HEAP_CHANNEL, sizeof(Channel) + capacity * sizeof(Object));
+    if (!channel) return NULL;
+
+    atomic_flag_clear(&channel->lock);
+    channel->capacity = capacity;
+    channel->epoch = s->epoch;
+
+    return channel;
+}
+
+// stops the vm so its worker can park the fiber once its registers are saved
+static void suspend(AVM *vm, SuspendReason reason, Channel *channel) {
+    vm->worker->suspend = reason;
+    vm->worker->parkedOn = channel;
+    vm->running = false;
+}
+
+// called with the channel's lock held
+static Fiber *wakeOne(Scheduler *s, FiberQueue *waiting) {
+    Fiber *fiber = dequeue(waiting);
+    if (fiber) atomic_fetch_sub(&s->population, PARKED_FIBER);
+
+    return fiber;
+}
+
+bool channelSend(AVM *vm, Channel *channel, Object value) {
+    Scheduler *s = getScheduler(vm);
+    lockChannel(channel);
+    claimChannel(s, channel);
+
+    if (channel->count == channel->capacity) {
+        unlockChannel(channel);
+        suspend(vm, SUSPEND_SEND, channel);
+        return false;
+    }
+
+    channel->values[(channel->head + channel->count) % channel->capacity] = value;
+    channel->count++;
+    writeBarrier(vm->heap, &channel->header, value);
+    Fiber *woken = wakeOne(s, &channel->receivers);
+
+    unlockChannel(channel);
+
+    if (woken) makeReady(vm->worker, woken);
+    return true;
+}
+
+bool channelRecv(AVM *vm, Channel *channel, Object *value) {
+    Scheduler *s = getScheduler(vm);
+    lockChannel(channel);
+    claimChannel(s, channel);
+
+    if (channel->count == 0) {
+        unlockChannel(channel);
+        suspend(vm, SUSPEND_RECV, channel);
+        return false;
+    }
+
+    *value = channel->values[channel->head];
+    channel->head = (channel->head + 1) % channel->capacity;
+    channel->count--;
+    Fiber *woken = wakeOne(s, &channel->senders);
+
+    unlockChannel(channel);
+
+    if (woken) makeReady(vm->worker, woken);
+    return true;
+}
+
+// a chunk starts its reductions from the operation's identity, or for min
+// and max from the value the loop started with, which changes neither
+static Object reductionStart(ReduceOp op, Object value) {
+    if (op == REDUCE_MIN || op == REDUCE_MAX) return value;
+
+    int32_t identity = op == REDUCE_MUL ? 1 : 0;
+    switch (objectType(value)) {
+        case OBJ_I64: return i64Object(identity);
+        case OBJ_F64: return f64Object(identity);
+        default: return i32Object(identity);
+    }
+}
+
+// integer arithmetic wraps, as it does in the vm
+static bool combineReduction(AVM *vm, ReduceOp op, Object *target, Object partial) {
+    if (objectType(*target) != objectType(partial)) return false;
+
+    switch (objectType(partial)) {
+        case OBJ_I32: {
+            int32_t a = asI32(*target), b = asI32(partial);
+            switch (op) {
+                case REDUCE_ADD: *target = i32Object((int32_t)((uint32_t)a + (uint32_t)b)); break;
+                case REDUCE_MUL: *target = i32Object((int32_t)((uint32_t)a * (uint32_t)b)); break;
+                case REDUCE_MIN: *target = i32Object(b < a ? b : a); break;
+                case REDUCE_MAX: *target = i32Object(b > a ? b : a); break;
+            }
+            return true;
+        }
+        case OBJ_I64: {
+            int64_t a = asI64(*target), b = asI64(partial);
+            switch (op) {
+                case REDUCE_ADD: *target = i64Value(vm, (int64_t)((uint64_t)a + (uint64_t)b)); break;
+                case REDUCE_MUL: *target = i64Value(vm, (int64_t)((uint64_t)a * (uint64_t)b)); break;
+                case REDUCE_MIN: *target = b < a ? partial : *target; break;
+                case REDUCE_MAX: *target = b > a ? partial : *target; break;
+            }
+            return true;
+        }
+        case OBJ_F64: {
+            double a = asF64(*target), b = asF64(partial);
+            switch (op) {
+                case REDUCE_ADD: *target = f64Object(a + b); break;
+                case REDUCE_MUL: *target = f64Object(a * b); break;
+                case REDUCE_MIN: *target = f64Object(b < a ? b : a); break;
+                case REDUCE_MAX: *target = f64Object(b > a ? b : a); break;
+            }
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+static void freeJob(ParallelJob *job) {
+    FREE_ALLOC(job->reductions);
+    FREE_ALLOC(job->partials);
+    FREE_ALLOC(job);
+}
+
+// folds every chunk's partials into the frame in chunk order
+static bool combineChunks(AVM *vm, ParallelJob *job) {
+    for (size_t r = 0; r < job->reductionCount; r++) {
+        Object *target = &vm->stack.values[vm->fp + job->reductions[r].slot];
+
+        for (size_t chunk = 0; chunk < job->chunkCount; chunk++) {
+            Object partial = job->partials[chunk * job->reductionCount + r];
+            if (!combineReduction(vm, job->reductions[r].op, target, partial)) {
+                avmError(vm, "A reduction of '%s' changed its value's type\n", job->function->name);
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static ParallelJob *newJob(const Function *function, const Object *operands, size_t reductionCount,
+                           size_t chunkCount) {
+    ParallelJob *job = alloc(sizeof(ParallelJob));
+    *job = (ParallelJob){
+        .function = function,
+        .reductions = alloc((reductionCount + 1) * sizeof(ParallelReduction)),
+        .reductionCount = reductionCount,
+        .partials = alloc((chunkCount * reductionCount + 1) * sizeof(Object)),
+        .chunkCount = chunkCount,
+        .remaining = chunkCount,
+    };
+    // collections visit the partials before every chunk has left its own
+    memset(job->partials, 0, (chunkCount * reductionCount + 1) * sizeof(Object));
+
+    for (size_t r = 0; r < reductionCount; r++) {
+        job->reductions[r] = (ParallelReduction){
+            .slot = (size_t)asI32(operands[2 + 2 * r]),
+            .op = (ReduceOp)asI32(operands[3 + 2 * r]),
+        };
+    }
+
+    return job;
+}
+
+// enough chunks that every worker has some to steal when others run long
+static size_t chunkCount(const Scheduler *s, int64_t iterations) {
+    size_t chunks = 4 * s->workerCount;
+    return (int64_t)chunks < iterations ? chunks : (size_t)iterations;
+}
+
+bool runParallel(AVM *vm, const Function *function, const Object *operands, size_t reductionCount) {
+    Fiber *self = vm->worker ? vm->worker->current : NULL;
+
+    // woken once the chunks have finished. the job stays the fiber's while
+    // combining, so a collection still sees the partials
+    if (self && self->joining) {
+        ParallelJob *job = self->joining;
+        bool combined = combineChunks(vm, job);
+
+        self->joining = NULL;
+        freeJob(job);
+        return combined;
+    }
+
+    int32_t start = asI32(operands[0]);
+    int32_t end = asI32(operands[1]);
+    if (start >= end) return true;
+
+    Scheduler *s = getScheduler(vm);
+    self = vm->worker->current;
+
+    int64_t iterations = (int64_t)end - start;
+    size_t chunks = chunkCount(s, iterations);
+    ParallelJob *job = newJob(function, operands, reductionCount, chunks);
+
+    // owned by the fiber from here on, so it is freed with the scheduler
+    // even if a chunk cannot be started
+    self->joining = job;
+
+    size_t captured = function->arity - 1;
+    for (size_t chunk = 0; chunk < chunks; chunk++) {
+        Fiber *fiber = prepareFiber(vm, s, function);
+        if (!fiber) return false;
+
+        Object *frame = fiber->stack.values;
+        memcpy(frame, vm->stack.values + vm->fp, captured * sizeof(Object));
+        for (size_t r = 0; r < reductionCount; r++) {
+            size_t slot = job->reductions[r].slot;
+            frame[slot] = reductionStart(job->reductions[r].op, frame[slot]);
+        }
+        for (size_t i = captured; i < function->localCount; i++) frame[i] = i32Object(0);
+
+        int32_t first = (int32_t)(start + iterations * (int64_t)chunk / (int64_t)chunks);
+        fiber->job = job;
+        fiber->chunk = chunk;
+        fiber->iteration = first;
+        fiber->chunkEnd = (int32_t)(start + iterations * (int64_t)(chunk + 1) / (int64_t)chunks);
+        frame[captured] = i32Object(first);
+
+        launchFiber(vm, s, fiber);
+    }
+
+    suspend(vm, SUSPEND_JOIN, NULL);
+    return false;
+}
+
+void nextIteration(AVM *vm) {
+    Fiber *fiber = vm->worker ? vm->worker->current : NULL;
+    if (!fiber || !fiber->job) {
+        avmError(vm, "NEXT outside of a parallel for\n");
+        return;
+    }
+
+    ParallelJob *job = fiber->job;
+    const Function *function = job->function;
+
+    // the body starts over on a frame holding only its slots
+    if (++fiber->iteration < fiber->chunkEnd) {
+        vm->stack.values[vm->fp + function->arity - 1] = i32Object(fiber->iteration);
+        vm->stack.top = vm->fp + function->localCount;
+        vm->pc = function->address;
+        return;
+    }
+
+    Object *partials = &job->partials[fiber->chunk * job->reductionCount];
+    for (size_t r = 0; r < job->reductionCount; r++) {
+        partials[r] = vm->stack.values[vm->fp + job->reductions[r].slot];
+    }
+
+    // like returning from the entry frame, the worker then finishes the fiber
+    vm->callStack.top = 0;
+    vm->running = false;
+}
+
+void yieldFiber(AVM *vm) {
+    // with nothing spawned there is nothing to give way to
+    if (!vm->worker) return;
+
+    suspend(vm, SUSPEND_YIELD, NULL);
+}
+
+static void freeScheduler(Scheduler *s) {
+    // a parallel for is only left unfinished when the program failed
+    if (s->main.joining) freeJob(s->main.joining);
+
+    for (Fiber *fiber = s->fibers; fiber; ) {
+        Fiber *next = fiber->allocated;
+        if (fiber->joining) freeJob(fiber->joining);
+        releaseRegion(&fiber->stack.region);
+        releaseRegion(&fiber->callStack.region);
+        FREE_ALLOC(fiber);
+        fiber = next;
+    }
+
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->wake);
+    FREE_ALLOC(s->workers);
+    FREE_ALLOC(s);
+}
+
+void interruptWorkers(AVM *vm) {
+    Scheduler *s = vm->worker->scheduler;
+
+    for (size_t i = 0; i < s->workerCount; i++) {
+        Worker *worker = &s->workers[i];
+        if (worker == vm->worker || !worker->vm) continue;
+
+        atomic_store(&worker->interrupted, true);
+        atomic_store(&worker->vm->running, false);
+    }
+}
+
+static void visitJob(const ParallelJob *job, void (*visit)(Object *values, size_t count, void *context),
+                     void *context) {
+    if (job) visit(job->partials, job->chunkCount * job->reductionCount, context);
+}
+
+// a running fiber's registers are only current once saved
+void visitFiberRoots(AVM *vm, void (*visit)(Object *values, size_t count, void *context), void *context) {
+    Scheduler *s = vm->worker->scheduler;
+
+    visit(s->main.stack.values, s->main.stack.top, context);
+    visitJob(s->main.joining, visit, context);
+    for (Fiber *fiber = s->fibers; fiber; fiber = fiber->allocated) {
+        if (!fiber->live) continue;
+
+        visit(fiber->stack.values, fiber->stack.top, context);
+        visitJob(fiber->joining, visit, context);
+    }
+}
+
+void runScheduler(AVM *vm) {
+    Worker *worker = vm->worker;
+    Scheduler *s = worker->scheduler;
+
+    // the vm's own function has returned, failed or given way to other fibers
+    resumeInterrupted(worker);
+    suspendFiber(worker);
+    leaveMutators(vm);
+    workLoop(worker);
+
+    stopScheduler(s, false);
+    for (size_t i = 1; i <= s->threads; i++) {
+        pthread_join(s->workers[i].thread, NULL);
+        releaseThreadVm(vm, &s->workers[i].threadVm);
+    }
+
+    // the main fiber's stacks are the vm's own, whichever fiber it ran last
+    loadFiber(vm, &s->main);
+    if (atomic_load(&s->failed)) vm->failed = true;
+    vm->running = false;
+    vm->worker = NULL;
+
+    freeScheduler(s);
+}
\ No newline at end of file
@@ -0,0 +1,186 @@
+#ifndef scheduler_h
+#define scheduler_h
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "vm.h"
+#include "heap.h"
+
+// fibers a worker keeps to itself, spawns past this go to the shared queue
+#define DEQUE_SIZE 256
+
+// a green thread with stacks of its own, run by whichever worker picks it up.
+// the main fiber's stacks are the ones the vm was created with
+typedef struct Fiber {
+    Stack stack;
+    CallStack callStack;
+    size_t pc;
+    size_t fp;
+
+    // the next fiber in whichever queue holds this one, a fiber is in at most one
+    struct Fiber *next;
+    // every fiber the scheduler made, so they are all freed with it
+    struct Fiber *allocated;
+    // spawned and not yet finished, its stack is then a root of the heap
+    bool live;
+
+    // set while the fiber runs a chunk of a parallel for, with the chunk's
+    // place among the job's chunks, its current index and the one it stops at
+    struct ParallelJob *job;
+    size_t chunk;
+    int32_t iteration;
+    int32_t chunkEnd;
+    // the parallel for whose chunks this fiber is waiting on
+    struct ParallelJob *joining;
+} Fiber;
+
+typedef struct {
+    Fiber *head;
+    Fiber *tail;
+} FiberQueue;
+
+// a bounded buffer of values between fibers, made by 'chan(capacity)'. it
+// lives on the heap and so may be moved by a collection, which never happens
+// while its lock is held
+typedef struct Channel {
+    HeapObject header;
+    atomic_flag lock;
+    size_t capacity;
+    size_t head;
+    size_t count;
+
+    // fibers parked until there is room for a value or a value to take,
+    // only meaningful while the scheduler of 'epoch' runs
+    FiberQueue senders;
+    FiberQueue receivers;
+    uint64_t epoch;
+
+    Object values[];
+} Channel;
+
+typedef struct {
+    // a slot of the frame that started the loop
+    size_t slot;
+    ReduceOp op;
+} ParallelReduction;
+
+// a parallel for split into chunks, each run as a fiber over a copy of the
+// frame that started it. that fiber parks until every chunk has finished
+typedef struct ParallelJob {
+    const Function *function;
+    ParallelReduction *reductions;
+    size_t reductionCount;
+
+    // what each chunk left in the reduced slots, in chunk order so that
+    // combining them gives the same result however the chunks were scheduled
+    Object *partials;
+    size_t chunkCount;
+
+    // chunks still running and the fiber waiting on them, under the scheduler's lock
+    size_t remaining;
+    Fiber *waiter;
+} ParallelJob;
+
+typedef enum {
+    SUSPEND_NONE,
+    SUSPEND_YIELD,
+    SUSPEND_SEND,
+    SUSPEND_RECV,
+    SUSPEND_JOIN,
+} SuspendReason;
+
+// a Chase-Lev deque: its worker pushes and pops at the bottom, others steal from the top
+typedef struct {
+    _Atomic int64_t top;
+    _Atomic int64_t bottom;
+    _Atomic(Fiber *) slots[DEQUE_SIZE];
+} Deque;
+
+typedef struct Scheduler Scheduler;
+
+typedef struct Worker {
+    Scheduler *scheduler;
+    size_t id;
+
+    // the vm whose registers hold the running fiber. the first worker runs on
+    // the vm that spawned the first fiber, the others on 'threadVm'
+    AVM *vm;
+    AVM threadVm;
+    pthread_t thread;
+
+    Deque deque;
+    Fiber *current;
+
+    // why the current fiber stopped running, and on which channel it waits
+    SuspendReason suspend;
+    Channel *parkedOn;
+
+    // set when a collection stopped the vm rather than the fiber giving way
+    atomic_bool interrupted;
+} Worker;
+
+struct Scheduler {
+    Worker *workers;
+    size_t workerCount;
+    bool started;
+    // worker threads actually running, the first worker is not one of them
+    size_t threads;
+
+    // guards the shared queue, the free fibers and the channel list
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    FiberQueue queue;
+    atomic_size_t queued;
+    atomic_size_t idle;
+
+    // live fibers in the high half, parked ones in the low half, one word so
+    // the deadlock check never compares counts taken at different moments
+    _Atomic uint64_t population;
+
+    atomic_bool done;
+    atomic_bool failed;
+    uint64_t epoch;
+
+    Fiber main;
+    Fiber *freeFibers;
+    Fiber *fibers;
+};
+
+// starts 'function' as a new fiber, taking its arguments off the vm's stack
+bool spawnFiber(AVM *vm, const Function *function);
+
+// a channel on the heap that buffers up to 'capacity' values, NULL when it did not fit
+Channel *newChannel(AVM *vm, size_t capacity);
+
+// false when the fiber has to wait, it is then parked and runs the
+// instruction again once woken
+bool channelSend(AVM *vm, Channel *channel, Object value);
+bool channelRecv(AVM *vm, Channel *channel, Object *value);
+
+// runs a parallel for over the range and reductions in 'operands'. the first
+// time a fiber reaches it the chunks are spawned and it is parked, false, and
+// once they have all finished their partial results are combined into its frame
+bool runParallel(AVM *vm, const Function *function, const Object *operands, size_t reductionCount);
+
+// ends an iteration of the running chunk, starting its next index or
+// finishing the fiber when the chunk has none left
+void nextIteration(AVM *vm);
+
+// moves the running fiber to the back of the shared queue
+void yieldFiber(AVM *vm);
+
+// what a collection needs of the scheduler: the running fiber's registers
+// saved, every other worker stopped, and the stacks of all live fibers and
+// the partial results of the parallel fors they wait on
+void saveRunningFiber(AVM *vm);
+void interruptWorkers(AVM *vm);
+void visitFiberRoots(AVM *vm, void (*visit)(Object *values, size_t count, void *context), void *context);
+
+// once the vm's own run stops, runs fibers until it has returned, then stops
+// the workers and frees everything the scheduler made
+void runScheduler(AVM *vm);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,505 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "verifier.h"
+#include "../util/alloc.h"
+
+typedef enum {
+    FN_UNVISITED,
+    FN_IN_PROGRESS,
+    FN_DONE,
+} FunctionState;
+
+typedef struct {
+    size_t start;
+    size_t end;
+
+    FunctionState state;
+    // frame-relative, the arguments and locals are counted in
+    size_t maxStack;
+    size_t maxCallDepth;
+
+    // the target of a SPAWN, so it starts a fiber's stacks
+    bool spawned;
+} FunctionInfo;
+
+typedef struct {
+    const Program *program;
+    FunctionInfo *functions;
+
+    // checks a single body without following calls into other functions
+    bool shallow;
+
+    bool ok;
+    const char *error;
+    size_t errorPc;
+} Verifier;
+
+static bool fail(Verifier *v, const char *error, size_t pc) {
+    if (v->ok) {
+        v->ok = false;
+        v->error = error;
+        v->errorPc = pc;
+    }
+
+    return false;
+}
+
+// a function extends from its address up to the next function's address
+static void computeExtents(Verifier *v) {
+    const FunctionTable *table = &v->program->functions;
+    size_t *ends = alloc((table->count + 1) * sizeof(size_t));
+    functionExtents(v->program, ends);
+
+    for (size_t i = 0; i < table->count; i++) {
+        v->functions[i] = (FunctionInfo){
+            .start = table->entries[i].address,
+            .end = ends[i],
+            .state = FN_UNVISITED,
+        };
+    }
+
+    FREE_ALLOC(ends);
+}
+
+static bool verifyFunction(Verifier *v, size_t index);
+
+static bool mergeDepth(Verifier *v, long *depths, size_t *worklist, size_t *pending,
+                       FunctionInfo *fn, size_t target, long depth, size_t fromPc) {
+    if (target < fn->start || target >= fn->end) {
+        return fail(v, "jump target outside of function", fromPc);
+    }
+
+    long *slot = &depths[target - fn->start];
+    if (*slot == -2) {
+        return fail(v, "jump target is not an instruction boundary", fromPc);
+    }
+    if (*slot == -1) {
+        *slot = depth;
+        worklist[(*pending)++] = target;
+        return true;
+    }
+    if (*slot != depth) {
+        return fail(v, "inconsistent stack depth at merge point", target);
+    }
+
+    return true;
+}
+
+// the values an array instruction takes off the stack
+static long arrayOperandCount(AvmInstruction instr) {
+    switch (instr) {
+        case INSTR_ARRAY_SET:
+        case INSTR_ARRAY_ADD:
+        case INSTR_ARRAY_MUL: return 3;
+        case INSTR_ARRAY_GET:
+        case INSTR_ARRAY_FILL:
+        case INSTR_ARRAY_COPY:
+        case INSTR_ARRAY_DOT: return 2;
+        default: return 1;
+    }
+}
+
+static bool verifyFunction(Verifier *v, size_t index) {
+    FunctionInfo *fn = &v->functions[index];
+    if (fn->state == FN_DONE) return true;
+    if (fn->state == FN_IN_PROGRESS) {
+        return fail(v, "recursive call graph has no static stack bound", fn->start);
+    }
+    fn->state = FN_IN_PROGRESS;
+
+    const Program *p = v->program;
+    size_t length = fn->end - fn->start;
+    if (length == 0) return fail(v, "function has no body", fn->start);
+
+    // -2 marks operand words, -1 instruction starts not yet reached
+    long *depths = alloc(length * sizeof(long));
+    for (size_t pc = fn->start; pc < fn->end; ) {
+        size_t operands = operandCount(p->code[pc]);
+        depths[pc - fn->start] = -1;
+
+        for (size_t i = 1; i <= operands && pc + i < fn->end; i++) {
+            depths[pc + i - fn->start] = -2;
+        }
+        pc += 1 + operands;
+    }
+
+    size_t *worklist = alloc(length * sizeof(size_t));
+    size_t pending = 0;
+
+    // execution starts with the frame's argument and local slots in place
+    const Function *entry = &p->functions.entries[index];
+    long locals = (long)entry->localCount;
+    if (entry->arity > entry->localCount) {
+        FREE_ALLOC(depths);
+        FREE_ALLOC(worklist);
+        return fail(v, "function has more arguments than local slots", fn->start);
+    }
+
+    depths[0] = locals;
+    worklist[pending++] = fn->start;
+    fn->maxStack = entry->localCount;
+
+    bool ok = true;
+
+    while (ok && pending > 0) {
+        size_t pc = worklist[--pending];
+        long depth = depths[pc - fn->start];
+        AvmInstruction instr = p->code[pc];
+        size_t next = pc + 1 + operandCount(instr);
+
+        if (next > fn->end) {
+            ok = fail(v, "truncated instruction operand", pc);
+            break;
+        }
+
+        bool fallsThrough = true;
+
+        switch (instr) {
+            case INSTR_PUSH_CONST: {
+                if ((size_t)p->code[pc + 1] >= p->constants.count) {
+                    ok = fail(v, "constant index out of range", pc);
+                    break;
+                }
+                depth++;
+                break;
+            }
+            case INSTR_PUSH_I64: {
+                depth++;
+                break;
+            }
+            case INSTR_EXEC: {
+                break;
+            }
+            case INSTR_PRINT: {
+                if (depth < 1) ok = fail(v, "stack underflow on PRINT", pc);
+                break;
+            }
+            case INSTR_HALT: {
+                fallsThrough = false;
+                break;
+            }
+            case INSTR_RET: {
+                if (depth <= locals) ok = fail(v, "no return value on RET", pc);
+                fallsThrough = false;
+                break;
+            }
+            case INSTR_LOAD_LOCAL: {
+                if ((size_t)p->code[pc + 1] >= entry->localCount) {
+                    ok = fail(v, "local slot out of range", pc);
+                    break;
+                }
+                depth++;
+                break;
+            }
+            case INSTR_STORE_LOCAL: {
+                if ((size_t)p->code[pc + 1] >= entry->localCount) {
+                    ok = fail(v, "local slot out of range", pc);
+                    break;
+                }
+                if (depth <= locals) {
+                    ok = fail(v, "stack underflow on STORE_LOCAL", pc);
+                    break;
+                }
+                depth--;
+                break;
+            }
+            case INSTR_CALL: {
+                size_t callee = (size_t)p->code[pc + 1];
+                if (callee >= p->functions.count) {
+                    ok = fail(v, "function index out of range", pc);
+                    break;
+                }
+                if (!v->shallow && !verifyFunction(v, callee)) {
+                    ok = false;
+                    break;
+                }
+
+                // the callee's frame starts where its arguments were pushed
+                long arity = (long)p->functions.entries[callee].arity;
+                if (depth - locals < arity) {
+                    ok = fail(v, "stack underflow on CALL", pc);
+                    break;
+                }
+                if (v->shallow) {
+                    depth = depth - arity + 1;
+                    break;
+                }
+
+                FunctionInfo *target = &v->functions[callee];
+                long base = depth - arity;
+                if (base + (long)target->maxStack > (long)fn->maxStack) {
+                    fn->maxStack = base + target->maxStack;
+                }
+                if (target->maxCallDepth + 1 > fn->maxCallDepth) {
+                    fn->maxCallDepth = target->maxCallDepth + 1;
+                }
+
+                depth = base + 1;
+                break;
+            }
+            case INSTR_SPAWN: {
+                // the fiber runs on its own stacks, so the target is not followed
+                // here and spawning a function from itself is no recursion
+                size_t target = (size_t)p->code[pc + 1];
+                if (target >= p->functions.count) {
+                    ok = fail(v, "function index out of range", pc);
+                    break;
+                }
+
+                long arity = (long)p->functions.entries[target].arity;
+                if (depth - locals < arity) {
+                    ok = fail(v, "stack underflow on SPAWN", pc);
+                    break;
+                }
+                if (!v->shallow) v->functions[target].spawned = true;
+
+                depth -= arity;
+                break;
+            }
+            case INSTR_CHANNEL:
+            case INSTR_RECV: {
+                if (depth - locals < 1) ok = fail(v, "stack underflow on channel operation", pc);
+                break;
+            }
+            case INSTR_SEND: {
+                if (depth - locals < 2) {
+                    ok = fail(v, "stack underflow on SEND", pc);
+                    break;
+                }
+                depth -= 2;
+                break;
+            }
+            case INSTR_YIELD: {
+                break;
+            }
+            case INSTR_ARRAY_NEW: {
+                if (!isNumericType((ValueType)p->code[pc + 1])) {
+                    ok = fail(v, "array of an unknown element type", pc);
+                    break;
+                }
+                if (depth - locals < 1) ok = fail(v, "stack underflow on array new", pc);
+                break;
+            }
+            case INSTR_ARRAY_GET:
+            case INSTR_ARRAY_SET:
+            case INSTR_ARRAY_LEN:
+            case INSTR_ARRAY_FILL:
+            case INSTR_ARRAY_COPY:
+            case INSTR_ARRAY_ADD:
+            case INSTR_ARRAY_MUL:
+            case INSTR_ARRAY_DOT:
+            case INSTR_ARRAY_SUM:
+            case INSTR_ARRAY_MIN:
+            case INSTR_ARRAY_MAX: {
+                long popped = arrayOperandCount(instr);
+                if (depth - locals < popped) {
+                    ok = fail(v, "stack underflow on array operation", pc);
+                    break;
+                }
+                // everything but SET leaves one value behind
+                depth -= instr == INSTR_ARRAY_SET ? popped : popped - 1;
+                break;
+            }
+            case INSTR_PARALLEL: {
+                // the chunks are fibers, their frames copies of this one's
+                // first slots followed by the iteration index
+                size_t target = (size_t)p->code[pc + 1];
+                if (target >= p->functions.count) {
+                    ok = fail(v, "function index out of range", pc);
+                    break;
+                }
+
+                size_t arity = p->functions.entries[target].arity;
+                if (arity == 0 || arity - 1 > entry->localCount) {
+                    ok = fail(v, "parallel body does not match the frame", pc);
+                    break;
+                }
+
+                long reductions = (int32_t)p->code[pc + 2];
+                long popped = 2 + 2 * reductions;
+                if (reductions < 0 || depth - locals < popped) {
+                    ok = fail(v, "stack underflow on PARALLEL", pc);
+                    break;
+                }
+                if (!v->shallow) v->functions[target].spawned = true;
+
+                depth -= popped;
+                break;
+            }
+            case INSTR_PARALLEL_NEXT: {
+                // the vm resets the frame and starts the body over
+                fallsThrough = false;
+                break;
+            }
+            case INSTR_JMP: {
+                size_t target = next + (int32_t)p->code[pc + 1];
+                ok = mergeDepth(v, depths, worklist, &pending, fn, target, depth, pc);
+                fallsThrough = false;
+                break;
+            }
+            case INSTR_JMP_IF_FALSE: {
+                // the condition's type is only known at run time, where it is always checked
+                if (depth - locals < 1) {
+                    ok = fail(v, "stack underflow on JMP_IF_FALSE", pc);
+                    break;
+                }
+                depth--;
+
+                size_t target = next + (int32_t)p->code[pc + 1];
+                ok = mergeDepth(v, depths, worklist, &pending, fn, target, depth, pc);
+                break;
+            }
+            case INSTR_POP: {
+                if (depth - locals < 1) {
+                    ok = fail(v, "stack underflow on POP", pc);
+                    break;
+                }
+                depth--;
+                break;
+            }
+            default: {
+                if (isBinaryInstruction(instr)) {
+                    if (depth - locals < 2) {
+                        ok = fail(v, "stack underflow on binary operator", pc);
+                        break;
+                    }
+                    depth--;
+                    break;
+                }
+                ok = fail(v, "unknown opcode", pc);
+                break;
+            }
+        }
+
+        if (!ok) break;
+
+        if (depth > (long)fn->maxStack) fn->maxStack = depth;
+
+        if (fallsThrough) {
+            if (next >= fn->end) {
+                ok = fail(v, "control falls off the end of the function", pc);
+                break;
+            }
+            ok = mergeDepth(v, depths, worklist, &pending, fn, next, depth, pc);
+        }
+    }
+
+    FREE_ALLOC(depths);
+    FREE_ALLOC(worklist);
+
+    fn->state = FN_DONE;
+    return ok;
+}
+
+// verifies every function, sizing the stacks for calls into 'entry', or
+// into whichever function needs the most when there is no entry
+static Verification verifyFrom(const Program *program, const char *entry) {
+    Verifier v = {
+        .program = program,
+        .functions = alloc((program->functions.count + 1) * sizeof(FunctionInfo)),
+        .ok = true,
+    };
+
+    computeExtents(&v);
+
+    size_t entryIndex = program->functions.count;
+    for (size_t i = 0; i < program->functions.count; i++) {
+        if (entry && strcmp(program->functions.entries[i].name, entry) == 0) {
+            entryIndex = i;
+        }
+        if (!verifyFunction(&v, i)) break;
+    }
+
+    if (v.ok && entry && entryIndex == program->functions.count) {
+        fail(&v, "no 'main' function", 0);
+    }
+
+    Verification result = {
+        .ok = v.ok,
+        .error = v.error,
+        .errorPc = v.errorPc,
+    };
+
+    // the entry frame is pushed by the VM itself
+    for (size_t i = 0; v.ok && i < program->functions.count; i++) {
+        if (entry && i != entryIndex) continue;
+
+        FunctionInfo *fn = &v.functions[i];
+        if (fn->maxStack > result.maxStack) result.maxStack = fn->maxStack;
+        if (fn->maxCallDepth + 1 > result.maxCallDepth) result.maxCallDepth = fn->maxCallDepth + 1;
+    }
+
+    for (size_t i = 0; v.ok && i < program->functions.count; i++) {
+        FunctionInfo *fn = &v.functions[i];
+        if (!fn->spawned) continue;
+
+        if (fn->maxStack > result.fiberStack) result.fiberStack = fn->maxStack;
+        if (fn->maxCallDepth + 1 > result.fiberCallDepth) result.fiberCallDepth = fn->maxCallDepth + 1;
+    }
+
+    FREE_ALLOC(v.functions);
+    return result;
+}
+
+Verification verifyProgram(const Program *program) {
+    return verifyFrom(program, "main");
+}
+
+Verification verifyAllEntries(const Program *program) {
+    return verifyFrom(program, NULL);
+}
+
+Verification verifyFunctionBody(const Program *program, size_t index, size_t end) {
+    Verifier v = {
+        .program = program,
+        .functions = alloc(program->functions.count * sizeof(FunctionInfo)),
+        .shallow = true,
+        .ok = true,
+    };
+
+    size_t start = program->functions.entries[index].address;
+    v.functions[index] = (FunctionInfo){
+        .start = start,
+        .end = end,
+        .state = FN_UNVISITED,
+    };
+
+    verifyFunction(&v, index);
+
+    Verification result = {
+        .ok = v.ok,
+        .maxStack = v.functions[index].maxStack,
+        .error = v.error,
+        .errorPc = v.errorPc,
+    };
+
+    FREE_ALLOC(v.functions);
+    return result;
+}
+
+void shrinkFiberLimits(AvmConfig *config, const Verification *verification) {
+    // nothing is spawned, so no fiber stacks are ever reserved
+    if (verification->fiberCallDepth == 0) return;
+
+    if (verification->fiberStack < config->fiberStackLimit) config->fiberStackLimit = verification->fiberStack;
+    if (verification->fiberCallDepth < config->fiberCallStackLimit) {
+        config->fiberCallStackLimit = verification->fiberCallDepth;
+    }
+}
+
+void printVerification(const Verification *verification) {
+    printf("=== Verifier Output ===\n");
+    if (verification->ok) {
+        printf("verified: max stack %zu, max call depth %zu\n",
+               verification->maxStack, verification->maxCallDepth);
+        if (verification->fiberCallDepth > 0) {
+            printf("fibers: max stack %zu, max call depth %zu\n",
+                   verification->fiberStack, verification->fiberCallDepth);
+        }
+    } else {
+        printf("not verified: %s (at %zu)\n", verification->error, verification->errorPc);
+    }
+    printf("=== End Verifier Output ===\n");
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+#ifndef verifier_h
+#define verifier_h
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "../assembler/assembler.h"
+#include "vm.h"
+
+typedef struct {
+    bool ok;
+
+    // value slots and frames needed by the deepest call chain from 'main'
+    size_t maxStack;
+    size_t maxCallDepth;
+
+    // the same for the fibers the program spawns, each runs on stacks of its own
+    size_t fiberStack;
+    size_t fiberCallDepth;
+
+    // set when 'ok' is false
+    const char *error;
+    size_t errorPc;
+} Verification;
+
+// abstractly interprets every function in the program, checking operands,
+// jump targets and stack balance. a verified program is safe to run on the
+// unchecked interpreter with stacks sized to 'maxStack' and 'maxCallDepth'
+Verification verifyProgram(const Program *program);
+
+// the same for a program any of whose functions may be called from outside,
+// with limits that cover the most demanding of them
+Verification verifyAllEntries(const Program *program);
+
+// checks one function's operands, jump targets and stack balance without
+// following its calls, used to validate image functions on first call.
+// 'end' is one past the function's last code word
+Verification verifyFunctionBody(const Program *program, size_t index, size_t end);
+
+// lowers the fiber stack limits in 'config' to what the verified fibers need
+void shrinkFiberLimits(AvmConfig *config, const Verification *verification);
+
+void printVerification(const Verification *verification);
+
+#endif
\ No newline at end of file
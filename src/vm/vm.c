@@ -1,38 +1,215 @@
 #include <stdio.h>
+#include <stdarg.h>
 #include <string.h>
+#include <signal.h>
+#include <pthread.h>
 
 #include "vm.h"
+#include "verifier.h"
+#include "scheduler.h"
+#include "heap.h"
+#include "array.h"
+#include "osr.h"
+#include "profile.h"
+#include "../trace/trace.h"
 #include "../util/alloc.h"
+#include "../util/hash.h"
+
+AvmConfig defaultAvmConfig(void) {
+    return (AvmConfig){
+        .stackLimit = AVM_STACK_LIMIT,
+        .callStackLimit = AVM_CALL_STACK_LIMIT,
+        .fiberStackLimit = AVM_FIBER_STACK_LIMIT,
+        .fiberCallStackLimit = AVM_FIBER_CALL_STACK_LIMIT,
+        .workers = 0,
+        .nurserySize = AVM_NURSERY_SIZE,
+        .heapLimit = AVM_HEAP_LIMIT,
+        .osrThreshold = AVM_OSR_THRESHOLD,
+    };
+}
+
+AVM newAVM(Program *program, AvmConfig config) {
+    // the command line refuses larger limits, this guards everything else
+    if (config.stackLimit > AVM_MAX_STACK_LIMIT) config.stackLimit = AVM_MAX_STACK_LIMIT;
+    if (config.callStackLimit > AVM_MAX_STACK_LIMIT) config.callStackLimit = AVM_MAX_STACK_LIMIT;
+
+    Region stackRegion = reserveRegion(config.stackLimit * sizeof(Object));
+    Region callRegion = reserveRegion(config.callStackLimit * sizeof(Frame));
 
-AVM newAVM(Program program) {
     AVM vm = {
         .program = program,
         .pc = 0,
+        .fp = 0,
         .running = true,
         .stack = {
-            .values = alloc(1024 * sizeof(Object)),
-            .top = 0
+            .values = stackRegion.base,
+            .top = 0,
+            .capacity = stackRegion.size / sizeof(Object),
+            .region = stackRegion
         },
         .callStack = {
-            .addresses = alloc(1024 * sizeof(uint16_t)),
-            .top = 0
-        }
+            .frames = callRegion.base,
+            .top = 0,
+            .capacity = callRegion.size / sizeof(Frame),
+            .region = callRegion
+        },
+        .config = config,
+        .worker = NULL,
+        .heap = NULL,
+        .verified = false,
+        .failed = false,
+        .materialize = NULL,
+        .materializeContext = NULL,
+        .output = stdout,
+        .errors = stderr,
+        .backEdges = NULL,
+        .backEdgeCapacity = 0,
+        .osrLoops = NULL,
+        .osrLoopCapacity = 0,
+        .osrCode = NULL,
+        .osrCompiled = 0,
+        .osrEntered = 0
     };
     
     return vm;
 }
 
+void resetAVM(AVM *vm) {
+    if (!vm) return;
+
+    vm->pc = 0;
+    vm->fp = 0;
+    vm->running = true;
+    vm->failed = false;
+    vm->stack.top = 0;
+    vm->callStack.top = 0;
+    resetHeap(vm->heap);
+}
+
+static void freeTranslations(AVM *vm) {
+    while (vm->osrCode) {
+        OsrCode *next = vm->osrCode->next;
+        freeOsrCode(vm->osrCode);
+        vm->osrCode = next;
+    }
+    if (vm->osrLoops) FREE_ALLOC(vm->osrLoops);
+    vm->osrLoopCapacity = 0;
+}
+
 void freeAVM(AVM *vm) {
     if (!vm) return;
+
+    releaseRegion(&vm->stack.region);
+    releaseRegion(&vm->callStack.region);
+    freeHeap(vm->heap);
+    if (vm->backEdges) FREE_ALLOC(vm->backEdges);
+    freeTranslations(vm);
+
+    vm->heap = NULL;
+    vm->stack.values = NULL;
+    vm->callStack.frames = NULL;
+}
+
+// the vm currently executing on this thread, consulted by the fault handler
+static _Thread_local AVM *activeVm = NULL;
+
+// the handler installed before the vm's, which every other fault goes to
+static struct sigaction previousSegfault;
+
+static void onSegfault(int signal, siginfo_t *info, void *context) {
+    AVM *vm = activeVm;
+    if (vm && (inRegionGuard(&vm->stack.region, info->si_addr) ||
+               inRegionGuard(&vm->callStack.region, info->si_addr))) {
+        siglongjmp(vm->overflow, 1);
+    }
+
+    struct sigaction previous = previousSegfault;
+    if (previous.sa_flags & SA_RESETHAND) {
+        struct sigaction reset = { .sa_handler = SIG_DFL };
+        sigaction(SIGSEGV, &reset, NULL);
+    }
+
+    if ((previous.sa_flags & SA_SIGINFO) && previous.sa_sigaction) {
+        previous.sa_sigaction(signal, info, context);
+    } else if (previous.sa_handler != SIG_DFL && previous.sa_handler != SIG_IGN) {
+        previous.sa_handler(signal);
+    } else {
+        // a fault that is ignored would only be raised again, so both take
+        // the process down as usual once the instruction is retried
+        struct sigaction action = { .sa_handler = SIG_DFL };
+        sigaction(SIGSEGV, &action, NULL);
+    }
+}
+
+static void setGuardHandler(void) {
+    struct sigaction action = {
+        .sa_sigaction = onSegfault,
+        .sa_flags = SA_SIGINFO | SA_NODEFER,
+    };
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGSEGV, &action, &previousSegfault);
+}
+
+// vms on any number of threads share the one handler
+static void installGuardHandler(void) {
+    static pthread_once_t installed = PTHREAD_ONCE_INIT;
+    pthread_once(&installed, setGuardHandler);
 }
 
 static void tick(AVM *vm) {
     vm->pc++;
 }
 
-static void avmInternalError(AVM *vm) {
-    fprintf(stderr, "An internal error occurred in the AVM\n");
+const Function *owningFunction(const Program *p, size_t address) {
+    const Function *owner = NULL;
+    for (size_t i = 0; i < p->functions.count; i++) {
+        const Function *function = &p->functions.entries[i];
+        if (function->stub || function->address > address) continue;
+        if (!owner || function->address > owner->address) owner = function;
+    }
+
+    return owner;
+}
+
+// the call stack at the failing instruction with the source line of every
+// frame, nothing when the program was built without a line table
+static void reportTrace(AVM *vm) {
+    const Program *p = vm->program;
+    if (!p || p->lines.count == 0 || vm->callStack.top == 0) return;
+
+    // an overflow may have counted the frame that ran into the guard page
+    size_t pc = vm->pc;
+    size_t frame = vm->callStack.top < vm->callStack.capacity ? vm->callStack.top : vm->callStack.capacity;
+    size_t shown = 0;
+
+    for (; frame > 0 && shown < AVM_TRACE_DEPTH; frame--, shown++) {
+        const Function *owner = pc < p->length ? owningFunction(p, pc) : NULL;
+        char location[256] = "unknown";
+        if (pc < p->length) formatLine(&p->lines, pc, location, sizeof(location));
+
+        fprintf(vm->errors, "  at %s (%s)\n", owner ? owner->name : "?", location);
+        pc = vm->callStack.frames[frame - 1].returnAddress - 1;
+    }
+
+    if (frame > 0) fprintf(vm->errors, "  ... %zu more frames\n", frame);
+}
+
+void avmError(AVM *vm, const char *format, ...) {
+    if (vm->errors) {
+        va_list args;
+        va_start(args, format);
+        vfprintf(vm->errors, format, args);
+        va_end(args);
+
+        if (vm->running) reportTrace(vm);
+    }
+
     vm->running = false;
+    vm->failed = true;
+}
+
+static void avmInternalError(AVM *vm) {
+    avmError(vm, "An internal error occurred in the AVM\n");
 }
 
 // static void avmUnknownError(AVM *vm) {
@@ -41,8 +218,7 @@ static void avmInternalError(AVM *vm) {
 // }
 
 static void avmStackoverflow(AVM *vm) {
-    fprintf(stderr, "A stackoverflow error occurred in the AVM\n");
-    vm->running = false;
+    avmError(vm, "A stackoverflow error occurred in the AVM\n");
 }
 
 // static void avmRuntimeError(AVM *vm) {
@@ -50,85 +226,802 @@ static void avmStackoverflow(AVM *vm) {
 //     vm->running = false;
 // }
 
-static void execPush(AVM *vm) {
-    if (!vm) return;
+// every handler takes 'checked' as a compile-time constant. the checked
+// interpreter guards each access, the unchecked one relies on the verifier
+// having proven the same properties before execution starts
+
+// stack overflow is never compared for here, a push past the limit lands on a
+// guard page and the fault handler unwinds back into 'execute'
+
+static inline void execPush(AVM *vm, bool checked) {
     tick(vm);
 
-    if (vm->stack.top >= 1024) {
-        avmStackoverflow(vm);
+    size_t index = vm->program->code[vm->pc];
+    tick(vm);
+
+    if (checked && index >= vm->program->constants.count) {
+        avmInternalError(vm);
         return;
     }
 
-    uint8_t value = vm->program.code[vm->pc];
+    vm->stack.values[vm->stack.top++] = vm->program->constants.values[index];
+}
+
+static inline void execPushI64(AVM *vm) {
+    tick(vm);
+
+    uint64_t high = (uint32_t)vm->program->code[vm->pc];
+    tick(vm);
+    uint64_t low = (uint32_t)vm->program->code[vm->pc];
+    tick(vm);
+
+    Object value = i64Value(vm, (int64_t)(high << 32 | low));
+    vm->stack.values[vm->stack.top++] = value;
+}
+
+void fprintObject(FILE *out, Object obj) {
+    switch (objectType(obj)) {
+        case OBJ_I32: fprintf(out, "%d", asI32(obj)); break;
+        case OBJ_I64: fprintf(out, "%lld", (long long)asI64(obj)); break;
+        case OBJ_F64: fprintf(out, "%g", asF64(obj)); break;
+        case OBJ_BOOL: fprintf(out, "%s", asBool(obj) ? "true" : "false"); break;
+        default: fprintf(out, "Unknown object type on PRINT"); break;
+    }
+}
+
+void printObject(Object obj) {
+    fprintObject(stdout, obj);
+}
+
+static inline void execPrint(AVM *vm, bool checked) {
     tick(vm);
 
-    Object constant = vm->program.constants.values[value];
+    if (checked && vm->stack.top == 0) {
+        avmError(vm, "Stack underflow on PRINT\n");
+        return;
+    }
+
+    if (!vm->output) return;
+    fprintObject(vm->output, vm->stack.values[vm->stack.top - 1]);
+    fputc('\n', vm->output);
+}
+
+// image functions are checked against their checksum and verified the first
+// time they are entered, so only code that actually runs is ever touched
+static bool matchesChecksum(const Program *program, size_t index, size_t end) {
+    const Function *func = &program->functions.entries[index];
+
+    uint64_t checksum = fnv1a(FNV_OFFSET_BASIS, program->code + func->address,
+                              (end - func->address) * sizeof(AvmInstruction));
+    return checksum == func->checksum;
+}
+
+static bool validateRange(AVM *vm, size_t index, size_t end) {
+    Function *func = &vm->program->functions.entries[index];
+
+    if (!matchesChecksum(vm->program, index, end)) {
+        avmError(vm, "Checksum mismatch in function '%s'\n", func->name);
+        return false;
+    }
+
+    Verification verification = verifyFunctionBody(vm->program, index, end);
+    if (!verification.ok) {
+        avmError(vm, "Invalid function '%s': %s (at %zu)\n", func->name,
+                 verification.error, verification.errorPc);
+        return false;
+    }
+
+    func->validated = true;
+    return true;
+}
 
-    Object obj = {
-        .type = OBJ_I32,
-        .i32 = constant.i32,
+void validateProgram(Program *program) {
+    size_t count = program->functions.count;
+    if (count == 0) return;
+
+    size_t *ends = alloc(count * sizeof(size_t));
+    functionExtents(program, ends);
+
+    for (size_t i = 0; i < count; i++) {
+        Function *func = &program->functions.entries[i];
+        if (func->validated || func->stub) continue;
+
+        if (matchesChecksum(program, i, ends[i]) && verifyFunctionBody(program, i, ends[i]).ok) {
+            func->validated = true;
+        }
+    }
+
+    FREE_ALLOC(ends);
+}
+
+static bool validateFunction(AVM *vm, size_t index) {
+    size_t address = vm->program->functions.entries[index].address;
+    return validateRange(vm, index, functionEnd(vm->program, address));
+}
+
+// lazily compiled functions start out as stubs, their code is appended to
+// the program when they are first called and validated like image code.
+// being the last code in the program, its end needs no search
+static bool materializeFunction(AVM *vm, size_t index) {
+    if (vm->materialize && vm->materialize(vm->materializeContext, vm->program, index)) {
+        return validateRange(vm, index, vm->program->length);
+    }
+
+    avmError(vm, "Could not compile function '%s'\n", vm->program->functions.entries[index].name);
+    return false;
+}
+
+// pushes a frame for 'func' whose arguments are already on the stack and
+// zeroes the remaining local slots
+static inline void enterFrame(AVM *vm, Function *func, size_t returnAddress) {
+    vm->callStack.frames[vm->callStack.top++] = (Frame){
+        .returnAddress = returnAddress,
+        .fp = vm->fp,
     };
 
-    vm->stack.values[vm->stack.top++] = obj;
+    vm->fp = vm->stack.top - func->arity;
+    for (size_t i = func->arity; i < func->localCount; i++) {
+        vm->stack.values[vm->stack.top++] = i32Object(0);
+    }
+
+    vm->pc = func->address;
+    TRACE_CALL(func->name);
 }
 
-static void execPrint(AVM *vm) {
-    if (!vm) return;
+static inline void execCall(AVM *vm, bool checked) {
     tick(vm);
 
-    if (vm->stack.top == 0) {
-        fprintf(stderr, "Stack underflow on PRINT\n");
-        vm->running = false;
+    size_t funcIndex = vm->program->code[vm->pc];
+    tick(vm);
+
+    if (checked && funcIndex >= vm->program->functions.count) {
+        avmInternalError(vm);
         return;
     }
 
-    Object obj = vm->stack.values[vm->stack.top - 1];
-    if (obj.type == OBJ_I32) {
-        printf("%d\n", obj.i32);
-    } else {
-        printf("Unknown object type on PRINT\n");
+    Function *func = &vm->program->functions.entries[funcIndex];
+    if (checked && func->stub && !materializeFunction(vm, funcIndex)) return;
+    if (checked && !func->validated && !validateFunction(vm, funcIndex)) return;
+
+    if (checked && vm->stack.top - vm->fp < func->arity) {
+        avmError(vm, "Stack underflow on CALL to '%s'\n", func->name);
+        return;
     }
+
+    enterFrame(vm, func, vm->pc);
 }
 
-static void execCall(AVM *vm) {
-    if (!vm) return;
+// the return value replaces the callee's whole frame on the stack
+static inline void execRet(AVM *vm, bool checked) {
+    tick(vm);
+
+    if (checked && (vm->callStack.top == 0 || vm->stack.top <= vm->fp)) {
+        avmError(vm, "Call stack underflow on RET\n");
+        return;
+    }
+
+    Object result = vm->stack.values[vm->stack.top - 1];
+    vm->stack.top = vm->fp;
+    vm->stack.values[vm->stack.top++] = result;
+
+    Frame frame = vm->callStack.frames[--vm->callStack.top];
+    vm->pc = frame.returnAddress;
+    vm->fp = frame.fp;
+    TRACE_RETURN();
+
+    // returning from the entry frame ends execution
+    if (vm->callStack.top == 0) vm->running = false;
+}
+
+static inline void execLoadLocal(AVM *vm, bool checked) {
     tick(vm);
 
-    uint8_t funcIndex = vm->program.code[vm->pc];
+    size_t slot = vm->program->code[vm->pc];
     tick(vm);
 
-    Function func = vm->program.functions.entries[funcIndex];
+    if (checked && vm->fp + slot >= vm->stack.top) {
+        avmInternalError(vm);
+        return;
+    }
+
+    vm->stack.values[vm->stack.top] = vm->stack.values[vm->fp + slot];
+    vm->stack.top++;
+}
 
-    if (vm->callStack.top >= 1024) {
-        avmStackoverflow(vm);
+static inline void execStoreLocal(AVM *vm, bool checked) {
+    tick(vm);
+
+    size_t slot = vm->program->code[vm->pc];
+    tick(vm);
+
+    if (checked && vm->fp + slot + 1 >= vm->stack.top) {
+        avmInternalError(vm);
         return;
     }
 
-    vm->callStack.addresses[vm->callStack.top++] = vm->pc;
-    vm->pc = func.address;
+    vm->stack.values[vm->fp + slot] = vm->stack.values[--vm->stack.top];
 }
 
-static void execRet(AVM *vm) {
-    if (!vm) return;
+// kept out of line so the counting in execJmp stays a compare and an increment
+static __attribute__((noinline, cold)) void growBackEdges(AVM *vm, size_t needed) {
+    size_t capacity = vm->program->length > needed ? vm->program->length : needed;
+    vm->backEdges = realloc(vm->backEdges, capacity * sizeof(uint64_t));
+    assertAlloc(vm->backEdges);
+
+    memset(vm->backEdges + vm->backEdgeCapacity, 0, (capacity - vm->backEdgeCapacity) * sizeof(uint64_t));
+    vm->backEdgeCapacity = capacity;
+}
+
+static inline void countBackEdge(AVM *vm, size_t address) {
+    if (address >= vm->backEdgeCapacity) growBackEdges(vm, address + 1);
+    vm->backEdges[address]++;
+}
+
+// translates the function on its first hot loop, every backward jump in it
+// then enters the same translation
+static OsrCode *translateLoop(AVM *vm, size_t address) {
+    const Program *p = vm->program;
+    const Function *owner = owningFunction(p, address);
+    if (!owner) return NULL;
+
+    size_t start = owner->address;
+    size_t end = functionEnd(p, start);
+    if (vm->backEdgeCapacity < end) growBackEdges(vm, end);
+
+    if (vm->osrLoopCapacity < end) {
+        size_t capacity = p->length > end ? p->length : end;
+        vm->osrLoops = realloc(vm->osrLoops, capacity * sizeof(OsrCode *));
+        assertAlloc(vm->osrLoops);
+        memset(vm->osrLoops + vm->osrLoopCapacity, 0, (capacity - vm->osrLoopCapacity) * sizeof(OsrCode *));
+        vm->osrLoopCapacity = capacity;
+    }
+
+    OsrCode *code = compileOsr(p, start, end);
+    code->next = vm->osrCode;
+    vm->osrCode = code;
+    vm->osrCompiled++;
+
+    for (size_t i = 0; i < code->opCount; i++) {
+        if (code->ops[i].backEdge) vm->osrLoops[code->ops[i].pc] = code;
+    }
+
+    return code;
+}
+
+// on-stack replacement: the loop's frame is already the one the tier runs
+// on, so moving into it only needs the pc of the loop's first instruction
+static __attribute__((noinline)) void enterOsr(AVM *vm, size_t address) {
+    OsrCode *code = address < vm->osrLoopCapacity ? vm->osrLoops[address] : NULL;
+    if (!code) code = translateLoop(vm, address);
+    if (!code) return;
+
+    vm->osrEntered++;
+    runOsr(vm, code, vm->pc);
+}
+
+static inline void execJmp(AVM *vm, bool checked) {
+    size_t address = vm->pc;
+    tick(vm);
+
+    int32_t offset = (int32_t)vm->program->code[vm->pc];
+    tick(vm);
+
+    size_t target = vm->pc + offset;
+    if (checked && target >= vm->program->length) {
+        avmInternalError(vm);
+        return;
+    }
+
+    vm->pc = target;
+    if (offset < 0) {
+        countBackEdge(vm, address);
+        if (!checked && vm->backEdges[address] >= vm->config.osrThreshold) enterOsr(vm, address);
+    }
+}
+
+static inline void execJmpIfFalse(AVM *vm, bool checked) {
+    tick(vm);
+
+    int32_t offset = (int32_t)vm->program->code[vm->pc];
+    tick(vm);
+
+    if (checked && vm->stack.top == 0) {
+        avmError(vm, "Stack underflow on JMP_IF_FALSE\n");
+        return;
+    }
+
+    Object condition = vm->stack.values[--vm->stack.top];
+    if (!isBool(condition)) {
+        avmError(vm, "Condition is not a bool\n");
+        return;
+    }
+    if (asBool(condition)) return;
+
+    size_t target = vm->pc + offset;
+    if (checked && target >= vm->program->length) {
+        avmInternalError(vm);
+        return;
+    }
+
+    vm->pc = target;
+}
+
+static inline void execPop(AVM *vm, bool checked) {
+    tick(vm);
+
+    if (checked && vm->stack.top == 0) {
+        avmError(vm, "Stack underflow on POP\n");
+        return;
+    }
+
+    vm->stack.top--;
+}
+
+static void avmDivisionByZero(AVM *vm) {
+    avmError(vm, "Division by zero in the AVM\n");
+}
+
+// pops the right operand and leaves 'left' pointing at the slot the result goes in
+static inline bool binaryOperands(AVM *vm, bool checked, Object **left, Object *right) {
+    tick(vm);
+
+    if (checked && vm->stack.top < 2) {
+        avmError(vm, "Stack underflow on binary operator\n");
+        return false;
+    }
+
+    *right = vm->stack.values[--vm->stack.top];
+    *left = &vm->stack.values[vm->stack.top - 1];
+    return true;
+}
+
+// integer arithmetic wraps on overflow rather than being undefined
+static inline void execBinaryI32(AVM *vm, BinaryOp op, bool checked) {
+    Object *left, right;
+    if (!binaryOperands(vm, checked, &left, &right)) return;
+
+    int32_t a = asI32(*left), b = asI32(right);
+    switch (op) {
+        case BIN_ADD: *left = i32Object((int32_t)((uint32_t)a + (uint32_t)b)); break;
+        case BIN_SUB: *left = i32Object((int32_t)((uint32_t)a - (uint32_t)b)); break;
+        case BIN_MUL: *left = i32Object((int32_t)((uint32_t)a * (uint32_t)b)); break;
+        case BIN_DIV: {
+            if (b == 0) {
+                avmDivisionByZero(vm);
+                return;
+            }
+            *left = i32Object(b == -1 ? (int32_t)(0u - (uint32_t)a) : a / b);
+            break;
+        }
+        case BIN_LT: *left = boolObject(a < b); break;
+        case BIN_LE: *left = boolObject(a <= b); break;
+        case BIN_GT: *left = boolObject(a > b); break;
+        case BIN_GE: *left = boolObject(a >= b); break;
+        case BIN_EQ: *left = boolObject(a == b); break;
+        case BIN_NE: *left = boolObject(a != b); break;
+        default: break;
+    }
+}
+
+static inline void execBinaryI64(AVM *vm, BinaryOp op, bool checked) {
+    Object *left, right;
+    if (!binaryOperands(vm, checked, &left, &right)) return;
+
+    int64_t a = asI64(*left), b = asI64(right);
+    switch (op) {
+        case BIN_ADD: *left = i64Value(vm, (int64_t)((uint64_t)a + (uint64_t)b)); break;
+        case BIN_SUB: *left = i64Value(vm, (int64_t)((uint64_t)a - (uint64_t)b)); break;
+        case BIN_MUL: *left = i64Value(vm, (int64_t)((uint64_t)a * (uint64_t)b)); break;
+        case BIN_DIV: {
+            if (b == 0) {
+                avmDivisionByZero(vm);
+                return;
+            }
+            *left = i64Value(vm, b == -1 ? (int64_t)(0u - (uint64_t)a) : a / b);
+            break;
+        }
+        case BIN_LT: *left = boolObject(a < b); break;
+        case BIN_LE: *left = boolObject(a <= b); break;
+        case BIN_GT: *left = boolObject(a > b); break;
+        case BIN_GE: *left = boolObject(a >= b); break;
+        case BIN_EQ: *left = boolObject(a == b); break;
+        case BIN_NE: *left = boolObject(a != b); break;
+        default: break;
+    }
+}
+
+static inline void execBinaryF64(AVM *vm, BinaryOp op, bool checked) {
+    Object *left, right;
+    if (!binaryOperands(vm, checked, &left, &right)) return;
+
+    double a = asF64(*left), b = asF64(right);
+    switch (op) {
+        case BIN_ADD: *left = f64Object(a + b); break;
+        case BIN_SUB: *left = f64Object(a - b); break;
+        case BIN_MUL: *left = f64Object(a * b); break;
+        case BIN_DIV: *left = f64Object(a / b); break;
+        case BIN_LT: *left = boolObject(a < b); break;
+        case BIN_LE: *left = boolObject(a <= b); break;
+        case BIN_GT: *left = boolObject(a > b); break;
+        case BIN_GE: *left = boolObject(a >= b); break;
+        case BIN_EQ: *left = boolObject(a == b); break;
+        case BIN_NE: *left = boolObject(a != b); break;
+        default: break;
+    }
+}
+
+static inline void execBinaryBool(AVM *vm, BinaryOp op, bool checked) {
+    Object *left, right;
+    if (!binaryOperands(vm, checked, &left, &right)) return;
+
+    bool equal = asBool(*left) == asBool(right);
+    *left = boolObject(op == BIN_EQ ? equal : !equal);
+}
+
+// the generic path reads the tags and reuses the typed handlers, the right
+// operand is still on the stack when they pop it again
+static void execBinaryGeneric(AVM *vm, BinaryOp op, bool checked) {
+    if (checked && vm->stack.top < 2) {
+        tick(vm);
+        avmError(vm, "Stack underflow on binary operator\n");
+        return;
+    }
+
+    ObjectType left = objectType(vm->stack.values[vm->stack.top - 2]);
+    ObjectType right = objectType(vm->stack.values[vm->stack.top - 1]);
+
+    if (left != right) {
+        tick(vm);
+        avmError(vm, "Mismatched operand types on %s\n", binaryOpName(op));
+        return;
+    }
+
+    switch (left) {
+        case OBJ_I32: execBinaryI32(vm, op, checked); break;
+        case OBJ_I64: execBinaryI64(vm, op, checked); break;
+        case OBJ_F64: execBinaryF64(vm, op, checked); break;
+        case OBJ_BOOL: {
+            if (op == BIN_EQ || op == BIN_NE) {
+                execBinaryBool(vm, op, checked);
+                break;
+            }
+            tick(vm);
+            avmError(vm, "Operator %s does not apply to bool\n", binaryOpName(op));
+            break;
+        }
+        default: {
+            tick(vm);
+            avmError(vm, "Operator %s does not apply to this value\n", binaryOpName(op));
+            break;
+        }
+    }
+}
+
+static inline void execSpawn(AVM *vm, bool checked) {
+    tick(vm);
+
+    size_t funcIndex = vm->program->code[vm->pc];
     tick(vm);
 
-    if (vm->callStack.top == 0) {
-        fprintf(stderr, "Call stack underflow on RET\n");
-        vm->running = false;
+    if (checked && funcIndex >= vm->program->functions.count) {
+        avmInternalError(vm);
         return;
     }
 
-    vm->pc = vm->callStack.addresses[--vm->callStack.top];
+    Function *func = &vm->program->functions.entries[funcIndex];
+    if (checked && func->stub && !materializeFunction(vm, funcIndex)) return;
+    if (checked && !func->validated && !validateFunction(vm, funcIndex)) return;
+
+    if (checked && vm->stack.top - vm->fp < func->arity) {
+        avmError(vm, "Stack underflow on SPAWN of '%s'\n", func->name);
+        return;
+    }
+
+    spawnFiber(vm, func);
+}
+
+static inline void execChannel(AVM *vm, bool checked) {
+    tick(vm);
+
+    if (checked && vm->stack.top == 0) {
+        avmError(vm, "Stack underflow on CHANNEL\n");
+        return;
+    }
+
+    Object *capacity = &vm->stack.values[vm->stack.top - 1];
+    if (objectType(*capacity) != OBJ_I32 || asI32(*capacity) < 1) {
+        avmError(vm, "A channel's capacity must be at least 1\n");
+        return;
+    }
+
+    Channel *channel = newChannel(vm, (size_t)asI32(*capacity));
+    if (channel) *capacity = ptrObject(channel);
+}
+
+// the tag is checked even when verified, the verifier knows nothing of types
+static inline Channel *channelOperand(AVM *vm, Object obj, const char *instr) {
+    if (!isPtr(obj) || ((HeapObject *)asPtr(obj))->kind != HEAP_CHANNEL) {
+        avmError(vm, "%s on a value that is not a channel\n", instr);
+        return NULL;
+    }
+
+    return asPtr(obj);
+}
+
+// a blocked SEND or RECV leaves the pc on itself, so the fiber runs it again once woken
+static inline void execSend(AVM *vm, bool checked) {
+    size_t start = vm->pc;
+    tick(vm);
+
+    if (checked && vm->stack.top < 2) {
+        avmError(vm, "Stack underflow on SEND\n");
+        return;
+    }
+
+    Channel *channel = channelOperand(vm, vm->stack.values[vm->stack.top - 2], "SEND");
+    if (!channel) return;
+
+    if (!channelSend(vm, channel, vm->stack.values[vm->stack.top - 1])) {
+        vm->pc = start;
+        return;
+    }
+
+    vm->stack.top -= 2;
+}
+
+static inline void execRecv(AVM *vm, bool checked) {
+    size_t start = vm->pc;
+    tick(vm);
+
+    if (checked && vm->stack.top == 0) {
+        avmError(vm, "Stack underflow on RECV\n");
+        return;
+    }
+
+    Object *top = &vm->stack.values[vm->stack.top - 1];
+    Channel *channel = channelOperand(vm, *top, "RECV");
+    if (!channel) return;
+
+    if (!channelRecv(vm, channel, top)) vm->pc = start;
+}
+
+// the range and every reduction's slot and operator are checked even when
+// verified, they are values on the stack rather than operands
+static bool parallelOperands(AVM *vm, const Function *func, const Object *operands, size_t reductionCount) {
+    if (objectType(operands[0]) != OBJ_I32 || objectType(operands[1]) != OBJ_I32) {
+        avmError(vm, "A parallel for's range must be i32\n");
+        return false;
+    }
+
+    for (size_t r = 0; r < reductionCount; r++) {
+        Object slot = operands[2 + 2 * r], op = operands[3 + 2 * r];
+        bool valid = objectType(slot) == OBJ_I32 && asI32(slot) >= 0 && (size_t)asI32(slot) < func->arity - 1
+            && objectType(op) == OBJ_I32 && asI32(op) >= REDUCE_ADD && asI32(op) <= REDUCE_MAX;
+        if (!valid) {
+            avmError(vm, "Invalid reduction in a parallel for\n");
+            return false;
+        }
+
+        ObjectType type = objectType(vm->stack.values[vm->fp + asI32(slot)]);
+        if (type != OBJ_I32 && type != OBJ_I64 && type != OBJ_F64) {
+            avmError(vm, "A parallel for can only reduce numbers\n");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// like SEND and RECV the pc is left on the instruction while the chunks run,
+// running it again then combines their results
+static inline void execParallel(AVM *vm, bool checked) {
+    size_t start = vm->pc;
+    tick(vm);
+
+    size_t funcIndex = vm->program->code[vm->pc];
+    tick(vm);
+    size_t reductionCount = vm->program->code[vm->pc];
+    tick(vm);
+
+    if (checked && funcIndex >= vm->program->functions.count) {
+        avmInternalError(vm);
+        return;
+    }
+
+    Function *func = &vm->program->functions.entries[funcIndex];
+    if (checked && func->stub && !materializeFunction(vm, funcIndex)) return;
+    if (checked && !func->validated && !validateFunction(vm, funcIndex)) return;
+
+    size_t popped = 2 + 2 * reductionCount;
+    if (checked && (func->arity == 0 || vm->stack.top < popped || vm->stack.top - popped < vm->fp + func->arity - 1)) {
+        avmError(vm, "Stack underflow on PARALLEL of '%s'\n", func->name);
+        return;
+    }
+
+    const Object *operands = &vm->stack.values[vm->stack.top - popped];
+    if (!parallelOperands(vm, func, operands, reductionCount)) return;
+
+    if (!runParallel(vm, func, operands, reductionCount)) {
+        if (!vm->failed) vm->pc = start;
+        return;
+    }
+
+    vm->stack.top -= popped;
+}
+
+static inline void execArrayNew(AVM *vm, bool checked) {
+    tick(vm);
+
+    ValueType elementType = (ValueType)vm->program->code[vm->pc];
+    tick(vm);
+
+    if (checked && !isNumericType(elementType)) {
+        avmInternalError(vm);
+        return;
+    }
+    if (checked && vm->stack.top == 0) {
+        avmError(vm, "Stack underflow on ARRAY NEW\n");
+        return;
+    }
+
+    Object *length = &vm->stack.values[vm->stack.top - 1];
+    if (!isI32(*length) || asI32(*length) < 0) {
+        avmError(vm, "An array's length must be at least 0\n");
+        return;
+    }
+
+    Array *array = newArray(vm, elementType, (size_t)asI32(*length));
+    if (array) *length = ptrObject(array);
+}
+
+// the array operations pop 'count' operands, the tags are checked even when
+// verified since the verifier knows nothing of types. NULL on an error
+static inline Object *arrayOperands(AVM *vm, bool checked, AvmInstruction instr, size_t count) {
+    tick(vm);
+
+    if (checked && vm->stack.top < count) {
+        avmError(vm, "Stack underflow on array %s\n", arrayOpName(instr));
+        return NULL;
+    }
+
+    return &vm->stack.values[vm->stack.top - count];
+}
+
+static inline Array *arrayOperand(AVM *vm, Object obj, AvmInstruction instr) {
+    if (!isPtr(obj) || ((HeapObject *)asPtr(obj))->kind != HEAP_ARRAY) {
+        avmError(vm, "Array %s on a value that is not an array\n", arrayOpName(instr));
+        return NULL;
+    }
+
+    return asPtr(obj);
+}
+
+static inline bool inBounds(AVM *vm, const Array *array, Object index) {
+    if (!isI32(index) || asI32(index) < 0 || (size_t)asI32(index) >= array->length) {
+        avmError(vm, "Index out of bounds for an array of length %zu\n", array->length);
+        return false;
+    }
+
+    return true;
+}
+
+static inline void execArrayGet(AVM *vm, bool checked) {
+    Object *operands = arrayOperands(vm, checked, INSTR_ARRAY_GET, 2);
+    if (!operands) return;
+
+    Array *array = arrayOperand(vm, operands[0], INSTR_ARRAY_GET);
+    if (!array || !inBounds(vm, array, operands[1])) return;
+
+    operands[0] = arrayGet(vm, array, (size_t)asI32(operands[1]));
+    vm->stack.top--;
+}
+
+static inline void execArraySet(AVM *vm, bool checked) {
+    Object *operands = arrayOperands(vm, checked, INSTR_ARRAY_SET, 3);
+    if (!operands) return;
+
+    Array *array = arrayOperand(vm, operands[0], INSTR_ARRAY_SET);
+    if (!array || !inBounds(vm, array, operands[1])) return;
+
+    if (!arraySet(array, (size_t)asI32(operands[1]), operands[2])) {
+        avmError(vm, "Array set of a value that is not %s\n", typeName(array->elementType));
+        return;
+    }
+
+    vm->stack.top -= 3;
+}
+
+static inline void execArrayLen(AVM *vm, bool checked) {
+    Object *operands = arrayOperands(vm, checked, INSTR_ARRAY_LEN, 1);
+    if (!operands) return;
+
+    Array *array = arrayOperand(vm, operands[0], INSTR_ARRAY_LEN);
+    if (array) operands[0] = i32Object((int32_t)array->length);
+}
+
+static inline void execArrayFill(AVM *vm, bool checked) {
+    Object *operands = arrayOperands(vm, checked, INSTR_ARRAY_FILL, 2);
+    if (!operands) return;
+
+    Array *array = arrayOperand(vm, operands[0], INSTR_ARRAY_FILL);
+    if (!array) return;
+
+    if (!arrayFill(array, operands[1])) {
+        avmError(vm, "Array fill with a value that is not %s\n", typeName(array->elementType));
+        return;
+    }
+
+    vm->stack.top--;
+}
+
+// the arrays an operation combines, all of one element type and length
+static bool matchingArrays(AVM *vm, Object *operands, size_t count, AvmInstruction instr, Array **arrays) {
+    for (size_t i = 0; i < count; i++) {
+        arrays[i] = arrayOperand(vm, operands[i], instr);
+        if (!arrays[i]) return false;
+
+        if (arrays[i]->elementType != arrays[0]->elementType) {
+            avmError(vm, "Array %s of %s and %s arrays\n", arrayOpName(instr),
+                     typeName(arrays[0]->elementType), typeName(arrays[i]->elementType));
+            return false;
+        }
+        if (arrays[i]->length != arrays[0]->length) {
+            avmError(vm, "Array %s of arrays of lengths %zu and %zu\n", arrayOpName(instr),
+                     arrays[0]->length, arrays[i]->length);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// copy, add and mul write into their first operand and leave it on the stack,
+// dot reduces its two operands to one value
+static inline void execArrayCombine(AVM *vm, AvmInstruction instr, bool checked) {
+    size_t count = instr == INSTR_ARRAY_ADD || instr == INSTR_ARRAY_MUL ? 3 : 2;
+    Object *operands = arrayOperands(vm, checked, instr, count);
+    if (!operands) return;
+
+    Array *arrays[3];
+    if (!matchingArrays(vm, operands, count, instr, arrays)) return;
+
+    switch (instr) {
+        case INSTR_ARRAY_COPY: arrayCopy(arrays[0], arrays[1]); break;
+        case INSTR_ARRAY_ADD: arrayAdd(arrays[0], arrays[1], arrays[2]); break;
+        case INSTR_ARRAY_MUL: arrayMul(arrays[0], arrays[1], arrays[2]); break;
+        default: operands[0] = arrayDot(vm, arrays[0], arrays[1]); break;
+    }
+
+    vm->stack.top -= count - 1;
+}
+
+static inline void execArrayReduce(AVM *vm, AvmInstruction instr, bool checked) {
+    Object *operands = arrayOperands(vm, checked, instr, 1);
+    if (!operands) return;
+
+    Array *array = arrayOperand(vm, operands[0], instr);
+    if (!array) return;
+
+    if (instr != INSTR_ARRAY_SUM && array->length == 0) {
+        avmError(vm, "Array %s of an empty array\n", arrayOpName(instr));
+        return;
+    }
+
+    switch (instr) {
+        case INSTR_ARRAY_SUM: operands[0] = arraySum(vm, array); break;
+        case INSTR_ARRAY_MIN: operands[0] = arrayMin(vm, array); break;
+        default: operands[0] = arrayMax(vm, array); break;
+    }
 }
 
-static void execInstr(AVM *vm, AvmInstruction instr) {
+static inline __attribute__((always_inline)) void execInstr(AVM *vm, AvmInstruction instr, bool checked) {
     switch (instr) {
-        case INSTR_PUSH_I32: {
-            execPush(vm);
+        case INSTR_PUSH_CONST: {
+            execPush(vm, checked);
             break;
         }
         case INSTR_RET: {
-            execRet(vm);
+            execRet(vm, checked);
             break;
         }
         case INSTR_EXEC: {
@@ -138,15 +1031,103 @@ static void execInstr(AVM *vm, AvmInstruction instr) {
         case INSTR_HALT: {
             vm->running = false;
             tick(vm);
-            printf("Program halted.\n");
+            if (vm->output) fprintf(vm->output, "Program halted.\n");
             break;
         }
         case INSTR_PRINT: {
-            execPrint(vm);
+            execPrint(vm, checked);
             break;
         }
         case INSTR_CALL: {
-            execCall(vm);
+            execCall(vm, checked);
+            break;
+        }
+        case INSTR_JMP: {
+            execJmp(vm, checked);
+            break;
+        }
+        case INSTR_LOAD_LOCAL: {
+            execLoadLocal(vm, checked);
+            break;
+        }
+        case INSTR_STORE_LOCAL: {
+            execStoreLocal(vm, checked);
+            break;
+        }
+        case INSTR_SPAWN: {
+            execSpawn(vm, checked);
+            break;
+        }
+        case INSTR_CHANNEL: {
+            execChannel(vm, checked);
+            break;
+        }
+        case INSTR_SEND: {
+            execSend(vm, checked);
+            break;
+        }
+        case INSTR_RECV: {
+            execRecv(vm, checked);
+            break;
+        }
+        case INSTR_YIELD: {
+            tick(vm);
+            yieldFiber(vm);
+            break;
+        }
+        case INSTR_ARRAY_NEW: execArrayNew(vm, checked); break;
+        case INSTR_ARRAY_GET: execArrayGet(vm, checked); break;
+        case INSTR_ARRAY_SET: execArraySet(vm, checked); break;
+        case INSTR_ARRAY_LEN: execArrayLen(vm, checked); break;
+        case INSTR_ARRAY_FILL: execArrayFill(vm, checked); break;
+        case INSTR_ARRAY_COPY:
+        case INSTR_ARRAY_ADD:
+        case INSTR_ARRAY_MUL:
+        case INSTR_ARRAY_DOT: execArrayCombine(vm, instr, checked); break;
+        case INSTR_ARRAY_SUM:
+        case INSTR_ARRAY_MIN:
+        case INSTR_ARRAY_MAX: execArrayReduce(vm, instr, checked); break;
+        case INSTR_PARALLEL: execParallel(vm, checked); break;
+        case INSTR_PARALLEL_NEXT: tick(vm); nextIteration(vm); break;
+        case INSTR_JMP_IF_FALSE: execJmpIfFalse(vm, checked); break;
+        case INSTR_POP: execPop(vm, checked); break;
+        case INSTR_PUSH_I64: execPushI64(vm); break;
+        case INSTR_ADD_I32: execBinaryI32(vm, BIN_ADD, checked); break;
+        case INSTR_SUB_I32: execBinaryI32(vm, BIN_SUB, checked); break;
+        case INSTR_MUL_I32: execBinaryI32(vm, BIN_MUL, checked); break;
+        case INSTR_DIV_I32: execBinaryI32(vm, BIN_DIV, checked); break;
+        case INSTR_LT_I32: execBinaryI32(vm, BIN_LT, checked); break;
+        case INSTR_LE_I32: execBinaryI32(vm, BIN_LE, checked); break;
+        case INSTR_GT_I32: execBinaryI32(vm, BIN_GT, checked); break;
+        case INSTR_GE_I32: execBinaryI32(vm, BIN_GE, checked); break;
+        case INSTR_EQ_I32: execBinaryI32(vm, BIN_EQ, checked); break;
+        case INSTR_NE_I32: execBinaryI32(vm, BIN_NE, checked); break;
+        case INSTR_ADD_I64: execBinaryI64(vm, BIN_ADD, checked); break;
+        case INSTR_SUB_I64: execBinaryI64(vm, BIN_SUB, checked); break;
+        case INSTR_MUL_I64: execBinaryI64(vm, BIN_MUL, checked); break;
+        case INSTR_DIV_I64: execBinaryI64(vm, BIN_DIV, checked); break;
+        case INSTR_LT_I64: execBinaryI64(vm, BIN_LT, checked); break;
+        case INSTR_LE_I64: execBinaryI64(vm, BIN_LE, checked); break;
+        case INSTR_GT_I64: execBinaryI64(vm, BIN_GT, checked); break;
+        case INSTR_GE_I64: execBinaryI64(vm, BIN_GE, checked); break;
+        case INSTR_EQ_I64: execBinaryI64(vm, BIN_EQ, checked); break;
+        case INSTR_NE_I64: execBinaryI64(vm, BIN_NE, checked); break;
+        case INSTR_ADD_F64: execBinaryF64(vm, BIN_ADD, checked); break;
+        case INSTR_SUB_F64: execBinaryF64(vm, BIN_SUB, checked); break;
+        case INSTR_MUL_F64: execBinaryF64(vm, BIN_MUL, checked); break;
+        case INSTR_DIV_F64: execBinaryF64(vm, BIN_DIV, checked); break;
+        case INSTR_LT_F64: execBinaryF64(vm, BIN_LT, checked); break;
+        case INSTR_LE_F64: execBinaryF64(vm, BIN_LE, checked); break;
+        case INSTR_GT_F64: execBinaryF64(vm, BIN_GT, checked); break;
+        case INSTR_GE_F64: execBinaryF64(vm, BIN_GE, checked); break;
+        case INSTR_EQ_F64: execBinaryF64(vm, BIN_EQ, checked); break;
+        case INSTR_NE_F64: execBinaryF64(vm, BIN_NE, checked); break;
+        case INSTR_EQ_BOOL: execBinaryBool(vm, BIN_EQ, checked); break;
+        case INSTR_NE_BOOL: execBinaryBool(vm, BIN_NE, checked); break;
+        case INSTR_ADD: case INSTR_SUB: case INSTR_MUL: case INSTR_DIV:
+        case INSTR_LT: case INSTR_LE: case INSTR_GT: case INSTR_GE:
+        case INSTR_EQ: case INSTR_NE: {
+            execBinaryGeneric(vm, (BinaryOp)(instr - INSTR_ADD), checked);
             break;
         }
         default: {
@@ -155,24 +1136,188 @@ static void execInstr(AVM *vm, AvmInstruction instr) {
     }
 }
 
+static void runChecked(AVM *vm) {
+    while (vm->running && vm->pc < vm->program->length) {
+        execInstr(vm, vm->program->code[vm->pc], true);
+    }
+}
+
+static void runUnchecked(AVM *vm) {
+    while (vm->running) {
+        execInstr(vm, vm->program->code[vm->pc], false);
+    }
+}
+
+// counts every instruction and times one in every few. OSR is turned off
+// while profiling, so every instruction passes through here
+static inline __attribute__((always_inline)) void runProfiled(AVM *vm, bool checked) {
+    Profile *profile = vm->profile;
+
+    while (vm->running && (!checked || vm->pc < vm->program->length)) {
+        AvmInstruction instr = vm->program->code[vm->pc];
+        if (checked && instr >= INSTR_COUNT) {
+            execInstr(vm, instr, true);
+            continue;
+        }
+
+        size_t pc = vm->pc;
+        profile->counts[instr]++;
+        if (profile->executed) profile->executed[pc]++;
+
+        if ((++profile->tick & PROFILE_TIMED_MASK) != 0) {
+            execInstr(vm, instr, checked);
+        } else {
+            CounterValues before;
+            if (profile->counters) readMappedCounters(profile->counters, &before);
+
+            uint64_t start = readCycles();
+            execInstr(vm, instr, checked);
+            profile->cycles[instr] += readCycles() - start;
+            profile->timed[instr]++;
+
+            if (profile->counters) countOpcode(profile, instr, &before);
+        }
+
+        if (instr == INSTR_JMP_IF_FALSE && profile->jumped && vm->pc != pc + 2) profile->jumped[pc]++;
+    }
+}
+
+void stepInstruction(AVM *vm) {
+    execInstr(vm, vm->program->code[vm->pc], false);
+}
+
+AVM *currentVm(void) {
+    return activeVm;
+}
+
+// 'entry', when not NULL, has its frame entered first, which may itself run into a guard page
+static void runFrom(AVM *vm, Function *entry) {
+    installGuardHandler();
+    AVM *previous = activeVm;
+    activeVm = vm;
+
+    // the handler neither blocks SIGSEGV nor masks anything else, so there is
+    // no signal mask to save, which keeps a call free of system calls
+    if (sigsetjmp(vm->overflow, 0) != 0) {
+        avmStackoverflow(vm);
+    } else {
+        if (entry) enterFrame(vm, entry, vm->program->length);
+
+        if (vm->profile && vm->verified) {
+            runProfiled(vm, false);
+        } else if (vm->profile) {
+            runProfiled(vm, true);
+        } else if (vm->verified) {
+            runUnchecked(vm);
+        } else {
+            runChecked(vm);
+        }
+    }
+
+    activeVm = previous;
+
+    // overflow leaves 'top' one past the usable stack
+    if (vm->stack.top > vm->stack.capacity) vm->stack.top = vm->stack.capacity;
+}
+
+void runFiber(AVM *vm) {
+    runFrom(vm, NULL);
+}
+
+bool callFunction(AVM *vm, size_t index, const Object *args, size_t argCount) {
+    if (!vm || index >= vm->program->functions.count) return false;
+
+    Function *entry = &vm->program->functions.entries[index];
+    if (argCount != entry->arity || vm->stack.top + argCount > vm->stack.capacity) {
+        avmError(vm, "'%s' takes %zu arguments, %zu were given\n", entry->name, entry->arity, argCount);
+        return false;
+    }
+
+    if (entry->stub && !materializeFunction(vm, index)) return false;
+    if (!entry->validated && !validateFunction(vm, index)) return false;
+
+    for (size_t i = 0; i < argCount; i++) vm->stack.values[vm->stack.top++] = args[i];
+
+    runFrom(vm, entry);
+
+    // what it spawned runs until it returns
+    if (vm->worker) runScheduler(vm);
+
+    return !vm->failed;
+}
+
+bool findFunction(const Program *program, const char *name, size_t *index) {
+    for (size_t i = 0; i < program->functions.count; i++) {
+        if (strcmp(program->functions.entries[i].name, name) == 0) {
+            *index = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
 void execute(AVM *vm) {
     if (!vm) return;
 
-    for (size_t i = 0; i < vm->program.functions.count; i++) {
-        Function func = vm->program.functions.entries[i];
-        if (strcmp(func.name, "main") == 0) {
-            vm->callStack.addresses[vm->callStack.top++] = vm->program.length;
-            vm->pc = func.address;
-            break;
-        }
+    size_t entryIndex;
+    if (!findFunction(vm->program, "main", &entryIndex)) {
+        avmError(vm, "No 'main' function to execute\n");
+        return;
     }
 
-    while (vm->running && vm->pc < vm->program.length) {
-        execInstr(vm, vm->program.code[vm->pc]);
+    if (vm->program->functions.entries[entryIndex].arity != 0) {
+        avmError(vm, "'main' must not take any arguments\n");
+        return;
     }
 
-    Object topObj = vm->stack.values[vm->stack.top - 1];
-    if (topObj.type == OBJ_I32) {
-        printf("\nVM execution finished: %d\n", topObj.i32);
+    callFunction(vm, entryIndex, NULL, 0);
+}
+
+bool vmResult(AVM *vm, Object *result) {
+    if (!vm || vm->failed || vm->stack.top == 0) return false;
+
+    *result = vm->stack.values[vm->stack.top - 1];
+    return true;
+}
+
+static int compareLoopCounts(const void *a, const void *b) {
+    uint64_t left = ((const LoopCount *)a)->count, right = ((const LoopCount *)b)->count;
+    return (left < right) - (left > right);
+}
+
+size_t hotLoops(const AVM *vm, LoopCount **loops) {
+    size_t count = 0;
+    *loops = alloc(sizeof(LoopCount) * (vm->backEdgeCapacity + 1));
+    for (size_t i = 0; i < vm->backEdgeCapacity; i++) {
+        if (vm->backEdges[i]) (*loops)[count++] = (LoopCount){ .address = i, .count = vm->backEdges[i] };
     }
+
+    qsort(*loops, count, sizeof(LoopCount), compareLoopCounts);
+    return count;
+}
+
+void resetCounters(AVM *vm) {
+    if (vm->backEdges) memset(vm->backEdges, 0, vm->backEdgeCapacity * sizeof(uint64_t));
+    vm->osrCompiled = 0;
+    vm->osrEntered = 0;
+}
+
+void releaseThreadVm(AVM *vm, AVM *worker) {
+    vm->osrCompiled += worker->osrCompiled;
+    vm->osrEntered += worker->osrEntered;
+    freeTranslations(worker);
+
+    mergeProfile(vm->profile, worker->profile);
+    freeProfile(worker->profile);
+    worker->profile = NULL;
+    if (!worker->backEdges) return;
+
+    if (worker->backEdgeCapacity > vm->backEdgeCapacity) growBackEdges(vm, worker->backEdgeCapacity);
+    for (size_t i = 0; i < worker->backEdgeCapacity; i++) {
+        vm->backEdges[i] += worker->backEdges[i];
+    }
+
+    FREE_ALLOC(worker->backEdges);
+    worker->backEdgeCapacity = 0;
 }
\ No newline at end of file
@@ -3,31 +3,189 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <setjmp.h>
+#include <stdatomic.h>
 
 #include "../assembler/assembler.h"
 #include "../assembler/object.h"
+#include "../util/region.h"
+
+// default limits, stacks are reserved up front but only committed as they are used
+#define AVM_STACK_LIMIT (1024 * 1024)
+#define AVM_CALL_STACK_LIMIT (256 * 1024)
+
+// the same for every spawned fiber, which are expected to be many and shallow
+#define AVM_FIBER_STACK_LIMIT (64 * 1024)
+#define AVM_FIBER_CALL_STACK_LIMIT (16 * 1024)
+
+// the most entries a stack may be given, far beyond any real program, which
+// keeps the size of its reservation from overflowing
+#define AVM_MAX_STACK_LIMIT ((size_t)1 << 28)
+
+// in bytes, the heap is only reserved once the program allocates
+#define AVM_NURSERY_SIZE (2 * 1024 * 1024)
+#define AVM_HEAP_LIMIT ((size_t)1024 * 1024 * 1024)
+
+// times a loop goes round in the interpreter before its function is
+// translated and the loop carries on in the optimised tier
+#define AVM_OSR_THRESHOLD 1000
+
+// frames a runtime error names before the rest are only counted
+#define AVM_TRACE_DEPTH 16
 
 typedef struct {
-    uint16_t *addresses;
-    uint16_t top;
+    // maximum number of values on the value stack
+    size_t stackLimit;
+    // maximum number of nested calls
+    size_t callStackLimit;
+
+    // the limits of each spawned fiber's own stacks
+    size_t fiberStackLimit;
+    size_t fiberCallStackLimit;
+
+    // threads that run fibers, one per core when 0
+    size_t workers;
+
+    // bytes of the heap's nursery and the most its old generation may hold
+    size_t nurserySize;
+    size_t heapLimit;
+
+    // only verified programs are translated, SIZE_MAX never translates
+    size_t osrThreshold;
+} AvmConfig;
+
+typedef struct {
+    size_t returnAddress;
+    // frame pointer of the caller, restored on RET
+    size_t fp;
+} Frame;
+
+typedef struct {
+    Frame *frames;
+    size_t top;
+    size_t capacity;
+    Region region;
 } CallStack;
 
 typedef struct {
     Object *values;
-    uint16_t top;
+    size_t top;
+    size_t capacity;
+    Region region;
 } Stack;
 
 typedef struct {
-    Program program;
-    uint16_t pc;
-    bool running;
+    // the vm never owns its program, any number of vms may run the same one
+    Program *program;
+    size_t pc;
+    // index of the current frame's first slot in the value stack
+    size_t fp;
+    // atomic so that a collection can stop a vm running on another thread
+    atomic_bool running;
+    // set when execution stopped on an error rather than returning from 'main'
+    bool failed;
     Stack stack;
     CallStack callStack;
+    AvmConfig config;
+
+    // set once the program spawns a fiber or makes a channel, the registers
+    // above then belong to whichever fiber the worker is running
+    struct Worker *worker;
+
+    // made by the first allocation and shared with every worker's vm
+    struct Heap *heap;
+
+    // set once the verifier has accepted the program, selects the unchecked interpreter
+    bool verified;
+
+    // compiles the body of a stub function on its first call, NULL when there are none
+    bool (*materialize)(void *context, Program *program, size_t index);
+    void *materializeContext;
+
+    // where PRINT writes and where errors are reported, either may be NULL to discard it
+    FILE *output;
+    FILE *errors;
+
+    // taken when a push runs into a stack guard page
+    sigjmp_buf overflow;
+
+    // times each backward jump was taken, by the jump's address. grown on
+    // the first jump past its end, so functions compiled later are counted too
+    uint64_t *backEdges;
+    size_t backEdgeCapacity;
+
+    // the translation each backward jump continues in once its loop is hot,
+    // by the jump's address, every translation made and how often a running
+    // loop moved into one
+    struct OsrCode **osrLoops;
+    size_t osrLoopCapacity;
+    struct OsrCode *osrCode;
+    uint64_t osrCompiled;
+    uint64_t osrEntered;
+
+    // set by --profile, every instruction is then counted and the timer
+    // samples the call stack. it belongs to whoever set it
+    struct Profile *profile;
 } AVM;
 
-AVM newAVM(Program program);
+// a loop by the address of the jump that closes it
+typedef struct {
+    size_t address;
+    uint64_t count;
+} LoopCount;
+
+AvmConfig defaultAvmConfig(void);
+
+AVM newAVM(Program *program, AvmConfig config);
 void freeAVM(AVM *vm);
 
+// readies the vm to run its program again, keeping the stacks it already reserved
+void resetAVM(AVM *vm);
+
+// validates every image function up front, so that running the program never
+// writes to it. functions that fail are left to report the error when called
+void validateProgram(Program *program);
+
+// the index of the function called 'name', false if there is none
+bool findFunction(const Program *program, const char *name, size_t *index);
+
+// runs 'main'
 void execute(AVM *vm);
 
+// runs the function at 'index' with 'args' as its arguments until it returns,
+// its result is then on top of the stack. false if it failed. any fibers it
+// spawns run until it returns, those still unfinished are then discarded
+bool callFunction(AVM *vm, size_t index, const Object *args, size_t argCount);
+
+// runs the current fiber from its pc until it returns, fails or gives way
+// to another fiber
+void runFiber(AVM *vm);
+
+// runs the single instruction at the pc on the unchecked interpreter, for
+// what the optimised tier does not handle itself
+void stepInstruction(AVM *vm);
+
+// the vm running on the calling thread, NULL if none is. safe in a signal handler
+AVM *currentVm(void);
+
+// stops the vm on an error, reported on its error stream unless that is NULL
+void avmError(AVM *vm, const char *format, ...);
+
+// the value 'main' returned, false if execution failed
+bool vmResult(AVM *vm, Object *result);
+
+// every loop that ran, hottest first, in a new array the caller frees
+size_t hotLoops(const AVM *vm, LoopCount **loops);
+// the function whose code holds 'address', NULL before the first. stubs have no code
+const Function *owningFunction(const Program *p, size_t address);
+// clears the loop and OSR counts, the translations are kept
+void resetCounters(AVM *vm);
+// adds the counts and profile of a worker's vm to 'vm', then frees them and its translations
+void releaseThreadVm(AVM *vm, AVM *worker);
+
+void printObject(Object obj);
+void fprintObject(FILE *out, Object obj);
+
 #endif
\ No newline at end of file